@@ -11,6 +11,18 @@ boolean core_startup()
 	struct core_module * cc = alloc(sizeof(*cc));
 	memset(cc, 0, sizeof(*cc));
 	cc->shutdown_mutex = create_mutex();
+	if (!intern_startup()) {
+		ERROR("Failed to initialize string pool.");
+		return FALSE;
+	}
+	if (!slab_startup()) {
+		ERROR("Failed to initialize object pools.");
+		return FALSE;
+	}
+	if (!profile_startup()) {
+		ERROR("Failed to initialize profiler.");
+		return FALSE;
+	}
 	if (!set_signals_handlers(cc)) {
 		ERROR("Failed to set signal handlers.");
 		return FALSE;
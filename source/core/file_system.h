@@ -72,6 +72,14 @@ size_t strip_file_name(
 
 boolean get_file_size(const char * file_path, size_t * size);
 
+/**
+ * Retrieves last modification time of a file.
+ *
+ * Returned time is only meaningful when compared 
+ * to other values returned by this function.
+ */
+boolean get_file_time(const char * file_path, uint64_t * time);
+
 file open_file(
 	const char * file_path,
 	enum file_access_type access_type);
@@ -106,8 +114,24 @@ boolean load_file(
 	void * data,
 	size_t size);
 
+/**
+ * Maps file contents into memory for reading.
+ *
+ * Returns NULL if file cannot be mapped or is empty.
+ * Mapped memory must be released with `unmap_file`.
+ */
+const void * map_file(const char * file_path, size_t * size);
+
+void unmap_file(const void * data, size_t size);
+
 boolean write_file(file file, const void * buffer, size_t count);
 
+/**
+ * Flushes buffered writes and waits until file contents
+ * are committed to disk.
+ */
+boolean flush_file(file file);
+
 boolean print_file(file  file, const char * fmt, ...);
 
 boolean make_file(
@@ -133,6 +157,31 @@ boolean replace_file(
 
 boolean remove_file(const char * path);
 
+/**
+ * Removes file contents from the file system cache 
+ * so that the next read is served from disk.
+ */
+boolean evict_file_cache(const char * file_path);
+
+/**
+ * Returns the number of bytes that were read 
+ * (or mapped) from files by all threads.
+ */
+uint64_t get_read_size();
+
+/**
+ * Returns the number of bytes that were read 
+ * (or mapped) from files by the calling thread.
+ */
+uint64_t get_thread_read_size();
+
+/**
+ * Creates a directory.
+ *
+ * Succeeds if directory already exists.
+ */
+boolean create_directory(const char * path);
+
 END_DECLS
 
 #endif /* _CORE_FILE_SYSTEM_H_ */
\ No newline at end of file
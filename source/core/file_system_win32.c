@@ -1,11 +1,22 @@
 #include "core/file_system.h"
 #include "core/string.h"
 #include "core/malloc.h"
+#include <io.h>
 #include <stdio.h>
 #define WIN32_LEAN_AND_MEAN
 #define NOGDI
 #include <Windows.h>
 
+/* Number of bytes that were read or mapped. */
+static volatile LONG64 g_ReadSize;
+static __declspec(thread) uint64_t t_ReadSize;
+
+static void countread(size_t size)
+{
+	t_ReadSize += size;
+	InterlockedExchangeAdd64(&g_ReadSize, (LONG64)size);
+}
+
 int make_path(
 	char * dst,
 	size_t maxcount,
@@ -104,6 +115,18 @@ boolean get_file_size(const char * file_path, size_t * size)
 	return TRUE;
 }
 
+boolean get_file_time(const char * file_path, uint64_t * time)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	ULARGE_INTEGER t;
+	if (!GetFileAttributesExA(file_path, GetFileExInfoStandard, &data))
+		return FALSE;
+	t.LowPart = data.ftLastWriteTime.dwLowDateTime;
+	t.HighPart = data.ftLastWriteTime.dwHighDateTime;
+	*time = t.QuadPart;
+	return TRUE;
+}
+
 file open_file(
 	const char * file_path,
 	enum file_access_type access_type)
@@ -141,10 +164,13 @@ boolean seek_file(file file, size_t offset, boolean from_start)
 
 boolean read_file(file file, void * buffer, size_t count)
 {
-	return (fread(buffer, count, 1, (FILE *)file) != 0);
+	if (fread(buffer, count, 1, (FILE *)file) == 0)
+		return FALSE;
+	countread(count);
+	return TRUE;
 }
 
-boolean read_line(file file, char * dst, size_t maxcount)
+static boolean readline(file file, char * dst, size_t maxcount)
 {
 	FILE * f = file;
 	char c = '\0';
@@ -180,6 +206,15 @@ boolean read_line(file file, char * dst, size_t maxcount)
 	return (c != EOF);
 }
 
+boolean read_line(file file, char * dst, size_t maxcount)
+{
+	if (!readline(file, dst, maxcount))
+		return FALSE;
+	/* Line terminator is not included in `dst`. */
+	countread(strlen(dst) + 1);
+	return TRUE;
+}
+
 const char * read_line_buffer(
 	const char * buf, 
 	char * dst, 
@@ -291,11 +326,52 @@ boolean load_file(
 	return r;
 }
 
+const void * map_file(const char * file_path, size_t * size)
+{
+	LARGE_INTEGER n;
+	HANDLE mapping;
+	void * data;
+	HANDLE file = CreateFileA(file_path, GENERIC_READ, 
+		FILE_SHARE_READ, NULL, OPEN_EXISTING, 
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	if (!GetFileSizeEx(file, &n) || !n.QuadPart) {
+		CloseHandle(file);
+		return NULL;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping)
+		return NULL;
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	/* View keeps a reference to the mapping object. */
+	CloseHandle(mapping);
+	if (!data)
+		return NULL;
+	*size = (size_t)n.QuadPart;
+	countread(*size);
+	return data;
+}
+
+void unmap_file(const void * data, size_t size)
+{
+	if (data)
+		UnmapViewOfFile(data);
+}
+
 boolean write_file(file file, const void * buffer, size_t count)
 {
 	return (fwrite(buffer, count, 1, file) == 1);
 }
 
+boolean flush_file(file file)
+{
+	if (fflush((FILE *)file) != 0)
+		return FALSE;
+	return (_commit(_fileno((FILE *)file)) == 0);
+}
+
 boolean print_file(file  file, const char * fmt, ...)
 {
 	va_list ap;
@@ -404,7 +480,38 @@ boolean replace_file(
 		NULL, NULL) != 0);
 }
 
+boolean evict_file_cache(const char * file_path)
+{
+	/* Opening a file without buffering makes the cache 
+	 * manager flush and purge cached pages of the file, 
+	 * unless it is still open or mapped elsewhere. */
+	HANDLE file = CreateFileA(file_path, GENERIC_READ, 
+		FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 
+		FILE_FLAG_NO_BUFFERING, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return FALSE;
+	CloseHandle(file);
+	return TRUE;
+}
+
+uint64_t get_read_size()
+{
+	return (uint64_t)InterlockedCompareExchange64(&g_ReadSize, 0, 0);
+}
+
+uint64_t get_thread_read_size()
+{
+	return t_ReadSize;
+}
+
 boolean remove_file(const char * path)
 {
 	return DeleteFileA(path);
 }
+
+boolean create_directory(const char * path)
+{
+	if (CreateDirectoryA(path, NULL))
+		return TRUE;
+	return (GetLastError() == ERROR_ALREADY_EXISTS);
+}
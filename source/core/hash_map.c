@@ -636,7 +636,7 @@ static void *xalloc(size_t size) {
 static void xfree(void *ptr) {
     if (ptr) {
         total_mem -= *(uintptr_t*)((char*)ptr-sizeof(uintptr_t));
-        free((char*)ptr-sizeof(uintptr_t));
+        dealloc((char*)ptr-sizeof(uintptr_t));
         total_allocs--;
     }
 }
@@ -0,0 +1,125 @@
+#include "core/intern.h"
+#include "core/hash_map.h"
+#include "core/internal.h"
+#include "core/malloc.h"
+#include "core/os.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Strings are stored in chunks to avoid 
+ * allocation overhead of each string. */
+#define CHUNK_SIZE 65536
+
+struct entry {
+	const char * str;
+	size_t length;
+};
+
+struct chunk {
+	struct chunk * next;
+	size_t used;
+	char data[CHUNK_SIZE];
+};
+
+struct pool {
+	mutex_t mutex;
+	hmap_t entries;
+	struct chunk * chunks;
+	struct intern_stats stats;
+};
+
+static struct pool g_Pool;
+
+static uint64_t hash_entry(
+	const void * item,
+	uint64_t seed0,
+	uint64_t seed1)
+{
+	const struct entry * e = item;
+	return hmap_murmur(e->str, e->length, seed0, seed1);
+}
+
+static int compare_entry(
+	const void * a,
+	const void * b,
+	void * user_data)
+{
+	const struct entry * ea = a;
+	const struct entry * eb = b;
+	if (ea->length != eb->length)
+		return 1;
+	return memcmp(ea->str, eb->str, ea->length);
+}
+
+static char * store(size_t size)
+{
+	struct chunk * c = g_Pool.chunks;
+	char * p;
+	if (size > CHUNK_SIZE / 4) {
+		/* Large strings are allocated separately, 
+		 * current chunk is kept in front. */
+		c = alloc(offsetof(struct chunk, data) + size);
+		c->used = size;
+		if (g_Pool.chunks) {
+			c->next = g_Pool.chunks->next;
+			g_Pool.chunks->next = c;
+		}
+		else {
+			c->next = NULL;
+			g_Pool.chunks = c;
+		}
+		return c->data;
+	}
+	if (!c || c->used + size > CHUNK_SIZE) {
+		c = alloc(sizeof(*c));
+		c->next = g_Pool.chunks;
+		c->used = 0;
+		g_Pool.chunks = c;
+	}
+	p = c->data + c->used;
+	c->used += size;
+	return p;
+}
+
+boolean intern_startup()
+{
+	g_Pool.mutex = create_mutex();
+	g_Pool.entries = hmap_new(sizeof(struct entry), 4096,
+		(uint64_t)strcpy, (uint64_t)memset,
+		hash_entry, compare_entry, NULL, NULL);
+	return (g_Pool.mutex && g_Pool.entries);
+}
+
+const char * intern_string(const char * str)
+{
+	struct entry e = { str, strlen(str) };
+	const struct entry * existing;
+	char * copy;
+	assert(g_Pool.mutex != NULL);
+	lock_mutex(g_Pool.mutex);
+	g_Pool.stats.intern_count++;
+	g_Pool.stats.intern_size += e.length + 1;
+	existing = hmap_get(g_Pool.entries, &e);
+	if (existing) {
+		str = existing->str;
+		unlock_mutex(g_Pool.mutex);
+		return str;
+	}
+	copy = store(e.length + 1);
+	memcpy(copy, str, e.length + 1);
+	e.str = copy;
+	hmap_set(g_Pool.entries, &e);
+	g_Pool.stats.count++;
+	g_Pool.stats.size += e.length + 1;
+	unlock_mutex(g_Pool.mutex);
+	return copy;
+}
+
+void get_intern_stats(struct intern_stats * stats)
+{
+	lock_mutex(g_Pool.mutex);
+	*stats = g_Pool.stats;
+	unlock_mutex(g_Pool.mutex);
+}
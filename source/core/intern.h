@@ -0,0 +1,46 @@
+#ifndef _CORE_INTERN_H_
+#define _CORE_INTERN_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+BEGIN_DECLS
+
+/*
+ * Interned string pool.
+ *
+ * Each distinct string is stored once and is kept 
+ * until the process exits.
+ *
+ * Pool is intended for names of game content, 
+ * which are interned while data is loaded. As 
+ * strings are never removed, names that are 
+ * created at runtime (i.e. by clients) must not 
+ * be interned.
+ *
+ * Functions are thread-safe.
+ */
+
+struct intern_stats {
+	/* Number of distinct strings in pool. */
+	uint64_t count;
+	/* Number of bytes used by distinct strings. */
+	uint64_t size;
+	/* Number of times strings were interned. */
+	uint64_t intern_count;
+	/* Number of bytes that would be used if every 
+	 * interned string was stored separately. */
+	uint64_t intern_size;
+};
+
+/*
+ * Returns the pooled copy of `str`, adding it 
+ * to the pool if it is not already interned.
+ */
+const char * intern_string(const char * str);
+
+void get_intern_stats(struct intern_stats * stats);
+
+END_DECLS
+
+#endif /* _CORE_INTERN_H_ */
@@ -13,6 +13,21 @@ struct core_module {
 
 boolean set_signals_handlers(struct core_module * cc);
 
+/*
+ * Initializes interned string pool.
+ */
+boolean intern_startup();
+
+/*
+ * Initializes object pool registry.
+ */
+boolean slab_startup();
+
+/*
+ * Calibrates profiler timestamps.
+ */
+boolean profile_startup();
+
 extern struct core_module * g_CoreModule;
 
 END_DECLS
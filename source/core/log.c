@@ -1,17 +1,169 @@
 #include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
 #include <time.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#define ATOMIC_INCREMENT(p) _InterlockedIncrement(p)
+#define ATOMIC_INCREMENT64(p) _InterlockedIncrement64(p)
+#define ATOMIC_EXCHANGE(p, v) _InterlockedExchange(p, v)
+#define ATOMIC_EXCHANGE64(p, v) _InterlockedExchange64(p, v)
+#define ATOMIC_CAS_POINTER(p, x, c) \
+	_InterlockedCompareExchangePointer((void * volatile *)(p), x, c)
+#else
+#define THREAD_LOCAL __thread
+#define ATOMIC_INCREMENT(p) __sync_add_and_fetch(p, 1)
+#define ATOMIC_INCREMENT64(p) __sync_add_and_fetch(p, 1)
+#define ATOMIC_EXCHANGE(p, v) __sync_lock_test_and_set(p, v)
+#define ATOMIC_EXCHANGE64(p, v) __sync_lock_test_and_set(p, v)
+#define ATOMIC_CAS_POINTER(p, x, c) __sync_val_compare_and_swap(p, c, x)
+#endif
+
+#define MAX_MESSAGE_LENGTH 1024
+/* Threads that log after this many threads have
+ * logged, write their messages synchronously. */
+#define MAX_RING_COUNT 64
+/* Must be a power of two. */
+#define RING_SIZE 65536
+#define MAX_RECORD_SIZE 4096
+#define MAX_ARG_COUNT 16
+#define MAX_SPEC_LENGTH 32
+#define RECORD_ALIGNMENT 8
+/* Must be a power of two. */
+#define SITE_COUNT 1024
+#define MAX_SITE_PROBE_COUNT 8
+/* Records that are written by the writer
+ * thread before checking other rings. */
+#define MAX_DRAIN_COUNT 4096
+
+/* Set for threads that write synchronously. */
+#define NO_RING ((struct ring *)(uintptr_t)1)
+
+#define ALIGN_RECORD(size) \
+	(((size) + RECORD_ALIGNMENT - 1) & ~(size_t)(RECORD_ALIGNMENT - 1))
+
+enum arg_kind {
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_INTMAX,
+	ARG_PTRDIFF,
+	ARG_DOUBLE,
+	ARG_LDOUBLE,
+	ARG_PTR,
+	ARG_STR,
+	ARG_UNSUPPORTED,
+};
+
+/* Marks the unused end of a ring,
+ * reader continues from the beginning. */
+#define RECORD_PAD 0xFF
+
+/*
+ * Message is kept in binary form, it is
+ * formatted by the writer thread.
+ *
+ * Arguments follow the header, and copies of
+ * string arguments follow the arguments.
+ */
+struct record {
+	uint32_t size;
+	uint8_t level;
+	uint8_t arg_count;
+	uint16_t reserved;
+	uint32_t line;
+	uint32_t reserved2;
+	int64_t time;
+	uint64_t seq;
+	const char * file;
+	const char * fmt;
+};
+
+struct arg {
+	uint32_t kind;
+	/* Length of string arguments. */
+	uint32_t length;
+	union {
+		int64_t i;
+		double d;
+		const void * p;
+		/* Offset of string copy in record,
+		 * negative for NULL strings. */
+		int64_t offset;
+	} value;
+};
+
+/*
+ * Single-producer, single-consumer ring.
+ *
+ * Records are written by the owning thread
+ * and are read by the writer thread.
+ */
+struct ring {
+	volatile int64_t head;
+	uint8_t padding[64 - sizeof(int64_t)];
+	volatile int64_t tail;
+	volatile long dropped;
+	uint32_t thread_id;
+	uint8_t padding2[64 - sizeof(int64_t) - sizeof(long) -
+		sizeof(uint32_t)];
+	uint8_t data[RING_SIZE];
+};
+
+/*
+ * Rate limiting state of a call site.
+ */
+struct site {
+	const char * volatile fmt;
+	const char * file;
+	uint32_t line;
+	volatile long second;
+	volatile long count;
+	volatile long suppressed;
+};
+
+struct spec {
+	/* Length of specification, including '%'. */
+	size_t length;
+	uint32_t star_count;
+	enum arg_kind kind;
+};
+
+struct log_ctx {
+	volatile boolean async;
+	volatile boolean stop;
+	thread_handle writer;
+	volatile int64_t now;
+	volatile long ring_count;
+	struct ring * volatile rings[MAX_RING_COUNT];
+	volatile int64_t seq;
+	uint32_t alloc_tag;
+	volatile int64_t written_count;
+	/* Updated by the writer thread. */
+	uint64_t dropped_count;
+	volatile long suppressed_count;
+	struct site sites[SITE_COUNT];
+};
+
 static log_callback_t g_Callback;
+static struct log_ctx g_Log;
+static THREAD_LOCAL struct ring * t_Ring;
 
 static size_t fmt_time(char * str, size_t maxlen, time_t t)
 {
 	const struct tm * tm = localtime(&t);
-	return snprintf(str, maxlen, 
-		"%04d-%02d-%02dT%02d:%02d:%02d", 
-		tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, 
+	return snprintf(str, maxlen,
+		"%04d-%02d-%02dT%02d:%02d:%02d",
+		tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
 		tm->tm_hour, tm->tm_min, tm->tm_sec);
 }
 
@@ -31,26 +183,14 @@ static const char * level_label(enum LogLevel level)
 	}
 }
 
-boolean log_init()
-{
-	return TRUE;
-}
-
-void log_msg(
+static void write_msg(
 	enum LogLevel level,
-	const char * file, 
+	const char * file,
 	uint32_t line,
-	const char * fmt,
-	...)
+	const char * timestr,
+	const char * msg)
 {
-	char msg[1024];
-	char timestr[128];
-	va_list ap;
 	FILE * out;
-	va_start(ap, fmt);
-	vsnprintf(msg, 1024, fmt, ap);
-	va_end(ap);
-	fmt_time(timestr, sizeof(timestr), time(NULL));
 	switch (level) {
 	default:
 	case LOG_LEVEL_TRACE:
@@ -64,11 +204,727 @@ void log_msg(
 	}
 	fprintf(out, "[%s| %-6s] %s\n",
 		timestr, level_label(level), msg);
+	ATOMIC_INCREMENT64(&g_Log.written_count);
 	if (g_Callback)
 		g_Callback(level, file, line, msg);
 }
 
+/*
+ * Returns current time, which is updated by the
+ * writer thread when it is running.
+ */
+static int64_t gettime()
+{
+	if (g_Log.async)
+		return g_Log.now;
+	return (int64_t)time(NULL);
+}
+
+/*
+ * Parses a conversion specification that
+ * starts at `fmt`, which points to a '%'.
+ */
+static void parsespec(const char * fmt, struct spec * spec)
+{
+	const char * c = fmt + 1;
+	enum { LEN_NONE, LEN_LONG, LEN_LLONG, LEN_SIZE, LEN_INTMAX,
+		LEN_PTRDIFF, LEN_LDOUBLE, LEN_WIDE } length = LEN_NONE;
+	spec->star_count = 0;
+	spec->kind = ARG_UNSUPPORTED;
+	while (*c && strchr("-+ #0", *c))
+		c++;
+	if (*c == '*') {
+		spec->star_count++;
+		c++;
+	}
+	while (*c >= '0' && *c <= '9')
+		c++;
+	if (*c == '.') {
+		c++;
+		if (*c == '*') {
+			spec->star_count++;
+			c++;
+		}
+		while (*c >= '0' && *c <= '9')
+			c++;
+	}
+	switch (*c) {
+	case 'h':
+		c += (c[1] == 'h') ? 2 : 1;
+		break;
+	case 'l':
+		if (c[1] == 'l') {
+			length = LEN_LLONG;
+			c += 2;
+		}
+		else {
+			length = LEN_LONG;
+			c++;
+		}
+		break;
+	case 'z':
+		length = LEN_SIZE;
+		c++;
+		break;
+	case 'j':
+		length = LEN_INTMAX;
+		c++;
+		break;
+	case 't':
+		length = LEN_PTRDIFF;
+		c++;
+		break;
+	case 'L':
+		length = LEN_LDOUBLE;
+		c++;
+		break;
+	case 'w':
+		length = LEN_WIDE;
+		c++;
+		break;
+	case 'I':
+		if (c[1] == '6' && c[2] == '4') {
+			length = LEN_LLONG;
+			c += 3;
+		}
+		else if (c[1] == '3' && c[2] == '2') {
+			c += 3;
+		}
+		else {
+			length = LEN_SIZE;
+			c++;
+		}
+		break;
+	}
+	if (!*c) {
+		spec->length = c - fmt;
+		return;
+	}
+	spec->length = c - fmt + 1;
+	switch (*c) {
+	case 'd':
+	case 'i':
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+		switch (length) {
+		case LEN_NONE:
+			spec->kind = ARG_INT;
+			break;
+		case LEN_LONG:
+			spec->kind = ARG_LONG;
+			break;
+		case LEN_LLONG:
+			spec->kind = ARG_LLONG;
+			break;
+		case LEN_SIZE:
+			spec->kind = ARG_SIZE;
+			break;
+		case LEN_INTMAX:
+			spec->kind = ARG_INTMAX;
+			break;
+		case LEN_PTRDIFF:
+			spec->kind = ARG_PTRDIFF;
+			break;
+		default:
+			break;
+		}
+		break;
+	case 'c':
+		if (length == LEN_NONE)
+			spec->kind = ARG_INT;
+		break;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->kind = (length == LEN_LDOUBLE) ? ARG_LDOUBLE : ARG_DOUBLE;
+		break;
+	case 's':
+		if (length == LEN_NONE)
+			spec->kind = ARG_STR;
+		break;
+	case 'p':
+		spec->kind = ARG_PTR;
+		break;
+	}
+}
+
+/*
+ * Reads arguments according to format.
+ *
+ * Returns FALSE if format has too many arguments
+ * or arguments that cannot be captured.
+ */
+static boolean captureargs(
+	const char * fmt,
+	va_list ap,
+	struct arg * args,
+	uint32_t * arg_count,
+	size_t * string_size)
+{
+	const char * c = fmt;
+	uint32_t count = 0;
+	*string_size = 0;
+	while ((c = strchr(c, '%')) != NULL) {
+		struct spec spec;
+		uint32_t i;
+		if (c[1] == '%') {
+			c += 2;
+			continue;
+		}
+		parsespec(c, &spec);
+		if (spec.kind == ARG_UNSUPPORTED ||
+			count + spec.star_count + 1 > MAX_ARG_COUNT) {
+			return FALSE;
+		}
+		for (i = 0; i < spec.star_count; i++) {
+			struct arg * a = &args[count++];
+			a->kind = ARG_INT;
+			a->value.i = va_arg(ap, int);
+		}
+		args[count].kind = spec.kind;
+		args[count].length = 0;
+		switch (spec.kind) {
+		case ARG_INT:
+			args[count].value.i = va_arg(ap, int);
+			break;
+		case ARG_LONG:
+			args[count].value.i = va_arg(ap, long);
+			break;
+		case ARG_LLONG:
+			args[count].value.i = va_arg(ap, long long);
+			break;
+		case ARG_SIZE:
+			args[count].value.i = (int64_t)va_arg(ap, size_t);
+			break;
+		case ARG_INTMAX:
+			args[count].value.i = (int64_t)va_arg(ap, intmax_t);
+			break;
+		case ARG_PTRDIFF:
+			args[count].value.i = (int64_t)va_arg(ap, ptrdiff_t);
+			break;
+		case ARG_DOUBLE:
+			args[count].value.d = va_arg(ap, double);
+			break;
+		case ARG_LDOUBLE:
+			args[count].value.d = (double)va_arg(ap, long double);
+			break;
+		case ARG_PTR:
+			args[count].value.p = va_arg(ap, void *);
+			break;
+		case ARG_STR:
+			args[count].value.p = va_arg(ap, const char *);
+			if (args[count].value.p) {
+				size_t length = strlen(args[count].value.p);
+				if (length >= MAX_MESSAGE_LENGTH)
+					length = MAX_MESSAGE_LENGTH - 1;
+				args[count].length = (uint32_t)length;
+				*string_size += length + 1;
+			}
+			break;
+		default:
+			return FALSE;
+		}
+		count++;
+		c += spec.length;
+	}
+	*arg_count = count;
+	return TRUE;
+}
+
+static struct ring * getring()
+{
+	struct ring * r = t_Ring;
+	if (!r) {
+		long index = ATOMIC_INCREMENT(&g_Log.ring_count) - 1;
+		if (index < MAX_RING_COUNT) {
+			r = alloc_tagged(sizeof(*r), g_Log.alloc_tag);
+			memset(r, 0, offsetof(struct ring, data));
+			r->thread_id = (uint32_t)get_current_thread_id();
+			g_Log.rings[index] = r;
+		}
+		else {
+			r = NO_RING;
+		}
+		t_Ring = r;
+	}
+	return (r != NO_RING) ? r : NULL;
+}
+
+/*
+ * Reserves space for a record in ring.
+ *
+ * Returns NULL if ring is full.
+ */
+static struct record * reserve(struct ring * r, size_t size)
+{
+	int64_t tail = r->tail;
+	size_t pos = (size_t)(tail & (RING_SIZE - 1));
+	size_t pad = 0;
+	if (RING_SIZE - pos < size)
+		pad = RING_SIZE - pos;
+	if ((size_t)(RING_SIZE - (tail - r->head)) < pad + size)
+		return NULL;
+	if (pad) {
+		struct record * p = (struct record *)&r->data[pos];
+		p->size = (uint32_t)pad;
+		p->level = RECORD_PAD;
+		/* Padding is published with the record. */
+		pos = 0;
+	}
+	return (struct record *)&r->data[pos];
+}
+
+static void publish(struct ring * r, const struct record * rec)
+{
+	int64_t tail = r->tail;
+	size_t pos = (size_t)(tail & (RING_SIZE - 1));
+	if ((const uint8_t *)rec != &r->data[pos])
+		tail += RING_SIZE - pos;
+	ATOMIC_EXCHANGE64(&r->tail, tail + rec->size);
+}
+
+static boolean enqueue(
+	struct ring * r,
+	enum LogLevel level,
+	const char * file,
+	uint32_t line,
+	int64_t t,
+	const char * fmt,
+	const struct arg * args,
+	uint32_t arg_count,
+	size_t string_size)
+{
+	size_t size = ALIGN_RECORD(sizeof(struct record) +
+		arg_count * sizeof(struct arg) + string_size);
+	struct record * rec;
+	struct arg * dst;
+	size_t offset;
+	uint32_t i;
+	if (size > MAX_RECORD_SIZE)
+		return FALSE;
+	rec = reserve(r, size);
+	if (!rec) {
+		ATOMIC_INCREMENT(&r->dropped);
+		return TRUE;
+	}
+	rec->size = (uint32_t)size;
+	rec->level = (uint8_t)level;
+	rec->arg_count = (uint8_t)arg_count;
+	rec->line = line;
+	rec->time = t;
+	rec->seq = (uint64_t)ATOMIC_INCREMENT64(&g_Log.seq);
+	rec->file = file;
+	rec->fmt = fmt;
+	dst = (struct arg *)(rec + 1);
+	offset = sizeof(struct record) + arg_count * sizeof(struct arg);
+	for (i = 0; i < arg_count; i++) {
+		dst[i] = args[i];
+		if (args[i].kind != ARG_STR)
+			continue;
+		if (!args[i].value.p) {
+			dst[i].value.offset = -1;
+			continue;
+		}
+		memcpy((uint8_t *)rec + offset, args[i].value.p, args[i].length);
+		((uint8_t *)rec)[offset + args[i].length] = '\0';
+		dst[i].value.offset = (int64_t)offset;
+		offset += args[i].length + 1;
+	}
+	publish(r, rec);
+	return TRUE;
+}
+
+static int formatarg(
+	char * dst,
+	size_t maxcount,
+	const char * spec,
+	const struct record * rec,
+	const struct arg * args,
+	uint32_t star_count)
+{
+	const struct arg * a = &args[star_count];
+	int w0 = star_count > 0 ? (int)args[0].value.i : 0;
+	int w1 = star_count > 1 ? (int)args[1].value.i : 0;
+#define FORMAT_ARG(value) \
+	((star_count == 0) ? snprintf(dst, maxcount, spec, value) : \
+	 (star_count == 1) ? snprintf(dst, maxcount, spec, w0, value) : \
+	 snprintf(dst, maxcount, spec, w0, w1, value))
+	switch (a->kind) {
+	case ARG_INT:
+		return FORMAT_ARG((int)a->value.i);
+	case ARG_LONG:
+		return FORMAT_ARG((long)a->value.i);
+	case ARG_LLONG:
+		return FORMAT_ARG((long long)a->value.i);
+	case ARG_SIZE:
+		return FORMAT_ARG((size_t)a->value.i);
+	case ARG_INTMAX:
+		return FORMAT_ARG((intmax_t)a->value.i);
+	case ARG_PTRDIFF:
+		return FORMAT_ARG((ptrdiff_t)a->value.i);
+	case ARG_DOUBLE:
+		return FORMAT_ARG(a->value.d);
+	case ARG_LDOUBLE:
+		return FORMAT_ARG((long double)a->value.d);
+	case ARG_PTR:
+		return FORMAT_ARG(a->value.p);
+	case ARG_STR:
+		if (a->value.offset < 0)
+			return FORMAT_ARG((const char *)NULL);
+		return FORMAT_ARG((const char *)rec + a->value.offset);
+	default:
+		return 0;
+	}
+#undef FORMAT_ARG
+}
+
+/*
+ * Formats a record the same way `vsnprintf`
+ * would have formatted the original call.
+ */
+static void formatrecord(
+	const struct record * rec,
+	char * msg,
+	size_t maxcount)
+{
+	const struct arg * args = (const struct arg *)(rec + 1);
+	const char * c = rec->fmt;
+	size_t len = 0;
+	uint32_t index = 0;
+	while (*c && len + 1 < maxcount) {
+		struct spec spec;
+		char specstr[MAX_SPEC_LENGTH];
+		int n;
+		if (*c != '%') {
+			msg[len++] = *c++;
+			continue;
+		}
+		if (c[1] == '%') {
+			msg[len++] = '%';
+			c += 2;
+			continue;
+		}
+		parsespec(c, &spec);
+		if (spec.length >= sizeof(specstr) ||
+			index + spec.star_count >= rec->arg_count) {
+			break;
+		}
+		memcpy(specstr, c, spec.length);
+		specstr[spec.length] = '\0';
+		n = formatarg(msg + len, maxcount - len, specstr, rec,
+			&args[index], spec.star_count);
+		if (n > 0)
+			len += MIN((size_t)n, maxcount - len - 1);
+		index += spec.star_count + 1;
+		c += spec.length;
+	}
+	msg[len] = '\0';
+}
+
+static struct site * getsite(
+	const char * file,
+	uint32_t line,
+	const char * fmt)
+{
+	size_t index = (((uintptr_t)fmt >> 3) ^ line) & (SITE_COUNT - 1);
+	uint32_t i;
+	for (i = 0; i < MAX_SITE_PROBE_COUNT; i++) {
+		struct site * s = &g_Log.sites[(index + i) & (SITE_COUNT - 1)];
+		const char * key = s->fmt;
+		if (key == fmt)
+			return s;
+		if (!key && !ATOMIC_CAS_POINTER(&s->fmt, (void *)fmt, NULL)) {
+			s->file = file;
+			s->line = line;
+			return s;
+		}
+		if (s->fmt == fmt)
+			return s;
+	}
+	return NULL;
+}
+
+static void logsuppressed(const struct site * s, long count, int64_t t);
+
+/*
+ * Returns FALSE if message should be suppressed.
+ */
+static boolean ratelimit(
+	const char * file,
+	uint32_t line,
+	const char * fmt,
+	int64_t t)
+{
+	struct site * s = getsite(file, line, fmt);
+	long second = (long)t;
+	if (!s)
+		return TRUE;
+	if (s->second != second &&
+		ATOMIC_EXCHANGE(&s->second, second) != second) {
+		long suppressed = ATOMIC_EXCHANGE(&s->suppressed, 0);
+		s->count = 0;
+		if (suppressed)
+			logsuppressed(s, suppressed, t);
+	}
+	if (ATOMIC_INCREMENT(&s->count) > LOG_RATE_LIMIT) {
+		ATOMIC_INCREMENT(&s->suppressed);
+		ATOMIC_INCREMENT(&g_Log.suppressed_count);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void logv(
+	enum LogLevel level,
+	const char * file,
+	uint32_t line,
+	int64_t t,
+	const char * fmt,
+	va_list ap)
+{
+	char msg[MAX_MESSAGE_LENGTH];
+	struct ring * r = NULL;
+	if (g_Log.async && level != LOG_LEVEL_ERROR)
+		r = getring();
+	if (r) {
+		struct arg args[MAX_ARG_COUNT];
+		uint32_t count = 0;
+		size_t string_size = 0;
+		struct arg a = { ARG_STR };
+		va_list copy;
+		boolean captured;
+		va_copy(copy, ap);
+		captured = captureargs(fmt, copy, args, &count, &string_size);
+		va_end(copy);
+		if (captured && enqueue(r, level, file, line, t, fmt, args,
+				count, string_size)) {
+			return;
+		}
+		/* Message is formatted by this thread,
+		 * only writing is deferred. */
+		vsnprintf(msg, sizeof(msg), fmt, ap);
+		a.value.p = msg;
+		a.length = (uint32_t)strlen(msg);
+		enqueue(r, level, file, line, t, "%s", &a, 1, a.length + 1);
+	}
+	else {
+		char timestr[128];
+		vsnprintf(msg, sizeof(msg), fmt, ap);
+		fmt_time(timestr, sizeof(timestr), (time_t)t);
+		write_msg(level, file, line, timestr, msg);
+		if (level == LOG_LEVEL_ERROR)
+			fflush(stderr);
+	}
+}
+
+static void logfmt(
+	enum LogLevel level,
+	const char * file,
+	uint32_t line,
+	int64_t t,
+	const char * fmt,
+	...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	logv(level, file, line, t, fmt, ap);
+	va_end(ap);
+}
+
+static void logsuppressed(const struct site * s, long count, int64_t t)
+{
+	logfmt(LOG_LEVEL_WARN, s->file, s->line, t,
+		"Suppressed %ld repeated messages (%s:%u).",
+		count, s->file, s->line);
+}
+
+/*
+ * Reports suppressed messages of call sites
+ * that did not log again since.
+ */
+static void reportsites(int64_t t)
+{
+	uint32_t i;
+	for (i = 0; i < SITE_COUNT; i++) {
+		struct site * s = &g_Log.sites[i];
+		long suppressed;
+		if (!s->fmt || !s->suppressed || s->second == (long)t)
+			continue;
+		suppressed = ATOMIC_EXCHANGE(&s->suppressed, 0);
+		if (suppressed)
+			logsuppressed(s, suppressed, t);
+	}
+}
+
+static void reportdrops(int64_t t)
+{
+	long count = MIN(g_Log.ring_count, MAX_RING_COUNT);
+	long i;
+	for (i = 0; i < count; i++) {
+		struct ring * r = g_Log.rings[i];
+		long dropped;
+		if (!r || !r->dropped)
+			continue;
+		dropped = ATOMIC_EXCHANGE(&r->dropped, 0);
+		g_Log.dropped_count += dropped;
+		logfmt(LOG_LEVEL_WARN, __FILE__, __LINE__, t,
+			"Dropped %ld log messages of thread %u.",
+			dropped, r->thread_id);
+	}
+}
+
+static const struct record * peek(struct ring * r)
+{
+	while (r->head != r->tail) {
+		const struct record * rec = (const struct record *)
+			&r->data[r->head & (RING_SIZE - 1)];
+		if (rec->level != RECORD_PAD)
+			return rec;
+		ATOMIC_EXCHANGE64(&r->head, r->head + rec->size);
+	}
+	return NULL;
+}
+
+/*
+ * Writes pending records in the order they were
+ * logged, returns the number of records written.
+ */
+static uint32_t drain()
+{
+	static char timestr[128];
+	static int64_t timestr_time = -1;
+	long count = MIN(g_Log.ring_count, MAX_RING_COUNT);
+	uint32_t written = 0;
+	while (written < MAX_DRAIN_COUNT) {
+		struct ring * next = NULL;
+		const struct record * rec = NULL;
+		char msg[MAX_MESSAGE_LENGTH];
+		long i;
+		for (i = 0; i < count; i++) {
+			struct ring * r = g_Log.rings[i];
+			const struct record * head;
+			if (!r)
+				continue;
+			head = peek(r);
+			if (head && (!rec || head->seq < rec->seq)) {
+				rec = head;
+				next = r;
+			}
+		}
+		if (!rec)
+			break;
+		if (rec->time != timestr_time) {
+			fmt_time(timestr, sizeof(timestr), (time_t)rec->time);
+			timestr_time = rec->time;
+		}
+		formatrecord(rec, msg, sizeof(msg));
+		write_msg(rec->level, rec->file, rec->line, timestr, msg);
+		ATOMIC_EXCHANGE64(&next->head, next->head + rec->size);
+		written++;
+	}
+	return written;
+}
+
+static int writer(void * param)
+{
+	int64_t last = g_Log.now;
+	while (TRUE) {
+		boolean stop = g_Log.stop;
+		int64_t t = (int64_t)time(NULL);
+		uint32_t count;
+		g_Log.now = t;
+		if (t != last) {
+			reportsites(t);
+			reportdrops(t);
+			last = t;
+		}
+		count = drain();
+		if (count) {
+			fflush(stdout);
+			fflush(stderr);
+		}
+		else if (stop) {
+			break;
+		}
+		else {
+			sleep(1);
+		}
+	}
+	return 0;
+}
+
+boolean log_init()
+{
+	return TRUE;
+}
+
+boolean log_start_writer()
+{
+	if (g_Log.writer)
+		return TRUE;
+	g_Log.alloc_tag = create_alloc_tag("Log");
+	g_Log.now = (int64_t)time(NULL);
+	g_Log.stop = FALSE;
+	g_Log.writer = create_thread(writer, NULL);
+	if (!g_Log.writer)
+		return FALSE;
+	g_Log.async = TRUE;
+	atexit(log_stop_writer);
+	return TRUE;
+}
+
+void log_stop_writer()
+{
+	if (!g_Log.writer)
+		return;
+	g_Log.async = FALSE;
+	g_Log.stop = TRUE;
+	wait_thread(g_Log.writer);
+	g_Log.writer = NULL;
+}
+
+void log_msg(
+	enum LogLevel level,
+	const char * file,
+	uint32_t line,
+	const char * fmt,
+	...)
+{
+	int64_t t = gettime();
+	va_list ap;
+	if (level != LOG_LEVEL_INFO && level != LOG_LEVEL_ERROR &&
+		!ratelimit(file, line, fmt, t)) {
+		return;
+	}
+	va_start(ap, fmt);
+	logv(level, file, line, t, fmt, ap);
+	va_end(ap);
+}
+
 void log_set_callback(log_callback_t cb)
 {
 	g_Callback = cb;
 }
+
+void log_get_stats(struct log_stats * stats)
+{
+	long count = MIN(g_Log.ring_count, MAX_RING_COUNT);
+	long i;
+	memset(stats, 0, sizeof(*stats));
+	stats->written_count = (uint64_t)g_Log.written_count;
+	stats->dropped_count = g_Log.dropped_count;
+	/* Include drops that were not reported yet. */
+	for (i = 0; i < count; i++) {
+		const struct ring * r = g_Log.rings[i];
+		if (r)
+			stats->dropped_count += r->dropped;
+	}
+	stats->suppressed_count = (uint64_t)g_Log.suppressed_count;
+}
@@ -15,6 +15,12 @@ BEGIN_DECLS
 #define ERROR(fmt, ...) log_msg(LOG_LEVEL_ERROR,\
 	__FILE__, __LINE__, (fmt), __VA_ARGS__)
 
+/* Maximum number of TRACE and WARN messages that
+ * are written from the same call site in a second,
+ * the rest are counted and reported later.
+ * ERROR messages are never suppressed. */
+#define LOG_RATE_LIMIT 100
+
 enum LogLevel {
 	LOG_LEVEL_TRACE,
 	LOG_LEVEL_INFO,
@@ -28,8 +34,47 @@ typedef void (*log_callback_t)(
 	uint32_t line,
 	const char * message);
 
+struct log_stats {
+	/* Number of messages that were written. */
+	uint64_t written_count;
+	/* Number of messages that were dropped because
+	 * the buffer of the logging thread was full. */
+	uint64_t dropped_count;
+	/* Number of messages that were suppressed
+	 * by rate limiting. */
+	uint64_t suppressed_count;
+};
+
 boolean log_init();
 
+/*
+ * Starts the log writer thread.
+ *
+ * Afterwards, messages are copied into buffers of
+ * the calling thread and are formatted and written
+ * by the writer thread. Log callback is also called
+ * from the writer thread.
+ *
+ * When a buffer is full, messages are dropped
+ * instead of blocking the calling thread.
+ *
+ * ERROR messages are written and flushed by the
+ * calling thread so that they are never dropped
+ * and are not lost if the process aborts. They
+ * may be written ahead of earlier messages that
+ * are still pending.
+ *
+ * Writer is stopped when the process exits.
+ */
+boolean log_start_writer();
+
+/*
+ * Writes pending messages and stops the writer
+ * thread, messages are written by the calling
+ * thread afterwards.
+ */
+void log_stop_writer();
+
 void log_msg(
 	enum LogLevel level,
 	const char * file, 
@@ -39,6 +84,8 @@ void log_msg(
 
 void log_set_callback(log_callback_t cb);
 
+void log_get_stats(struct log_stats * stats);
+
 END_DECLS
 
-#endif /* _LOG_LOG_H_ */
\ No newline at end of file
+#endif /* _LOG_LOG_H_ */
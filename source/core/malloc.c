@@ -1,37 +1,299 @@
 #include "core/malloc.h"
+#include "core/os.h"
+#include <assert.h>
 #include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#define ATOMIC_INCREMENT(p) _InterlockedIncrement(p)
+#define ATOMIC_EXCHANGE(p, v) _InterlockedExchange(p, v)
+#define ATOMIC_CAS_POINTER(p, x, c) \
+	_InterlockedCompareExchangePointer((void * volatile *)(p), x, c)
+#else
+#define THREAD_LOCAL __thread
+#define ATOMIC_INCREMENT(p) __sync_add_and_fetch(p, 1)
+#define ATOMIC_EXCHANGE(p, v) __sync_lock_test_and_set(p, v)
+#define ATOMIC_CAS_POINTER(p, x, c) __sync_val_compare_and_swap(p, c, x)
+#endif
+
+#define MAX_STATS_SLOT_COUNT 256
+/* Failed allocations are retried for about a
+ * second before the process is aborted. */
+#define MAX_RETRY_COUNT 100
+#define HEADER_MAGIC 0xA110C8EDu
+
+/*
+ * Each allocation is preceded by a header that
+ * records its size and tag, so that memory can be
+ * attributed to its owner when it is freed.
+ *
+ * Header is 16 bytes so that alignment guaranteed
+ * by `malloc` is preserved.
+ */
+struct header {
+	uint64_t size;
+	uint32_t tag;
+	uint32_t magic;
+};
+
+struct tag_counter {
+	int64_t count;
+	int64_t size;
+	uint64_t total_count;
+};
+
+/*
+ * Each thread counts allocations in its own slot
+ * so that counting does not require atomic operations.
+ *
+ * Slots are padded to a cache line to prevent
+ * threads from invalidating each others slots.
+ */
+struct stats_slot {
+	struct alloc_stats stats;
+	struct tag_counter * volatile tags;
+	uint8_t padding[64 - sizeof(struct alloc_stats) -
+		sizeof(struct tag_counter *)];
+};
+
+static struct stats_slot g_Slots[MAX_STATS_SLOT_COUNT];
+static volatile long g_SlotCount;
+static THREAD_LOCAL struct stats_slot * t_Slot;
+static THREAD_LOCAL uint32_t t_Tag;
+static char g_TagNames[MAX_ALLOC_TAG_COUNT][MAX_ALLOC_TAG_NAME_LENGTH] = {
+	"Untagged" };
+static volatile long g_TagCount = 1;
+static volatile long g_TagLock;
+
+static struct stats_slot * getslot()
+{
+	struct stats_slot * slot = t_Slot;
+	if (!slot) {
+		long index = ATOMIC_INCREMENT(&g_SlotCount) - 1;
+		/* If there are too many threads, last slot
+		 * is shared and counts become approximate. */
+		if (index >= MAX_STATS_SLOT_COUNT)
+			index = MAX_STATS_SLOT_COUNT - 1;
+		slot = &g_Slots[index];
+		if (!slot->tags) {
+			/* Counters are not allocated with `alloc`,
+			 * as they would need to be counted. */
+			struct tag_counter * tags = calloc(MAX_ALLOC_TAG_COUNT,
+				sizeof(*tags));
+			while (!tags) {
+				sleep(10);
+				tags = calloc(MAX_ALLOC_TAG_COUNT, sizeof(*tags));
+			}
+			if (ATOMIC_CAS_POINTER(&slot->tags, tags, NULL) != NULL)
+				free(tags);
+		}
+		t_Slot = slot;
+	}
+	return slot;
+}
+
+static void countalloc(uint32_t tag, size_t n)
+{
+	struct stats_slot * slot = getslot();
+	struct tag_counter * t = &slot->tags[tag];
+	slot->stats.count++;
+	slot->stats.size += n;
+	t->count++;
+	t->size += n;
+	t->total_count++;
+}
+
+static void countrealloc(uint32_t tag, size_t prev, size_t n)
+{
+	struct stats_slot * slot = getslot();
+	struct tag_counter * t = &slot->tags[tag];
+	slot->stats.count++;
+	slot->stats.size += n;
+	t->size += (int64_t)n - (int64_t)prev;
+	t->total_count++;
+}
+
+static void countfree(uint32_t tag, size_t n)
+{
+	struct tag_counter * t = &getslot()->tags[tag];
+	t->count--;
+	t->size -= n;
+}
+
+/*
+ * Memory may be released by other threads,
+ * so allocation is retried for a while before
+ * giving up.
+ */
+static void * retry(void * p, size_t n)
+{
+	uint32_t i;
+	for (i = 0; i < MAX_RETRY_COUNT; i++) {
+		void * r;
+		sleep(10);
+		r = p ? realloc(p, n) : malloc(n);
+		if (r)
+			return r;
+	}
+	fprintf(stderr, "Failed to allocate %llu bytes.\n",
+		(unsigned long long)n);
+	abort();
+	return NULL;
+}
+
+static struct header * getheader(void * p)
+{
+	struct header * h = (struct header *)p - 1;
+	assert(h->magic == HEADER_MAGIC);
+	return h;
+}
+
+static void locktags()
+{
+	while (ATOMIC_EXCHANGE(&g_TagLock, 1))
+		sleep(0);
+}
+
+static void unlocktags()
+{
+	ATOMIC_EXCHANGE(&g_TagLock, 0);
+}
 
 void * alloc(size_t n)
 {
-	void * p;
+	return alloc_tagged(n, t_Tag);
+}
+
+void * alloc_tagged(size_t n, uint32_t tag)
+{
+	struct header * h;
 	if (!n)
 		return NULL;
-	p = malloc(n);
-	while (!p) {
-		/* TODO: */
-		p = malloc(n);
-	}
-	return p;
+	assert(tag < MAX_ALLOC_TAG_COUNT);
+	h = malloc(sizeof(*h) + n);
+	if (!h)
+		h = retry(NULL, sizeof(*h) + n);
+	h->size = n;
+	h->tag = tag;
+	h->magic = HEADER_MAGIC;
+	countalloc(tag, n);
+	return h + 1;
 }
 
 void * reallocate(void * p, size_t n)
 {
-	void * pnew;
+	struct header * h;
+	struct header * hnew;
+	size_t prev;
+	if (!p)
+		return alloc(n);
 	if (!n) {
-		if (p)
-			dealloc(p);
+		dealloc(p);
 		return NULL;
 	}
-	pnew = realloc(p, n);
-	while (!pnew) {
-		/* TODO: */
-		pnew = realloc(p, n);
-	}
-	return pnew;
+	h = getheader(p);
+	prev = (size_t)h->size;
+	hnew = realloc(h, sizeof(*h) + n);
+	if (!hnew)
+		hnew = retry(h, sizeof(*h) + n);
+	hnew->size = n;
+	countrealloc(hnew->tag, prev, n);
+	return hnew + 1;
 }
 
 void dealloc(void * p)
 {
-	free(p);
+	struct header * h;
+	if (!p)
+		return;
+	h = getheader(p);
+	countfree(h->tag, (size_t)h->size);
+	/* Helps to catch double frees. */
+	h->magic = 0;
+	free(h);
+}
+
+void get_thread_alloc_stats(struct alloc_stats * stats)
+{
+	*stats = getslot()->stats;
+}
+
+void get_alloc_stats(struct alloc_stats * stats)
+{
+	long count = MIN(g_SlotCount, MAX_STATS_SLOT_COUNT);
+	long i;
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < count; i++) {
+		stats->count += g_Slots[i].stats.count;
+		stats->size += g_Slots[i].stats.size;
+	}
+}
+
+uint32_t create_alloc_tag(const char * name)
+{
+	uint32_t tag = ALLOC_TAG_UNTAGGED;
+	uint32_t count;
+	uint32_t i;
+	size_t length = strlen(name);
+	if (length >= MAX_ALLOC_TAG_NAME_LENGTH)
+		length = MAX_ALLOC_TAG_NAME_LENGTH - 1;
+	locktags();
+	count = (uint32_t)g_TagCount;
+	for (i = 0; i < count; i++) {
+		if (strncmp(g_TagNames[i], name, length) == 0 &&
+			g_TagNames[i][length] == '\0') {
+			unlocktags();
+			return i;
+		}
+	}
+	if (count < MAX_ALLOC_TAG_COUNT) {
+		memcpy(g_TagNames[count], name, length);
+		g_TagNames[count][length] = '\0';
+		tag = count;
+		/* Name is written before count is increased,
+		 * so that readers do not need to lock. */
+		ATOMIC_EXCHANGE(&g_TagCount, (long)count + 1);
+	}
+	unlocktags();
+	return tag;
+}
+
+uint32_t set_alloc_tag(uint32_t tag)
+{
+	uint32_t prev = t_Tag;
+	assert(tag < MAX_ALLOC_TAG_COUNT);
+	t_Tag = tag;
+	return prev;
+}
+
+uint32_t get_alloc_tag()
+{
+	return t_Tag;
+}
+
+uint32_t get_alloc_tag_count()
+{
+	return (uint32_t)g_TagCount;
+}
+
+void get_alloc_tag_stats(uint32_t tag, struct alloc_tag_stats * stats)
+{
+	long count = MIN(g_SlotCount, MAX_STATS_SLOT_COUNT);
+	long i;
+	memset(stats, 0, sizeof(*stats));
+	if (tag >= (uint32_t)g_TagCount)
+		return;
+	stats->name = g_TagNames[tag];
+	for (i = 0; i < count; i++) {
+		const struct tag_counter * t = g_Slots[i].tags;
+		if (!t)
+			continue;
+		stats->count += t[tag].count;
+		stats->size += t[tag].size;
+		stats->total_count += t[tag].total_count;
+	}
 }
@@ -4,14 +4,101 @@
 #include "core/macros.h"
 #include "core/types.h"
 
+/* Allocations that are made while no tag is 
+ * set are counted with this tag. */
+#define ALLOC_TAG_UNTAGGED 0
+#define MAX_ALLOC_TAG_COUNT 1024
+#define MAX_ALLOC_TAG_NAME_LENGTH 48
+
 BEGIN_DECLS
 
+struct alloc_stats {
+	/* Number of allocations made by `alloc` and 
+	 * `reallocate`. */
+	uint64_t count;
+	/* Total number of bytes that were requested. */
+	uint64_t size;
+};
+
+/*
+ * Statistics of memory that is owned by a tag.
+ *
+ * Memory is owned by the tag it was allocated with, 
+ * even if it is reallocated or freed while another 
+ * tag is set.
+ */
+struct alloc_tag_stats {
+	const char * name;
+	/* Number of live allocations. */
+	int64_t count;
+	/* Number of live bytes. */
+	int64_t size;
+	/* Number of allocations that were made. */
+	uint64_t total_count;
+};
+
+/*
+ * Allocates memory that is owned by the tag 
+ * that is set for the calling thread.
+ */
 void * alloc(size_t n);
 
+/*
+ * Allocates memory that is owned by `tag`.
+ */
+void * alloc_tagged(size_t n, uint32_t tag);
+
 void * reallocate(void * p, size_t n);
 
 void dealloc(void * p);
 
+/*
+ * Retrieves allocation statistics of the calling thread.
+ */
+void get_thread_alloc_stats(struct alloc_stats * stats);
+
+/*
+ * Retrieves allocation statistics of all threads.
+ *
+ * Statistics of other threads are read without 
+ * synchronization, so they may lag behind slightly.
+ */
+void get_alloc_stats(struct alloc_stats * stats);
+
+/*
+ * Returns the tag with given name, creating 
+ * it if it does not exist.
+ *
+ * If tag limit is reached, returns 
+ * `ALLOC_TAG_UNTAGGED`.
+ */
+uint32_t create_alloc_tag(const char * name);
+
+/*
+ * Sets the tag of the calling thread.
+ *
+ * Returns the previous tag, so that it can 
+ * be restored when scope of the new tag ends.
+ */
+uint32_t set_alloc_tag(uint32_t tag);
+
+uint32_t get_alloc_tag();
+
+/*
+ * Returns the number of tags that were created, 
+ * tags are numbered from zero.
+ */
+uint32_t get_alloc_tag_count();
+
+/*
+ * Retrieves statistics of a tag, summed 
+ * over all threads.
+ *
+ * Like `get_alloc_stats`, counts of other threads 
+ * are read without synchronization.
+ */
+void get_alloc_tag_stats(uint32_t tag, struct alloc_tag_stats * stats);
+
 END_DECLS
 
 #endif /* _CORE_MALLOC_H_ */
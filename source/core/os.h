@@ -101,6 +101,31 @@ boolean create_process(
 	const char * command_line,
 	const char * current_dir);
 
+/*
+ * Runs a process and waits for it to exit.
+ *
+ * Returns FALSE if process could not be created.
+ */
+boolean run_process(
+	const char * application_path, 
+	const char * command_line,
+	const char * current_dir,
+	uint32_t * exit_code);
+
+/*
+ * Retrieves current and peak size of the 
+ * working set of the process in bytes.
+ */
+boolean get_memory_usage(uint64_t * current, uint64_t * peak);
+
+/*
+ * Hints the system to read pages of a memory 
+ * range (i.e. a mapped file) ahead of time.
+ *
+ * Does not wait for pages to be read.
+ */
+void prefetch_memory(const void * data, size_t size);
+
 /*
  * Suspends the execution of the current thread 
  * for at least until the time-out interval elapses.
@@ -7,6 +7,7 @@
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <Psapi.h>
 
 struct mutex_t {
 	CRITICAL_SECTION cs;
@@ -167,6 +168,70 @@ boolean create_process(
 	return TRUE;
 }
 
+boolean run_process(
+	const char * application_path, 
+	const char * command_line,
+	const char * current_dir,
+	uint32_t * exit_code)
+{
+	char cmd[2048];
+	STARTUPINFO startup = { 0 };
+	PROCESS_INFORMATION proc = { 0 };
+	DWORD code = 0;
+	BOOL ret;
+	startup.cb = sizeof(startup);
+	snprintf(cmd, sizeof(cmd), "\"%s\" %s", application_path, command_line);
+	ret = CreateProcessA(NULL, cmd, NULL, NULL, FALSE, 0, NULL, 
+		current_dir, &startup, &proc);
+	if (!ret)
+		return FALSE;
+	WaitForSingleObject(proc.hProcess, INFINITE);
+	GetExitCodeProcess(proc.hProcess, &code);
+	CloseHandle(proc.hThread);
+	CloseHandle(proc.hProcess);
+	if (exit_code)
+		*exit_code = (uint32_t)code;
+	return TRUE;
+}
+
+boolean get_memory_usage(uint64_t * current, uint64_t * peak)
+{
+	PROCESS_MEMORY_COUNTERS counters = { 0 };
+	counters.cb = sizeof(counters);
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, 
+			sizeof(counters))) {
+		return FALSE;
+	}
+	*current = counters.WorkingSetSize;
+	*peak = counters.PeakWorkingSetSize;
+	return TRUE;
+}
+
+void prefetch_memory(const void * data, size_t size)
+{
+	/* Same layout as WIN32_MEMORY_RANGE_ENTRY, which is 
+	 * only declared when targeting Windows 8 and later. */
+	struct memory_range {
+		PVOID address;
+		SIZE_T size;
+	};
+	typedef BOOL (WINAPI * prefetch_t)(HANDLE, ULONG_PTR, 
+		struct memory_range *, ULONG);
+	static prefetch_t prefetch;
+	static boolean resolved;
+	struct memory_range range;
+	if (!resolved) {
+		prefetch = (prefetch_t)GetProcAddress(
+			GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+		resolved = TRUE;
+	}
+	if (!prefetch || !size)
+		return;
+	range.address = (PVOID)data;
+	range.size = size;
+	prefetch(GetCurrentProcess(), 1, &range, 0);
+}
+
 void sleep(uint32_t ms)
 {
 	Sleep((DWORD)ms);
@@ -0,0 +1,275 @@
+#include "core/profile.h"
+#include "core/file_system.h"
+#include "core/internal.h"
+#include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
+#include "core/string.h"
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#define ATOMIC_INCREMENT(p) _InterlockedIncrement(p)
+#define ATOMIC_EXCHANGE64(p, v) _InterlockedExchange64(p, v)
+#define ATOMIC_LOAD_ACQUIRE64(p) _InterlockedCompareExchange64(p, 0, 0)
+#define READ_TIMESTAMP() __rdtsc()
+#else
+#include <x86intrin.h>
+#define THREAD_LOCAL __thread
+#define ATOMIC_INCREMENT(p) __sync_add_and_fetch(p, 1)
+#define ATOMIC_EXCHANGE64(p, v) __sync_lock_test_and_set(p, v)
+#define ATOMIC_LOAD_ACQUIRE64(p) \
+	(__atomic_thread_fence(__ATOMIC_ACQUIRE), \
+	 __atomic_load_n(p, __ATOMIC_ACQUIRE))
+#define READ_TIMESTAMP() __rdtsc()
+#endif
+
+/* Threads that begin zones after this limit
+ * is reached are not profiled. */
+#define MAX_THREAD_COUNT 64
+/* Number of zones that are kept per thread,
+ * main loop records a few thousand zones per
+ * second. Must be a power of two. */
+#define EVENT_COUNT 131072
+#define MAX_DEPTH 64
+
+struct event {
+	const char * name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+struct zone {
+	const char * name;
+	uint64_t begin;
+};
+
+struct thread_profile {
+	uint64_t thread_id;
+	char name[PROFILE_MAX_THREAD_NAME_LENGTH];
+	struct zone stack[MAX_DEPTH];
+	uint32_t depth;
+	/* Number of events that were recorded, event
+	 * `i` is stored at `i % EVENT_COUNT`. */
+	volatile int64_t count;
+	struct event events[EVENT_COUNT];
+};
+
+static struct thread_profile * volatile g_Threads[MAX_THREAD_COUNT];
+static volatile long g_ThreadCount;
+static THREAD_LOCAL struct thread_profile * t_Thread;
+static THREAD_LOCAL boolean t_Disabled;
+static THREAD_LOCAL char t_Name[PROFILE_MAX_THREAD_NAME_LENGTH];
+static timer_t g_Timer;
+static uint64_t g_StartTimestamp;
+
+static struct thread_profile * getthread()
+{
+	struct thread_profile * t = t_Thread;
+	long index;
+	if (t || t_Disabled)
+		return t;
+	index = ATOMIC_INCREMENT(&g_ThreadCount) - 1;
+	if (index >= MAX_THREAD_COUNT) {
+		t_Disabled = TRUE;
+		return NULL;
+	}
+	t = alloc_tagged(sizeof(*t), ALLOC_TAG_UNTAGGED);
+	memset(t, 0, sizeof(*t));
+	t->thread_id = get_current_thread_id();
+	strlcpy(t->name, t_Name, sizeof(t->name));
+	t_Thread = t;
+	g_Threads[index] = t;
+	return t;
+}
+
+static double getfrequency()
+{
+	uint64_t us = timer_delta_no_reset(g_Timer);
+	uint64_t ticks = READ_TIMESTAMP() - g_StartTimestamp;
+	if (!us)
+		return 1.0;
+	return (double)ticks / (double)us;
+}
+
+/*
+ * Writes `str` as a JSON string.
+ */
+static void printstring(file f, const char * str)
+{
+	char buf[128];
+	size_t len = 0;
+	buf[len++] = '"';
+	while (*str && len < sizeof(buf) - 3) {
+		char c = *str++;
+		if (c == '"' || c == '\\')
+			buf[len++] = '\\';
+		else if ((unsigned char)c < 0x20)
+			c = ' ';
+		buf[len++] = c;
+	}
+	buf[len++] = '"';
+	write_file(f, buf, len);
+}
+
+/*
+ * Copies events that were recorded after
+ * `min_timestamp` to `events`.
+ *
+ * Events may be overwritten by the owning thread
+ * while they are copied, count is read again
+ * afterwards to discard events that may have
+ * been overwritten.
+ * The event at the second count may be in the
+ * middle of being written, and it shares its
+ * slot with the oldest copied event, so that
+ * event is discarded as well.
+ */
+static uint32_t copyevents(
+	struct thread_profile * t,
+	uint64_t min_timestamp,
+	struct event * events)
+{
+	int64_t end = ATOMIC_LOAD_ACQUIRE64(&t->count);
+	int64_t begin = MAX(end - EVENT_COUNT, 0);
+	int64_t i;
+	int64_t valid;
+	uint32_t count = 0;
+	for (i = begin; i < end; i++)
+		events[i - begin] = t->events[i & (EVENT_COUNT - 1)];
+	valid = ATOMIC_LOAD_ACQUIRE64(&t->count) - EVENT_COUNT + 1;
+	for (i = MAX(begin, valid); i < end; i++) {
+		const struct event * e = &events[i - begin];
+		if (e->end >= min_timestamp)
+			events[count++] = *e;
+	}
+	return count;
+}
+
+boolean profile_startup()
+{
+	g_Timer = create_timer();
+	g_StartTimestamp = READ_TIMESTAMP();
+	return (g_Timer != NULL);
+}
+
+void profile_begin(const char * name)
+{
+	struct thread_profile * t = getthread();
+	struct zone * z;
+	if (!t)
+		return;
+	assert(t->depth < MAX_DEPTH);
+	if (t->depth >= MAX_DEPTH) {
+		/* Keeps begin and end calls balanced,
+		 * zone is not recorded. */
+		t->depth++;
+		return;
+	}
+	z = &t->stack[t->depth++];
+	z->name = name;
+	z->begin = READ_TIMESTAMP();
+}
+
+void profile_end()
+{
+	struct thread_profile * t = t_Thread;
+	const struct zone * z;
+	struct event * e;
+	int64_t count;
+	if (!t)
+		return;
+	assert(t->depth != 0);
+	if (!t->depth || --t->depth >= MAX_DEPTH)
+		return;
+	z = &t->stack[t->depth];
+	count = t->count;
+	e = &t->events[count & (EVENT_COUNT - 1)];
+	e->name = z->name;
+	e->begin = z->begin;
+	e->end = READ_TIMESTAMP();
+	/* Publishes event to exporting threads. */
+	ATOMIC_EXCHANGE64(&t->count, count + 1);
+}
+
+uint64_t profile_get_timestamp()
+{
+	return READ_TIMESTAMP();
+}
+
+double profile_get_timestamp_frequency()
+{
+	return getfrequency();
+}
+
+void profile_set_thread_name(const char * name)
+{
+	strlcpy(t_Name, name, sizeof(t_Name));
+	if (t_Thread)
+		strlcpy(t_Thread->name, name, sizeof(t_Thread->name));
+}
+
+boolean profile_export_trace(const char * path, uint32_t seconds)
+{
+	file f;
+	struct event * events;
+	double frequency;
+	uint64_t now;
+	uint64_t min_timestamp = 0;
+	uint32_t thread_count;
+	uint32_t i;
+	boolean first = TRUE;
+	if (!g_Timer) {
+		ERROR("Profiler is not started.");
+		return FALSE;
+	}
+	f = open_file(path, FILE_ACCESS_WRITE);
+	if (!f) {
+		ERROR("Failed to create trace file (%s).", path);
+		return FALSE;
+	}
+	frequency = getfrequency();
+	now = READ_TIMESTAMP();
+	if (seconds && (double)seconds * 1e6 * frequency < (double)now)
+		min_timestamp = now - (uint64_t)((double)seconds * 1e6 * frequency);
+	thread_count = (uint32_t)MIN(g_ThreadCount, MAX_THREAD_COUNT);
+	/* Events are copied so that they are not overwritten
+	 * while they are written, which is much slower
+	 * than recording. */
+	events = alloc_tagged(EVENT_COUNT * sizeof(*events),
+		ALLOC_TAG_UNTAGGED);
+	print_file(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (i = 0; i < thread_count; i++) {
+		struct thread_profile * t = g_Threads[i];
+		uint32_t count;
+		uint32_t j;
+		/* Thread has reserved a slot but
+		 * has not yet stored it. */
+		if (!t)
+			continue;
+		print_file(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":",
+			first ? "" : ",\n", (unsigned long long)t->thread_id);
+		printstring(f, t->name[0] ? t->name : "Thread");
+		print_file(f, "}}");
+		first = FALSE;
+		count = copyevents(t, min_timestamp, events);
+		for (j = 0; j < count; j++) {
+			const struct event * e = &events[j];
+			uint64_t begin = e->begin - MIN(e->begin, g_StartTimestamp);
+			uint64_t duration = e->end - MIN(e->end, e->begin);
+			print_file(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+				(unsigned long long)t->thread_id,
+				(double)begin / frequency,
+				(double)duration / frequency);
+			printstring(f, e->name);
+			print_file(f, "}");
+		}
+	}
+	print_file(f, "\n]}\n");
+	dealloc(events);
+	close_file(f);
+	return TRUE;
+}
@@ -0,0 +1,79 @@
+#ifndef _CORE_PROFILE_H_
+#define _CORE_PROFILE_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+/* Profiling zones are compiled in unless
+ * PROFILE_DISABLED is defined. */
+#ifndef PROFILE_DISABLED
+#define PROFILE_BEGIN(name) profile_begin(name)
+#define PROFILE_END() profile_end()
+#else
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#endif
+
+#define PROFILE_MAX_THREAD_NAME_LENGTH 32
+
+BEGIN_DECLS
+
+/*
+ * Scoped profiling zones.
+ *
+ * Each thread records completed zones into its own
+ * ring buffer, so recording does not lock and older
+ * zones are overwritten as new ones are recorded.
+ * Ring buffer of a thread is allocated when it first
+ * begins a zone.
+ *
+ * Zones can be nested and need to be ended on
+ * the thread that began them, in reverse order.
+ */
+
+/*
+ * Begins a profiling zone.
+ *
+ * `name` is not copied and needs to remain valid
+ * until the process exits (i.e. a string literal).
+ */
+void profile_begin(const char * name);
+
+/*
+ * Ends the last zone that was begun by the calling
+ * thread and records it.
+ */
+void profile_end();
+
+/*
+ * Sets the name of the calling thread
+ * in exported traces.
+ */
+void profile_set_thread_name(const char * name);
+
+/*
+ * Returns the timestamp that zones are
+ * recorded with.
+ */
+uint64_t profile_get_timestamp();
+
+/*
+ * Returns the number of timestamp ticks
+ * in a microsecond.
+ */
+double profile_get_timestamp_frequency();
+
+/*
+ * Writes zones that were recorded in the last
+ * `seconds` seconds to a file in Chrome trace
+ * event format, which can be opened with
+ * chrome://tracing or Perfetto.
+ *
+ * Can be called from any thread while other
+ * threads are recording zones.
+ */
+boolean profile_export_trace(const char * path, uint32_t seconds);
+
+END_DECLS
+
+#endif /* _CORE_PROFILE_H_ */
@@ -0,0 +1,318 @@
+#include "core/slab.h"
+#include "core/internal.h"
+#include "core/malloc.h"
+#include "core/os.h"
+#include "core/string.h"
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#define ATOMIC_INCREMENT64(p) _InterlockedIncrement64(p)
+#define ATOMIC_DECREMENT64(p) _InterlockedDecrement64(p)
+#define ATOMIC_CAS64(p, x, c) _InterlockedCompareExchange64(p, x, c)
+#else
+#define THREAD_LOCAL __thread
+#define ATOMIC_INCREMENT64(p) __sync_add_and_fetch(p, 1)
+#define ATOMIC_DECREMENT64(p) __sync_sub_and_fetch(p, 1)
+#define ATOMIC_CAS64(p, x, c) __sync_val_compare_and_swap(p, c, x)
+#endif
+
+/* Pools that are created after this limit
+ * is reached are not cached by threads and
+ * are not iterated. */
+#define MAX_POOL_COUNT 512
+#define SLAB_SIZE 65536
+#define MIN_SLAB_OBJECT_COUNT 8
+/* Objects and slab headers are aligned
+ * to this boundary. */
+#define SLAB_ALIGNMENT 16
+/* Thread caches move at most this many
+ * objects to and from pools at once. */
+#define MAX_BATCH_COUNT 32
+#define BATCH_SIZE 16384
+
+#define ALIGN_SIZE(size, alignment) \
+	(((size) + (alignment) - 1) & ~((size_t)(alignment) - 1))
+
+struct free_object {
+	struct free_object * next;
+};
+
+struct slab {
+	struct slab * next;
+	uint8_t padding[SLAB_ALIGNMENT - sizeof(struct slab *)];
+};
+
+struct slab_pool {
+	char name[SLAB_MAX_NAME_LENGTH];
+	uint32_t index;
+	uint32_t flags;
+	uint32_t alloc_tag;
+	size_t object_size;
+	uint32_t slab_object_count;
+	uint32_t batch_count;
+	mutex_t mutex;
+	struct slab * slabs;
+	uint32_t slab_count;
+	struct free_object * free_objects;
+	/* Remaining objects in the last slab,
+	 * that were never allocated. */
+	uint8_t * cursor;
+	uint8_t * end;
+	/* Counters are updated without locking
+	 * the pool, padding keeps them from sharing
+	 * a cache line with fields above. */
+	uint8_t padding[64];
+	volatile int64_t used_count;
+	volatile int64_t peak_used_count;
+	volatile int64_t alloc_count;
+};
+
+struct cache {
+	struct free_object * head;
+	uint32_t count;
+};
+
+static mutex_t g_Mutex;
+static struct slab_pool * g_Pools[MAX_POOL_COUNT];
+static uint32_t g_PoolCount;
+static THREAD_LOCAL struct cache * t_Caches;
+
+static size_t getsizeclass(size_t size)
+{
+	if (size < sizeof(struct free_object))
+		size = sizeof(struct free_object);
+	if (size <= 256)
+		return ALIGN_SIZE(size, 16);
+	if (size <= 1024)
+		return ALIGN_SIZE(size, 64);
+	if (size <= 8192)
+		return ALIGN_SIZE(size, 256);
+	return ALIGN_SIZE(size, 1024);
+}
+
+static struct slab_pool * createpool(
+	const char * name,
+	size_t object_size,
+	uint32_t flags)
+{
+	struct slab_pool * pool = alloc(sizeof(*pool));
+	memset(pool, 0, sizeof(*pool));
+	strlcpy(pool->name, name, sizeof(pool->name));
+	pool->flags = flags;
+	pool->alloc_tag = create_alloc_tag(name);
+	pool->object_size = getsizeclass(object_size);
+	pool->slab_object_count = (uint32_t)MAX(SLAB_SIZE / pool->object_size,
+		MIN_SLAB_OBJECT_COUNT);
+	pool->batch_count = (uint32_t)CLAMP(BATCH_SIZE / pool->object_size,
+		1, MAX_BATCH_COUNT);
+	pool->mutex = create_mutex();
+	if (g_PoolCount < MAX_POOL_COUNT) {
+		pool->index = g_PoolCount;
+		g_Pools[g_PoolCount++] = pool;
+	}
+	else {
+		pool->index = UINT32_MAX;
+	}
+	return pool;
+}
+
+static struct cache * getcache(struct slab_pool * pool)
+{
+	struct cache * caches = t_Caches;
+	if (pool->index == UINT32_MAX)
+		return NULL;
+	if (!caches) {
+		size_t size = MAX_POOL_COUNT * sizeof(*caches);
+		caches = alloc(size);
+		memset(caches, 0, size);
+		t_Caches = caches;
+	}
+	return &caches[pool->index];
+}
+
+/*
+ * Takes up to `count` free objects and returns
+ * them as a list. Pool needs to be locked.
+ */
+static struct free_object * takeobjects(
+	struct slab_pool * pool,
+	uint32_t count,
+	uint32_t * taken)
+{
+	struct free_object * head = NULL;
+	uint32_t i = 0;
+	while (i < count && pool->free_objects) {
+		struct free_object * o = pool->free_objects;
+		pool->free_objects = o->next;
+		o->next = head;
+		head = o;
+		i++;
+	}
+	if (!i && pool->cursor == pool->end) {
+		size_t size = sizeof(struct slab) +
+			pool->slab_object_count * pool->object_size;
+		struct slab * s = alloc_tagged(size, pool->alloc_tag);
+		s->next = pool->slabs;
+		pool->slabs = s;
+		pool->slab_count++;
+		pool->cursor = (uint8_t *)s + sizeof(*s);
+		pool->end = (uint8_t *)s + size;
+	}
+	while (i < count && pool->cursor != pool->end) {
+		struct free_object * o = (struct free_object *)pool->cursor;
+		pool->cursor += pool->object_size;
+		o->next = head;
+		head = o;
+		i++;
+	}
+	*taken = i;
+	return head;
+}
+
+static void countalloc(struct slab_pool * pool)
+{
+	int64_t used = ATOMIC_INCREMENT64(&pool->used_count);
+	int64_t peak = pool->peak_used_count;
+	ATOMIC_INCREMENT64(&pool->alloc_count);
+	while (used > peak) {
+		int64_t prev = ATOMIC_CAS64(&pool->peak_used_count,
+			used, peak);
+		if (prev == peak)
+			break;
+		peak = prev;
+	}
+}
+
+boolean slab_startup()
+{
+	g_Mutex = create_mutex();
+	return (g_Mutex != NULL);
+}
+
+struct slab_pool * slab_create(
+	const char * name,
+	size_t object_size,
+	uint32_t flags)
+{
+	struct slab_pool * pool;
+	assert(g_Mutex != NULL);
+	lock_mutex(g_Mutex);
+	pool = createpool(name, object_size, flags);
+	unlock_mutex(g_Mutex);
+	return pool;
+}
+
+struct slab_pool * slab_create_once(
+	struct slab_pool * volatile * pool,
+	const char * name,
+	size_t object_size,
+	uint32_t flags)
+{
+	struct slab_pool * p = *pool;
+	if (p)
+		return p;
+	assert(g_Mutex != NULL);
+	lock_mutex(g_Mutex);
+	p = *pool;
+	if (!p) {
+		p = createpool(name, object_size, flags);
+		*pool = p;
+	}
+	unlock_mutex(g_Mutex);
+	return p;
+}
+
+void * slab_alloc(struct slab_pool * pool)
+{
+	struct cache * c;
+	struct free_object * o;
+	uint32_t taken;
+	countalloc(pool);
+	if (!(pool->flags & SLAB_POOL_RECYCLE))
+		return alloc_tagged(pool->object_size, pool->alloc_tag);
+	c = getcache(pool);
+	if (!c) {
+		lock_mutex(pool->mutex);
+		o = takeobjects(pool, 1, &taken);
+		unlock_mutex(pool->mutex);
+		return o;
+	}
+	if (!c->head) {
+		lock_mutex(pool->mutex);
+		c->head = takeobjects(pool, pool->batch_count, &c->count);
+		unlock_mutex(pool->mutex);
+	}
+	o = c->head;
+	c->head = o->next;
+	c->count--;
+	return o;
+}
+
+void slab_free(struct slab_pool * pool, void * object)
+{
+	struct free_object * o = object;
+	struct cache * c;
+	ATOMIC_DECREMENT64(&pool->used_count);
+	if (!(pool->flags & SLAB_POOL_RECYCLE)) {
+		dealloc(object);
+		return;
+	}
+	c = getcache(pool);
+	if (!c) {
+		lock_mutex(pool->mutex);
+		o->next = pool->free_objects;
+		pool->free_objects = o;
+		unlock_mutex(pool->mutex);
+		return;
+	}
+	o->next = c->head;
+	c->head = o;
+	if (++c->count >= 2 * pool->batch_count) {
+		/* Return a batch to the pool so that objects
+		 * freed by one thread and allocated by another
+		 * do not accumulate in a single cache. */
+		struct free_object * head = c->head;
+		struct free_object * tail = head;
+		uint32_t i;
+		for (i = 1; i < pool->batch_count; i++)
+			tail = tail->next;
+		c->head = tail->next;
+		c->count -= pool->batch_count;
+		lock_mutex(pool->mutex);
+		tail->next = pool->free_objects;
+		pool->free_objects = head;
+		unlock_mutex(pool->mutex);
+	}
+}
+
+void slab_get_stats(struct slab_pool * pool, struct slab_stats * stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->name = pool->name;
+	stats->object_size = pool->object_size;
+	lock_mutex(pool->mutex);
+	stats->slab_count = pool->slab_count;
+	stats->reserved_size = (uint64_t)pool->slab_count *
+		(sizeof(struct slab) +
+			pool->slab_object_count * pool->object_size);
+	unlock_mutex(pool->mutex);
+	stats->used_count = (uint64_t)MAX(pool->used_count, 0);
+	stats->peak_used_count = (uint64_t)pool->peak_used_count;
+	stats->alloc_count = (uint64_t)pool->alloc_count;
+}
+
+boolean slab_iterate(size_t * index, struct slab_pool ** pool)
+{
+	boolean result = FALSE;
+	lock_mutex(g_Mutex);
+	if (*index < g_PoolCount) {
+		*pool = g_Pools[(*index)++];
+		result = TRUE;
+	}
+	unlock_mutex(g_Mutex);
+	return result;
+}
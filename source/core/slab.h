@@ -0,0 +1,104 @@
+#ifndef _CORE_SLAB_H_
+#define _CORE_SLAB_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+#define SLAB_MAX_NAME_LENGTH 64
+
+BEGIN_DECLS
+
+/*
+ * Fixed-size object pools.
+ *
+ * Object sizes are rounded up to a size class and
+ * objects are carved out of slabs that are allocated
+ * when a pool runs out of free objects.
+ *
+ * Each thread keeps a small cache of free objects
+ * for every pool, so that most allocations and
+ * deallocations do not lock the pool. Objects that
+ * are cached by a thread when it exits are not
+ * reused.
+ *
+ * Slabs are kept until the process exits. Memory 
+ * of a pool is owned by an allocation tag with the 
+ * same name.
+ *
+ * Functions are thread-safe.
+ */
+
+struct slab_pool;
+
+enum slab_pool_flag_bits {
+	/* Freed objects are reused by later allocations.
+	 * Without this flag, objects are allocated and
+	 * freed individually, and the pool only keeps
+	 * statistics (i.e. to let heap debugging tools
+	 * catch use-after-free). */
+	SLAB_POOL_RECYCLE = 1u << 0,
+};
+
+struct slab_stats {
+	const char * name;
+	/* Size of each object, rounded up to size class. */
+	size_t object_size;
+	uint32_t slab_count;
+	/* Number of bytes allocated for slabs. */
+	uint64_t reserved_size;
+	/* Number of objects that are currently in use. */
+	uint64_t used_count;
+	/* Highest number of objects that were in use
+	 * at the same time. */
+	uint64_t peak_used_count;
+	/* Number of objects that were allocated. */
+	uint64_t alloc_count;
+};
+
+/*
+ * Creates an object pool.
+ *
+ * `name` is copied and is only used for statistics.
+ */
+struct slab_pool * slab_create(
+	const char * name,
+	size_t object_size,
+	uint32_t flags);
+
+/*
+ * Creates the pool that `pool` points to, if it
+ * was not already created by another thread.
+ *
+ * Returns the pool that `pool` points to.
+ */
+struct slab_pool * slab_create_once(
+	struct slab_pool * volatile * pool,
+	const char * name,
+	size_t object_size,
+	uint32_t flags);
+
+/*
+ * Allocates an object.
+ *
+ * Object contents are undefined.
+ */
+void * slab_alloc(struct slab_pool * pool);
+
+/*
+ * Returns an object that was allocated
+ * with `slab_alloc` to the pool.
+ */
+void slab_free(struct slab_pool * pool, void * object);
+
+void slab_get_stats(struct slab_pool * pool, struct slab_stats * stats);
+
+/*
+ * Iterates pools in the order they were created.
+ *
+ * `index` should be initialized to zero.
+ */
+boolean slab_iterate(size_t * index, struct slab_pool ** pool);
+
+END_DECLS
+
+#endif /* _CORE_SLAB_H_ */
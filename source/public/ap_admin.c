@@ -1,5 +1,6 @@
 #include <assert.h>
 
+#include "core/intern.h"
 #include "core/malloc.h"
 #include "core/string.h"
 #include "core/vector.h"
@@ -11,11 +12,27 @@ struct uint_map_item {
 	uint32_t index;
 };
 
+/* Names longer than this are rejected. */
+#define MAX_NAME_LENGTH 255
+
+/*
+ * Keys of admins that intern names point to the
+ * pooled copy of the name.
+ *
+ * Other admins store names inline, `key` is NULL
+ * in stored items. In items that are only used
+ * for lookups, `key` points to the looked up name.
+ */
 struct str_map_item {
-	char key[256];
+	const char * key;
 	uint32_t index;
 };
 
+struct str_map_item_inline {
+	struct str_map_item base;
+	char name[MAX_NAME_LENGTH + 1];
+};
+
 static const struct uint_map_item * uint_item_const(const void * i)
 {
 	return i;
@@ -26,6 +43,13 @@ static const struct str_map_item * str_item_const(const void * i)
 	return i;
 }
 
+static const char * itemkey(const struct str_map_item * i)
+{
+	if (i->key)
+		return i->key;
+	return ((const struct str_map_item_inline *)i)->name;
+}
+
 static uint64_t hash_uint(
 	const void * item, 
 	uint64_t seed0,
@@ -48,8 +72,8 @@ static uint64_t hash_str(
 	uint64_t seed0,
 	uint64_t seed1)
 {
-	const struct str_map_item * i = item;
-	return hmap_murmur(i->key, strlen(i->key), seed0, seed1);
+	const char * key = itemkey(item);
+	return hmap_murmur(key, strlen(key), seed0, seed1);
 }
 
 static int compare_str(
@@ -57,15 +81,72 @@ static int compare_str(
 	const void * b, 
 	void * user_data)
 {
-	return strcmp(str_item_const(a)->key, str_item_const(b)->key);
+	const char * ka = itemkey(str_item_const(a));
+	const char * kb = itemkey(str_item_const(b));
+	if (ka == kb)
+		return 0;
+	return strcmp(ka, kb);
 }
 
+/*
+ * Prepares an item that is only used for lookups,
+ * name is neither copied nor interned.
+ */
+static boolean make_str_map_query(
+	struct str_map_item_inline * item,
+	const char * key)
+{
+	if (strnlen(key, MAX_NAME_LENGTH + 1) > MAX_NAME_LENGTH)
+		return FALSE;
+	item->base.key = key;
+	return TRUE;
+}
+
+/*
+ * Prepares an item that is stored in string map.
+ */
 static boolean make_str_map_item(
-	struct str_map_item * item, 
+	struct ap_admin * admin,
+	struct str_map_item_inline * item,
 	const char * key)
 {
-	return (strlcpy(item->key, key, 
-		sizeof(item->key)) < sizeof(item->key));
+	if (!admin->intern_names) {
+		item->base.key = NULL;
+		return (strlcpy(item->name, key,
+			sizeof(item->name)) < sizeof(item->name));
+	}
+	if (strnlen(key, MAX_NAME_LENGTH + 1) > MAX_NAME_LENGTH)
+		return FALSE;
+	item->base.key = intern_string(key);
+	return TRUE;
+}
+
+static void initadmin(
+	struct ap_admin * admin,
+	size_t object_size,
+	uint32_t object_count,
+	boolean intern_names)
+{
+	uint32_t i;
+	memset(admin, 0, sizeof(*admin));
+	admin->uint_map = hmap_new(sizeof(struct uint_map_item), 16, 
+		(uint64_t)strcpy, (uint64_t)memset, 
+		hash_uint, compare_uint, NULL, NULL);
+	admin->str_map = hmap_new(intern_names ? 
+		sizeof(struct str_map_item) : 
+		sizeof(struct str_map_item_inline), 16, 
+		(uint64_t)strcpy, (uint64_t)memset, 
+		hash_str, compare_str, NULL, NULL);
+	admin->objects = vec_new_reserved(object_size, object_count);
+	vec_set_count(admin->objects, object_count);
+	admin->free_objects = (void **)vec_new_reserved(
+		sizeof(void *), object_count);
+	for (i = 0; i < object_count; i++) {
+		void * obj = vec_at(admin->objects, i);
+		vec_push_back((void **)&admin->free_objects, &obj);
+	}
+	admin->object_size = object_size;
+	admin->intern_names = intern_names;
 }
 
 static void * add_object(
@@ -91,23 +172,15 @@ void ap_admin_init(
 	size_t object_size,
 	uint32_t object_count)
 {
-	uint32_t i;
-	memset(admin, 0, sizeof(*admin));
-	admin->uint_map = hmap_new(sizeof(struct uint_map_item), 16, 
-		(uint64_t)strcpy, (uint64_t)memset, 
-		hash_uint, compare_uint, NULL, NULL);
-	admin->str_map = hmap_new(sizeof(struct str_map_item), 16, 
-		(uint64_t)strcpy, (uint64_t)memset, 
-		hash_str, compare_str, NULL, NULL);
-	admin->objects = vec_new_reserved(object_size, object_count);
-	vec_set_count(admin->objects, object_count);
-	admin->free_objects = (void **)vec_new_reserved(
-		sizeof(void *), object_count);
-	for (i = 0; i < object_count; i++) {
-		void * obj = vec_at(admin->objects, i);
-		vec_push_back((void **)&admin->free_objects, &obj);
-	}
-	admin->object_size = object_size;
+	initadmin(admin, object_size, object_count, FALSE);
+}
+
+void ap_admin_init_interned(
+	struct ap_admin * admin,
+	size_t object_size,
+	uint32_t object_count)
+{
+	initadmin(admin, object_size, object_count, TRUE);
 }
 
 void ap_admin_destroy(struct ap_admin * admin)
@@ -136,15 +209,16 @@ void * ap_admin_add_object_by_name(
 	struct ap_admin * admin, 
 	const char * name)
 {
-	struct str_map_item i = { 0 };
-	struct str_map_item * r;
+	struct str_map_item_inline i;
+	struct str_map_item_inline q;
 	void * obj;
-	if (!make_str_map_item(&i, name))
+	if (!make_str_map_query(&q, name))
 		return NULL;
-	r = hmap_get(admin->str_map, &i);
-	if (r)
+	if (hmap_get(admin->str_map, &q))
 		return NULL;
-	obj = add_object(admin, &i.index);
+	if (!make_str_map_item(admin, &i, name))
+		return NULL;
+	obj = add_object(admin, &i.base.index);
 	hmap_set(admin->str_map, &i);
 	return obj;
 }
@@ -156,17 +230,20 @@ void * ap_admin_add_object(
 {
 	struct uint_map_item iuint = { id, 0 };
 	struct uint_map_item * ruint;
-	struct str_map_item istr = { 0 };
+	struct str_map_item_inline istr;
+	struct str_map_item_inline q;
 	struct str_map_item * rstr;
 	void * obj;
-	if (!make_str_map_item(&istr, name))
+	if (!make_str_map_query(&q, name))
 		return NULL;
 	ruint = hmap_get(admin->uint_map, &iuint);
-	rstr = hmap_get(admin->str_map, &istr);
+	rstr = hmap_get(admin->str_map, &q);
 	if (ruint || rstr)
 		return NULL;
+	if (!make_str_map_item(admin, &istr, name))
+		return NULL;
 	obj = add_object(admin, &iuint.index);
-	istr.index = iuint.index;
+	istr.base.index = iuint.index;
 	hmap_set(admin->uint_map, &iuint);
 	hmap_set(admin->str_map, &istr);
 	return obj;
@@ -179,9 +256,9 @@ boolean ap_admin_add_id(
 {
 	struct uint_map_item iuint = { id, 0 };
 	struct uint_map_item * ruint;
-	struct str_map_item istr = { 0 };
+	struct str_map_item_inline istr;
 	struct str_map_item * rstr;
-	if (!make_str_map_item(&istr, name))
+	if (!make_str_map_query(&istr, name))
 		return FALSE;
 	rstr = hmap_get(admin->str_map, &istr);
 	if (!rstr)
@@ -202,14 +279,17 @@ boolean ap_admin_add_name(
 {
 	struct uint_map_item i = { id, 0 };
 	struct uint_map_item * r = hmap_get(admin->uint_map, &i);
-	struct str_map_item istr = { 0 };
+	struct str_map_item_inline istr;
+	struct str_map_item_inline q;
 	if (!r)
 		return FALSE;
-	if (!make_str_map_item(&istr, name))
+	if (!make_str_map_query(&q, name))
+		return FALSE;
+	if (hmap_get(admin->str_map, &q))
 		return FALSE;
-	if (hmap_get(admin->str_map, &istr))
+	if (!make_str_map_item(admin, &istr, name))
 		return FALSE;
-	istr.index = r->index;
+	istr.base.index = r->index;
 	hmap_set(admin->str_map, &istr);
 	return TRUE;
 }
@@ -219,17 +299,17 @@ boolean ap_admin_update_name(
 	const char * original_name,
 	const char * new_name)
 {
-	struct str_map_item i = { 0 };
-	struct str_map_item n = { 0 };
+	struct str_map_item_inline i;
+	struct str_map_item_inline n;
 	struct str_map_item * r;
-	if (!make_str_map_item(&i, original_name))
+	if (!make_str_map_query(&i, original_name))
 		return FALSE;
 	r = hmap_get(admin->str_map, &i);
 	if (!r)
 		return FALSE;
-	if (!make_str_map_item(&n, new_name))
+	if (!make_str_map_item(admin, &n, new_name))
 		return FALSE;
-	n.index = r->index;
+	n.base.index = r->index;
 	if (!hmap_delete(admin->str_map, r))
 		return FALSE;
 	hmap_set(admin->str_map, &n);
@@ -243,12 +323,12 @@ boolean ap_admin_update_name_by_id(
 {
 	struct uint_map_item i = { id, 0 };
 	struct uint_map_item * r = hmap_get(admin->uint_map, &i);
-	struct str_map_item n;
+	struct str_map_item_inline n;
 	if (!r)
 		return FALSE;
-	if (!make_str_map_item(&n, new_name))
+	if (!make_str_map_item(admin, &n, new_name))
 		return FALSE;
-	n.index = r->index;
+	n.base.index = r->index;
 	hmap_set(admin->str_map, &n);
 	return TRUE;
 }
@@ -282,11 +362,11 @@ boolean ap_admin_remove_object_by_name(
 	struct ap_admin * admin, 
 	const char * name)
 {
-	struct str_map_item i = { 0 };
+	struct str_map_item_inline i;
 	struct str_map_item * r;
 	uint32_t index;
 	void * obj;
-	if (!make_str_map_item(&i, name))
+	if (!make_str_map_query(&i, name))
 		return FALSE;
 	r = hmap_get(admin->str_map, &i);
 	if (!r)
@@ -307,13 +387,13 @@ boolean ap_admin_remove_object(
 	uint64_t id,
 	const char * name)
 {
-	struct str_map_item items = { 0 };
+	struct str_map_item_inline items;
 	struct str_map_item * rs;
 	struct uint_map_item itemu = { id, 0 };
 	struct uint_map_item * ru;
 	void * obj;
 	void * r[2] = { 0 };
-	if (!make_str_map_item(&items, name))
+	if (!make_str_map_query(&items, name))
 		return FALSE;
 	ru = hmap_get(admin->uint_map, &itemu);
 	if (!ru)
@@ -364,9 +444,9 @@ void * ap_admin_get_object_by_name(
 	struct ap_admin * admin,
 	const char * name)
 {
-	struct str_map_item i = { 0 };
+	struct str_map_item_inline i;
 	struct str_map_item * r;
-	if (!make_str_map_item(&i, name))
+	if (!make_str_map_query(&i, name))
 		return FALSE;
 	r = hmap_get(admin->str_map, &i);
 	if (!r)
@@ -420,5 +500,5 @@ const char * ap_admin_iterate_name(
 		return NULL;
 	if (object)
 		*object = vec_at(admin->objects, r->index);
-	return r->key;
+	return itemkey(r);
 }
@@ -14,6 +14,7 @@ struct ap_admin {
 	void * objects;
 	void ** free_objects;
 	size_t object_size;
+	boolean intern_names;
 };
 
 void ap_admin_init(
@@ -21,6 +22,21 @@ void ap_admin_init(
 	size_t object_size,
 	uint32_t object_count);
 
+/*
+ * Initializes an admin that interns names of its 
+ * objects instead of storing a copy in each entry, 
+ * so that the same name in several admins is 
+ * stored once.
+ *
+ * Interned names are never released, use only for 
+ * game content that is loaded from data files.
+ * Lookups do not use the string pool.
+ */
+void ap_admin_init_interned(
+	struct ap_admin * admin,
+	size_t object_size,
+	uint32_t object_count);
+
 void ap_admin_destroy(struct ap_admin * admin);
 
 /*
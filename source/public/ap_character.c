@@ -2053,13 +2053,81 @@ void ap_character_kill(
 		AP_CHARACTER_CB_DEATH, &cb);
 }
 
+static uint32_t findtimer(
+	const struct ap_character * character,
+	uint8_t duration_index)
+{
+	uint32_t i;
+	for (i = 0; i < character->special_status_timer_count; i++) {
+		if (character->special_status_timer_indices[i] == duration_index)
+			break;
+	}
+	return i;
+}
+
+static void removetimer(
+	struct ap_character * character,
+	uint8_t duration_index)
+{
+	uint32_t index = findtimer(character, duration_index);
+	uint32_t count;
+	assert(index < character->special_status_timer_count);
+	if (index >= character->special_status_timer_count)
+		return;
+	count = --character->special_status_timer_count - index;
+	memmove(&character->special_status_end_ticks[index],
+		&character->special_status_end_ticks[index + 1],
+		count * sizeof(character->special_status_end_ticks[0]));
+	memmove(&character->special_status_timer_indices[index],
+		&character->special_status_timer_indices[index + 1],
+		count * sizeof(character->special_status_timer_indices[0]));
+	character->special_status_timed &= ~(1ull << duration_index);
+}
+
+/*
+ * Sets end tick of a special status timer, keeping 
+ * timers sorted by end tick.
+ *
+ * If special status already has a timer, 
+ * its end tick is only extended.
+ */
+static void settimer(
+	struct ap_character * character,
+	uint8_t duration_index,
+	uint64_t end_tick)
+{
+	uint64_t * ticks = character->special_status_end_ticks;
+	uint8_t * indices = character->special_status_timer_indices;
+	uint32_t index;
+	if (character->special_status_timed & (1ull << duration_index)) {
+		index = findtimer(character, duration_index);
+		if (end_tick <= ticks[index])
+			return;
+		removetimer(character, duration_index);
+	}
+	/* Each duration index has at most one timer, 
+	 * so the set cannot overflow. */
+	index = character->special_status_timer_count;
+	while (index && ticks[index - 1] > end_tick) {
+		ticks[index] = ticks[index - 1];
+		indices[index] = indices[index - 1];
+		index--;
+	}
+	ticks[index] = end_tick;
+	indices[index] = duration_index;
+	character->special_status_timer_count++;
+	character->special_status_timed |= 1ull << duration_index;
+}
+
 void ap_character_special_status_on(
 	struct ap_character_module * mod,
 	struct ap_character * character,
 	uint64_t special_status,
 	uint64_t duration_ms)
 {
-	uint32_t index = ap_character_get_special_status_duration_index(special_status);
+	/* Duration is tracked for the lowest status bit. */
+	uint8_t index = ap_character_get_special_status_duration_index(special_status);
+	uint64_t timed = 1ull << index;
 	boolean temporary = FALSE;
 	assert(!(special_status & AP_CHARACTER_SPECIAL_STATUS_LEVELLIMIT));
 	if (!(character->special_status & special_status)) {
@@ -2072,18 +2140,16 @@ void ap_character_special_status_on(
 		if (duration_ms)
 			temporary = TRUE;
 	}
-	else if (character->special_status_end_tick[index] && duration_ms) {
+	else if ((character->special_status_timed & timed) && duration_ms) {
 		temporary = TRUE;
 	}
 	if (temporary) {
 		/* Special status is temporary, extend the duration if necessary. */
-		uint64_t endtick = ap_tick_get(mod->ap_tick) + duration_ms;
-		if (endtick > character->special_status_end_tick[index])
-			character->special_status_end_tick[index] = endtick;
+		settimer(character, index, ap_tick_get(mod->ap_tick) + duration_ms);
 	}
-	else {
+	else if (character->special_status_timed & timed) {
 		/* Special status is permanent. */
-		character->special_status_end_tick[index] = 0;
+		removetimer(character, index);
 	}
 }
 
@@ -2092,12 +2158,13 @@ void ap_character_special_status_off(
 	struct ap_character * character,
 	uint64_t special_status)
 {
+	uint8_t index = ap_character_get_special_status_duration_index(special_status);
 	assert(!(special_status & AP_CHARACTER_SPECIAL_STATUS_LEVELLIMIT));
+	if (character->special_status_timed & (1ull << index))
+		removetimer(character, index);
 	if (character->special_status & special_status) {
 		struct ap_character_cb_special_status_off cb = { 0 };
-		uint32_t index = ap_character_get_special_status_duration_index(special_status);
 		character->special_status &= ~special_status;
-		character->special_status_end_tick[index] = 0;
 		ap_character_update(mod, character, AP_CHARACTER_BIT_SPECIAL_STATUS, FALSE);
 		cb.character = character;
 		cb.special_status = special_status;
@@ -2105,6 +2172,24 @@ void ap_character_special_status_off(
 	}
 }
 
+void ap_character_expire_special_statuses(
+	struct ap_character_module * mod,
+	struct ap_character * character,
+	uint64_t tick)
+{
+	/* Most characters do not have any 
+	 * temporary special statuses. */
+	if (!character->special_status_timed)
+		return;
+	/* Turning off a special status removes its timer, 
+	 * callbacks may add new timers. */
+	while (character->special_status_timer_count &&
+		tick >= character->special_status_end_ticks[0]) {
+		ap_character_special_status_off(mod, character,
+			1ull << character->special_status_timer_indices[0]);
+	}
+}
+
 void ap_character_gain_experience(
 	struct ap_character_module * mod,
 	struct ap_character * character,
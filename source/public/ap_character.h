@@ -35,6 +35,10 @@
 #define AP_CHARACTER_DEFAULT_MOVE_SPEED 4000
 #define AP_CHARACTER_MAX_COMBAT_MODE_TIME 10
 
+/* Duration is tracked for one bit of each special 
+ * status, so every special status can be timed. */
+#define AP_CHARACTER_MAX_SPECIAL_STATUS_TIMER_COUNT 64
+
 #define AP_CHARACTER_MAX_TOWN_NAME 64
 
 #define AP_CHARACTER_MAX_CHARISMA_POINT 1000000
@@ -777,7 +781,15 @@ struct ap_character {
 	uint64_t chantra_coins;
 	uint8_t extra_bank_slots;
 	uint64_t special_status;
-	uint64_t special_status_end_tick[64];
+	/* Special statuses that have a timer. */
+	uint64_t special_status_timed;
+	/* End ticks of special statuses that end after a 
+	 * duration, sorted in ascending order. */
+	uint64_t special_status_end_ticks[AP_CHARACTER_MAX_SPECIAL_STATUS_TIMER_COUNT];
+	/* Duration index of the special status 
+	 * for each end tick. */
+	uint8_t special_status_timer_indices[AP_CHARACTER_MAX_SPECIAL_STATUS_TIMER_COUNT];
+	uint32_t special_status_timer_count;
 	uint8_t face_index;
 	uint8_t hair_index;
 	uint32_t option_flags;
@@ -1199,6 +1211,16 @@ void ap_character_kill(
 	struct ap_character * killer,
 	enum ap_character_death_cause cause);
 
+/*
+ * Turns on a special status.
+ *
+ * If `duration_ms` is not zero, special status 
+ * is turned off after the duration, otherwise it 
+ * remains on until it is turned off.
+ * Turning on a special status that is already on 
+ * extends its duration, or makes it permanent if 
+ * `duration_ms` is zero.
+ */
 void ap_character_special_status_on(
 	struct ap_character_module * mod,
 	struct ap_character * character,
@@ -1210,6 +1232,15 @@ void ap_character_special_status_off(
 	struct ap_character * character,
 	uint64_t special_status);
 
+/*
+ * Turns off special statuses with durations 
+ * that have ended by `tick`.
+ */
+void ap_character_expire_special_statuses(
+	struct ap_character_module * mod,
+	struct ap_character * character,
+	uint64_t tick);
+
 void ap_character_gain_experience(
 	struct ap_character_module * mod,
 	struct ap_character * character,
@@ -53,7 +53,7 @@ struct ap_chat_module * ap_chat_create_module()
 		AU_PACKET_TYPE_CHAR, AP_CHARACTER_MAX_NAME_LENGTH + 1,
 		AU_PACKET_TYPE_MEMORY_BLOCK, 1, /* chatting message */
 		AU_PACKET_TYPE_END);
-	ap_admin_init(&mod->cmd_admin, sizeof(struct command), 128);
+	ap_admin_init_interned(&mod->cmd_admin, sizeof(struct command), 128);
 	return mod;
 }
 
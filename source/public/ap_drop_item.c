@@ -64,19 +64,27 @@ struct option_pool {
 	uint32_t total_probability;
 };
 
+struct rate_tables {
+	uint32_t option_num_drop_rate[AP_ITEM_OPTION_MAX_COUNT][AP_ITEM_OPTION_MAX_COUNT];
+	uint32_t socket_num_drop_rate[AP_ITEM_CONVERT_MAX_SOCKET][AP_ITEM_CONVERT_MAX_SOCKET];
+	struct ap_drop_item_drop_rank_rate drop_rank_rate[AP_DROP_ITEM_MAX_DROP_RANK + 1];
+	struct ap_drop_item_drop_group_rate drop_group_rate[AP_DROP_ITEM_MAX_DROP_GROUP_ID + 1];
+};
+
+struct ap_drop_item_rate_stage {
+	struct rate_tables rates;
+};
+
 struct ap_drop_item_module {
 	struct ap_module_instance instance;
 	struct ap_character_module * ap_character;
 	struct ap_item_module * ap_item;
 	size_t character_attachment_offset;
 	size_t item_attachment_offset;
-	uint32_t option_num_drop_rate[AP_ITEM_OPTION_MAX_COUNT][AP_ITEM_OPTION_MAX_COUNT];
-	uint32_t socket_num_drop_rate[AP_ITEM_CONVERT_MAX_SOCKET][AP_ITEM_CONVERT_MAX_SOCKET];
+	struct rate_tables rates;
 	struct option_pool option_drop_pool[AP_ITEM_OPTION_MAX_TYPE][AP_ITEM_PART_COUNT];
 	struct option_pool option_refine_pool[AP_ITEM_OPTION_MAX_TYPE][AP_ITEM_PART_COUNT];
 	struct option_pool option_gacha_pool[AP_ITEM_OPTION_MAX_TYPE][AP_ITEM_PART_COUNT];
-	struct ap_drop_item_drop_rank_rate drop_rank_rate[AP_DROP_ITEM_MAX_DROP_RANK + 1];
-	struct ap_drop_item_drop_group_rate drop_group_rate[AP_DROP_ITEM_MAX_DROP_GROUP_ID + 1];
 	pcg32_random_t rng;
 	uint32_t * type_list;
 };
@@ -488,8 +496,8 @@ struct ap_drop_item_character_template_attachment * ap_drop_item_get_character_t
 	return ap_module_get_attached_data(temp, mod->character_attachment_offset);
 }
 
-boolean ap_drop_item_read_option_num_drop_rate(
-	struct ap_drop_item_module * mod,
+static boolean readoptionnumdroprate(
+	struct rate_tables * rates,
 	const char * file_path, 
 	boolean decrypt)
 {
@@ -523,22 +531,26 @@ boolean ap_drop_item_read_option_num_drop_rate(
 			switch (id) {
 			case NUM_OPTION_COLUMN_OPTIONNUM:
 				optioncount = strtoul(value, NULL, 10) - 1;
-				assert(optioncount < AP_ITEM_OPTION_MAX_COUNT);
+				if (optioncount >= AP_ITEM_OPTION_MAX_COUNT) {
+					ERROR("Invalid option count (%s).", value);
+					au_table_destroy(table);
+					return FALSE;
+				}
 				break;
 			case NUM_OPTION_COLUMN_DROPRATE1:
-				mod->option_num_drop_rate[0][optioncount] = strtoul(value, NULL, 10);
+				rates->option_num_drop_rate[0][optioncount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_OPTION_COLUMN_DROPRATE2:
-				mod->option_num_drop_rate[1][optioncount] = strtoul(value, NULL, 10);
+				rates->option_num_drop_rate[1][optioncount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_OPTION_COLUMN_DROPRATE3:
-				mod->option_num_drop_rate[2][optioncount] = strtoul(value, NULL, 10);
+				rates->option_num_drop_rate[2][optioncount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_OPTION_COLUMN_DROPRATE4:
-				mod->option_num_drop_rate[3][optioncount] = strtoul(value, NULL, 10);
+				rates->option_num_drop_rate[3][optioncount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_OPTION_COLUMN_DROPRATE5:
-				mod->option_num_drop_rate[4][optioncount] = strtoul(value, NULL, 10);
+				rates->option_num_drop_rate[4][optioncount] = strtoul(value, NULL, 10);
 				break;
 			default:
 				ERROR("Invalid column id (%u).", id);
@@ -563,8 +575,8 @@ enum num_socket_drop_rate_column_id {
 	NUM_SOCKET_COLUMN_DROPRATE8,
 };
 
-boolean ap_drop_item_read_socket_num_drop_rate(
-	struct ap_drop_item_module * mod,
+static boolean readsocketnumdroprate(
+	struct rate_tables * rates,
 	const char * file_path, 
 	boolean decrypt)
 {
@@ -601,31 +613,35 @@ boolean ap_drop_item_read_socket_num_drop_rate(
 			switch (id) {
 			case NUM_SOCKET_COLUMN_SOCKETNUM:
 				socketcount = strtoul(value, NULL, 10) - 1;
-				assert(socketcount < AP_ITEM_CONVERT_MAX_SOCKET);
+				if (socketcount >= AP_ITEM_CONVERT_MAX_SOCKET) {
+					ERROR("Invalid socket count (%s).", value);
+					au_table_destroy(table);
+					return FALSE;
+				}
 				break;
 			case NUM_SOCKET_COLUMN_DROPRATE1:
-				mod->socket_num_drop_rate[0][socketcount] = strtoul(value, NULL, 10);
+				rates->socket_num_drop_rate[0][socketcount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_SOCKET_COLUMN_DROPRATE2:
-				mod->socket_num_drop_rate[1][socketcount] = strtoul(value, NULL, 10);
+				rates->socket_num_drop_rate[1][socketcount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_SOCKET_COLUMN_DROPRATE3:
-				mod->socket_num_drop_rate[2][socketcount] = strtoul(value, NULL, 10);
+				rates->socket_num_drop_rate[2][socketcount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_SOCKET_COLUMN_DROPRATE4:
-				mod->socket_num_drop_rate[3][socketcount] = strtoul(value, NULL, 10);
+				rates->socket_num_drop_rate[3][socketcount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_SOCKET_COLUMN_DROPRATE5:
-				mod->socket_num_drop_rate[4][socketcount] = strtoul(value, NULL, 10);
+				rates->socket_num_drop_rate[4][socketcount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_SOCKET_COLUMN_DROPRATE6:
-				mod->socket_num_drop_rate[5][socketcount] = strtoul(value, NULL, 10);
+				rates->socket_num_drop_rate[5][socketcount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_SOCKET_COLUMN_DROPRATE7:
-				mod->socket_num_drop_rate[6][socketcount] = strtoul(value, NULL, 10);
+				rates->socket_num_drop_rate[6][socketcount] = strtoul(value, NULL, 10);
 				break;
 			case NUM_SOCKET_COLUMN_DROPRATE8:
-				mod->socket_num_drop_rate[7][socketcount] = strtoul(value, NULL, 10);
+				rates->socket_num_drop_rate[7][socketcount] = strtoul(value, NULL, 10);
 				break;
 			default:
 				ERROR("Invalid column id (%u).", id);
@@ -647,8 +663,8 @@ static void setdroprankrate(
 	rank->rate[drop_rank] = strtoul(value, NULL, 10);
 }
 
-boolean ap_drop_item_read_drop_rank_rate(
-	struct ap_drop_item_module * mod,
+static boolean readdroprankrate(
+	struct rate_tables * rates,
 	const char * file_path, 
 	boolean decrypt)
 {
@@ -692,8 +708,12 @@ boolean ap_drop_item_read_drop_rank_rate(
 			char * value = au_table_get_value(table);
 			if (id == DROP_RANK_RATE_COL_MONSTERRANK) {
 				uint32_t monsterrank = strtoul(value, NULL, 10);
-				assert(monsterrank <= AP_DROP_ITEM_MAX_DROP_RANK);
-				rank = &mod->drop_rank_rate[monsterrank];
+				if (monsterrank > AP_DROP_ITEM_MAX_DROP_RANK) {
+					ERROR("Invalid monster rank (%u).", monsterrank);
+					au_table_destroy(table);
+					return FALSE;
+				}
+				rank = &rates->drop_rank_rate[monsterrank];
 				continue;
 			}
 			assert(rank != NULL);
@@ -749,8 +769,8 @@ static void setgrouplevelbonus(
 	group->level_bonus[index] = strtol(value, NULL, 10);
 }
 
-boolean ap_drop_item_read_drop_group_rate(
-	struct ap_drop_item_module * mod,
+static boolean readdropgrouprate(
+	struct rate_tables * rates,
 	const char * file_path, 
 	boolean decrypt)
 {
@@ -800,8 +820,12 @@ boolean ap_drop_item_read_drop_group_rate(
 			char * value = au_table_get_value(table);
 			if (id == DROP_GROUP_COL_GROUPID) {
 				uint32_t groupid = strtoul(value, NULL, 10);
-				assert(groupid <= AP_DROP_ITEM_MAX_DROP_GROUP_ID);
-				group = &mod->drop_group_rate[groupid];
+				if (groupid > AP_DROP_ITEM_MAX_DROP_GROUP_ID) {
+					ERROR("Invalid drop group id (%u).", groupid);
+					au_table_destroy(table);
+					return FALSE;
+				}
+				group = &rates->drop_group_rate[groupid];
 				group->id = groupid;
 				continue;
 			}
@@ -857,6 +881,115 @@ boolean ap_drop_item_read_drop_group_rate(
 	return TRUE;
 }
 
+boolean ap_drop_item_read_option_num_drop_rate(
+	struct ap_drop_item_module * mod,
+	const char * file_path, 
+	boolean decrypt)
+{
+	return readoptionnumdroprate(&mod->rates, file_path, decrypt);
+}
+
+boolean ap_drop_item_read_socket_num_drop_rate(
+	struct ap_drop_item_module * mod,
+	const char * file_path, 
+	boolean decrypt)
+{
+	return readsocketnumdroprate(&mod->rates, file_path, decrypt);
+}
+
+boolean ap_drop_item_read_drop_rank_rate(
+	struct ap_drop_item_module * mod,
+	const char * file_path, 
+	boolean decrypt)
+{
+	return readdroprankrate(&mod->rates, file_path, decrypt);
+}
+
+boolean ap_drop_item_read_drop_group_rate(
+	struct ap_drop_item_module * mod,
+	const char * file_path, 
+	boolean decrypt)
+{
+	return readdropgrouprate(&mod->rates, file_path, decrypt);
+}
+
+/*
+ * A row that is in use must not become empty, 
+ * otherwise count generation has nothing to pick from.
+ */
+static boolean validaterates(
+	const uint32_t * current,
+	const uint32_t * staged,
+	uint32_t count,
+	const char * name,
+	uint32_t row)
+{
+	uint32_t currenttotal = 0;
+	uint32_t stagedtotal = 0;
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		currenttotal += current[i];
+		stagedtotal += staged[i];
+	}
+	if (currenttotal && !stagedtotal) {
+		ERROR("Reloaded %s drop rates are empty (row = %u).", 
+			name, row + 1);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+struct ap_drop_item_rate_stage * ap_drop_item_read_rate_stage(
+	struct ap_drop_item_module * mod,
+	const char * option_num_file_path,
+	const char * socket_num_file_path,
+	const char * drop_rank_file_path,
+	const char * drop_group_file_path,
+	boolean decrypt)
+{
+	struct ap_drop_item_rate_stage * stage = alloc(sizeof(*stage));
+	struct rate_tables * rates = &stage->rates;
+	boolean result = TRUE;
+	uint32_t i;
+	memset(stage, 0, sizeof(*stage));
+	if (!readoptionnumdroprate(rates, option_num_file_path, decrypt) ||
+		!readsocketnumdroprate(rates, socket_num_file_path, decrypt) ||
+		!readdroprankrate(rates, drop_rank_file_path, decrypt) ||
+		!readdropgrouprate(rates, drop_group_file_path, decrypt)) {
+		dealloc(stage);
+		return NULL;
+	}
+	for (i = 0; i < AP_ITEM_OPTION_MAX_COUNT; i++) {
+		result &= validaterates(mod->rates.option_num_drop_rate[i],
+			rates->option_num_drop_rate[i], AP_ITEM_OPTION_MAX_COUNT,
+			"option number", i);
+	}
+	for (i = 0; i < AP_ITEM_CONVERT_MAX_SOCKET; i++) {
+		result &= validaterates(mod->rates.socket_num_drop_rate[i],
+			rates->socket_num_drop_rate[i], AP_ITEM_CONVERT_MAX_SOCKET,
+			"socket number", i);
+	}
+	if (!result) {
+		dealloc(stage);
+		return NULL;
+	}
+	return stage;
+}
+
+void ap_drop_item_apply_rate_stage(
+	struct ap_drop_item_module * mod,
+	struct ap_drop_item_rate_stage * stage)
+{
+	memcpy(&mod->rates, &stage->rates, sizeof(mod->rates));
+	INFO("Applied reloaded item drop rates.");
+	ap_drop_item_free_rate_stage(stage);
+}
+
+void ap_drop_item_free_rate_stage(struct ap_drop_item_rate_stage * stage)
+{
+	dealloc(stage);
+}
+
 enum drop_table_column_id {
 	DROP_TABLE_COLUMN_ID_MONSTERNAME,
 	DROP_TABLE_COLUMN_ID_MONSTERTID,
@@ -981,12 +1114,12 @@ uint32_t ap_drop_item_generate_option_count(
 		return min_option;
 	}
 	for (i = min_option - 1; i <= max_option - 1; i++)
-		total += mod->option_num_drop_rate[max_option - 1][i];
+		total += mod->rates.option_num_drop_rate[max_option - 1][i];
 	assert(total != 0);
 	rng = pcg32_boundedrand_r(&mod->rng, total);
 	total = 0;
 	for (i = max_option - 1; i >= min_option - 1; i--) {
-		total += mod->option_num_drop_rate[max_option - 1][i];
+		total += mod->rates.option_num_drop_rate[max_option - 1][i];
 		if (rng < total)
 			return (i + 1);
 	}
@@ -1010,12 +1143,12 @@ uint32_t ap_drop_item_generate_socket_count(
 		return min_socket;
 	}
 	for (i = min_socket - 1; i <= max_socket - 1; i++)
-		total += mod->socket_num_drop_rate[max_socket - 1][i];
+		total += mod->rates.socket_num_drop_rate[max_socket - 1][i];
 	assert(total != 0);
 	rng = pcg32_boundedrand_r(&mod->rng, total);
 	total = 0;
 	for (i = max_socket - 1; i >= min_socket - 1; i--) {
-		total += mod->socket_num_drop_rate[max_socket - 1][i];
+		total += mod->rates.socket_num_drop_rate[max_socket - 1][i];
 		if (rng < total)
 			return (i + 1);
 	}
@@ -1204,7 +1337,7 @@ float ap_drop_item_get_drop_rank_rate(
 	assert(monster_drop_rank <= AP_DROP_ITEM_MAX_DROP_RANK);
 	assert(item_drop_rank != 0);
 	assert(item_drop_rank <= AP_DROP_ITEM_MAX_DROP_RANK);
-	return (float)mod->drop_rank_rate[monster_drop_rank].rate[item_drop_rank] / 100.0f;
+	return (float)mod->rates.drop_rank_rate[monster_drop_rank].rate[item_drop_rank] / 100.0f;
 }
 
 uint32_t * ap_drop_item_get_drop_rank_rates(
@@ -1213,7 +1346,7 @@ uint32_t * ap_drop_item_get_drop_rank_rates(
 {
 	assert(monster_drop_rank != 0);
 	assert(monster_drop_rank <= AP_DROP_ITEM_MAX_DROP_RANK);
-	return mod->drop_rank_rate[monster_drop_rank].rate;
+	return mod->rates.drop_rank_rate[monster_drop_rank].rate;
 }
 
 boolean ap_drop_item_is_drop_group_affected_by_drop_meditation(
@@ -1221,7 +1354,7 @@ boolean ap_drop_item_is_drop_group_affected_by_drop_meditation(
 	uint32_t group_id)
 {
 	assert(group_id <= AP_DROP_ITEM_MAX_DROP_GROUP_ID);
-	return mod->drop_group_rate[group_id].is_affected_by_drop_med;
+	return mod->rates.drop_group_rate[group_id].is_affected_by_drop_med;
 }
 
 uint32_t ap_drop_item_get_drop_group_rate(
@@ -1229,7 +1362,7 @@ uint32_t ap_drop_item_get_drop_group_rate(
 	uint32_t group_id)
 {
 	assert(group_id <= AP_DROP_ITEM_MAX_DROP_GROUP_ID);
-	return mod->drop_group_rate[group_id].rate;
+	return mod->rates.drop_group_rate[group_id].rate;
 }
 
 uint32_t ap_drop_item_get_drop_group_bonus(
@@ -1240,5 +1373,5 @@ uint32_t ap_drop_item_get_drop_group_bonus(
 	assert(group_id <= AP_DROP_ITEM_MAX_DROP_GROUP_ID);
 	assert(character_level != 0);
 	assert(character_level <= AP_CHARACTER_MAX_LEVEL);
-	return mod->drop_group_rate[group_id].level_bonus[(character_level - 1) / 10];
+	return mod->rates.drop_group_rate[group_id].level_bonus[(character_level - 1) / 10];
 }
@@ -116,6 +116,36 @@ boolean ap_drop_item_read_drop_group_rate(
 	const char * file_path, 
 	boolean decrypt);
 
+/*
+ * Reads option/socket number, drop rank and drop group 
+ * rate tables into a stage without modifying the module, 
+ * so that it can be done on a task thread.
+ *
+ * Drop groups that are built from item templates 
+ * and drop tables are not affected.
+ *
+ * Returns NULL if any of the tables is invalid.
+ */
+struct ap_drop_item_rate_stage * ap_drop_item_read_rate_stage(
+	struct ap_drop_item_module * mod,
+	const char * option_num_file_path,
+	const char * socket_num_file_path,
+	const char * drop_rank_file_path,
+	const char * drop_group_file_path,
+	boolean decrypt);
+
+/*
+ * Replaces current rates with staged ones.
+ *
+ * Must be called from the main thread.
+ * Stage is consumed.
+ */
+void ap_drop_item_apply_rate_stage(
+	struct ap_drop_item_module * mod,
+	struct ap_drop_item_rate_stage * stage);
+
+void ap_drop_item_free_rate_stage(struct ap_drop_item_rate_stage * stage);
+
 boolean ap_drop_item_read_drop_table(
 	struct ap_drop_item_module * mod,
 	const char * file_path, 
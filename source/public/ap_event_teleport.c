@@ -357,8 +357,8 @@ struct ap_event_teleport_module * ap_event_teleport_create_module()
 		sizeof(struct ap_event_teleport_point), NULL, NULL);
 	ap_module_set_module_data(mod, AP_EVENT_TELEPORT_MDI_TELEPORT_GROUP, 
 		sizeof(struct ap_event_teleport_group), NULL, NULL);
-	ap_admin_init(&mod->point_admin, sizeof(struct ap_event_teleport_point *), 128);
-	ap_admin_init(&mod->group_admin, sizeof(struct ap_event_teleport_group *), 128);
+	ap_admin_init_interned(&mod->point_admin, sizeof(struct ap_event_teleport_point *), 128);
+	ap_admin_init_interned(&mod->group_admin, sizeof(struct ap_event_teleport_group *), 128);
 	ap_module_stream_add_callback(mod, AP_EVENT_TELEPORT_MDI_TELEPORT_POINT,
 		AP_EVENT_TELEPORT_MODULE_NAME, mod, cbpointread, cbpointwrite);
 	ap_module_stream_add_callback(mod, AP_EVENT_TELEPORT_MDI_TELEPORT_GROUP,
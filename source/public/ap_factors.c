@@ -84,12 +84,6 @@ static struct ap_factors_detail g_Detail[AP_FACTORS_TYPE_COUNT] = {
 	{ AP_FACTORS_TYPE_NONE, AP_FACTORS_OWNER_TYPE_COUNT },
 	{ AP_FACTORS_TYPE_NONE, AP_FACTORS_AGRO_TYPE_COUNT } };
 
-static boolean invalid_type(enum ap_factors_type type)
-{
-	assert(!(type < 0 || type >= AP_FACTORS_TYPE_COUNT));
-	return (type < 0 || type >= AP_FACTORS_TYPE_COUNT);
-}
-
 static void make_attr_packet(
 	struct ap_factors_module * mod,
 	void * buffer, 
@@ -844,67 +838,6 @@ boolean ap_factors_get_character_class(
 	return FALSE;
 }
 
-void ap_factors_enable(
-	struct ap_factor * factor,
-	enum ap_factors_type type)
-{
-	if (invalid_type(type))
-		return;
-	switch (type) {
-	case AP_FACTORS_TYPE_CHAR_STATUS:
-		factor->factors[type] = &factor->char_status;
-		break;
-	case AP_FACTORS_TYPE_CHAR_TYPE:
-		factor->factors[type] = &factor->char_type;
-		break;
-	case AP_FACTORS_TYPE_CHAR_POINT:
-		factor->factors[type] = &factor->char_point;
-		break;
-	case AP_FACTORS_TYPE_CHAR_POINT_MAX:
-		factor->factors[type] = &factor->char_point_max;
-		break;
-	case AP_FACTORS_TYPE_CHAR_POINT_RECOVERY_RATE:
-		factor->factors[type] = &factor->char_point_recovery_rate;
-		break;
-	case AP_FACTORS_TYPE_ATTRIBUTE:
-		assert(0);
-		factor->factors[type] = &factor->attribute;
-		break;
-	case AP_FACTORS_TYPE_DAMAGE:
-		factor->factors[type] = &factor->damage;
-		break;
-	case AP_FACTORS_TYPE_DEFENSE:
-		factor->factors[type] = &factor->defense;
-		break;
-	case AP_FACTORS_TYPE_ATTACK:
-		factor->factors[type] = &factor->attack;
-		break;
-	case AP_FACTORS_TYPE_ITEM:
-		factor->factors[type] = &factor->item;
-		break;
-	case AP_FACTORS_TYPE_PRICE:
-		factor->factors[type] = &factor->price;
-		break;
-	case AP_FACTORS_TYPE_DIRT:
-		factor->factors[type] = &factor->dirt;
-		break;
-	case AP_FACTORS_TYPE_OWNER:
-		factor->factors[type] = &factor->owner;
-		break;
-	case AP_FACTORS_TYPE_AGRO:
-		factor->factors[type] = &factor->agro;
-		break;
-	}
-}
-
-void ap_factors_disable(
-	struct ap_factor * factor,
-	enum ap_factors_type type)
-{
-	if (!invalid_type(type))
-		factor->factors[type] = NULL;
-}
-
 void ap_factors_set_value(
 	struct ap_factor * factor, 
 	enum ap_factors_type type, 
@@ -1317,14 +1250,7 @@ void ap_factors_copy(
 	struct ap_factor * dst, 
 	const struct ap_factor * src)
 {
-	uint32_t i;
 	memcpy(dst, src, sizeof(*src));
-	for (i = 0; i < AP_FACTORS_TYPE_COUNT; i++) {
-		if (src->factors[i])
-			ap_factors_enable(dst, i);
-		else
-			ap_factors_disable(dst, i);
-	}
 }
 
 void ap_factors_make_packet(
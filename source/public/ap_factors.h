@@ -416,7 +416,6 @@ struct ap_factors_detail {
  */
 struct ap_factor {
 	boolean is_point;
-	void * factors[AP_FACTORS_TYPE_COUNT];
 	struct ap_factors_char_status char_status;
 	struct ap_factors_char_type char_type;
 	struct ap_factors_char_point char_point;
@@ -450,14 +449,6 @@ boolean ap_factors_get_character_class(
 	const char * name,
 	enum au_char_class_type * class_);
 
-void ap_factors_enable(
-	struct ap_factor * factor,
-	enum ap_factors_type type);
-
-void ap_factors_disable(
-	struct ap_factor * factor,
-	enum ap_factors_type type);
-
 void ap_factors_set_value(
 	struct ap_factor * factor, 
 	enum ap_factors_type type, 
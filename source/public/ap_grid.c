@@ -41,6 +41,67 @@ static inline struct ap_grid_item * getitembyindex(
 	return &g->items[index];
 }
 
+static inline uint32_t hashid(const struct ap_grid * g, uint32_t id)
+{
+	return (uint32_t)(id * 0x9E3779B1u) >> g->id_index_shift;
+}
+
+/*
+ * Returns the position of an id in id index, 
+ * or AP_GRID_INVALID_INDEX if it is not found.
+ */
+static uint32_t findid(const struct ap_grid * g, uint32_t id)
+{
+	uint32_t pos = hashid(g, id);
+	while (g->id_index[pos] != AP_GRID_INVALID_INDEX) {
+		if (g->items[g->id_index[pos]].id == id)
+			return pos;
+		pos = (pos + 1) & g->id_index_mask;
+	}
+	return AP_GRID_INVALID_INDEX;
+}
+
+static void insertid(struct ap_grid * g, uint32_t index)
+{
+	uint32_t pos = hashid(g, g->items[index].id);
+	assert(findid(g, g->items[index].id) == AP_GRID_INVALID_INDEX);
+	while (g->id_index[pos] != AP_GRID_INVALID_INDEX)
+		pos = (pos + 1) & g->id_index_mask;
+	g->id_index[pos] = index;
+}
+
+/*
+ * Removes an id from id index.
+ *
+ * Item with the id needs to be in the grid, 
+ * following entries are shifted back so that 
+ * lookups do not need tombstones.
+ */
+static void removeid(struct ap_grid * g, uint32_t id)
+{
+	uint32_t pos = findid(g, id);
+	uint32_t next = pos;
+	assert(pos != AP_GRID_INVALID_INDEX);
+	if (pos == AP_GRID_INVALID_INDEX)
+		return;
+	while (TRUE) {
+		uint32_t home;
+		next = (next + 1) & g->id_index_mask;
+		if (g->id_index[next] == AP_GRID_INVALID_INDEX)
+			break;
+		home = hashid(g, g->items[g->id_index[next]].id);
+		/* Entry can be moved to the free position if 
+		 * its home position is not cyclically 
+		 * between the free position and itself. */
+		if (((next - home) & g->id_index_mask) >= 
+			((next - pos) & g->id_index_mask)) {
+			g->id_index[pos] = g->id_index[next];
+			pos = next;
+		}
+	}
+	g->id_index[pos] = AP_GRID_INVALID_INDEX;
+}
+
 static inline void fromindex(
 	struct ap_grid * g,
 	uint32_t index,
@@ -62,13 +123,27 @@ struct ap_grid * ap_grid_new(
 	uint16_t column_count,
 	uint32_t item_types)
 {
-	size_t sz = sizeof(struct ap_grid) + 
-		sizeof(struct ap_grid_item) * layer_count * row_count * 
-		column_count;
-	struct ap_grid * g = alloc(sz);
+	uint32_t count = layer_count * row_count * column_count;
+	uint32_t index_count = 2;
+	uint32_t index_bits = 1;
+	size_t sz;
+	struct ap_grid * g;
+	/* Id index is kept at most half full. */
+	while (index_count < 2 * count) {
+		index_count *= 2;
+		index_bits++;
+	}
+	sz = sizeof(struct ap_grid) + 
+		sizeof(struct ap_grid_item) * count + 
+		sizeof(uint32_t) * index_count;
+	g = alloc(sz);
 	memset(g, 0, sz);
-	g->grid_count = layer_count * row_count * column_count;
+	g->grid_count = count;
 	g->items = (struct ap_grid_item *)((uintptr_t)g + sizeof(*g));
+	g->id_index = (uint32_t *)&g->items[count];
+	g->id_index_mask = index_count - 1;
+	g->id_index_shift = 32 - index_bits;
+	memset(g->id_index, 0xFF, sizeof(uint32_t) * index_count);
 	g->layer_count = layer_count;
 	g->row_count = row_count;
 	g->column_count = column_count;
@@ -84,6 +159,8 @@ void ap_grid_free(struct ap_grid * grid)
 void ap_grid_clear(struct ap_grid * grid)
 {
 	memset(grid->items, 0, grid->grid_count * sizeof(*grid->items));
+	memset(grid->id_index, 0xFF, 
+		(grid->id_index_mask + 1) * sizeof(*grid->id_index));
 	grid->item_count = 0;
 }
 
@@ -112,8 +189,10 @@ void ap_grid_set_empty(
 	}
 	if (grid->items[index].id) {
 		assert(grid->item_count != 0);
+		removeid(grid, grid->items[index].id);
 		memset(&grid->items[index], 0, sizeof(struct ap_grid_item));
 		grid->item_count--;
+		assert(ap_grid_check_id_index(grid));
 	}
 }
 
@@ -124,9 +203,11 @@ void ap_grid_set_empty_by_index(
 	if (index < grid->grid_count) {
 		if (grid->items[index].id) {
 			assert(grid->item_count != 0);
+			removeid(grid, grid->items[index].id);
 			memset(&grid->items[index], 0, 
 				sizeof(struct ap_grid_item));
 			grid->item_count--;
+			assert(ap_grid_check_id_index(grid));
 		}
 	}
 }
@@ -190,6 +271,8 @@ void ap_grid_add_item(
 	item->tid = tid;
 	item->object = object;
 	grid->item_count++;
+	insertid(grid, (uint32_t)(item - grid->items));
+	assert(ap_grid_check_id_index(grid));
 }
 
 void ap_grid_add_item_by_index(
@@ -217,6 +300,8 @@ void ap_grid_add_item_by_index(
 	item->tid = tid;
 	item->object = object;
 	grid->item_count++;
+	insertid(grid, (uint32_t)(item - grid->items));
+	assert(ap_grid_check_id_index(grid));
 }
 
 void * ap_grid_get_object(
@@ -235,12 +320,50 @@ void * ap_grid_get_object_by_id(
 	struct ap_grid * grid,
 	uint32_t object_id)
 {
+	uint32_t index = ap_grid_get_index_by_id(grid, object_id);
+	if (index == AP_GRID_INVALID_INDEX)
+		return NULL;
+	return grid->items[index].object;
+}
+
+uint32_t ap_grid_get_index_by_id(
+	const struct ap_grid * grid,
+	uint32_t object_id)
+{
+	uint32_t pos;
+	if (!object_id)
+		return AP_GRID_INVALID_INDEX;
+	pos = findid(grid, object_id);
+	if (pos == AP_GRID_INVALID_INDEX)
+		return AP_GRID_INVALID_INDEX;
+	return grid->id_index[pos];
+}
+
+boolean ap_grid_check_id_index(const struct ap_grid * grid)
+{
+	uint32_t count = 0;
 	uint32_t i;
 	for (i = 0; i < grid->grid_count; i++) {
-		if (grid->items[i].id == object_id)
-			return grid->items[i].object;
+		uint32_t pos;
+		if (!grid->items[i].id)
+			continue;
+		pos = findid(grid, grid->items[i].id);
+		if (pos == AP_GRID_INVALID_INDEX || grid->id_index[pos] != i) {
+			ERROR("Grid item is missing from id index (id = %u, index = %u).",
+				grid->items[i].id, i);
+			return FALSE;
+		}
+		count++;
 	}
-	return NULL;
+	for (i = 0; i <= grid->id_index_mask; i++) {
+		if (grid->id_index[i] != AP_GRID_INVALID_INDEX)
+			count--;
+	}
+	if (count) {
+		ERROR("Id index of grid has stale entries.");
+		return FALSE;
+	}
+	return TRUE;
 }
 
 boolean ap_grid_move_item(
@@ -257,7 +380,14 @@ boolean ap_grid_move_item(
 	struct ap_grid_item * dst = getitem(grid, layer, row, col);
 	if (!src || !dst || dst->id)
 		return FALSE;
+	if (src->id) {
+		uint32_t pos = findid(grid, src->id);
+		assert(pos != AP_GRID_INVALID_INDEX);
+		if (pos != AP_GRID_INVALID_INDEX)
+			grid->id_index[pos] = (uint32_t)(dst - grid->items);
+	}
 	memcpy(dst, src, sizeof(*src));
 	memset(src, 0, sizeof(*src));
+	assert(ap_grid_check_id_index(grid));
 	return TRUE;
 }
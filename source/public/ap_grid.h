@@ -47,6 +47,14 @@ struct ap_grid {
 	uint16_t row_count;
 	uint16_t column_count;
 	uint32_t item_types;
+	/* Open-addressing hash table that maps item ids 
+	 * to item indices, so that items can be found 
+	 * without scanning the grid.
+	 *
+	 * Unused entries are AP_GRID_INVALID_INDEX. */
+	uint32_t * id_index;
+	uint32_t id_index_mask;
+	uint32_t id_index_shift;
 };
 
 struct ap_grid * ap_grid_new(
@@ -138,6 +146,28 @@ void * ap_grid_get_object_by_id(
 	struct ap_grid * grid,
 	uint32_t object_id);
 
+/**
+ * Find grid item index by id.
+ * \param[in] grid      Grid pointer.
+ * \param[in] object_id Grid item id.
+ *
+ * \return Grid item index if an item with the id is 
+ *         in the grid. Otherwise AP_GRID_INVALID_INDEX.
+ */
+uint32_t ap_grid_get_index_by_id(
+	const struct ap_grid * grid,
+	uint32_t object_id);
+
+/**
+ * Check that id index of the grid is consistent 
+ * with grid items.
+ * \param[in] grid Grid pointer.
+ *
+ * \return TRUE if id index is consistent, 
+ *         FALSE if not.
+ */
+boolean ap_grid_check_id_index(const struct ap_grid * grid);
+
 /**
  * Move grid item within grid.
  * \param[in] grid       Grid pointer.
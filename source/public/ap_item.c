@@ -14,6 +14,7 @@
 #include "public/ap_tick.h"
 
 #include "utility/au_packet.h"
+#include "utility/au_snapshot.h"
 #include "utility/au_table.h"
 
 #include <assert.h>
@@ -71,6 +72,10 @@ struct ap_item_module {
 	uint32_t chatting_emphasis_tid;
 };
 
+struct ap_item_import_stage {
+	struct ap_admin template_admin;
+};
+
 static void * makeoptionpacket(
 	struct ap_item_module * mod,
 	const struct ap_item * item)
@@ -605,15 +610,175 @@ struct ap_item_module * ap_item_create_module()
 	return mod;
 }
 
-boolean ap_item_read_import_data(
+/*
+ * Parsed item templates are snapshot as copies of their 
+ * module data (including attached data), as they are 
+ * before completion callbacks run.
+ *
+ * Pointers are cleared in the copy and are resolved 
+ * again when templates are restored.
+ */
+struct import_snapshot_header {
+	uint32_t template_size;
+	uint32_t data_size;
+	uint32_t count;
+	uint32_t catalyst_tid;
+	uint32_t lucky_scroll_tid;
+	uint32_t chatting_emphasis_tid;
+};
+
+static void captureimport(
+	struct ap_item_module * mod,
+	const char * file_path)
+{
+	struct import_snapshot_header header = { 0 };
+	size_t size = ap_module_get_module_data_size(mod, 
+		AP_ITEM_MDI_TEMPLATE);
+	size_t index = 0;
+	void * object;
+	uint8_t * data;
+	uint8_t * cursor;
+	header.template_size = sizeof(struct ap_item_template);
+	header.data_size = (uint32_t)size;
+	header.count = ap_admin_get_object_count(&mod->template_admin);
+	header.catalyst_tid = mod->catalyst_tid;
+	header.lucky_scroll_tid = mod->lucky_scroll_tid;
+	header.chatting_emphasis_tid = mod->chatting_emphasis_tid;
+	data = alloc(sizeof(header) + header.count * size);
+	memcpy(data, &header, sizeof(header));
+	cursor = data + sizeof(header);
+	while (ap_admin_iterate_id(&mod->template_admin, &index, &object)) {
+		struct ap_item_template * temp = (struct ap_item_template *)cursor;
+		memcpy(cursor, *(struct ap_item_template **)object, size);
+		memset(temp->options, 0, sizeof(temp->options));
+		memset(temp->link_pools, 0, sizeof(temp->link_pools));
+		temp->usable.lottery_box.items = NULL;
+		cursor += size;
+	}
+	/* Source table is not needed once parsed 
+	 * templates are in the snapshot. */
+	if (au_snapshot_add(file_path, AU_SNAPSHOT_INDEX_PARSED, 
+			data, (size_t)(cursor - data))) {
+		au_snapshot_remove(file_path, 0);
+	}
+	dealloc(data);
+}
+
+static const void * findimportsnapshot(
+	struct ap_item_module * mod,
+	const char * file_path)
+{
+	struct import_snapshot_header header;
+	size_t size = 0;
+	size_t datasize = ap_module_get_module_data_size(mod, 
+		AP_ITEM_MDI_TEMPLATE);
+	const void * data = au_snapshot_find(file_path, 
+		AU_SNAPSHOT_INDEX_PARSED, &size);
+	if (!data || size < sizeof(header))
+		return NULL;
+	memcpy(&header, data, sizeof(header));
+	if (header.template_size != sizeof(struct ap_item_template) ||
+		header.data_size != datasize ||
+		size != sizeof(header) + header.count * datasize) {
+		WARN("Item template snapshot does not match template layout (%s).",
+			file_path);
+		return NULL;
+	}
+	return data;
+}
+
+static boolean loadimport(
+	struct ap_item_module * mod,
+	const void * data)
+{
+	struct import_snapshot_header header;
+	size_t size = ap_module_get_module_data_size(mod, 
+		AP_ITEM_MDI_TEMPLATE);
+	const uint8_t * cursor = (const uint8_t *)data + sizeof(header);
+	uint32_t i;
+	memcpy(&header, data, sizeof(header));
+	for (i = 0; i < header.count; i++) {
+		uint32_t tid;
+		uint32_t j;
+		struct ap_item_template ** t;
+		struct ap_item_template * temp;
+		memcpy(&tid, cursor, sizeof(tid));
+		t = ap_admin_add_object_by_id(&mod->template_admin, tid);
+		if (!t) {
+			ERROR("Multiple item templates with same id (%u).", tid);
+			return FALSE;
+		}
+		temp = ap_module_create_module_data(mod, AP_ITEM_MDI_TEMPLATE);
+		memcpy(temp, cursor, size);
+		*t = temp;
+		cursor += size;
+		for (j = 0; j < temp->option_count; j++) {
+			temp->options[j] = ap_item_get_option_template(mod, 
+				temp->option_tid[j]);
+			if (!temp->options[j]) {
+				ERROR("Invalid option template id (item = [%u] %s, option_tid = %u).",
+					temp->tid, temp->name, temp->option_tid[j]);
+				return FALSE;
+			}
+		}
+		for (j = 0; j < temp->link_count; j++)
+			temp->link_pools[j] = &mod->option_link_pools[temp->link_id[j]];
+		if (temp->type == AP_ITEM_TYPE_USABLE &&
+			temp->usable.usable_type == AP_ITEM_USABLE_TYPE_LOTTERY_BOX) {
+			temp->usable.lottery_box.items = 
+				vec_new(sizeof(struct ap_item_lottery_item));
+		}
+	}
+	mod->catalyst_tid = header.catalyst_tid;
+	mod->lucky_scroll_tid = header.lucky_scroll_tid;
+	mod->chatting_emphasis_tid = header.chatting_emphasis_tid;
+	return TRUE;
+}
+
+static boolean endreadimport(struct ap_item_module * mod)
+{
+	size_t index = 0;
+	void * object;
+	INFO("Loaded %u item templates.", 
+		ap_admin_get_object_count(&mod->template_admin));
+	while (ap_admin_iterate_id(&mod->template_admin, &index, &object)) {
+		struct ap_item_cb_end_read_import cb = { 0 };
+		cb.temp = *(struct ap_item_template **)object;
+		if (!ap_module_enum_callback(mod, AP_ITEM_CB_END_READ_IMPORT, &cb)) {
+			ERROR("Completion callback failed.");
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * If `stage` is set, templates are added to the stage 
+ * without module data constructors and callbacks, 
+ * and module state is left untouched.
+ *
+ * Otherwise, templates are restored from the data 
+ * snapshot if it holds the parsed table.
+ */
+static boolean readimport(
 	struct ap_item_module * mod,
 	const char * file_path, 
-	boolean decrypt)
+	boolean decrypt,
+	struct ap_item_import_stage * stage)
 {
-	struct au_table * table = au_table_open(file_path, decrypt);
+	struct au_table * table;
+	struct ap_admin * admin = 
+		stage ? &stage->template_admin : &mod->template_admin;
 	boolean r = TRUE;
-	size_t index;
-	void * object;
+	if (!stage) {
+		const void * parsed = findimportsnapshot(mod, file_path);
+		if (parsed) {
+			if (!loadimport(mod, parsed))
+				return FALSE;
+			return endreadimport(mod);
+		}
+	}
+	table = au_table_open(file_path, decrypt);
 	if (!table) {
 		ERROR("Failed to open file (%s).", file_path);
 		return FALSE;
@@ -895,16 +1060,21 @@ boolean ap_item_read_import_data(
 			if (id == AP_ITEM_DCID_TID) {
 				uint32_t tid = strtoul(value, NULL, 10);
 				struct ap_item_template ** t = 
-					ap_admin_add_object_by_id(&mod->template_admin,
-						tid);
+					ap_admin_add_object_by_id(admin, tid);
 				if (!t) {
 					ERROR("Multiple item templates with same id (%u).",
 						tid);
 					au_table_destroy(table);
 					return FALSE;
 				}
-				temp = ap_module_create_module_data(mod, 
-					AP_ITEM_MDI_TEMPLATE);
+				if (stage) {
+					temp = alloc(sizeof(*temp));
+					memset(temp, 0, sizeof(*temp));
+				}
+				else {
+					temp = ap_module_create_module_data(mod, 
+						AP_ITEM_MDI_TEMPLATE);
+				}
 				temp->tid = tid;
 				*t = temp;
 				continue;
@@ -980,42 +1150,44 @@ boolean ap_item_read_import_data(
 				break;
 			case AP_ITEM_DCID_PART:
 				assert(temp->type == AP_ITEM_TYPE_EQUIP);
-				temp->equip.part = strtol(value, NULL, 10);
+				temp->equip.part = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_KIND:
 				assert(temp->type == AP_ITEM_TYPE_EQUIP);
-				temp->equip.kind = strtol(value, NULL, 10);
+				temp->equip.kind = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_ITEMTYPE:
-				temp->type = strtol(value, NULL, 10);
+				temp->type = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_TYPE:
 				switch (temp->type) {
 				case AP_ITEM_TYPE_EQUIP:
 					if (temp->equip.kind == AP_ITEM_EQUIP_KIND_WEAPON) {
 						temp->equip.weapon_type = 
-							strtol(value, NULL, 10);
+							au_table_get_i32(table);
 					}
 					break;
 				case AP_ITEM_TYPE_USABLE:
 					temp->usable.usable_type = 
-						strtol(value, NULL, 10);
+						au_table_get_i32(table);
 					switch (temp->usable.usable_type) {
 					case AP_ITEM_USABLE_TYPE_CONVERT_CATALYST:
-						mod->catalyst_tid = temp->tid;
+						if (!stage)
+							mod->catalyst_tid = temp->tid;
 						break;
 					case AP_ITEM_USABLE_TYPE_LOTTERY_BOX:
 						temp->usable.lottery_box.items = 
 							vec_new(sizeof(struct ap_item_lottery_item));
 						break;
 					case AP_ITEM_USABLE_TYPE_LUCKY_SCROLL:
-						mod->lucky_scroll_tid = temp->tid;
+						if (!stage)
+							mod->lucky_scroll_tid = temp->tid;
 						break;
 					}
 					break;
 				case AP_ITEM_TYPE_OTHER:
 					temp->other.other_type = 
-						strtol(value, NULL, 10);
+						au_table_get_i32(table);
 					break;
 				default:
 					WARN("Invalid item type (tid = %u).",
@@ -1026,32 +1198,33 @@ boolean ap_item_read_import_data(
 			case AP_ITEM_DCID_SUBTYPE:
 				switch (temp->type) {
 				case AP_ITEM_TYPE_EQUIP:
-					temp->subtype = strtol(value, NULL, 10);
+					temp->subtype = au_table_get_i32(table);
 					break;
 				case AP_ITEM_TYPE_USABLE:
 					switch (temp->usable.usable_type) {
 					case AP_ITEM_USABLE_TYPE_TELEPORT_SCROLL:
 						temp->usable.teleport_scroll_type = 
-							strtol(value, NULL, 10);
+							au_table_get_i32(table);
 						break;
 					case AP_ITEM_USABLE_TYPE_RUNE:
 						temp->usable.rune_attribute_type = 
-							strtol(value, NULL, 10);
+							au_table_get_i32(table);
 						break;
 					case AP_ITEM_USABLE_TYPE_POTION:
 						temp->usable.is_percent_potion = TRUE;
 						break;
 					case AP_ITEM_USABLE_TYPE_SKILL_SCROLL:
 						temp->usable.scroll_subtype = 
-							strtol(value, NULL, 10);
+							au_table_get_i32(table);
 						break;
 					case AP_ITEM_USABLE_TYPE_AREA_CHATTING:
 						temp->usable.area_chatting_type = 
-							strtol(value, NULL, 10);
+							au_table_get_i32(table);
 						break;
 					default:
-						temp->subtype = strtol(value, NULL, 10);
-						if (temp->usable.usable_type == AP_ITEM_USABLE_TYPE_CHATTING &&
+						temp->subtype = au_table_get_i32(table);
+						if (!stage &&
+							temp->usable.usable_type == AP_ITEM_USABLE_TYPE_CHATTING &&
 							temp->subtype == AP_ITEM_USABLE_CHATTING_TYPE_EMPHASIS) {
 							mod->chatting_emphasis_tid = temp->tid;
 						}
@@ -1068,7 +1241,7 @@ boolean ap_item_read_import_data(
 				}
 				break;
 			case AP_ITEM_DCID_EXTRATYPE:
-				temp->extra_type = strtol(value, NULL, 10);
+				temp->extra_type = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_BOUNDTYPE:
 				temp->status_flags &= ~AP_ITEM_STATUS_FLAG_BIND_ON_ACQUIRE;
@@ -1087,16 +1260,16 @@ boolean ap_item_read_import_data(
 				}
 				break;
 			case AP_ITEM_DCID_EVENTITEM:
-				temp->is_event_item = strtol(value, NULL, 10);
+				temp->is_event_item = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_PCBANG_ONLY:
-				temp->is_use_only_pc_bang = strtol(value, NULL, 10);
+				temp->is_use_only_pc_bang = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_VILLAIN_ONLY:
-				temp->is_villain_only = strtol(value, NULL, 10);
+				temp->is_villain_only = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_FONT_COLOR:
-				temp->title_font_color = strtol(value, NULL, 10);
+				temp->title_font_color = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_SPIRIT_TYPE:
 				if (temp->type != AP_ITEM_TYPE_USABLE ||
@@ -1107,7 +1280,7 @@ boolean ap_item_read_import_data(
 					return FALSE;
 				}
 				temp->usable.spirit_stone_type = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_NPC_PRICE:
 				ap_factors_set_value(&temp->factor,
@@ -1134,7 +1307,7 @@ boolean ap_item_read_import_data(
 				break;
 			case AP_ITEM_DCID_STACK:
 				temp->max_stackable_count = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				if (temp->max_stackable_count)
 					temp->is_stackable = TRUE;
 				break;
@@ -1157,16 +1330,16 @@ boolean ap_item_read_import_data(
 					value);
 				break;
 			case AP_ITEM_DCID_MINSOCKET:
-				temp->min_socket_count = strtol(value, NULL, 10);
+				temp->min_socket_count = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_MAXSOCKET:
-				temp->max_socket_count = strtol(value, NULL, 10);
+				temp->max_socket_count = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_MINOPTION:
-				temp->min_option_count = strtol(value, NULL, 10);
+				temp->min_option_count = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_MAXOPTION:
-				temp->max_option_count = strtol(value, NULL, 10);
+				temp->max_option_count = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_ATK_RANGE:
 				ap_factors_set_value(&temp->factor,
@@ -1438,15 +1611,15 @@ boolean ap_item_read_import_data(
 				break;
 			case AP_ITEM_DCID_APPLY_EFFECT_COUNT:
 				temp->usable.effect_apply_count = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_APPLY_EFFECT_TIME:
 				temp->usable.effect_apply_interval = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_USE_INTERVAL:
 				temp->usable.use_interval = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_HP:
 				ap_factors_set_value(&temp->factor,
@@ -1476,11 +1649,11 @@ boolean ap_item_read_import_data(
 				break;
 			case AP_ITEM_DCID_USE_SKILL_ID:
 				temp->usable.use_skill_tid = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_USE_SKILL_LEVEL:
 				temp->usable.use_skill_level = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_POLYMORPH_ID:
 				if (temp->type != AP_ITEM_TYPE_USABLE ||
@@ -1491,7 +1664,7 @@ boolean ap_item_read_import_data(
 					return FALSE;
 				}
 				temp->usable.transform_tid = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_POLYMORPH_DUR:
 				if (temp->type != AP_ITEM_TYPE_USABLE ||
@@ -1502,17 +1675,17 @@ boolean ap_item_read_import_data(
 					return FALSE;
 				}
 				temp->usable.transform_duration = 
-					strtol(value, NULL, 10);
+					au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_FIRSTCATEGORY:
-				temp->first_category = strtol(value, NULL, 10);
+				temp->first_category = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_FIRSTCATEGORYNAME:
 				strlcpy(temp->first_category_name, value,
 					sizeof(temp->first_category_name));
 				break;
 			case AP_ITEM_DCID_SECONDCATEGORY:
-				temp->second_category = strtol(value, NULL, 10);
+				temp->second_category = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_SECONDCATEGORYNAME:
 				strlcpy(temp->second_category_name, value,
@@ -1525,22 +1698,22 @@ boolean ap_item_read_import_data(
 					value);
 				break;
 			case AP_ITEM_DCID_HP_BUFF:
-				temp->hp_buff = strtol(value, NULL, 10);
+				temp->hp_buff = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_MP_BUFF:
-				temp->mp_buff = strtol(value, NULL, 10);
+				temp->mp_buff = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_ATTACK_BUFF:
-				temp->attack_buff = strtol(value, NULL, 10);
+				temp->attack_buff = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_DEFENSE_BUFF:
-				temp->defense_buff = strtol(value, NULL, 10);
+				temp->defense_buff = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_RUN_BUFF:
-				temp->run_buff = strtol(value, NULL, 10);
+				temp->run_buff = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_CASH: {
-				int d = strtol(value, NULL, 10);
+				int d = au_table_get_i32(table);
 				if (d >= 100) {
 					temp->not_continuous = TRUE;
 					d -= 100;
@@ -1561,28 +1734,28 @@ boolean ap_item_read_import_data(
 				break;
 			case AP_ITEM_DCID_REMAINTIME:
 				temp->remain_time = 
-					(uint64_t)strtol(value, NULL, 10) * 60 * 1000;
+					(uint64_t)au_table_get_i32(table) * 60 * 1000;
 				break;
 			case AP_ITEM_DCID_EXPIRETIME:
-				temp->expire_time = strtol(value, NULL, 10) * 60;
+				temp->expire_time = au_table_get_i32(table) * 60;
 				break;
 			case AP_ITEM_DCID_CLASSIFY_ID:
-				temp->classify_id = strtol(value, NULL, 10);
+				temp->classify_id = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_CANSTOPUSINGITEM:
-				temp->can_stop_using = strtol(value, NULL, 10);
+				temp->can_stop_using = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_CASHITEMUSETYPE:
-				temp->cash_item_use_type = strtol(value, NULL, 10);
+				temp->cash_item_use_type = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_ENABLEONRIDE:
-				temp->enable_on_ride = strtol(value, NULL, 10);
+				temp->enable_on_ride = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_BUYER_TYPE:
-				temp->buyer_type = strtol(value, NULL, 10);
+				temp->buyer_type = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_USING_TYPE:
-				temp->using_type = strtol(value, NULL, 10);
+				temp->using_type = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_OPTIONTID: {
 				char * token = strtok(value, ";");
@@ -1604,7 +1777,7 @@ boolean ap_item_read_import_data(
 				break;
 			}
 			case AP_ITEM_DCID_POTIONTYPE2: {
-				int32_t d = strtol(value, NULL, 10);
+				int32_t d = au_table_get_i32(table);
 				if (d != 0)
 					temp->usable.potion_type2 = d;
 				break;
@@ -1615,6 +1788,7 @@ boolean ap_item_read_import_data(
 					uint32_t index = temp->link_count++;
 					uint32_t linkid = strtoul(token, NULL, 10);
 					assert(linkid < LINK_ID_CAP);
+					temp->link_id[index] = (uint16_t)linkid;
 					temp->link_pools[index] = &mod->option_link_pools[linkid];
 					if (temp->option_count == AP_ITEM_OPTION_MAX_LINK_COUNT)
 						break;
@@ -1626,7 +1800,7 @@ boolean ap_item_read_import_data(
 				char * token = strtok(value, ";");
 				while (token) {
 					temp->skill_plus_tid[temp->skill_plus_count++] =
-						(uint16_t)strtol(value, NULL, 10);
+						(uint16_t)au_table_get_i32(table);
 					if (temp->skill_plus_count == AP_ITEM_MAX_SKILL_PLUS)
 						break;
 					token = strtok(NULL, ";");
@@ -1634,13 +1808,13 @@ boolean ap_item_read_import_data(
 				break;
 			}
 			case AP_ITEM_DCID_GAMBLING:
-				temp->enable_gamble = strtol(value, NULL, 10);
+				temp->enable_gamble = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_QUESTITEM:
-				temp->quest_group = strtol(value, NULL, 10);
+				temp->quest_group = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_GACHA_TYPE_NUMER:
-				temp->gacha_type = strtol(value, NULL, 10);
+				temp->gacha_type = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_GACHARANK:
 				ap_factors_set_value(&temp->factor,
@@ -1652,14 +1826,14 @@ boolean ap_item_read_import_data(
 				break;
 			case AP_ITEM_DCID_STAMINACURE:
 				temp->stamina_cure = 
-					(uint64_t)strtol(value, NULL, 10) * 1000;
+					(uint64_t)au_table_get_i32(table) * 1000;
 				break;
 			case AP_ITEM_DCID_REMAINPETSTAMINA:
 				temp->stamina_remain_time = 
-					(uint64_t)strtol(value, NULL, 10) * 1000;
+					(uint64_t)au_table_get_i32(table) * 1000;
 				break;
 			case AP_ITEM_DCID_ITEM_SECTION_NUM:
-				temp->section_type = strtol(value, NULL, 10);
+				temp->section_type = au_table_get_i32(table);
 				break;
 			case AP_ITEM_DCID_HEROIC_MIN_DAMAGE:
 				ap_factors_set_attribute(&temp->factor,
@@ -1684,6 +1858,10 @@ boolean ap_item_read_import_data(
 				break;
 			default: {
 				struct ap_item_cb_read_import cb = { 0 };
+				/* Staged templates have no attached data 
+				 * for callbacks to read into. */
+				if (stage)
+					break;
 				cb.temp = temp;
 				cb.column_id = id;
 				cb.value = value;
@@ -1697,18 +1875,133 @@ boolean ap_item_read_import_data(
 		}
 	}
 	au_table_destroy(table);
-	INFO("Loaded %u item templates.", 
+	if (stage)
+		return TRUE;
+	if (au_snapshot_is_capturing())
+		captureimport(mod, file_path);
+	return endreadimport(mod);
+}
+
+boolean ap_item_read_import_data(
+	struct ap_item_module * mod,
+	const char * file_path, 
+	boolean decrypt)
+{
+	return readimport(mod, file_path, decrypt, NULL);
+}
+
+struct ap_item_import_stage * ap_item_read_import_stage(
+	struct ap_item_module * mod,
+	const char * file_path, 
+	boolean decrypt)
+{
+	struct ap_item_import_stage * stage = alloc(sizeof(*stage));
+	ap_admin_init(&stage->template_admin, sizeof(struct ap_item_template *),
 		ap_admin_get_object_count(&mod->template_admin));
-	index = 0;
-	while (ap_admin_iterate_id(&mod->template_admin, &index, &object)) {
-		struct ap_item_cb_end_read_import cb = { 0 };
-		cb.temp = *(struct ap_item_template **)object;
-		if (!ap_module_enum_callback(mod, AP_ITEM_CB_END_READ_IMPORT, &cb)) {
-			ERROR("Completion callback failed.");
-			return FALSE;
+	if (!readimport(mod, file_path, decrypt, stage)) {
+		ap_item_free_import_stage(mod, stage);
+		return NULL;
+	}
+	return stage;
+}
+
+boolean ap_item_validate_import_stage(
+	struct ap_item_module * mod,
+	struct ap_item_import_stage * stage)
+{
+	size_t index = 0;
+	struct ap_item_template ** object = NULL;
+	uint32_t count = ap_admin_get_object_count(&mod->template_admin);
+	boolean result = TRUE;
+	if (ap_admin_get_object_count(&stage->template_admin) != count) {
+		ERROR("Item template count has changed (%u -> %u).", count,
+			ap_admin_get_object_count(&stage->template_admin));
+		result = FALSE;
+	}
+	while (ap_admin_iterate_id(&stage->template_admin, &index, 
+			(void **)&object)) {
+		const struct ap_item_template * s = *object;
+		const struct ap_item_template * t = 
+			ap_item_get_template(mod, s->tid);
+		if (!t) {
+			ERROR("Item template was added (tid = %u).", s->tid);
+			result = FALSE;
+			continue;
+		}
+		if (s->type != t->type ||
+			s->equip.part != t->equip.part ||
+			s->equip.kind != t->equip.kind ||
+			s->usable.usable_type != t->usable.usable_type ||
+			s->other.other_type != t->other.other_type) {
+			ERROR("Item template type has changed (tid = %u).", s->tid);
+			result = FALSE;
 		}
 	}
-	return TRUE;
+	return result;
+}
+
+void ap_item_apply_import_stage(
+	struct ap_item_module * mod,
+	struct ap_item_import_stage * stage)
+{
+	size_t index = 0;
+	struct ap_item_template ** object = NULL;
+	while (ap_admin_iterate_id(&stage->template_admin, &index, 
+			(void **)&object)) {
+		const struct ap_item_template * s = *object;
+		struct ap_item_template * t = ap_item_get_template(mod, s->tid);
+		uint32_t i;
+		if (!t)
+			continue;
+		t->is_stackable = s->is_stackable;
+		t->max_stackable_count = s->max_stackable_count;
+		ap_factors_copy(&t->factor, &s->factor);
+		ap_factors_copy(&t->factor_restrict, &s->factor_restrict);
+		t->min_socket_count = s->min_socket_count;
+		t->max_socket_count = s->max_socket_count;
+		t->min_option_count = s->min_option_count;
+		t->max_option_count = s->max_option_count;
+		t->hp_buff = s->hp_buff;
+		t->mp_buff = s->mp_buff;
+		t->attack_buff = s->attack_buff;
+		t->defense_buff = s->defense_buff;
+		t->run_buff = s->run_buff;
+		t->remain_time = s->remain_time;
+		t->expire_time = s->expire_time;
+		t->option_count = s->option_count;
+		for (i = 0; i < s->option_count; i++) {
+			t->option_tid[i] = s->option_tid[i];
+			t->options[i] = s->options[i];
+		}
+		t->stamina_cure = s->stamina_cure;
+		t->stamina_remain_time = s->stamina_remain_time;
+		t->npc_arena_coin = s->npc_arena_coin;
+		if (t->type == AP_ITEM_TYPE_USABLE) {
+			t->usable.use_interval = s->usable.use_interval;
+			t->usable.effect_apply_count = s->usable.effect_apply_count;
+			t->usable.effect_apply_interval = 
+				s->usable.effect_apply_interval;
+			t->usable.transform_duration = s->usable.transform_duration;
+		}
+	}
+	INFO("Applied %u reloaded item templates.", 
+		ap_admin_get_object_count(&stage->template_admin));
+	ap_item_free_import_stage(mod, stage);
+}
+
+void ap_item_free_import_stage(
+	struct ap_item_module * mod,
+	struct ap_item_import_stage * stage)
+{
+	size_t index = 0;
+	struct ap_item_template ** object = NULL;
+	while (ap_admin_iterate_id(&stage->template_admin, &index, 
+			(void **)&object)) {
+		cbtempdtor(mod, *object);
+		dealloc(*object);
+	}
+	ap_admin_destroy(&stage->template_admin);
+	dealloc(stage);
 }
 
 boolean ap_item_read_option_data(
@@ -2926,8 +3219,6 @@ struct ap_item * ap_item_create(struct ap_item_module * mod, uint32_t tid)
 	struct ap_item * item;
 	if (!temp)
 		return NULL;
-	/** \todo Use a freelist instead of allocating/deallocating
-	 *        every time an item is created/destroyed. */
 	item = ap_module_create_module_data(mod, 
 		AP_ITEM_MDI_ITEM);
 	item->tid = tid;
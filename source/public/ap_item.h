@@ -1021,7 +1021,6 @@ struct ap_item {
 	uint32_t stack_count;
 	struct au_pos position;
 	struct ap_factor factor;
-	struct ap_factor factor_percent;
 	enum ap_item_status new_status;
 	enum ap_item_status status;
 	uint32_t status_flags;
@@ -1101,7 +1100,13 @@ struct ap_item_cb_end_read_option {
 	struct ap_item_option_template * temp;
 };
 
-/** \brief AP_ITEM_CB_READ_IMPORT callback data. */
+/**
+ * \brief AP_ITEM_CB_READ_IMPORT callback data.
+ *
+ * Attached template data that is set by this callback 
+ * is restored from the data snapshot byte for byte, 
+ * so it must not hold pointers.
+ */
 struct ap_item_cb_read_import {
 	struct ap_item_template * temp;
 	enum ap_item_data_column_id column_id;
@@ -1142,6 +1147,46 @@ boolean ap_item_read_import_data(
 	const char * file_path, 
 	boolean decrypt);
 
+/*
+ * Reads item data table into a stage without 
+ * modifying templates, so that it can be done on 
+ * a task thread while the server is running.
+ *
+ * Returns NULL if table is invalid.
+ */
+struct ap_item_import_stage * ap_item_read_import_stage(
+	struct ap_item_module * mod,
+	const char * file_path, 
+	boolean decrypt);
+
+/*
+ * Checks that staged templates can replace the current 
+ * ones, which requires the same set of templates with 
+ * unchanged types.
+ */
+boolean ap_item_validate_import_stage(
+	struct ap_item_module * mod,
+	struct ap_item_import_stage * stage);
+
+/*
+ * Updates tunable values (factors, restrictions, 
+ * option and socket ranges, durations, etc.) of 
+ * current templates from the stage.
+ *
+ * Existing items keep the factors that were copied 
+ * when they were created.
+ *
+ * Must be called from the main thread.
+ * Stage is consumed.
+ */
+void ap_item_apply_import_stage(
+	struct ap_item_module * mod,
+	struct ap_item_import_stage * stage);
+
+void ap_item_free_import_stage(
+	struct ap_item_module * mod,
+	struct ap_item_import_stage * stage);
+
 boolean ap_item_read_option_data(
 	struct ap_item_module * mod,
 	const char * file_path, 
@@ -18,9 +18,25 @@ struct ap_map_module {
 	struct ap_module_instance instance;
 	struct ap_config_module * ap_config;
 	struct ap_map_region_template region_templates[AP_MAP_MAX_REGION_ID + 1];
+	/* Region templates by name. */
+	struct ap_admin region_admin;
 	struct ap_admin glossary_admin;
 };
 
+static void addregionname(
+	struct ap_map_module * mod,
+	struct ap_map_region_template * temp)
+{
+	struct ap_map_region_template ** obj = 
+		ap_admin_add_object_by_name(&mod->region_admin, temp->name);
+	if (!obj) {
+		WARN("Region name is not unique (Id = %u, Name = %s).", 
+			temp->id, temp->name);
+		return;
+	}
+	*obj = temp;
+}
+
 static void match_glossary(struct ap_map_module * mod)
 {
 	uint32_t i;
@@ -81,6 +97,7 @@ static boolean oninitialize(struct ap_map_module * mod)
 
 static void onshutdown(struct ap_map_module * mod)
 {
+	ap_admin_destroy(&mod->region_admin);
 	ap_admin_destroy(&mod->glossary_admin);
 }
 
@@ -88,7 +105,9 @@ struct ap_map_module * ap_map_create_module()
 {
 	struct ap_map_module * mod = ap_module_instance_new(AP_MAP_MODULE_NAME,
 		sizeof(*mod), onregister, oninitialize, NULL, onshutdown);
-	ap_admin_init(&mod->glossary_admin, sizeof(struct ap_map_region_glossary), 128);
+	ap_admin_init_interned(&mod->region_admin, 
+		sizeof(struct ap_map_region_template *), 128);
+	ap_admin_init_interned(&mod->glossary_admin, sizeof(struct ap_map_region_glossary), 128);
 	return mod;
 }
 
@@ -194,6 +213,7 @@ boolean ap_map_read_region_templates(
 		strlcpy(key, line, maxcount);
 		if (strcmp(key, "Name") == 0) {
 			strlcpy(tmp->name, cursor, sizeof(tmp->name));
+			addregionname(mod, tmp);
 		}
 		else if (strcmp(key, "ParentIndex") == 0) {
 			tmp->parent_id = strtol(cursor, NULL, 10);
@@ -490,6 +510,7 @@ struct ap_map_region_template * ap_map_add_region_template(
 			mod->region_templates[i].id = i;
 			mod->region_templates[i].world_map_index = UINT32_MAX;
 			memcpy(mod->region_templates[i].name, name, sizeof(name));
+			addregionname(mod, &mod->region_templates[i]);
 			ap_map_add_glossary(mod, name, "Region%u");
 			return &mod->region_templates[i];
 		}
@@ -512,14 +533,9 @@ struct ap_map_region_template * ap_map_get_region_template_by_name(
 	struct ap_map_module * mod,
 	const char * region_name)
 {
-	uint32_t i;
-	for (i = 0; i < COUNT_OF(mod->region_templates); i++) {
-		struct ap_map_region_template * r = 
-			&mod->region_templates[i];
-		if (r->in_use && strcmp(r->name, region_name) == 0)
-			return r;
-	}
-	return NULL;
+	struct ap_map_region_template ** r = 
+		ap_admin_get_object_by_name(&mod->region_admin, region_name);
+	return r ? *r : NULL;
 }
 
 boolean ap_map_add_glossary(
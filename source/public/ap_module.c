@@ -1,16 +1,89 @@
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "core/malloc.h"
+#include "core/profile.h"
+#include "core/slab.h"
 #include "core/string.h"
 
 #include "public/ap_module.h"
 
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static enum ap_module_callback_profiling g_CallbackProfiling;
+static THREAD_LOCAL uint32_t t_SampleState;
+
+/*
+ * Calls are sampled randomly rather than at fixed 
+ * intervals, so that a callback that is always 
+ * enumerated at the same point of a loop is not 
+ * always (or never) sampled.
+ */
+static boolean samplecall()
+{
+	uint32_t x = t_SampleState;
+	if (!x)
+		x = (uint32_t)(uintptr_t)&t_SampleState | 1;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	t_SampleState = x;
+	return ((x & (AP_MODULE_CALLBACK_SAMPLE_INTERVAL - 1)) == 0);
+}
+
+static boolean profilecallback(
+	struct ap_module * mod,
+	uint32_t id,
+	uint32_t index,
+	void * data)
+{
+	struct ap_module_callback_stats * stats = &mod->callback_stats[id][index];
+	uint64_t begin;
+	uint64_t duration;
+	boolean r;
+	stats->call_count++;
+	if (g_CallbackProfiling == AP_MODULE_CALLBACK_PROFILING_SAMPLED &&
+		!samplecall()) {
+		return mod->callbacks[id][index](mod->callback_modules[id][index], data);
+	}
+	begin = profile_get_timestamp();
+	r = mod->callbacks[id][index](mod->callback_modules[id][index], data);
+	duration = profile_get_timestamp() - begin;
+	stats->sample_count++;
+	stats->total_time += duration;
+	if (duration > stats->max_time)
+		stats->max_time = duration;
+	return r;
+}
+
+static boolean callcallback(
+	struct ap_module * mod,
+	uint32_t id,
+	uint32_t index,
+	void * data)
+{
+	struct ap_module * cbmod = mod->callback_modules[id][index];
+	uint32_t tag = set_alloc_tag(cbmod->alloc_tag);
+	boolean r;
+	if (g_CallbackProfiling == AP_MODULE_CALLBACK_PROFILING_DISABLED)
+		r = mod->callbacks[id][index](cbmod, data);
+	else
+		r = profilecallback(mod, id, index, data);
+	set_alloc_tag(tag);
+	return r;
+}
+
 void ap_module_init(ap_module_t module_, const char * name)
 {
 	struct ap_module * mod = module_;
 	memset(mod, 0, sizeof(*mod));
 	strlcpy(mod->name, name, sizeof(mod->name));
+	mod->alloc_tag = create_alloc_tag(name);
 }
 
 void ap_module_set_module_data(
@@ -25,6 +98,21 @@ void ap_module_set_module_data(
 	mod->data[index].size = size;
 	mod->data[index].ctor = constructor;
 	mod->data[index].dtor = destructor;
+	mod->data[index].pool_flags = SLAB_POOL_RECYCLE;
+}
+
+void ap_module_set_module_data_recycle(
+	ap_module_t module_,
+	uint32_t index, 
+	boolean recycle)
+{
+	struct ap_module * mod = module_;
+	assert(index < AP_MODULE_MAX_MODULE_DATA_COUNT);
+	assert(mod->data[index].pool == NULL);
+	if (recycle)
+		mod->data[index].pool_flags |= SLAB_POOL_RECYCLE;
+	else
+		mod->data[index].pool_flags &= ~SLAB_POOL_RECYCLE;
 }
 
 size_t ap_module_attach_data(
@@ -40,6 +128,8 @@ size_t ap_module_attach_data(
 	struct ap_module_attached_data * ad;
 	assert(data_index < AP_MODULE_MAX_MODULE_DATA_COUNT);
 	assert(d->attached_data_count < AP_MODULE_MAX_ATTACHED_DATA_COUNT);
+	/* Pool object size cannot be changed. */
+	assert(d->pool == NULL);
 	if (d->attached_data_count >= AP_MODULE_MAX_ATTACHED_DATA_COUNT)
 		return SIZE_MAX;
 	ad = &d->attached_data[d->attached_data_count++];
@@ -61,6 +151,18 @@ size_t ap_module_get_module_data_size(
 	return d->size;
 }
 
+static struct slab_pool * getpool(
+	struct ap_module * mod,
+	uint32_t data_index)
+{
+	struct ap_module_data * d = &mod->data[data_index];
+	char name[SLAB_MAX_NAME_LENGTH];
+	if (d->pool)
+		return d->pool;
+	snprintf(name, sizeof(name), "%s[%u]", mod->name, data_index);
+	return slab_create_once(&d->pool, name, d->size, d->pool_flags);
+}
+
 void * ap_module_create_module_data(
 	ap_module_t module_, 
 	uint32_t data_index)
@@ -72,7 +174,7 @@ void * ap_module_create_module_data(
 	assert(data_index < AP_MODULE_MAX_MODULE_DATA_COUNT);
 	if (!d->size)
 		return NULL;
-	md = alloc(d->size);
+	md = slab_alloc(getpool(mod, data_index));
 	memset(md, 0, d->size);
 	if (d->ctor)
 		d->ctor(mod, md);
@@ -122,7 +224,22 @@ void ap_module_destroy_module_data(
 	}
 	if (d->dtor)
 		d->dtor(mod, data);
-	dealloc(data);
+	assert(d->pool != NULL);
+	slab_free(d->pool, data);
+}
+
+boolean ap_module_get_module_data_stats(
+	ap_module_t module_, 
+	uint32_t data_index,
+	struct slab_stats * stats)
+{
+	struct ap_module * mod = module_;
+	struct ap_module_data * d = &mod->data[data_index];
+	assert(data_index < AP_MODULE_MAX_MODULE_DATA_COUNT);
+	if (!d->pool)
+		return FALSE;
+	slab_get_stats(d->pool, stats);
+	return TRUE;
 }
 
 void ap_module_destruct_module_data(
@@ -153,6 +270,12 @@ void ap_module_add_callback(
 	struct ap_module * mod = module_;
 	assert(id < AP_MODULE_MAX_CALLBACK_ID);
 	assert(mod->callback_count[id] < AP_MODULE_MAX_CALLBACK_COUNT);
+	if (!mod->callback_stats[id]) {
+		size_t size = AP_MODULE_MAX_CALLBACK_COUNT * 
+			sizeof(*mod->callback_stats[id]);
+		mod->callback_stats[id] = alloc(size);
+		memset(mod->callback_stats[id], 0, size);
+	}
 	mod->callback_modules[id][mod->callback_count[id]] = callback_module;
 	mod->callbacks[id][mod->callback_count[id]++] = callback;
 }
@@ -167,7 +290,7 @@ boolean ap_module_enum_callback(
 	boolean r = TRUE;
 	assert(id < AP_MODULE_MAX_CALLBACK_ID);
 	for (i = 0; i < mod->callback_count[id]; i++)
-		r &= mod->callbacks[id][i](mod->callback_modules[id][i], data);
+		r &= callcallback(mod, id, i, data);
 	return r;
 }
 
@@ -180,8 +303,42 @@ boolean ap_module_enum_callback_indexed(
 	struct ap_module * mod = module_;
 	assert(id < AP_MODULE_MAX_CALLBACK_ID);
 	assert(callback_index < mod->callback_count[id]);
-	return mod->callbacks[id][callback_index](
-		mod->callback_modules[id][callback_index], data);
+	return callcallback(mod, id, callback_index, data);
+}
+
+void ap_module_set_callback_profiling(enum ap_module_callback_profiling mode)
+{
+	g_CallbackProfiling = mode;
+}
+
+enum ap_module_callback_profiling ap_module_get_callback_profiling()
+{
+	return g_CallbackProfiling;
+}
+
+void ap_module_get_callback_stats(
+	ap_module_t module_,
+	uint32_t id,
+	uint32_t callback_index,
+	struct ap_module_callback_stats * stats)
+{
+	struct ap_module * mod = module_;
+	assert(id < AP_MODULE_MAX_CALLBACK_ID);
+	assert(callback_index < mod->callback_count[id]);
+	*stats = mod->callback_stats[id][callback_index];
+}
+
+void ap_module_reset_callback_stats(ap_module_t module_)
+{
+	struct ap_module * mod = module_;
+	uint32_t i;
+	for (i = 0; i < AP_MODULE_MAX_CALLBACK_ID; i++) {
+		if (mod->callback_stats[i]) {
+			memset(mod->callback_stats[i], 0, 
+				AP_MODULE_MAX_CALLBACK_COUNT * 
+				sizeof(*mod->callback_stats[i]));
+		}
+	}
 }
 
 struct ap_module_stream * ap_module_stream_create()
@@ -214,6 +371,23 @@ boolean ap_module_stream_open(
 		decrypt);
 }
 
+boolean ap_module_stream_open_parts(
+	struct ap_module_stream ** streams,
+	uint32_t stream_count,
+	const char * file,
+	boolean decrypt)
+{
+	struct au_ini_mgr_ctx ** ctxs = alloc(
+		(size_t)MAX(stream_count, 1) * sizeof(*ctxs));
+	uint32_t i;
+	boolean result;
+	for (i = 0; i < stream_count; i++)
+		ctxs[i] = streams[i]->ini_mgr;
+	result = au_ini_mgr_read_parts(ctxs, stream_count, file, decrypt);
+	dealloc(ctxs);
+	return result;
+}
+
 boolean ap_module_stream_parse(
 	struct ap_module_stream * stream,
 	void * data,
@@ -250,18 +424,14 @@ boolean ap_module_stream_set_section_name(
 	struct ap_module_stream * stream,
 	const char * section_name)
 {
-	uint32_t c = au_ini_mgr_get_section_count(stream->ini_mgr);
 	strlcpy(stream->section_name, section_name,
 		sizeof(stream->section_name));
 	stream->module_data_index = 0;
 	stream->value_id = UINT32_MAX;
-	for (uint32_t i = 0; i < c; i++) {
-		if (strcmp(au_ini_mgr_get_section_name(stream->ini_mgr, i),
-				stream->section_name) == 0) {
-			stream->section_id = i;
-			return TRUE;
-		}
-	}
+	stream->section_id = au_ini_mgr_find_section(stream->ini_mgr,
+		stream->section_name);
+	if (stream->section_id != UINT32_MAX)
+		return TRUE;
 	stream->section_id = au_ini_mgr_add_section(stream->ini_mgr,
 		stream->section_name);
 	return (stream->section_id != UINT32_MAX);
@@ -2,6 +2,7 @@
 #define _AP_MODULE_H_
 
 #include "core/macros.h"
+#include "core/slab.h"
 #include "core/types.h"
 
 #include "utility/au_ini_manager.h"
@@ -14,6 +15,10 @@
 #define AP_MODULE_MAX_ATTACHED_DATA_COUNT 32
 #define AP_MODULE_MAX_CALLBACK_ID 32
 #define AP_MODULE_MAX_CALLBACK_COUNT 16
+/* In sampled profiling mode, one in this many 
+ * callback calls is timed on average. 
+ * Must be a power of two. */
+#define AP_MODULE_CALLBACK_SAMPLE_INTERVAL 64
 
 BEGIN_DECLS
 
@@ -57,6 +62,33 @@ struct ap_module_stream {
 	size_t enum_end_len;
 };
 
+enum ap_module_callback_profiling {
+	AP_MODULE_CALLBACK_PROFILING_DISABLED,
+	/* Every callback call is counted and timed. */
+	AP_MODULE_CALLBACK_PROFILING_FULL,
+	/* Every callback call is counted, randomly 
+	 * sampled calls are timed. */
+	AP_MODULE_CALLBACK_PROFILING_SAMPLED,
+};
+
+/*
+ * Cost of a callback handler.
+ *
+ * Counters are not synchronized, they may be 
+ * slightly off when a callback is enumerated 
+ * by several threads at once.
+ */
+struct ap_module_callback_stats {
+	uint64_t call_count;
+	/* Number of calls that were timed. */
+	uint64_t sample_count;
+	/* Cumulative and maximum duration of timed 
+	 * calls, in profiler timestamp ticks. 
+	 * Durations include nested callbacks. */
+	uint64_t total_time;
+	uint64_t max_time;
+};
+
 struct ap_module_attached_data {
 	size_t offset;
 	ap_module_t module_;
@@ -71,6 +103,10 @@ struct ap_module_data {
 	struct ap_module_attached_data attached_data[AP_MODULE_MAX_ATTACHED_DATA_COUNT];
 	uint32_t attached_data_count;
 	struct ap_module_stream_data * stream_data;
+	/* Created when module data is first created, 
+	 * after all data is attached. */
+	struct slab_pool * volatile pool;
+	uint32_t pool_flags;
 };
 
 struct ap_module {
@@ -79,6 +115,12 @@ struct ap_module {
 	ap_module_t callback_modules[AP_MODULE_MAX_CALLBACK_ID][AP_MODULE_MAX_CALLBACK_COUNT];
 	ap_module_default_t callbacks[AP_MODULE_MAX_CALLBACK_ID][AP_MODULE_MAX_CALLBACK_COUNT];
 	uint32_t callback_count[AP_MODULE_MAX_CALLBACK_ID];
+	/* Allocated when the first callback with 
+	 * the same id is added. */
+	struct ap_module_callback_stats * callback_stats[AP_MODULE_MAX_CALLBACK_ID];
+	/* Memory that is allocated while module 
+	 * callbacks are running is owned by this tag. */
+	uint32_t alloc_tag;
 };
 
 void ap_module_init(
@@ -92,6 +134,17 @@ void ap_module_set_module_data(
 	ap_module_default_t constructor,
 	ap_module_default_t destructor);
 
+/*
+ * Sets whether destroyed module data objects are reused.
+ *
+ * Recycling is enabled by default, it should be set 
+ * before any module data is created.
+ */
+void ap_module_set_module_data_recycle(
+	ap_module_t module_,
+	uint32_t index, 
+	boolean recycle);
+
 /*
  * Attempts to add new attached data and returns the data 
  * offset if successful.
@@ -118,6 +171,12 @@ size_t ap_module_get_module_data_size(
 	ap_module_t module_, 
 	uint32_t data_index);
 
+/*
+ * Allocates and constructs module data.
+ *
+ * Module data is allocated from a pool that is 
+ * shared by all threads.
+ */
 void * ap_module_create_module_data(
 	ap_module_t module_, 
 	uint32_t data_index);
@@ -138,6 +197,16 @@ void ap_module_destroy_module_data(
 	uint32_t data_index,
 	void * data);
 
+/*
+ * Retrieves pool statistics of module data.
+ *
+ * Returns FALSE if no module data was created yet.
+ */
+boolean ap_module_get_module_data_stats(
+	ap_module_t module_, 
+	uint32_t data_index,
+	struct slab_stats * stats);
+
 /**
  * Destruct module data but do not deallocate.
  * \param[in]     ctx        Module context pointer.
@@ -166,6 +235,29 @@ boolean ap_module_enum_callback_indexed(
 	void * data,
 	uint32_t callback_index);
 
+/*
+ * Sets whether callback calls of all modules 
+ * are counted and timed.
+ *
+ * Profiling is disabled by default.
+ */
+void ap_module_set_callback_profiling(enum ap_module_callback_profiling mode);
+
+enum ap_module_callback_profiling ap_module_get_callback_profiling();
+
+/*
+ * Retrieves the cost of the callback handler with 
+ * index `callback_index`, among the handlers of 
+ * callback `id`.
+ */
+void ap_module_get_callback_stats(
+	ap_module_t module_,
+	uint32_t id,
+	uint32_t callback_index,
+	struct ap_module_callback_stats * stats);
+
+void ap_module_reset_callback_stats(ap_module_t module_);
+
 struct ap_module_stream * ap_module_stream_create();
 
 void ap_module_stream_destroy(struct ap_module_stream * stream);
@@ -176,6 +268,18 @@ boolean ap_module_stream_open(
 	uint32_t part_index,
 	boolean decrypt);
 
+/*
+ * Opens the first `stream_count` parts of a part-indexed 
+ * file, reading the file only once.
+ *
+ * Part `i` is opened in `streams[i]`.
+ */
+boolean ap_module_stream_open_parts(
+	struct ap_module_stream ** streams,
+	uint32_t stream_count,
+	const char * file,
+	boolean decrypt);
+
 boolean ap_module_stream_parse(
 	struct ap_module_stream * stream,
 	void * data,
@@ -23,5 +23,9 @@ ap_module_t ap_module_instance_new(
 
 void ap_module_instance_destroy(ap_module_t module_)
 {
+    struct ap_module * mod = module_;
+    uint32_t i;
+    for (i = 0; i < AP_MODULE_MAX_CALLBACK_ID; i++)
+        dealloc(mod->callback_stats[i]);
     dealloc(module_);
 }
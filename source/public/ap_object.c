@@ -509,6 +509,36 @@ void ap_object_destroy(struct ap_object_module * mod, struct ap_object * obj)
 	*/
 }
 
+void ap_object_read_sector_stream(
+	struct ap_object_module * mod,
+	struct ap_module_stream * stream,
+	struct ap_object *** list)
+{
+	uint32_t c = ap_module_stream_get_section_count(stream);
+	uint32_t i;
+	for (i = 0; i < c; i++) {
+		uint32_t object_id = strtoul(
+			ap_module_stream_read_section_name(stream, i), 
+			NULL, 10);
+		struct ap_object * obj = ap_object_create(mod);
+		obj->object_id = object_id;
+		if (!ap_module_stream_enum_read(mod, stream, 
+				AP_OBJECT_MDI_OBJECT, obj)) {
+			ERROR("Failed to read object (oid = %u).",
+				object_id);
+			ap_object_destroy(mod, obj);
+			continue;
+		}
+		if (!ap_module_enum_callback(mod, AP_OBJECT_CB_INIT_OBJECT, obj)) {
+			WARN("Failed to initialize object (%u).", 
+				obj->object_id);
+			ap_object_destroy(mod, obj);
+			continue;
+		}
+		vec_push_back((void **)list, &obj);
+	}
+}
+
 boolean ap_object_load_sector(
 	struct ap_object_module * mod,
 	const char * object_dir,
@@ -524,8 +554,6 @@ boolean ap_object_load_sector(
 	uint32_t part_index =
 		sector_z * AP_SECTOR_DEFAULT_DEPTH + sector_x;
 	struct ap_module_stream * stream;
-	uint32_t c;
-	uint32_t i;
 	if (!make_path(path, sizeof(path), "%s/obj%05u.ini",
 			object_dir, map_x * 100 + map_z)) {
 		ERROR("Failed to create path.");
@@ -540,30 +568,7 @@ boolean ap_object_load_sector(
 		ap_module_stream_destroy(stream);
 		return FALSE;
 	}
-	c = ap_module_stream_get_section_count(stream);
-	for (i = 0; i < c; i++) {
-		uint32_t object_id = strtoul(
-			ap_module_stream_read_section_name(stream, i), 
-			NULL, 10);
-		struct ap_object * obj = ap_object_create(mod);
-		obj->object_id = object_id;
-		if (!ap_module_stream_enum_read(mod, stream, 
-				AP_OBJECT_MDI_OBJECT, obj)) {
-			ERROR("Failed to read object (oid = %u).",
-				object_id);
-			c--;
-			i--;
-			ap_object_destroy(mod, obj);
-			continue;
-		}
-		if (!ap_module_enum_callback(mod, AP_OBJECT_CB_INIT_OBJECT, obj)) {
-			WARN("Failed to initialize object (%u).", 
-				obj->object_id);
-			ap_object_destroy(mod, obj);
-			continue;
-		}
-		vec_push_back((void **)list, &obj);
-	}
+	ap_object_read_sector_stream(mod, stream, list);
 	ap_module_stream_destroy(stream);
 	return TRUE;
 }
@@ -118,6 +118,16 @@ struct ap_object * ap_object_duplicate(
 
 void ap_object_destroy(struct ap_object_module * mod, struct ap_object * obj);
 
+/*
+ * Creates objects from a stream that is opened with 
+ * a sector part of an object file, and adds them to 
+ * `list` (a vector of `struct ap_object` pointers).
+ */
+void ap_object_read_sector_stream(
+	struct ap_object_module * mod,
+	struct ap_module_stream * stream,
+	struct ap_object *** list);
+
 /*
  * If successful, returns a vector of `struct ap_object` 
  * pointers.
@@ -68,7 +68,7 @@ struct ap_refinery_module * ap_refinery_create_module()
 		AU_PACKET_TYPE_INT32, 1, /* Result */
 		AU_PACKET_TYPE_INT32, 1, /* Result Item TID */
 		AU_PACKET_TYPE_END);
-	ap_admin_init(&mod->recipe_admin, sizeof(struct ap_refinery_recipe), 128);
+	ap_admin_init_interned(&mod->recipe_admin, sizeof(struct ap_refinery_recipe), 128);
 	return mod;
 }
 
@@ -3,6 +3,7 @@
 #include "core/log.h"
 #include "core/malloc.h"
 #include "core/string.h"
+#include "core/vector.h"
 
 #include "public/ap_admin.h"
 #include "public/ap_character.h"
@@ -11,12 +12,41 @@
 #include "public/ap_tick.h"
 
 #include "utility/au_packet.h"
+#include "utility/au_snapshot.h"
 #include "utility/au_table.h"
 
 #include <assert.h>
 #include <stdarg.h>
 #include <stdlib.h>
 
+/* Const factor block holds `used_const_factor` 
+ * followed by `used_const_factor2`. */
+#define CONST_BLOCK_SIZE \
+	(2 * AP_SKILL_MAX_SKILL_CAP * AP_SKILL_CONST_COUNT * sizeof(float))
+
+struct const_generation {
+	uint32_t epoch;
+	/* Number of buffs that were added during 
+	 * this generation and are still applied. */
+	uint32_t buff_count;
+	/* Const blocks that were replaced when 
+	 * this generation ended. */
+	void ** retired;
+};
+
+struct ap_skill_const_stage_entry {
+	struct ap_skill_template * temp;
+	float (*factor)[AP_SKILL_CONST_COUNT];
+	boolean available[AP_SKILL_MAX_SKILL_CAP];
+	boolean available2[AP_SKILL_MAX_SKILL_CAP];
+	uint64_t cost_type;
+	uint64_t end_effect_type;
+};
+
+struct ap_skill_const_stage {
+	struct ap_admin entries;
+};
+
 struct ap_skill_module {
 	struct ap_module_instance instance;
 	struct ap_character_module * ap_character;
@@ -32,6 +62,9 @@ struct ap_skill_module {
 	uint32_t id_counter;
 	struct ap_skill * freelist;
 	size_t character_offset;
+	uint32_t const_epoch;
+	/* Oldest first, last one is current. */
+	struct const_generation * const_generations;
 };
 
 #define INI_NAME_NAME "Name"
@@ -1436,12 +1469,84 @@ static boolean skillctor(struct ap_skill_module * mod, struct ap_skill * s)
 	return TRUE;
 }
 
+static boolean templatector(
+	struct ap_skill_module * mod,
+	struct ap_skill_template * temp)
+{
+	float (*block)[AP_SKILL_CONST_COUNT] = alloc(CONST_BLOCK_SIZE);
+	memset(block, 0, CONST_BLOCK_SIZE);
+	temp->used_const_factor = block;
+	temp->used_const_factor2 = block + AP_SKILL_MAX_SKILL_CAP;
+	return TRUE;
+}
+
+static boolean templatedtor(
+	struct ap_skill_module * mod,
+	struct ap_skill_template * temp)
+{
+	dealloc(temp->used_const_factor);
+	return TRUE;
+}
+
+static struct const_generation * findconstgeneration(
+	struct ap_skill_module * mod,
+	uint32_t epoch)
+{
+	uint32_t i = vec_count(mod->const_generations);
+	/* Most buffs belong to the current generation. */
+	while (i--) {
+		if (mod->const_generations[i].epoch == epoch)
+			return &mod->const_generations[i];
+	}
+	return NULL;
+}
+
+static void freeconstgeneration(struct const_generation * g)
+{
+	uint32_t count = vec_count(g->retired);
+	uint32_t i;
+	for (i = 0; i < count; i++)
+		dealloc(g->retired[i]);
+	vec_free(g->retired);
+}
+
+/*
+ * A block that was retired at the end of a generation 
+ * can only be referenced by buffs of that generation 
+ * or of the ones before it, so generations are 
+ * released in order.
+ */
+static void reclaimconst(struct ap_skill_module * mod)
+{
+	while (vec_count(mod->const_generations) > 1 &&
+		!mod->const_generations[0].buff_count) {
+		freeconstgeneration(&mod->const_generations[0]);
+		vec_erase_iterator(mod->const_generations, 0);
+	}
+}
+
+static void releasebuffconst(
+	struct ap_skill_module * mod,
+	const struct ap_skill_buff_list * buff)
+{
+	struct const_generation * g = 
+		findconstgeneration(mod, buff->const_epoch);
+	if (!g || !g->buff_count) {
+		assert(0);
+		return;
+	}
+	if (!--g->buff_count && g != vec_back(mod->const_generations))
+		reclaimconst(mod);
+}
+
 static boolean chardtor(struct ap_skill_module * mod, struct ap_character * c)
 {
 	struct ap_skill_character * sc = ap_skill_get_character(mod, c);
 	uint32_t i;
 	for (i = 0; i < sc->skill_count; i++)
 		ap_skill_free(mod, sc->skill[i]);
+	for (i = 0; i < sc->buff_count; i++)
+		releasebuffconst(mod, &sc->buff_list[i]);
 	return TRUE;
 }
 
@@ -1465,6 +1570,8 @@ static void onshutdown(struct ap_skill_module * mod)
 	size_t index = 0;
 	struct ap_skill_template * temp = NULL;
 	struct ap_skill * skill = mod->freelist;
+	uint32_t count = vec_count(mod->const_generations);
+	uint32_t i;
 	while (skill) {
 		struct ap_skill * next = skill->next;
 		dealloc(skill);
@@ -1476,12 +1583,16 @@ static void onshutdown(struct ap_skill_module * mod)
 			AP_SKILL_MDI_TEMPLATE, temp);
 	}
 	ap_admin_destroy(&mod->template_admin);
+	for (i = 0; i < count; i++)
+		freeconstgeneration(&mod->const_generations[i]);
+	vec_free(mod->const_generations);
 }
 
 struct ap_skill_module * ap_skill_create_module()
 {
 	struct ap_skill_module * mod = ap_module_instance_new(AP_SKILL_MODULE_NAME,
 		sizeof(*mod), onregister, NULL, NULL, onshutdown);
+	struct const_generation * gen;
 	au_packet_init(&mod->packet, sizeof(uint16_t),
 		AU_PACKET_TYPE_UINT8, 1, /* Packet Type */ 
 		AU_PACKET_TYPE_INT32, 1, /* Skill Id */
@@ -1520,12 +1631,15 @@ struct ap_skill_module * ap_skill_create_module()
 		AU_PACKET_TYPE_UINT32, 1, /* expired time */
 		AU_PACKET_TYPE_MEMORY_BLOCK, 1, /* BuffedSkillCombatArg */
 		AU_PACKET_TYPE_END);
-	ap_admin_init(&mod->template_admin, 
+	ap_admin_init_interned(&mod->template_admin, 
 		sizeof(struct ap_skill_template), 512);
+	mod->const_generations = vec_new(sizeof(*mod->const_generations));
+	gen = vec_add_empty(&mod->const_generations);
+	gen->retired = vec_new(sizeof(*gen->retired));
 	ap_module_set_module_data(mod, AP_SKILL_MDI_SKILL,
 		sizeof(struct ap_skill), skillctor, NULL);
 	ap_module_set_module_data(mod, AP_SKILL_MDI_TEMPLATE,
-		sizeof(struct ap_skill_template), NULL, NULL);
+		sizeof(struct ap_skill_template), templatector, templatedtor);
 	ap_skill_add_stream_callback(mod, AP_SKILL_MDI_TEMPLATE, 
 		AP_SKILL_MODULE_NAME, mod, template_read, NULL);
 	return mod;
@@ -1550,15 +1664,7 @@ boolean ap_skill_read_templates(
 		uint32_t tid = strtoul(
 			ap_module_stream_read_section_name(stream, i), NULL, 10);
 		struct ap_skill_template * temp = 
-			ap_module_create_module_data(mod, 
-				AP_SKILL_MDI_TEMPLATE);
-		if (!temp) {
-			ERROR("Failed to add skill template (tid = %u).", 
-				tid);
-			ap_module_stream_destroy(stream);
-			return FALSE;
-		}
-		temp = ap_admin_add_object_by_id(&mod->template_admin, tid);
+			ap_admin_add_object_by_id(&mod->template_admin, tid);
 		if (!temp) {
 			ERROR("Failed to add skill template (tid = %u).",
 				tid);
@@ -3379,15 +3485,247 @@ boolean ap_skill_read_spec(
 	return TRUE;
 }
 
-boolean ap_skill_read_const(
+static struct ap_skill_const_stage_entry * getstageentry(
+	struct ap_skill_const_stage * stage,
+	struct ap_skill_template * temp)
+{
+	struct ap_skill_const_stage_entry * e = 
+		ap_admin_get_object_by_id(&stage->entries, temp->id);
+	if (e)
+		return e;
+	e = ap_admin_add_object_by_id(&stage->entries, temp->id);
+	e->temp = temp;
+	e->factor = alloc(CONST_BLOCK_SIZE);
+	memset(e->factor, 0, CONST_BLOCK_SIZE);
+	return e;
+}
+
+/*
+ * Parsed const tables are snapshot as the factor rows 
+ * that were read for each template.
+ *
+ * Each template record is followed by a row of 
+ * `const_count` factors for each bit that is set 
+ * in `level_mask`, in level order.
+ */
+struct const_snapshot_header {
+	uint32_t const_count;
+	uint32_t level_cap;
+	uint32_t level_up_cap;
+	uint32_t template_count;
+};
+
+struct const_snapshot_template {
+	uint32_t tid;
+	uint32_t level_mask;
+	uint64_t cost_type;
+	uint64_t end_effect_type;
+	uint32_t level_up_skill_tid[AP_SKILL_MAX_SKILL_CAP][AP_SKILL_MAX_SKILL_LEVELUP_TID];
+	uint32_t level_up_skill_count[AP_SKILL_MAX_SKILL_CAP];
+};
+
+#define CONST_ROW_SIZE (AP_SKILL_CONST_COUNT * sizeof(float))
+
+static uint32_t getconstlevelmask(
+	const struct ap_skill_template * temp,
+	boolean second)
+{
+	const boolean * available = second ? 
+		temp->available_const_factor2 : temp->available_const_factor;
+	uint32_t mask = 0;
+	uint32_t i;
+	for (i = 0; i < AP_SKILL_MAX_SKILL_CAP; i++) {
+		if (available[i])
+			mask |= 1u << i;
+	}
+	return mask;
+}
+
+static uint32_t countlevels(uint32_t mask)
+{
+	uint32_t count = 0;
+	while (mask) {
+		mask &= mask - 1;
+		count++;
+	}
+	return count;
+}
+
+/*
+ * `second` selects the table that is read 
+ * by `readconst2`.
+ */
+static void captureconst(
+	struct ap_skill_module * mod,
+	const char * file_path,
+	boolean second)
+{
+	struct const_snapshot_header header = { 0 };
+	struct ap_skill_template * temp = NULL;
+	size_t size = sizeof(header);
+	size_t index = 0;
+	uint8_t * data;
+	uint8_t * cursor;
+	while (ap_admin_iterate_id(&mod->template_admin, 
+			&index, (void **)&temp)) {
+		uint32_t mask = getconstlevelmask(temp, second);
+		if (!mask)
+			continue;
+		size += sizeof(struct const_snapshot_template) + 
+			countlevels(mask) * CONST_ROW_SIZE;
+		header.template_count++;
+	}
+	header.const_count = AP_SKILL_CONST_COUNT;
+	header.level_cap = AP_SKILL_MAX_SKILL_CAP;
+	header.level_up_cap = AP_SKILL_MAX_SKILL_LEVELUP_TID;
+	data = alloc(size);
+	memcpy(data, &header, sizeof(header));
+	cursor = data + sizeof(header);
+	index = 0;
+	while (ap_admin_iterate_id(&mod->template_admin, 
+			&index, (void **)&temp)) {
+		struct const_snapshot_template t = { 0 };
+		float (*factor)[AP_SKILL_CONST_COUNT] = second ?
+			temp->used_const_factor2 : temp->used_const_factor;
+		uint32_t i;
+		t.level_mask = getconstlevelmask(temp, second);
+		if (!t.level_mask)
+			continue;
+		t.tid = temp->id;
+		if (second) {
+			memcpy(t.level_up_skill_tid, temp->level_up_skill_tid, 
+				sizeof(t.level_up_skill_tid));
+			memcpy(t.level_up_skill_count, temp->level_up_skill_count, 
+				sizeof(t.level_up_skill_count));
+		}
+		else {
+			t.cost_type = temp->cost_type;
+			t.end_effect_type = temp->end_effect_type;
+		}
+		memcpy(cursor, &t, sizeof(t));
+		cursor += sizeof(t);
+		for (i = 0; i < AP_SKILL_MAX_SKILL_CAP; i++) {
+			if (t.level_mask & (1u << i)) {
+				memcpy(cursor, factor[i], CONST_ROW_SIZE);
+				cursor += CONST_ROW_SIZE;
+			}
+		}
+	}
+	/* Source table is not needed once parsed 
+	 * rows are in the snapshot. */
+	if (au_snapshot_add(file_path, AU_SNAPSHOT_INDEX_PARSED, data, size))
+		au_snapshot_remove(file_path, 0);
+	dealloc(data);
+}
+
+static const void * findconstsnapshot(const char * file_path)
+{
+	struct const_snapshot_header header;
+	size_t size = 0;
+	size_t offset = sizeof(header);
+	const uint8_t * data = au_snapshot_find(file_path, 
+		AU_SNAPSHOT_INDEX_PARSED, &size);
+	uint32_t i;
+	if (!data || size < sizeof(header))
+		return NULL;
+	memcpy(&header, data, sizeof(header));
+	if (header.const_count != AP_SKILL_CONST_COUNT ||
+		header.level_cap != AP_SKILL_MAX_SKILL_CAP ||
+		header.level_up_cap != AP_SKILL_MAX_SKILL_LEVELUP_TID) {
+		WARN("Skill const snapshot does not match const layout (%s).",
+			file_path);
+		return NULL;
+	}
+	for (i = 0; i < header.template_count; i++) {
+		struct const_snapshot_template t;
+		if (size - offset < sizeof(t))
+			break;
+		memcpy(&t, data + offset, sizeof(t));
+		offset += sizeof(t);
+		if (size - offset < countlevels(t.level_mask) * CONST_ROW_SIZE)
+			break;
+		offset += countlevels(t.level_mask) * CONST_ROW_SIZE;
+	}
+	if (i != header.template_count || offset != size) {
+		WARN("Skill const snapshot is truncated (%s).", file_path);
+		return NULL;
+	}
+	return data;
+}
+
+static boolean loadconst(
+	struct ap_skill_module * mod,
+	const void * data,
+	boolean second)
+{
+	struct const_snapshot_header header;
+	const uint8_t * cursor = (const uint8_t *)data + sizeof(header);
+	uint32_t i;
+	memcpy(&header, data, sizeof(header));
+	for (i = 0; i < header.template_count; i++) {
+		struct const_snapshot_template t;
+		struct ap_skill_template * temp;
+		float (*factor)[AP_SKILL_CONST_COUNT];
+		boolean * available;
+		uint32_t level;
+		memcpy(&t, cursor, sizeof(t));
+		cursor += sizeof(t);
+		temp = ap_skill_get_template(mod, t.tid);
+		if (!temp) {
+			ERROR("Invalid skill const template id (%u).", t.tid);
+			return FALSE;
+		}
+		if (second) {
+			factor = temp->used_const_factor2;
+			available = temp->available_const_factor2;
+			memcpy(temp->level_up_skill_tid, t.level_up_skill_tid, 
+				sizeof(t.level_up_skill_tid));
+			memcpy(temp->level_up_skill_count, t.level_up_skill_count, 
+				sizeof(t.level_up_skill_count));
+		}
+		else {
+			factor = temp->used_const_factor;
+			available = temp->available_const_factor;
+			temp->cost_type |= t.cost_type;
+			temp->end_effect_type |= t.end_effect_type;
+		}
+		for (level = 0; level < AP_SKILL_MAX_SKILL_CAP; level++) {
+			if (t.level_mask & (1u << level)) {
+				memcpy(factor[level], cursor, CONST_ROW_SIZE);
+				available[level] = TRUE;
+				cursor += CONST_ROW_SIZE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * If `stage` is set, const factors are read into 
+ * the stage and templates are left untouched.
+ *
+ * Otherwise, const factors are restored from the 
+ * data snapshot if it holds the parsed table.
+ */
+static boolean readconst(
 	struct ap_skill_module * mod,
 	const char * file_path, 
-	boolean decrypt)
+	boolean decrypt,
+	struct ap_skill_const_stage * stage)
 {
-	struct au_table * table = au_table_open(file_path, decrypt);
+	struct au_table * table;
 	boolean r = TRUE;
 	struct ap_skill_template * temp = NULL;
+	struct ap_skill_const_stage_entry * entry = NULL;
+	uint64_t * costtype = NULL;
+	uint64_t * endeffecttype = NULL;
 	uint32_t count = 0;
+	if (!stage) {
+		const void * parsed = findconstsnapshot(file_path);
+		if (parsed)
+			return loadconst(mod, parsed, FALSE);
+	}
+	table = au_table_open(file_path, decrypt);
 	if (!table) {
 		ERROR("Failed to open file (%s).", file_path);
 		return FALSE;
@@ -4064,9 +4402,19 @@ boolean ap_skill_read_const(
 				if (!temp) {
 					ERROR("Invalid skill const name (%s).",
 						value);
-					assert(0);
+					assert(stage != NULL);
+					au_table_destroy(table);
 					return FALSE;
 				}
+				if (stage) {
+					entry = getstageentry(stage, temp);
+					costtype = &entry->cost_type;
+					endeffecttype = &entry->end_effect_type;
+				}
+				else {
+					costtype = &temp->cost_type;
+					endeffecttype = &temp->end_effect_type;
+				}
 				count++;
 				continue;
 			}
@@ -4078,8 +4426,14 @@ boolean ap_skill_read_const(
 				uint32_t level = strtol(value, NULL, 10);
 				if (level >= AP_SKILL_MAX_SKILL_CAP)
 					break;
-				factor = &temp->used_const_factor[level][0];
-				temp->available_const_factor[level] = TRUE;
+				if (entry) {
+					factor = &entry->factor[level][0];
+					entry->available[level] = TRUE;
+				}
+				else {
+					factor = &temp->used_const_factor[level][0];
+					temp->available_const_factor[level] = TRUE;
+				}
 			}
 			if (!factor) {
 				assert(0);
@@ -4131,19 +4485,19 @@ boolean ap_skill_read_const(
 						factor[factorindex];
 					break;
 				case AP_SKILL_CONST_COST_HP:
-					temp->cost_type |= AP_SKILL_COST_HP;
+					*costtype |= AP_SKILL_COST_HP;
 					break;
 				case AP_SKILL_CONST_COST_MP:
-					temp->cost_type |= AP_SKILL_COST_MP;
+					*costtype |= AP_SKILL_COST_MP;
 					break;
 				case AP_SKILL_CONST_COST_SP:
-					temp->cost_type |= AP_SKILL_COST_SP;
+					*costtype |= AP_SKILL_COST_SP;
 					break;
 				case AP_SKILL_CONST_COST_ARROW:
-					temp->cost_type |= AP_SKILL_COST_ARROW;
+					*costtype |= AP_SKILL_COST_ARROW;
 					break;
 				case AP_SKILL_CONST_ENDSKILL_COST_HP:
-					temp->end_effect_type |= 
+					*endeffecttype |= 
 						AP_SKILL_ENDSKILL_CONSUME_HP;
 					break;
 				}
@@ -4151,18 +4505,36 @@ boolean ap_skill_read_const(
 		}
 	}
 	au_table_destroy(table);
+	if (!stage && au_snapshot_is_capturing())
+		captureconst(mod, file_path, FALSE);
 	return TRUE;
 }
 
-boolean ap_skill_read_const2(
+boolean ap_skill_read_const(
 	struct ap_skill_module * mod,
 	const char * file_path, 
 	boolean decrypt)
 {
-	struct au_table * table = au_table_open(file_path, decrypt);
+	return readconst(mod, file_path, decrypt, NULL);
+}
+
+static boolean readconst2(
+	struct ap_skill_module * mod,
+	const char * file_path, 
+	boolean decrypt,
+	struct ap_skill_const_stage * stage)
+{
+	struct au_table * table;
 	boolean r = TRUE;
 	struct ap_skill_template * temp = NULL;
+	struct ap_skill_const_stage_entry * entry = NULL;
 	uint32_t count = 0;
+	if (!stage) {
+		const void * parsed = findconstsnapshot(file_path);
+		if (parsed)
+			return loadconst(mod, parsed, TRUE);
+	}
+	table = au_table_open(file_path, decrypt);
 	if (!table) {
 		ERROR("Failed to open file (%s).", file_path);
 		return FALSE;
@@ -4586,9 +4958,12 @@ boolean ap_skill_read_const2(
 				temp = ap_skill_get_template_by_name(mod, value);
 				if (!temp) {
 					ERROR("Invalid skill const name (%s).", value);
-					assert(0);
+					assert(stage != NULL);
+					au_table_destroy(table);
 					return FALSE;
 				}
+				if (stage)
+					entry = getstageentry(stage, temp);
 				count++;
 				continue;
 			}
@@ -4600,8 +4975,14 @@ boolean ap_skill_read_const2(
 				level = strtol(value, NULL, 10);
 				if (level >= AP_SKILL_MAX_SKILL_CAP)
 					break;
-				factor = &temp->used_const_factor2[level][0];
-				temp->available_const_factor2[level] = TRUE;
+				if (entry) {
+					factor = &entry->factor[AP_SKILL_MAX_SKILL_CAP + level][0];
+					entry->available2[level] = TRUE;
+				}
+				else {
+					factor = &temp->used_const_factor2[level][0];
+					temp->available_const_factor2[level] = TRUE;
+				}
 			}
 			if (!factor) {
 				assert(0);
@@ -4614,6 +4995,9 @@ boolean ap_skill_read_const2(
 				percent = FALSE;
 			}
 			else if (id == CONST2_DCID_SPECIFIC_SKILL_LEVELUP2) {
+				/* Level-up skills are not reloaded. */
+				if (stage)
+					continue;
 				assert(temp->level_up_skill_count[level] < AP_SKILL_MAX_SKILL_LEVELUP_TID);
 				temp->level_up_skill_tid[level][temp->level_up_skill_count[level]++] =
 					strtoul(value, NULL, 10);
@@ -4645,9 +5029,93 @@ boolean ap_skill_read_const2(
 		}
 	}
 	au_table_destroy(table);
+	if (!stage && au_snapshot_is_capturing())
+		captureconst(mod, file_path, TRUE);
 	return TRUE;
 }
 
+boolean ap_skill_read_const2(
+	struct ap_skill_module * mod,
+	const char * file_path, 
+	boolean decrypt)
+{
+	return readconst2(mod, file_path, decrypt, NULL);
+}
+
+struct ap_skill_const_stage * ap_skill_read_const_stage(
+	struct ap_skill_module * mod,
+	const char * const_file_path, 
+	const char * const2_file_path, 
+	boolean decrypt)
+{
+	struct ap_skill_const_stage * stage = alloc(sizeof(*stage));
+	ap_admin_init(&stage->entries, sizeof(struct ap_skill_const_stage_entry), 
+		ap_admin_get_object_count(&mod->template_admin));
+	if (!readconst(mod, const_file_path, decrypt, stage) ||
+		!readconst2(mod, const2_file_path, decrypt, stage)) {
+		ap_skill_free_const_stage(stage);
+		return NULL;
+	}
+	return stage;
+}
+
+void ap_skill_apply_const_stage(
+	struct ap_skill_module * mod,
+	struct ap_skill_const_stage * stage)
+{
+	struct const_generation * current = vec_back(mod->const_generations);
+	struct const_generation * next;
+	size_t index = 0;
+	struct ap_skill_const_stage_entry * e = NULL;
+	while (ap_admin_iterate_id(&stage->entries, &index, (void **)&e)) {
+		struct ap_skill_template * temp = e->temp;
+		vec_push_back((void **)&current->retired, &temp->used_const_factor);
+		temp->used_const_factor = e->factor;
+		temp->used_const_factor2 = e->factor + AP_SKILL_MAX_SKILL_CAP;
+		memcpy(temp->available_const_factor, e->available, 
+			sizeof(e->available));
+		memcpy(temp->available_const_factor2, e->available2, 
+			sizeof(e->available2));
+		temp->cost_type |= e->cost_type;
+		temp->end_effect_type |= e->end_effect_type;
+		e->factor = NULL;
+	}
+	INFO("Applied skill const generation %u (%u templates).", 
+		mod->const_epoch + 1, ap_admin_get_object_count(&stage->entries));
+	ap_skill_free_const_stage(stage);
+	next = vec_add_empty(&mod->const_generations);
+	next->epoch = ++mod->const_epoch;
+	next->retired = vec_new(sizeof(*next->retired));
+	reclaimconst(mod);
+}
+
+void ap_skill_free_const_stage(struct ap_skill_const_stage * stage)
+{
+	size_t index = 0;
+	struct ap_skill_const_stage_entry * e = NULL;
+	while (ap_admin_iterate_id(&stage->entries, &index, (void **)&e))
+		dealloc(e->factor);
+	ap_admin_destroy(&stage->entries);
+	dealloc(stage);
+}
+
+uint32_t ap_skill_get_retired_const_generation_count(
+	struct ap_skill_module * mod)
+{
+	return vec_count(mod->const_generations) - 1;
+}
+
+uint32_t ap_skill_get_const_generation_buff_count(
+	struct ap_skill_module * mod)
+{
+	uint32_t count = vec_count(mod->const_generations);
+	uint32_t total = 0;
+	uint32_t i;
+	for (i = 0; i < count; i++)
+		total += mod->const_generations[i].buff_count;
+	return total;
+}
+
 struct ap_skill * ap_skill_new(struct ap_skill_module * mod)
 {
 	struct ap_skill * c = mod->freelist;
@@ -5289,6 +5757,10 @@ struct ap_skill_buff_list * ap_skill_add_buff(
 	buff->skill_tid = temp->id;
 	buff->skill_level = skill_level;
 	buff->temp = temp;
+	buff->const_factor = &temp->used_const_factor[skill_level][0];
+	buff->const_factor2 = &temp->used_const_factor2[skill_level][0];
+	buff->const_epoch = mod->const_epoch;
+	((struct const_generation *)vec_back(mod->const_generations))->buff_count++;
 	buff->caster_id = caster_id;
 	buff->caster_tid = caster_tid;
 	buff->duration_ms = duration;
@@ -5457,6 +5929,7 @@ uint32_t ap_skill_remove_buff(
 		}
 	}
 	ap_module_enum_callback(mod, AP_SKILL_CB_REMOVE_BUFF, &cb);
+	releasebuffconst(mod, cb.buff);
 	memmove(&attachment->buff_list[buff_index], 
 		&attachment->buff_list[buff_index + 1],
 		((size_t)--attachment->buff_count - buff_index) * sizeof(attachment->buff_list[0]));
@@ -1126,6 +1126,12 @@ struct ap_skill_buff_list {
 	uint32_t skill_tid;
 	uint32_t skill_level;
 	const struct ap_skill_template * temp;
+	/* Const factors of the generation that was current 
+	 * when buff was added, so that the buff is removed 
+	 * with the same values it was applied with. */
+	const float * const_factor;
+	const float * const_factor2;
+	uint32_t const_epoch;
 	uint32_t caster_id;
 	uint32_t caster_tid;
 	uint32_t spell_count;
@@ -1274,9 +1280,12 @@ struct ap_skill_template {
 	uint64_t end_effect_type;
 	uint32_t condition2;
 	struct au_dirt use_dirt_point;
-	float used_const_factor[AP_SKILL_MAX_SKILL_CAP][AP_SKILL_CONST_COUNT];
+	/* Current const generation, both tables are 
+	 * allocated as a single block 
+	 * (AP_SKILL_MAX_SKILL_CAP rows each). */
+	float (*used_const_factor)[AP_SKILL_CONST_COUNT];
 	boolean available_const_factor[AP_SKILL_MAX_SKILL_CAP];
-	float used_const_factor2[AP_SKILL_MAX_SKILL_CAP][AP_SKILL_CONST_COUNT];
+	float (*used_const_factor2)[AP_SKILL_CONST_COUNT];
 	boolean available_const_factor2[AP_SKILL_MAX_SKILL_CAP];
 	boolean is_shrine_skill;
 	boolean is_sigil_skill;
@@ -1415,6 +1424,53 @@ boolean ap_skill_read_const2(
 	const char * file_path, 
 	boolean decrypt);
 
+/*
+ * Reads skill const tables into a stage without 
+ * modifying templates, so that it can be done on a 
+ * task thread while the server is running.
+ *
+ * Only templates that are listed in const tables 
+ * receive a new const generation.
+ *
+ * Returns NULL if either of the tables is invalid.
+ */
+struct ap_skill_const_stage * ap_skill_read_const_stage(
+	struct ap_skill_module * mod,
+	const char * const_file_path, 
+	const char * const2_file_path, 
+	boolean decrypt);
+
+/*
+ * Makes staged const factors current.
+ *
+ * Buffs that are already applied keep referencing 
+ * the previous generation until they are removed, 
+ * after which it is released.
+ *
+ * Must be called from the main thread.
+ * Stage is consumed.
+ */
+void ap_skill_apply_const_stage(
+	struct ap_skill_module * mod,
+	struct ap_skill_const_stage * stage);
+
+void ap_skill_free_const_stage(struct ap_skill_const_stage * stage);
+
+/*
+ * Returns the number of retired const generations 
+ * that are still referenced by buffs.
+ */
+uint32_t ap_skill_get_retired_const_generation_count(
+	struct ap_skill_module * mod);
+
+/*
+ * Returns the number of applied buffs that are 
+ * counted by const generations, which should be 
+ * equal to the number of buffs of all characters.
+ */
+uint32_t ap_skill_get_const_generation_buff_count(
+	struct ap_skill_module * mod);
+
 struct ap_skill * ap_skill_new(struct ap_skill_module * mod);
 
 void ap_skill_free(struct ap_skill_module * mod, struct ap_skill * skill);
@@ -1650,14 +1706,14 @@ static inline const float * ap_skill_get_buff_const_factor(
 	const struct ap_skill_buff_list * buff)
 {
 	assert(buff->skill_level < AP_SKILL_MAX_SKILL_CAP);
-	return &buff->temp->used_const_factor[buff->skill_level][0];
+	return buff->const_factor;
 }
 
 static inline const float * ap_skill_get_buff_const_factor2(
 	const struct ap_skill_buff_list * buff)
 {
 	assert(buff->skill_level < AP_SKILL_MAX_SKILL_CAP);
-	return &buff->temp->used_const_factor2[buff->skill_level][0];
+	return buff->const_factor2;
 }
 
 static inline uint32_t ap_skill_get_exp(const struct ap_skill * skill)
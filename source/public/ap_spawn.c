@@ -50,7 +50,7 @@ struct ap_spawn_module * ap_spawn_create_module()
 {
 	struct ap_spawn_module * mod = ap_module_instance_new(AP_SPAWN_MODULE_NAME,
 		sizeof(*mod), NULL, NULL, NULL, onshutdown);
-	ap_admin_init(&mod->data_admin, sizeof(struct ap_spawn_data), 128);
+	ap_admin_init_interned(&mod->data_admin, sizeof(struct ap_spawn_data), 128);
 	mod->instances = vec_new_reserved(sizeof(struct ap_spawn_instance), 512);
 	return mod;
 }
@@ -3,13 +3,17 @@
 #include "core/log.h"
 #include "core/malloc.h"
 #include "core/string.h"
+#include "core/vector.h"
 
 #include "public/ap_admin.h"
+#include "public/ap_config.h"
 #include "public/ap_module.h"
 #include "public/ap_tick.h"
 
 #include "server/as_database.h"
 #include "server/as_http_server.h"
+#include "server/as_journal.h"
+#include "server/as_storage.h"
 
 #include "vendor/PostgreSQL/openssl/evp.h"
 #include "vendor/pcg/pcg_basic.h"
@@ -17,13 +21,21 @@
 #include <assert.h>
 #include <time.h>
 
-#define STMT_INSERT "INSERT_ACCOUNT"
-#define STMT_SELECT_LIST "SELECT_ACCOUNT_LIST"
-#define STMT_SELECT "SELECT_ACCOUNT"
-#define STMT_UPDATE "UPDATE_ACCOUNT"
-
 #define MAX_USER_DATA_SIZE ((size_t)1u << 14)
 
+#define COMMIT_INTERVAL 300000
+/* Delay before a failed commit is retried. */
+#define COMMIT_RETRY_INTERVAL 5000
+/* Upper bound of accounts commited in a single transaction, 
+ * linked accounts are exempt as they need to be commited 
+ * together. */
+#define MAX_COMMIT_BATCH_SIZE 64
+
+#define JOURNAL_NAME "account"
+#define DEFAULT_JOURNAL_SYNC_INTERVAL 200
+#define DEFAULT_JOURNAL_INTERVAL 5000
+#define DEFAULT_JOURNAL_COMPACT_INTERVAL 300000
+
 struct load_task {
 	struct as_account_module * mod;
 	ap_module_t callback_module;
@@ -41,6 +53,7 @@ struct update_entry {
 	char account_id[AP_LOGIN_MAX_ID_LENGTH + 1];
 	struct as_database_codec * codec;
 	boolean linked;
+	uint32_t journal_sequence;
 	struct update_entry * next;
 };
 
@@ -56,9 +69,35 @@ struct create_task {
 	struct as_database_codec * codec;
 };
 
+struct load_context {
+	struct as_account_module * mod;
+	struct as_account * account;
+};
+
+enum journal_record_type {
+	/* Encoded account data. */
+	JOURNAL_RECORD_STATE,
+	/* Account was commited, state records up to 
+	 * the sequence are older than database state. */
+	JOURNAL_RECORD_COMMIT,
+};
+
+/* Prefixes data of each journal record. */
+struct journal_record_header {
+	uint32_t type;
+	uint32_t sequence;
+};
+
+struct replay_record {
+	uint32_t sequence;
+	void * data;
+	size_t size;
+};
+
 struct as_account_module {
 	struct ap_module_instance instance;
 	struct ap_character_module * ap_character;
+	struct ap_config_module * ap_config;
 	struct ap_tick_module * ap_tick;
 	struct as_character_module * as_character;
 	struct as_database_module * as_database;
@@ -72,6 +111,27 @@ struct as_account_module {
 	struct update_entry * entry_freelist;
 	struct create_entry * create_freelist;
 	struct as_account * create_buffer;
+	struct as_journal * journal;
+	char journal_dir[512];
+	uint32_t journal_sync_interval;
+	uint64_t journal_interval;
+	uint64_t journal_compact_interval;
+	uint64_t last_journal_tick;
+	uint64_t last_compact_tick;
+	/* Last assigned journal record sequence. */
+	uint32_t journal_sequence;
+	void * journal_buffer;
+	size_t journal_buffer_size;
+	/* Dirty accounts with journal records in segments 
+	 * older than this are commited immediately. */
+	uint32_t compact_before;
+	/* Min-heap of cached accounts, ordered by 
+	 * commit deadline. */
+	struct as_account ** commit_queue;
+	/* Accounts that are no longer referenced 
+	 * and need to be commited and unloaded. */
+	struct as_account ** release_queue;
+	struct as_account_commit_stats commit_stats;
 };
 
 static struct load_callback * getcallback(
@@ -122,38 +182,137 @@ static void freeentry(
 	mod->entry_freelist = e;
 }
 
-static boolean create_statements(PGconn * conn)
+static void swap_queued(
+	struct as_account ** queue,
+	uint32_t i,
+	uint32_t j)
 {
-	PGresult * res;
-	res = PQprepare(conn, STMT_INSERT, 
-		"INSERT INTO accounts VALUES ($1,$2);", 2, NULL);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
+	struct as_account * a = queue[i];
+	queue[i] = queue[j];
+	queue[j] = a;
+	queue[i]->commit_queue_index = i;
+	queue[j]->commit_queue_index = j;
+}
+
+static void sift_up(struct as_account ** queue, uint32_t index)
+{
+	while (index) {
+		uint32_t parent = (index - 1) / 2;
+		if (queue[parent]->commit_deadline <= queue[index]->commit_deadline)
+			break;
+		swap_queued(queue, parent, index);
+		index = parent;
 	}
-	PQclear(res);
-	res = PQprepare(conn, STMT_SELECT_LIST, 
-		"SELECT data FROM accounts;", 0, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
+}
+
+static void sift_down(struct as_account ** queue, uint32_t index)
+{
+	uint32_t count = vec_count(queue);
+	for (;;) {
+		uint32_t left = index * 2 + 1;
+		uint32_t right = left + 1;
+		uint32_t min = index;
+		if (left < count && 
+			queue[left]->commit_deadline < queue[min]->commit_deadline) {
+			min = left;
+		}
+		if (right < count && 
+			queue[right]->commit_deadline < queue[min]->commit_deadline) {
+			min = right;
+		}
+		if (min == index)
+			break;
+		swap_queued(queue, min, index);
+		index = min;
 	}
-	PQclear(res);
-	res = PQprepare(conn, STMT_SELECT, 
-		"SELECT data FROM accounts WHERE account_id=$1;", 1, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
+}
+
+/*
+ * Schedules account to be commited at `deadline`, 
+ * replacing its previous deadline.
+ */
+static void schedule_commit(
+	struct as_account_module * mod,
+	struct as_account * account,
+	uint64_t deadline)
+{
+	uint32_t index = account->commit_queue_index;
+	account->commit_deadline = deadline;
+	if (index == AS_ACCOUNT_NOT_SCHEDULED) {
+		index = vec_count(mod->commit_queue);
+		vec_push_back((void **)&mod->commit_queue, &account);
+		account->commit_queue_index = index;
+		sift_up(mod->commit_queue, index);
 	}
-	PQclear(res);
-	res = PQprepare(conn, STMT_UPDATE, 
-		"UPDATE accounts SET data=$2 WHERE account_id=$1;", 2, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
+	else {
+		sift_up(mod->commit_queue, index);
+		sift_down(mod->commit_queue, account->commit_queue_index);
 	}
-	PQclear(res);
-	return TRUE;
+}
+
+static void unschedule_commit(
+	struct as_account_module * mod,
+	struct as_account * account)
+{
+	uint32_t index = account->commit_queue_index;
+	uint32_t last;
+	if (index == AS_ACCOUNT_NOT_SCHEDULED)
+		return;
+	last = vec_count(mod->commit_queue) - 1;
+	if (index != last)
+		swap_queued(mod->commit_queue, index, last);
+	vec_set_count(mod->commit_queue, last);
+	account->commit_queue_index = AS_ACCOUNT_NOT_SCHEDULED;
+	if (index != last) {
+		struct as_account * moved = mod->commit_queue[index];
+		sift_up(mod->commit_queue, index);
+		sift_down(mod->commit_queue, moved->commit_queue_index);
+	}
+}
+
+static struct as_account * pop_due(
+	struct as_account_module * mod,
+	uint64_t tick)
+{
+	struct as_account * account;
+	if (vec_is_empty(mod->commit_queue))
+		return NULL;
+	account = mod->commit_queue[0];
+	if (account->commit_deadline > tick)
+		return NULL;
+	unschedule_commit(mod, account);
+	return account;
+}
+
+static void queue_release(
+	struct as_account_module * mod,
+	struct as_account * account)
+{
+	if (account->release_queued)
+		return;
+	account->release_queued = TRUE;
+	vec_push_back((void **)&mod->release_queue, &account);
+}
+
+/*
+ * Schedules the next commit of an account that 
+ * has just been cached or commited.
+ */
+static void schedule_next_commit(
+	struct as_account_module * mod,
+	struct as_account * account)
+{
+	if (account->commit_linked) {
+		schedule_commit(mod, account, 0);
+	}
+	else if (!mod->journal) {
+		/* When journal is enabled, interval commits are 
+		 * replaced by journal compaction. */
+		schedule_commit(mod, account, 
+			account->last_commit + COMMIT_INTERVAL);
+	}
+	if (!account->refcount)
+		queue_release(mod, account);
 }
 
 static boolean decode_account(
@@ -286,16 +445,6 @@ static struct as_database_codec * encode_account(
 	return NULL;
 }
 
-static boolean cbdatabaseconnect(struct as_account_module * mod, void * data)
-{
-	struct as_database_cb_connect * d = data;
-	if (!create_statements(d->conn)) {
-		ERROR("Failed to create account database statements.");
-		return FALSE;
-	}
-	return TRUE;
-}
-
 static boolean cbhttprequest(
 	struct as_account_module * mod, 
 	struct as_http_server_cb_request * cb)
@@ -370,7 +519,7 @@ static void executecallbacks(
 static boolean task_load(struct as_database_task_data * task)
 {
 	struct load_task * d = task->data;
-	d->account = as_account_load_from_db(d->mod, task->conn, 
+	d->account = as_account_load_from_db(d->mod, task->storage, 
 		d->account_id);
 	return (d->account != NULL);
 }
@@ -414,42 +563,49 @@ static boolean task_update(
 	struct as_database_task_data * task)
 {
 	struct update_task * d = task->data;
-	PGresult * res;
 	struct update_entry * e = d->entries;
-	res = PQexec(task->conn, "BEGIN");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		res = PQexec(task->conn, "ROLLBACK");
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
+	struct as_storage_write * writes;
+	uint32_t count = 0;
+	boolean result;
 	while (e) {
-		const char * values[2] = { e->account_id, e->codec->data };
-		int lengths[2] = { 
-			(int)strlen(e->account_id), 
-			(int)as_database_get_encoded_length(e->codec) };
-		const int formats[2] = { 0, 1 };
-		res = PQexecPrepared(task->conn, STMT_UPDATE, 
-			2, values, lengths, formats, 0);
-		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-			PQclear(res);
-			res = PQexec(task->conn, "ROLLBACK");
-			PQclear(res);
-			return FALSE;
-		}
-		PQclear(res);
+		count++;
 		e = e->next;
 	}
-	res = PQexec(task->conn, "END");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		res = PQexec(task->conn, "ROLLBACK");
-		PQclear(res);
-		return FALSE;
+	writes = alloc(count * sizeof(*writes));
+	memset(writes, 0, count * sizeof(*writes));
+	count = 0;
+	for (e = d->entries; e; e = e->next) {
+		struct as_storage_write * w = &writes[count++];
+		w->operation = AS_STORAGE_UPDATE;
+		w->id = e->account_id;
+		w->data = as_database_get_stored_data(d->mod->as_database, 
+			e->codec, &w->size);
 	}
-	PQclear(res);
-	return TRUE;
+	result = as_storage_write_batch(task->storage, 
+		AS_STORAGE_TABLE_ACCOUNT, writes, count);
+	dealloc(writes);
+	return result;
+}
+
+static uint32_t append_journal_record(
+	struct as_account_module * mod,
+	const char * account_id,
+	enum journal_record_type type,
+	uint32_t sequence,
+	const void * data,
+	size_t size)
+{
+	struct journal_record_header h = { type, sequence };
+	if (sizeof(h) + size > mod->journal_buffer_size) {
+		mod->journal_buffer_size = sizeof(h) + size;
+		mod->journal_buffer = reallocate(mod->journal_buffer, 
+			mod->journal_buffer_size);
+	}
+	memcpy(mod->journal_buffer, &h, sizeof(h));
+	if (size)
+		memcpy((uint8_t *)mod->journal_buffer + sizeof(h), data, size);
+	return as_journal_append(mod->journal, account_id, 
+		mod->journal_buffer, sizeof(h) + size);
 }
 
 static void syncaftersuccess(
@@ -461,9 +617,21 @@ static void syncaftersuccess(
 	uint32_t rc;
 	account->committing = FALSE;
 	account->last_commit = t->tick;
+	if (account->journal_sequence == e->journal_sequence)
+		account->journal_dirty = FALSE;
+	if (mod->journal && 
+		e->journal_sequence > account->journal_committed_sequence) {
+		/* Without a marker, replaying journal would 
+		 * overwrite the commited state with older 
+		 * journaled state. */
+		append_journal_record(mod, account->account_id, 
+			JOURNAL_RECORD_COMMIT, e->journal_sequence, NULL, 0);
+		account->journal_committed_sequence = e->journal_sequence;
+	}
 	assert(account->refcount != 0);
 	rc = account->refcount--;
 	INFO("Updated account (%s).", account->account_id);
+	mod->commit_stats.commit_count++;
 	if (rc <= 1 && account->unloading) {
 		struct as_account ** object = 
 			ap_admin_get_object_by_name(&mod->account_admin, 
@@ -480,19 +648,30 @@ static void syncaftersuccess(
 			assert(0);
 			return;
 		}
+		assert(account->commit_queue_index == AS_ACCOUNT_NOT_SCHEDULED);
+		assert(!account->release_queued);
 		as_account_free(mod, account);
+		return;
 	}
+	account->unloading = FALSE;
+	schedule_next_commit(mod, account);
 }
 
 static void syncafterfail(
+	struct as_account_module * mod,
 	struct as_account * account, 
 	struct update_entry * e)
 {
 	account->committing = FALSE;
 	account->unloading = FALSE;
 	if (e->linked)
-		account->commit_linked;
-	as_account_release(account);
+		account->commit_linked = TRUE;
+	assert(account->refcount != 0);
+	account->refcount--;
+	/* Failed commits are retried after a delay, including 
+	 * accounts that are no longer referenced. */
+	schedule_commit(mod, account, 
+		ap_tick_get(mod->ap_tick) + COMMIT_RETRY_INTERVAL);
 }
 
 static void task_update_post(
@@ -528,7 +707,7 @@ static void task_update_post(
 			struct as_account * account = 
 				getcached(mod, e->account_id);
 			if (account) {
-				syncafterfail(account, e);
+				syncafterfail(mod, account, e);
 			}
 			else {
 				/* Unreachable. We do not completely release 
@@ -541,37 +720,19 @@ static void task_update_post(
 			e = next;
 		}
 	}
+	if (!result)
+		mod->commit_stats.failed_batch_count++;
 	as_database_free_task(mod->as_database, task);
 }
 
 static boolean taskcreate(struct as_database_task_data * task)
 {
 	struct create_task * d = task->data;
-	PGresult * res;
-	const char * values[2] = { d->account_id, d->codec->data };
-	int lengths[2] = { 
-		(int)strlen(d->account_id), 
-		(int)as_database_get_encoded_length(d->codec) };
-	const int formats[2] = { 0, 1 };
-	res = PQexec(task->conn, "BEGIN");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	res = PQexecPrepared(task->conn, STMT_INSERT, 2, values, lengths, formats, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	res = PQexec(task->conn, "END");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	return TRUE;
+	size_t size;
+	const void * data = as_database_get_stored_data(d->mod->as_database, 
+		d->codec, &size);
+	return as_storage_insert(task->storage, AS_STORAGE_TABLE_ACCOUNT, 
+		d->account_id, data, size);
 }
 
 static void taskcreatepost(
@@ -590,79 +751,289 @@ static void taskcreatepost(
 static struct update_entry * process_commit(
 	struct as_account_module * mod,
 	struct update_entry * list,
-	struct as_account * account,
-	uint64_t tick,
-	boolean force)
+	struct as_account * account)
 {
 	struct as_database_codec * codec;
 	struct update_entry * e;
-	uint32_t rc;
-	boolean commit_now;
-	boolean commit_relaxed;
 	struct as_account_cb_pre_commit cb = { account };
 	if (account->committing) {
-		/* We force commits when server is shutting down,
-		 * in which case we will have waited for previous 
-		 * commits to have been completed. */
-		assert(force == FALSE);
+		/* Account is rescheduled when the 
+		 * ongoing commit is completed. */
 		return list;
 	}
-	rc = account->refcount;
-	commit_now = force || account->commit_linked;
-	/* What this translates to is that either commit interval 
-	 * has arrived or account can be released, at the same time 
-	 * commit list should be empty. */
-	commit_relaxed = 
-		(tick >= account->last_commit + 300000 || !rc) && 
-			!list;
-	if (!commit_now && !commit_relaxed)
-		return list;
 	ap_module_enum_callback(mod, AS_ACCOUNT_CB_PRE_COMMIT, &cb);
 	codec = encode_account(mod, account);
 	if (!codec) {
 		ERROR("Failed to encode account (%s).", 
 			account->account_id);
+		schedule_commit(mod, account, 
+			ap_tick_get(mod->ap_tick) + COMMIT_RETRY_INTERVAL);
 		return list;
 	}
+	unschedule_commit(mod, account);
 	e = getentry(mod);
 	strlcpy(e->account_id, account->account_id, 
 		sizeof(e->account_id));
 	e->codec = codec;
 	e->linked = account->commit_linked;
+	e->journal_sequence = account->journal_sequence;
 	e->next = list;
 	account->commit_linked = FALSE;
 	account->committing = TRUE;
-	if (!rc)
+	if (!account->refcount)
 		account->unloading = TRUE;
 	as_account_reference(account);
 	return e;
 }
 
+static void add_update_task(
+	struct as_account_module * mod,
+	struct update_entry * list,
+	uint64_t tick)
+{
+	struct update_task * task = as_database_add_task(mod->as_database, 
+		task_update, task_update_post, sizeof(*task));
+	memset(task, 0, sizeof(*task));
+	task->mod = mod;
+	task->tick = tick;
+	task->entries = list;
+	mod->commit_stats.batch_count++;
+}
+
+static uint64_t hash_data(const void * data, size_t size)
+{
+	const uint8_t * p = data;
+	uint64_t hash = 14695981039346656037ull;
+	size_t i;
+	for (i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/*
+ * Appends account to journal if it was modified 
+ * since it was last journaled.
+ */
+static void journal_account(
+	struct as_account_module * mod,
+	struct as_account * account)
+{
+	struct as_database_codec * codec;
+	size_t length;
+	uint64_t hash;
+	if (!account->refcount)
+		return;
+	codec = encode_account(mod, account);
+	if (!codec) {
+		ERROR("Failed to encode account for journal (%s).", 
+			account->account_id);
+		return;
+	}
+	length = as_database_get_encoded_length(codec);
+	hash = hash_data(codec->data, length);
+	if (hash != account->journal_hash) {
+		account->journal_sequence = ++mod->journal_sequence;
+		account->journal_segment = append_journal_record(mod,
+			account->account_id, JOURNAL_RECORD_STATE, 
+			account->journal_sequence, codec->data, length);
+		account->journal_hash = hash;
+		account->journal_dirty = TRUE;
+	}
+	as_database_free_codec(mod->as_database, codec);
+}
+
+static boolean cbreplay(
+	const char * key,
+	const void * data,
+	size_t size,
+	struct ap_admin * records)
+{
+	struct replay_record * r = 
+		ap_admin_get_object_by_name(records, key);
+	struct journal_record_header h;
+	if (size < sizeof(h)) {
+		ERROR("Invalid account journal record (%s).", key);
+		return FALSE;
+	}
+	memcpy(&h, data, sizeof(h));
+	data = (const uint8_t *)data + sizeof(h);
+	size -= sizeof(h);
+	switch (h.type) {
+	case JOURNAL_RECORD_STATE:
+		if (!r) {
+			r = ap_admin_add_object_by_name(records, key);
+			if (!r)
+				return FALSE;
+			r->data = NULL;
+		}
+		r->sequence = h.sequence;
+		r->data = reallocate(r->data, size);
+		r->size = size;
+		memcpy(r->data, data, size);
+		return TRUE;
+	case JOURNAL_RECORD_COMMIT:
+		/* Records are replayed in append order, state 
+		 * that is journaled after commit is kept. */
+		if (r && r->data && r->sequence <= h.sequence) {
+			dealloc(r->data);
+			r->data = NULL;
+			r->size = 0;
+		}
+		return TRUE;
+	default:
+		ERROR("Invalid account journal record type (%s, %u).", 
+			key, h.type);
+		return FALSE;
+	}
+}
+
+/*
+ * Applies latest journaled state of each account to 
+ * database and removes journal segments.
+ */
+static boolean replay_journal(
+	struct as_account_module * mod,
+	struct as_storage * storage)
+{
+	struct ap_admin records;
+	size_t index = 0;
+	struct replay_record * r = NULL;
+	const char * account_id;
+	boolean result = TRUE;
+	struct as_storage_write * writes;
+	uint32_t count;
+	uint32_t i = 0;
+	ap_admin_init(&records, sizeof(struct replay_record), 128);
+	if (!as_journal_replay(mod->journal_dir, JOURNAL_NAME, cbreplay, 
+			&records)) {
+		ERROR("Failed to read account journal.");
+		ap_admin_destroy(&records);
+		return FALSE;
+	}
+	count = 0;
+	while (ap_admin_iterate_name(&records, &index, (void **)&r)) {
+		if (r->data)
+			count++;
+	}
+	if (!count) {
+		index = 0;
+		while (ap_admin_iterate_name(&records, &index, (void **)&r))
+			dealloc(r->data);
+		ap_admin_destroy(&records);
+		return as_journal_clear(mod->journal_dir, JOURNAL_NAME);
+	}
+	writes = alloc(count * sizeof(*writes));
+	memset(writes, 0, count * sizeof(*writes));
+	index = 0;
+	while ((account_id = ap_admin_iterate_name(&records, 
+			&index, (void **)&r)) != NULL) {
+		struct as_storage_write * w;
+		/* Database already holds a newer state. */
+		if (!r->data)
+			continue;
+		w = &writes[i++];
+		w->operation = AS_STORAGE_UPDATE;
+		w->id = account_id;
+		w->data = r->data;
+		w->size = r->size;
+	}
+	result = as_storage_write_batch(storage, AS_STORAGE_TABLE_ACCOUNT, 
+		writes, count);
+	if (result) {
+		for (i = 0; i < count; i++) {
+			if (!writes[i].applied) {
+				WARN("Journaled account does not exist in database (%s).", 
+					writes[i].id);
+			}
+		}
+		INFO("Replayed %u journaled accounts.", count);
+	}
+	else {
+		ERROR("Failed to apply journaled accounts.");
+	}
+	dealloc(writes);
+	index = 0;
+	while (ap_admin_iterate_name(&records, &index, (void **)&r))
+		dealloc(r->data);
+	ap_admin_destroy(&records);
+	if (!result)
+		return FALSE;
+	return as_journal_clear(mod->journal_dir, JOURNAL_NAME);
+}
+
 static boolean onregister(
 	struct as_account_module * mod,
 	struct ap_module_registry * registry)
 {
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_character, AP_CHARACTER_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_config, AP_CONFIG_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_tick, AP_TICK_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_character, AS_CHARACTER_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_database, AS_DATABASE_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_http_server, AS_HTTP_SERVER_MODULE_NAME);
-	as_database_add_callback(mod->as_database, AS_DATABASE_CB_CONNECT, mod, cbdatabaseconnect);
 	as_http_server_add_callback(mod->as_http_server, AS_HTTP_SERVER_CB_REQUEST, mod, cbhttprequest);
 	return TRUE;
 }
 
+static uint64_t get_config_u64(
+	struct as_account_module * mod,
+	const char * key,
+	uint64_t default_value)
+{
+	const char * value = ap_config_get(mod->ap_config, key);
+	if (!value)
+		return default_value;
+	return strtoull(value, NULL, 10);
+}
+
 static boolean oninitialize(struct as_account_module * mod)
 {
+	const char * dir = ap_config_get(mod->ap_config, "AccountJournalDir");
 	mod->create_buffer = as_account_new(mod);
+	if (dir)
+		strlcpy(mod->journal_dir, dir, sizeof(mod->journal_dir));
+	mod->journal_sync_interval = (uint32_t)get_config_u64(mod, 
+		"AccountJournalSyncInterval", DEFAULT_JOURNAL_SYNC_INTERVAL);
+	mod->journal_interval = get_config_u64(mod, 
+		"AccountJournalInterval", DEFAULT_JOURNAL_INTERVAL);
+	mod->journal_compact_interval = get_config_u64(mod, 
+		"AccountJournalCompactInterval", 
+		DEFAULT_JOURNAL_COMPACT_INTERVAL);
 	return TRUE;
 }
 
 static void onclose(struct as_account_module * mod)
 {
 	as_account_commit(mod, TRUE);
+	INFO("Account commits: %llu accounts in %llu batches, %llu failed batches.",
+		(unsigned long long)mod->commit_stats.commit_count,
+		(unsigned long long)mod->commit_stats.batch_count,
+		(unsigned long long)mod->commit_stats.failed_batch_count);
 	as_account_free(mod, mod->create_buffer);
 	mod->create_buffer = NULL;
+	if (mod->journal) {
+		size_t index = 0;
+		struct as_account ** object = NULL;
+		boolean dirty = FALSE;
+		as_journal_close(mod->journal);
+		mod->journal = NULL;
+		dealloc(mod->journal_buffer);
+		mod->journal_buffer = NULL;
+		mod->journal_buffer_size = 0;
+		while (ap_admin_iterate_name(&mod->account_admin, &index, 
+				(void **)&object)) {
+			if ((*object)->journal_dirty) {
+				dirty = TRUE;
+				break;
+			}
+		}
+		/* Journal is only needed if some accounts 
+		 * could not be commited. */
+		if (!dirty)
+			as_journal_clear(mod->journal_dir, JOURNAL_NAME);
+	}
 }
 
 static void onshutdown(struct as_account_module * mod)
@@ -686,6 +1057,8 @@ static void onshutdown(struct as_account_module * mod)
 	ap_admin_destroy(&mod->load_admin);
 	ap_admin_destroy(&mod->account_admin);
 	ap_admin_destroy(&mod->account_id_admin);
+	vec_free(mod->commit_queue);
+	vec_free(mod->release_queue);
 }
 
 struct as_account_module * as_account_create_module()
@@ -697,6 +1070,8 @@ struct as_account_module * as_account_create_module()
 	ap_admin_init(&mod->account_admin, sizeof(struct as_account *), 1024);
 	ap_admin_init(&mod->account_id_admin, sizeof(boolean), 1024);
 	ap_admin_init(&mod->load_admin, sizeof(struct load_callback *), 16);
+	mod->commit_queue = vec_new_reserved(sizeof(*mod->commit_queue), 1024);
+	mod->release_queue = vec_new_reserved(sizeof(*mod->release_queue), 128);
 	return mod;
 }
 
@@ -704,6 +1079,7 @@ struct as_account * as_account_new(struct as_account_module * mod)
 {
 	struct as_account * account = ap_module_create_module_data(mod, 
 		AS_ACCOUNT_MDI_ACCOUNT);
+	account->commit_queue_index = AS_ACCOUNT_NOT_SCHEDULED;
 	return account;
 }
 
@@ -781,87 +1157,80 @@ boolean as_account_set_database_stream(
 	return TRUE;
 }
 
-boolean as_account_preprocess(struct as_account_module * mod)
+static boolean cbpreprocess(
+	const void * data,
+	size_t size,
+	void * user_data)
 {
-	PGresult * res;
-	time_t ct;
-	int row_count;
-	int i;
-	PGconn * conn = as_database_get_conn(mod->as_database);
-	if (!conn) {
-		ERROR("Failed to retrieve database connection.");
-		return FALSE;
-	}
-	res = PQexec(conn, "BEGIN");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
+	struct as_account_module * mod = user_data;
+	struct as_account * account = as_account_new(mod);
+	uint32_t i;
+	if (!decode_account(mod, account, data, size)) {
+		ERROR("Failed to decode account.");
+		as_account_free(mod, account);
 		return FALSE;
 	}
-	PQclear(res);
-	res = PQexecPrepared(conn, STMT_SELECT_LIST, 0, 0, 0, 0, 1);
-	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-		PQclear(res);
+	INFO("Preprocessing account (%s).", account->account_id);
+	if (!as_account_cache_id(mod, account->account_id)) {
+		ERROR("Failed to cache account id (%s).", 
+			account->account_id);
+		as_account_free(mod, account);
 		return FALSE;
 	}
-	ct = time(0);
-	row_count = PQntuples(res);
-	for (i = 0; i < row_count; i++) {
-		struct as_account * account = as_account_new(mod);
-		void * data = PQgetvalue(res, i, 0);
-		int len = PQgetlength(res, i, 0);
-		uint32_t j;
-		if (!data || 
-			len <= 0 || 
-			!decode_account(mod, account, data, (size_t)len)) {
-			ERROR("Failed to decode account.");
+	for (i = 0; i < account->character_count; i++) {
+		struct as_character_db * c = account->characters[i];
+		struct as_account_cb_preprocess_char cb = {
+			account, c };
+		if (!as_character_reserve_name(mod->as_character, c->name, 
+				account->account_id)) {
+			ERROR("Failed to reserve character name (%s).",
+				c->name);
 			as_account_free(mod, account);
 			return FALSE;
 		}
-		INFO("Preprocessing account (%s).", account->account_id);
-		if (!as_account_cache_id(mod, account->account_id)) {
-			ERROR("Failed to cache account id (%s).", 
-				account->account_id);
-			PQclear(res);
+		if (!ap_character_get_template(mod->ap_character, c->tid)) {
+			ERROR("Character with invalid tid (name = %s, tid = %u).",
+				c->name, c->tid);
 			as_account_free(mod, account);
 			return FALSE;
 		}
-		for (j = 0; j < account->character_count; j++) {
-			struct as_character_db * c = account->characters[j];
-			struct as_account_cb_preprocess_char cb = {
-				account, c };
-			if (!as_character_reserve_name(mod->as_character, c->name, 
-					account->account_id)) {
-				ERROR("Failed to reserve character name (%s).",
-					c->name);
-				PQclear(res);
-				as_account_free(mod, account);
-				return FALSE;
-			}
-			if (!ap_character_get_template(mod->ap_character, c->tid)) {
-				ERROR("Character with invalid tid (name = %s, tid = %u).",
-					c->name, c->tid);
-				PQclear(res);
-				as_account_free(mod, account);
-				return FALSE;
-			}
-			if (!ap_module_enum_callback(mod, AS_ACCOUNT_CB_PREPROCESS_CHARACTER, 
-					&cb)) {
-				ERROR("Failed to preprocess database character (name = %s).",
-					c->name);
-				PQclear(res);
-				as_account_free(mod, account);
-				return FALSE;
-			}
+		if (!ap_module_enum_callback(mod, AS_ACCOUNT_CB_PREPROCESS_CHARACTER, 
+				&cb)) {
+			ERROR("Failed to preprocess database character (name = %s).",
+				c->name);
+			as_account_free(mod, account);
+			return FALSE;
 		}
-		as_account_free(mod, account);
 	}
-	PQclear(res);
-	res = PQexec(conn, "END");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
+	as_account_free(mod, account);
+	return TRUE;
+}
+
+boolean as_account_preprocess(struct as_account_module * mod)
+{
+	struct as_storage * storage = as_database_get_storage(mod->as_database);
+	if (!storage) {
+		ERROR("Failed to retrieve database storage.");
+		return FALSE;
+	}
+	if (mod->journal_dir[0]) {
+		if (!replay_journal(mod, storage)) {
+			ERROR("Failed to replay account journal.");
+			return FALSE;
+		}
+		mod->journal = as_journal_open(mod->journal_dir, JOURNAL_NAME, 
+			mod->journal_sync_interval);
+		if (!mod->journal) {
+			ERROR("Failed to open account journal.");
+			return FALSE;
+		}
+		mod->last_journal_tick = ap_tick_get(mod->ap_tick);
+		mod->last_compact_tick = mod->last_journal_tick;
+	}
+	if (!as_storage_load_list(storage, AS_STORAGE_TABLE_ACCOUNT, 
+			cbpreprocess, mod)) {
 		return FALSE;
 	}
-	PQclear(res);
 	if (!ap_module_enum_callback(mod, AS_ACCOUNT_CB_PREPROCESS_COMPLETE, NULL)) {
 		ERROR("Account complete preprocess callback failed.");
 		return FALSE;
@@ -869,40 +1238,33 @@ boolean as_account_preprocess(struct as_account_module * mod)
 	return TRUE;
 }
 
+static boolean cbload(
+	const void * data,
+	size_t size,
+	void * user_data)
+{
+	struct load_context * context = user_data;
+	context->account = as_account_new(context->mod);
+	if (!decode_account(context->mod, context->account, data, size)) {
+		as_account_free(context->mod, context->account);
+		context->account = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
 struct as_account * as_account_load_from_db(
 	struct as_account_module * mod,
-	PGconn * conn, 
+	struct as_storage * storage, 
 	const char * account_id)
 {
-	PGresult * res;
-	const char * values[1] = { account_id };
-	const int lengths[1] = { (int)strlen(account_id) };
-	const int formats[1] = { 0 };
-	void * data = 0;
-	struct as_account * account = NULL;
-	int len;
-	res = PQexecPrepared(conn, STMT_SELECT, 
-		1, values, lengths, formats, 1);
-	if (PQresultStatus(res) != PGRES_TUPLES_OK || 
-		PQntuples(res) != 1) {
-		PQclear(res);
+	struct load_context context = { mod, NULL };
+	if (!as_storage_load(storage, AS_STORAGE_TABLE_ACCOUNT, account_id, 
+			cbload, &context)) {
 		return NULL;
 	}
-	data = (void *)PQgetvalue(res, 0, 0);
-	len = PQgetlength(res, 0, 0);
-	if (!data || len <= 0) {
-		PQclear(res);
-		return NULL;
-	}
-	account = as_account_new(mod);
-	if (!decode_account(mod, account, data, (size_t)len)) {
-		PQclear(res);
-		dealloc(account);
-		return NULL;
-	}
-	PQclear(res);
-	account->refcount = 0;
-	return account;
+	context.account->refcount = 0;
+	return context.account;
 }
 
 struct as_account * as_account_load_from_cache(
@@ -985,49 +1347,22 @@ boolean as_account_hash_password(
 
 boolean as_account_create_in_db(
 	struct as_account_module * mod,
-	PGconn  * conn,
+	struct as_storage * storage,
 	struct as_account * account)
 {
 	struct as_database_codec * codec = encode_account(mod, account);
-	PGresult * res;
-	const char * values[2] = { account->account_id, NULL };
-	int lengths[2] = { (int)strlen(account->account_id), 0 };
-	const int formats[2] = { 0, 1 };
+	const void * data;
+	size_t size;
+	boolean result;
 	if (!codec) {
 		ERROR("Failed to encode account.");
 		return FALSE;
 	}
-	res = PQexec(conn, "BEGIN");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		res = PQexec(conn, "ROLLBACK");
-		PQclear(res);
-		as_database_free_codec(mod->as_database, codec);
-		return FALSE;
-	}
-	PQclear(res);
-	values[1] = (const char *)codec->data;
-	lengths[1] = (int)as_database_get_encoded_length(codec);
-	res = PQexecPrepared(conn, STMT_INSERT, 
-		2, values, lengths, formats, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		res = PQexec(conn, "ROLLBACK");
-		PQclear(res);
-		as_database_free_codec(mod->as_database, codec);
-		return FALSE;
-	}
-	PQclear(res);
+	data = as_database_get_stored_data(mod->as_database, codec, &size);
+	result = as_storage_insert(storage, AS_STORAGE_TABLE_ACCOUNT, 
+		account->account_id, data, size);
 	as_database_free_codec(mod->as_database, codec);
-	res = PQexec(conn, "END");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		res = PQexec(conn, "ROLLBACK");
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	return TRUE;
+	return result;
 }
 
 enum as_account_create_result as_account_create_deferred(
@@ -1069,7 +1404,12 @@ boolean as_account_cache(
 	assert(account->refcount == 0);
 	if (reference)
 		account->refcount = 1;
+	/* Loaded state supersedes every journal record 
+	 * of previous instances of the account. */
+	account->journal_sequence = mod->journal_sequence;
+	account->journal_committed_sequence = mod->journal_sequence;
 	*object = account;
+	schedule_next_commit(mod, account);
 	return TRUE;
 }
 
@@ -1105,38 +1445,165 @@ struct as_account * as_account_copy_detached(
 	return copy;
 }
 
-void as_account_release(struct as_account * account)
+void as_account_release(
+	struct as_account_module * mod,
+	struct as_account * account)
 {
 	assert(account->refcount != 0);
-	account->refcount--;
+	if (!--account->refcount)
+		queue_release(mod, account);
 }
 
-void as_account_commit(struct as_account_module * mod, boolean force)
+void as_account_link_commit(
+	struct as_account_module * mod,
+	struct as_account * account)
+{
+	account->commit_linked = TRUE;
+	if (!account->committing)
+		schedule_commit(mod, account, 0);
+}
+
+static void commit_all(struct as_account_module * mod, uint64_t tick)
 {
 	size_t index = 0;
 	struct as_account ** object = NULL;
-	uint64_t tick = ap_tick_get(mod->ap_tick);
 	struct update_entry * list = NULL;
-	if (force) {
+	uint32_t i;
+	uint32_t count;
+	/* We force commits when server is shutting down,
+	 * wait for previous commits to be completed. */
+	as_database_process(mod->as_database);
+	task_wait_all();
+	/* Every cached account is commited below, including
+	 * released ones, so release queue is no longer needed
+	 * and must not refer to accounts that are unloaded. */
+	count = vec_count(mod->release_queue);
+	for (i = 0; i < count; i++)
+		mod->release_queue[i]->release_queued = FALSE;
+	vec_clear(mod->release_queue);
+	while (ap_admin_iterate_name(&mod->account_admin, &index, 
+			(void **)&object)) {
+		list = process_commit(mod, list, *object);
+	}
+	if (list) {
+		add_update_task(mod, list, tick);
 		as_database_process(mod->as_database);
 		task_wait_all();
 	}
+}
+
+/*
+ * Journals every referenced account and schedules 
+ * dirty accounts with records in sealed segments 
+ * to be commited immediately.
+ */
+static void journal_accounts(struct as_account_module * mod, uint64_t tick)
+{
+	size_t index = 0;
+	struct as_account ** object = NULL;
+	uint32_t oldest_dirty_segment = UINT32_MAX;
 	while (ap_admin_iterate_name(&mod->account_admin, &index, 
 			(void **)&object)) {
 		struct as_account * account = *object;
-		list = process_commit(mod, list, account, tick, force);
+		journal_account(mod, account);
+		if (!account->journal_dirty)
+			continue;
+		if (account->journal_segment < oldest_dirty_segment)
+			oldest_dirty_segment = account->journal_segment;
+		if (account->journal_segment < mod->compact_before &&
+			!account->committing) {
+			schedule_commit(mod, account, tick);
+		}
 	}
-	if (list) {
-		struct update_task * task;
-		task = as_database_add_task(mod->as_database, task_update, 
-			task_update_post, sizeof(*task));
-		memset(task, 0, sizeof(*task));
-		task->mod = mod;
-		task->tick = tick;
-		task->entries = list;
-		if (force) {
-			as_database_process(mod->as_database);
-			task_wait_all();
+	/* Segments that do not hold any record that is 
+	 * newer than database state can be removed. */
+	if (oldest_dirty_segment == UINT32_MAX)
+		oldest_dirty_segment = as_journal_get_segment(mod->journal);
+	as_journal_release_segments(mod->journal, oldest_dirty_segment);
+}
+
+void as_account_commit(struct as_account_module * mod, boolean force)
+{
+	uint64_t tick = ap_tick_get(mod->ap_tick);
+	struct update_entry * linked = NULL;
+	struct update_entry * list = NULL;
+	struct update_entry * next;
+	struct as_account * account;
+	uint32_t batch_size = 0;
+	uint32_t due_count = 0;
+	uint32_t i;
+	uint32_t count;
+	if (force) {
+		commit_all(mod, tick);
+		return;
+	}
+	if (mod->journal) {
+		boolean journal = FALSE;
+		uint32_t sealed;
+		if (tick >= mod->last_compact_tick + mod->journal_compact_interval &&
+			as_journal_rotate(mod->journal, &sealed)) {
+			mod->last_compact_tick = tick;
+			mod->compact_before = sealed + 1;
+			journal = TRUE;
+		}
+		if (tick >= mod->last_journal_tick + mod->journal_interval)
+			journal = TRUE;
+		if (journal) {
+			mod->last_journal_tick = tick;
+			journal_accounts(mod, tick);
+		}
+	}
+	while ((account = pop_due(mod, tick)) != NULL) {
+		due_count++;
+		if (account->commit_linked) {
+			/* Linked accounts are commited in a single 
+			 * transaction regardless of batch size. */
+			linked = process_commit(mod, linked, account);
+			continue;
+		}
+		next = process_commit(mod, list, account);
+		/* Skipped accounts are not added to the batch. */
+		if (next == list)
+			continue;
+		list = next;
+		if (++batch_size >= MAX_COMMIT_BATCH_SIZE) {
+			add_update_task(mod, list, tick);
+			list = NULL;
+			batch_size = 0;
+		}
+	}
+	count = vec_count(mod->release_queue);
+	for (i = 0; i < count; i++) {
+		account = mod->release_queue[i];
+		account->release_queued = FALSE;
+		if (account->refcount || account->committing)
+			continue;
+		due_count++;
+		next = process_commit(mod, list, account);
+		/* Skipped accounts are not added to the batch. */
+		if (next == list)
+			continue;
+		list = next;
+		if (++batch_size >= MAX_COMMIT_BATCH_SIZE) {
+			add_update_task(mod, list, tick);
+			list = NULL;
+			batch_size = 0;
 		}
 	}
+	vec_clear(mod->release_queue);
+	if (linked)
+		add_update_task(mod, linked, tick);
+	if (list)
+		add_update_task(mod, list, tick);
+	if (due_count)
+		mod->commit_stats.last_due_count = due_count;
+}
+
+void as_account_get_commit_stats(
+	struct as_account_module * mod,
+	struct as_account_commit_stats * stats)
+{
+	*stats = mod->commit_stats;
+	stats->scheduled_count = vec_count(mod->commit_queue);
+	stats->release_queue_depth = vec_count(mod->release_queue);
 }
@@ -17,6 +17,8 @@
 
 #define AS_ACCOUNT_HASH_ITERATION 1173
 
+#define AS_ACCOUNT_NOT_SCHEDULED UINT32_MAX
+
 BEGIN_DECLS
 
 struct as_account;
@@ -91,6 +93,42 @@ struct as_account {
 	boolean committing;
 	boolean unloading;
 	uint32_t refcount;
+	/** Hash of the last journaled account data. */
+	uint64_t journal_hash;
+	/** Journal segment that holds the latest record. */
+	uint32_t journal_segment;
+	/** 
+	 * Sequence of the latest journal record, sequences 
+	 * are assigned in append order across all accounts. */
+	uint32_t journal_sequence;
+	/** 
+	 * Journal records up to this sequence are known to 
+	 * be older than database state. */
+	uint32_t journal_committed_sequence;
+	/** 
+	 * Account has journaled changes that are not yet 
+	 * commited to database. */
+	boolean journal_dirty;
+	/** Tick at which account is due to be commited. */
+	uint64_t commit_deadline;
+	/** 
+	 * Index of account in commit queue, 
+	 * AS_ACCOUNT_NOT_SCHEDULED if it is not scheduled. */
+	uint32_t commit_queue_index;
+	/** Account is in release queue. */
+	boolean release_queued;
+};
+
+struct as_account_commit_stats {
+	/** Number of accounts waiting for their commit deadline. */
+	uint32_t scheduled_count;
+	/** Number of released accounts waiting to be unloaded. */
+	uint32_t release_queue_depth;
+	/** Number of accounts that were due in the last commit. */
+	uint32_t last_due_count;
+	uint64_t commit_count;
+	uint64_t batch_count;
+	uint64_t failed_batch_count;
 };
 
 /** \brief AS_ACCOUNT_CB_PREPROCESS_CHARACTER callback data. */
@@ -172,7 +210,7 @@ boolean as_account_preprocess(struct as_account_module * mod);
 
 struct as_account * as_account_load_from_db(
 	struct as_account_module * mod,
-	PGconn * conn, 
+	struct as_storage * storage, 
 	const char * account_id);
 
 struct as_account * as_account_load_from_cache(
@@ -205,7 +243,7 @@ boolean as_account_hash_password(
  */
 boolean as_account_create_in_db(
 	struct as_account_module * mod,
-	PGconn * conn,
+	struct as_storage * storage,
 	struct as_account * account);
 
 enum as_account_create_result as_account_create_deferred(
@@ -248,11 +286,38 @@ struct as_account * as_account_copy_detached(
 
 /**
  * Release cached account.
+ *
+ * Accounts that are no longer referenced are 
+ * commited and unloaded in the next commit.
  */
-void as_account_release(struct as_account * account);
+void as_account_release(
+	struct as_account_module * mod,
+	struct as_account * account);
 
+/**
+ * Commit account in the same transaction as other 
+ * linked accounts, as soon as possible.
+ *
+ * See `commit_linked`.
+ */
+void as_account_link_commit(
+	struct as_account_module * mod,
+	struct as_account * account);
+
+/**
+ * Commit accounts that are due.
+ *
+ * Each call only visits accounts whose commit deadline 
+ * has passed and accounts that were released. 
+ * If `force` is TRUE, every cached account is commited 
+ * and the call blocks until commits are completed.
+ */
 void as_account_commit(struct as_account_module * mod, boolean force);
 
+void as_account_get_commit_stats(
+	struct as_account_module * mod,
+	struct as_account_commit_stats * stats);
+
 END_DECLS
 
 #endif /* _AS_ACCOUNT_H_ */
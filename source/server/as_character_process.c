@@ -384,7 +384,6 @@ static void processchar(
 	float dt)
 {
 	struct as_character * sc = as_character_get(mod->as_character, c);
-	uint32_t i;
 	if (tick >= c->action_end_tick && 
 		c->action_status == AP_CHARACTER_ACTION_STATUS_NORMAL) {
 		if (sc->move_input.not_processed)
@@ -398,13 +397,7 @@ static void processchar(
 	ap_character_process(mod->ap_character, c, tick, dt);
 	if (c->char_type & AGPMCHARACTER_TYPE_MONSTER)
 		processmonster(mod, c, tick, dt);
-	for (i = 0; i < 64; i++) {
-		if ((c->special_status & (1ull << i)) &&
-			c->special_status_end_tick[i] &&
-			tick >= c->special_status_end_tick[i]) {
-			ap_character_special_status_off(mod->ap_character, c, 1ull << i);
-		}
-	}
+	ap_character_expire_special_statuses(mod->ap_character, c, tick);
 }
 
 static boolean cbreceive(
@@ -1,30 +1,60 @@
 #include <assert.h>
+#include <stdlib.h>
 
 #include "core/log.h"
 #include "core/malloc.h"
 #include "core/os.h"
+#include "core/string.h"
 #include "core/vector.h"
 
 #include "public/ap_config.h"
 
 #include "server/as_database.h"
 
+#include "utility/au_lz4.h"
+
 #define CODEC_SIZE ((size_t)1u << 24)
 #define TASK_BUFFER_SIZE ((size_t)1u << 20)
 
+/* Unframed data starts with the encoded id of its
+ * first field. Module database ids are far below 0xDBF0,
+ * so frame magic cannot be mistaken for legacy data. */
+#define FRAME_MAGIC 0xDBF05A4Cu
+#define FRAME_VERSION 1
+/* Blobs smaller than this are never compressed. */
+#define MIN_COMPRESS_SIZE 128
+
+struct frame_header {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t compression;
+	uint16_t reserved;
+	uint32_t encoded_length;
+};
+
 struct as_database_module {
 	struct ap_module_instance instance;
 	struct ap_config_module * ap_config;
 	boolean is_blocking;
-	PGconn * conn;
+	struct as_storage * storage;
 	struct task_descriptor * free_tasklist;
 	struct task_descriptor * task_queue;
 	uint32_t active_task_count;
 	struct as_database_codec * free_codecs;
 	struct as_database_codec * free_codecs_thread;
 	uint64_t main_thread_id;
+	enum as_database_compression compression;
+	/* Shared timer, only read with `timer_delta_no_reset`. */
+	timer_t timer;
+	mutex_t stats_mutex;
+	struct as_database_codec_stats stats;
+	struct as_database_task_stats task_stats;
 };
 
+static const char * COMPRESSION_NAMES[AS_DATABASE_COMPRESSION_COUNT] = {
+	"none",
+	"lz4" };
+
 static struct as_database_codec * getcodec(struct as_database_module * mod)
 {
 	uint64_t threadid = get_current_thread_id();
@@ -56,15 +86,49 @@ static boolean onregister(
 	return TRUE;
 }
 
+static boolean oninitialize(struct as_database_module * mod)
+{
+	const char * compression = ap_config_get(mod->ap_config, "DBCompression");
+	uint32_t i;
+	mod->compression = AS_DATABASE_COMPRESSION_NONE;
+	if (!compression)
+		return TRUE;
+	for (i = 0; i < AS_DATABASE_COMPRESSION_COUNT; i++) {
+		if (strcasecmp(compression, COMPRESSION_NAMES[i]) == 0) {
+			mod->compression = i;
+			INFO("Database compression: %s.", COMPRESSION_NAMES[i]);
+			return TRUE;
+		}
+	}
+	ERROR("Invalid database compression (%s).", compression);
+	return FALSE;
+}
+
+static void freecodec(struct as_database_codec * codec)
+{
+	if (codec->stored)
+		dealloc(codec->stored);
+	dealloc(codec);
+}
+
 static void onshutdown(struct as_database_module * mod)
 {
 	struct task_descriptor * task;
 	struct as_database_codec * codec;
 	if (!mod)
 		return;
-	if (mod->conn) {
-		PQfinish(mod->conn);
-		mod->conn = NULL;
+	if (mod->stats.stored_count) {
+		INFO("Database codec: %llu blobs, %llu bytes encoded, %llu bytes stored (%.1f%%), %llu us compressing.",
+			(unsigned long long)mod->stats.stored_count,
+			(unsigned long long)mod->stats.encoded_bytes,
+			(unsigned long long)mod->stats.stored_bytes,
+			100.0 * (double)mod->stats.stored_bytes /
+				(double)mod->stats.encoded_bytes,
+			(unsigned long long)mod->stats.compress_time);
+	}
+	if (mod->storage) {
+		as_storage_destroy(mod->storage);
+		mod->storage = NULL;
 	}
 	task = mod->task_queue;
 	while (task) {
@@ -81,43 +145,72 @@ static void onshutdown(struct as_database_module * mod)
 	codec = mod->free_codecs;
 	while (codec) {
 		struct as_database_codec * next = codec->next;
-		dealloc(codec);
+		freecodec(codec);
 		codec = next;
 	}
 	codec = mod->free_codecs_thread;
 	while (codec) {
 		struct as_database_codec * next = codec->next;
-		dealloc(codec);
+		freecodec(codec);
 		codec = next;
 	}
+	if (mod->stats_mutex) {
+		destroy_mutex(mod->stats_mutex);
+		mod->stats_mutex = NULL;
+	}
 }
 
 struct as_database_module * as_database_create_module()
 {
 	struct as_database_module * mod = ap_module_instance_new(AS_DATABASE_MODULE_NAME,
-		sizeof(*mod), onregister, NULL, NULL, onshutdown);
+		sizeof(*mod), onregister, oninitialize, NULL, onshutdown);
 	mod->is_blocking = TRUE;
 	mod->main_thread_id = get_current_thread_id();
+	mod->timer = create_timer();
+	mod->stats_mutex = create_mutex();
 	return mod;
 }
 
-boolean as_database_connect(struct as_database_module * mod)
+static struct as_storage * create_postgresql_storage(
+	struct as_database_module * mod)
 {
 	char conn_info[256];
-	struct as_database_cb_connect cb = { 0 };
 	const char * db = ap_config_get(mod->ap_config, "DBName");
 	const char * user = ap_config_get(mod->ap_config, "DBUser");
 	const char * pwd = ap_config_get(mod->ap_config, "DBPassword");
 	if (!db || !user || !pwd) {
 		ERROR("Failed to retrieve database configuration.");
-		return FALSE;
+		return NULL;
 	}
 	snprintf(conn_info, sizeof(conn_info), 
 		"dbname=%s user=%s password=%s", db, user, pwd);
-	mod->conn = PQconnectdb(conn_info);
-	if (PQstatus(mod->conn) != CONNECTION_OK)
+	return as_storage_create_postgresql(conn_info);
+}
+
+boolean as_database_connect(struct as_database_module * mod)
+{
+	struct as_database_cb_connect cb = { 0 };
+	const char * backend = ap_config_get(mod->ap_config, "DBBackend");
+	const char * latency = ap_config_get(mod->ap_config, "DBLatency");
+	if (!backend || strcasecmp(backend, "postgresql") == 0) {
+		mod->storage = create_postgresql_storage(mod);
+	}
+	else if (strcasecmp(backend, "memory") == 0) {
+		mod->storage = as_storage_create_memory(
+			ap_config_get(mod->ap_config, "DBMemoryFile"));
+	}
+	else {
+		ERROR("Invalid database backend (%s).", backend);
+		return FALSE;
+	}
+	if (!mod->storage)
 		return FALSE;
-	cb.conn = mod->conn;
+	if (latency)
+		as_storage_set_latency(mod->storage, strtoul(latency, NULL, 10));
+	INFO("Database backend: %s (latency = %u ms).", 
+		as_storage_get_backend_name(mod->storage),
+		mod->storage->latency);
+	cb.storage = mod->storage;
 	return ap_module_enum_callback(mod, AS_DATABASE_CB_CONNECT, &cb);
 }
 
@@ -126,14 +219,14 @@ void as_database_set_blocking(struct as_database_module * mod, boolean is_blocki
 	mod->is_blocking = is_blocking;
 }
 
-PGconn * as_database_get_conn(struct as_database_module * mod)
+struct as_storage * as_database_get_storage(struct as_database_module * mod)
 {
 	if (!mod->is_blocking) {
-		ERROR("Database connection can only be accessed by tasks in non-blocking mode.");
+		ERROR("Database storage can only be accessed by tasks in non-blocking mode.");
 		assert(0);
 		return NULL;
 	}
-	return mod->conn;
+	return mod->storage;
 }
 
 void as_database_add_callback(
@@ -172,8 +265,9 @@ void * as_database_add_task(
 		task->data = (void *)((uintptr_t)task + sizeof(*task));
 	}
 	tdata = task->data;
-	tdata->conn = mod->conn;
+	tdata->storage = mod->storage;
 	tdata->data = (void *)((uintptr_t)tdata + sizeof(*tdata));
+	tdata->add_time = timer_delta_no_reset(mod->timer);
 	task->work_cb = work_cb;
 	task->post_cb = post_cb;
 	task->next = NULL;
@@ -191,7 +285,13 @@ void * as_database_add_task(
 
 void as_database_free_task(struct as_database_module * mod, struct task_descriptor * task)
 {
+	const struct as_database_task_data * tdata = task->data;
+	uint64_t latency = timer_delta_no_reset(mod->timer) - tdata->add_time;
 	assert(mod->active_task_count > 0);
+	mod->task_stats.completed_count++;
+	mod->task_stats.total_latency += latency;
+	if (latency > mod->task_stats.max_latency)
+		mod->task_stats.max_latency = latency;
 	task->next = mod->free_tasklist;
 	mod->free_tasklist = task->next;
 	mod->active_task_count--;
@@ -277,22 +377,133 @@ size_t as_database_get_encoded_length(
 		(uintptr_t)codec->data);
 }
 
+const void * as_database_get_stored_data(
+	struct as_database_module * mod,
+	struct as_database_codec * codec,
+	size_t * size)
+{
+	size_t length = as_database_get_encoded_length(codec);
+	size_t bound;
+	size_t compressed;
+	struct frame_header header = { 0 };
+	uint64_t begin;
+	uint64_t elapsed;
+	if (mod->compression == AS_DATABASE_COMPRESSION_NONE ||
+		length < MIN_COMPRESS_SIZE) {
+		*size = length;
+		return codec->data;
+	}
+	bound = sizeof(header) + au_lz4_compress_bound(length);
+	if (codec->stored_capacity < bound) {
+		codec->stored = reallocate(codec->stored, bound);
+		codec->stored_capacity = bound;
+	}
+	begin = timer_delta_no_reset(mod->timer);
+	compressed = au_lz4_compress(codec->data, length,
+		(void *)((uintptr_t)codec->stored + sizeof(header)),
+		bound - sizeof(header));
+	elapsed = timer_delta_no_reset(mod->timer) - begin;
+	lock_mutex(mod->stats_mutex);
+	mod->stats.stored_count++;
+	mod->stats.encoded_bytes += length;
+	mod->stats.compress_time += elapsed;
+	if (!compressed || compressed + sizeof(header) >= length) {
+		/* Incompressible data is stored unframed. */
+		mod->stats.stored_bytes += length;
+		unlock_mutex(mod->stats_mutex);
+		*size = length;
+		return codec->data;
+	}
+	mod->stats.compressed_count++;
+	mod->stats.stored_bytes += compressed + sizeof(header);
+	unlock_mutex(mod->stats_mutex);
+	header.magic = FRAME_MAGIC;
+	header.version = FRAME_VERSION;
+	header.compression = (uint8_t)mod->compression;
+	header.encoded_length = (uint32_t)length;
+	memcpy(codec->stored, &header, sizeof(header));
+	*size = compressed + sizeof(header);
+	return codec->stored;
+}
+
+static boolean decode_frame(
+	struct as_database_module * mod,
+	struct as_database_codec * codec,
+	const void * data,
+	size_t size)
+{
+	struct frame_header header;
+	size_t length = 0;
+	uint64_t begin;
+	memcpy(&header, data, sizeof(header));
+	if (header.version != FRAME_VERSION) {
+		WARN("Unsupported database frame version (%u).", header.version);
+		return FALSE;
+	}
+	if (header.encoded_length > CODEC_SIZE) {
+		WARN("Data size exceeds codec limits.");
+		return FALSE;
+	}
+	switch (header.compression) {
+	case AS_DATABASE_COMPRESSION_NONE:
+		if (size - sizeof(header) != header.encoded_length) {
+			WARN("Invalid database frame length.");
+			return FALSE;
+		}
+		memcpy(codec->data, (const void *)((uintptr_t)data + sizeof(header)),
+			header.encoded_length);
+		codec->length = header.encoded_length;
+		return TRUE;
+	case AS_DATABASE_COMPRESSION_LZ4:
+		begin = timer_delta_no_reset(mod->timer);
+		if (!au_lz4_decompress((const void *)((uintptr_t)data + sizeof(header)),
+				size - sizeof(header), codec->data, header.encoded_length,
+				&length) ||
+			length != header.encoded_length) {
+			WARN("Failed to decompress database frame.");
+			return FALSE;
+		}
+		lock_mutex(mod->stats_mutex);
+		mod->stats.decompressed_count++;
+		mod->stats.decompress_time +=
+			timer_delta_no_reset(mod->timer) - begin;
+		unlock_mutex(mod->stats_mutex);
+		codec->length = length;
+		return TRUE;
+	default:
+		WARN("Unsupported database frame compression (%u).",
+			header.compression);
+		return FALSE;
+	}
+}
+
 struct as_database_codec * as_database_get_decoder(
 	struct as_database_module * mod,
 	const void * data,
 	size_t size)
 {
-	struct as_database_codec * e = getcodec(mod);
+	struct as_database_codec * e;
+	uint32_t magic = 0;
 	if (size > CODEC_SIZE) {
 		WARN("Data size exceeds codec limits.");
 		return NULL;
 	}
+	e = getcodec(mod);
 	if (!e) {
 		e = alloc(sizeof(*e) + CODEC_SIZE);
 		memset(e, 0, sizeof(*e));
 		e->data = (void *)((uintptr_t)e + sizeof(*e));
 		e->cursor = e->data;
 	}
+	if (size >= sizeof(struct frame_header))
+		memcpy(&magic, data, sizeof(magic));
+	if (magic == FRAME_MAGIC) {
+		if (!decode_frame(mod, e, data, size)) {
+			as_database_free_codec(mod, e);
+			return NULL;
+		}
+		return e;
+	}
 	memcpy(e->data, data, size);
 	e->length = size;
 	return e;
@@ -365,3 +576,26 @@ void as_database_free_codec(struct as_database_module * mod, struct as_database_
 		mod->free_codecs_thread = codec;
 	}
 }
+
+void as_database_get_codec_stats(
+	struct as_database_module * mod,
+	struct as_database_codec_stats * stats)
+{
+	lock_mutex(mod->stats_mutex);
+	*stats = mod->stats;
+	unlock_mutex(mod->stats_mutex);
+}
+
+void as_database_get_task_stats(
+	struct as_database_module * mod,
+	struct as_database_task_stats * stats)
+{
+	const struct task_descriptor * task = mod->task_queue;
+	*stats = mod->task_stats;
+	stats->queued_count = 0;
+	while (task) {
+		stats->queued_count++;
+		task = task->next;
+	}
+	stats->active_count = mod->active_task_count;
+}
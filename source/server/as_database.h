@@ -6,10 +6,10 @@
 
 #include "task/task.h"
 
-#include "vendor/PostgreSQL/libpq-fe.h"
-
 #include "public/ap_module.h"
 
+#include "server/as_storage.h"
+
 #define AS_DATABASE_MODULE_NAME "AgsmDatabase"
 
 #define AS_DATABASE_ENCODE(CODEC, ID, DATA)\
@@ -59,28 +59,77 @@ enum as_database_callback_id {
 };
 
 struct as_database_cb_connect {
-	PGconn * conn;
+	struct as_storage * storage;
 };
 
 struct as_database_task_data {
-	PGconn * conn;
+	struct as_storage * storage;
 	void * data;
+	/* Time the task was added, in microseconds 
+	 * since the module was created. */
+	uint64_t add_time;
+};
+
+enum as_database_compression {
+	AS_DATABASE_COMPRESSION_NONE,
+	AS_DATABASE_COMPRESSION_LZ4,
+	AS_DATABASE_COMPRESSION_COUNT
 };
 
 struct as_database_codec {
 	void * data;
 	void * cursor;
 	size_t length;
+	/** \brief Framed (and possibly compressed) data. */
+	void * stored;
+	size_t stored_capacity;
 	struct as_database_codec * next;
 };
 
+struct as_database_codec_stats {
+	/** \brief Number of blobs prepared for storage. */
+	uint64_t stored_count;
+	/** \brief Number of blobs that were compressed. */
+	uint64_t compressed_count;
+	uint64_t encoded_bytes;
+	uint64_t stored_bytes;
+	/** \brief Time spent compressing, in microseconds. */
+	uint64_t compress_time;
+	/** \brief Number of compressed blobs that were decoded. */
+	uint64_t decompressed_count;
+	uint64_t decompress_time;
+};
+
+struct as_database_task_stats {
+	/** \brief Tasks waiting to be submitted. */
+	uint32_t queued_count;
+	/** \brief Submitted tasks that were not yet freed. */
+	uint32_t active_count;
+	uint64_t completed_count;
+	/** \brief Cumulative and maximum time between adding 
+	 *         and freeing tasks, in microseconds. */
+	uint64_t total_latency;
+	uint64_t max_latency;
+};
+
 struct as_database_module * as_database_create_module();
 
+/**
+ * \brief Open storage backend selected with `DBBackend`.
+ *
+ * `postgresql` (default) connects to the configured
+ * database, `memory` keeps records in memory and
+ * optionally persists them to `DBMemoryFile`.
+ * `DBLatency` injects a fixed latency (milliseconds)
+ * into every storage operation.
+ *
+ * \return TRUE if successful. Otherwise FALSE.
+ */
 boolean as_database_connect(struct as_database_module * mod);
 
 void as_database_set_blocking(struct as_database_module * mod, boolean is_blocking);
 
-PGconn * as_database_get_conn(struct as_database_module * mod);
+struct as_storage * as_database_get_storage(struct as_database_module * mod);
 
 void as_database_add_callback(
 	struct as_database_module * mod,
@@ -119,6 +168,35 @@ boolean as_database_write_encoded(
 size_t as_database_get_encoded_length(
 	struct as_database_codec * codec);
 
+/**
+ * \brief Retrieve encoded data in the form that
+ *        is written to database.
+ * \param[in]  codec Encoder.
+ * \param[out] size  Size of stored data.
+ *
+ * Depending on `DBCompression` configuration, encoded
+ * data is compressed and prefixed with a versioned
+ * frame header. Data is left as is when compression
+ * is disabled or does not reduce its size.
+ *
+ * Returned data is owned by codec and remains valid
+ * until codec is modified or freed.
+ *
+ * \return Pointer to stored data.
+ */
+const void * as_database_get_stored_data(
+	struct as_database_module * mod,
+	struct as_database_codec * codec,
+	size_t * size);
+
+/**
+ * \brief Retrieve a decoder for stored data.
+ *
+ * Both framed and unframed (legacy) data is accepted,
+ * framed data is decompressed if needed.
+ *
+ * \return Decoder if successful. Otherwise NULL.
+ */
 struct as_database_codec * as_database_get_decoder(
 	struct as_database_module * mod,
 	const void * data,
@@ -150,6 +228,19 @@ boolean as_database_advance_codec(
 
 void as_database_free_codec(struct as_database_module * mod, struct as_database_codec * codec);
 
+void as_database_get_codec_stats(
+	struct as_database_module * mod,
+	struct as_database_codec_stats * stats);
+
+/**
+ * \brief Retrieve task queue statistics.
+ *
+ * Should only be called from the main thread.
+ */
+void as_database_get_task_stats(
+	struct as_database_module * mod,
+	struct as_database_task_stats * stats);
+
 END_DECLS
 
 #endif /* _AS_DATABASE_H_ */
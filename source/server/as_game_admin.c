@@ -152,7 +152,7 @@ static void removeplayer(
 	as_map_remove_character(mod->as_map, character);
 	as_character_reflect(mod->as_character, character);
 	ap_character_free(mod->ap_character, character);
-	as_account_release(account);
+	as_account_release(mod->as_account, account);
 }
 
 static void dcsameaccount(
@@ -340,7 +340,7 @@ static boolean handle_ac_character(
 			if (!account)
 				return FALSE;
 			if (!as_login_confirm_auth_key(mod->as_login, cname, authkey)) {
-				as_account_release(account);
+				as_account_release(mod->as_account, account);
 				return FALSE;
 			}
 			for (i = 0; i < account->character_count; i++) {
@@ -351,7 +351,7 @@ static boolean handle_ac_character(
 			}
 			if (!cdb) {
 				assert(0);
-				as_account_release(account);
+				as_account_release(mod->as_account, account);
 				return FALSE;
 			}
 			dcsameaccount(mod, account);
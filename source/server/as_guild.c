@@ -12,15 +12,10 @@
 #include "server/as_character.h"
 #include "server/as_database.h"
 #include "server/as_player.h"
+#include "server/as_storage.h"
 
 #include <assert.h>
 
-#define STMT_INSERT "INSERT_GUILD"
-#define STMT_SELECT_LIST "SELECT_GUILD_LIST"
-#define STMT_SELECT "SELECT_GUILD"
-#define STMT_UPDATE "UPDATE_GUILD"
-#define STMT_DELETE "DELETE_GUILD"
-
 #define DB_STREAM_MODULE_ID 2
 #define MAKE_ID(ID) AS_DATABASE_MAKE_ID(DB_STREAM_MODULE_ID, ID)
 
@@ -92,47 +87,6 @@ static void freeentry(
 	mod->entry_freelist = e;
 }
 
-static boolean createstatements(PGconn * conn)
-{
-	PGresult * res;
-	res = PQprepare(conn, STMT_INSERT, 
-		"INSERT INTO guilds VALUES ($1,$2);", 2, NULL);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	res = PQprepare(conn, STMT_SELECT_LIST, 
-		"SELECT data FROM guilds;", 0, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	res = PQprepare(conn, STMT_SELECT, 
-		"SELECT data FROM guilds WHERE guild_id=$1;", 1, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	res = PQprepare(conn, STMT_UPDATE, 
-		"UPDATE guilds SET data=$2 WHERE guild_id=$1;", 2, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	res = PQprepare(conn, STMT_DELETE, 
-		"DELETE FROM guilds WHERE guild_id=$1;", 1, 0);
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	return TRUE;
-}
-
 struct as_guild_db * decodeguild(
 	struct as_database_codec * codec)
 {
@@ -409,89 +363,52 @@ static boolean cbplayerremove(
 	return TRUE;
 }
 
-static boolean preprocessguilds(
-	struct as_guild_module * mod, 
-	PGconn * conn)
+static boolean cbpreprocess(
+	const void * data,
+	size_t size,
+	void * user_data)
 {
-	PGresult * res;
-	time_t ct;
-	int row_count;
-	int i;
-	res = PQexec(conn, "BEGIN");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
+	struct as_guild_module * mod = user_data;
+	struct ap_guild * guild;
+	struct as_guild_db * db;
+	struct as_database_codec * codec;
+	codec = as_database_get_decoder(mod->as_database, data, size);
+	if (!codec) {
+		ERROR("Failed to create codec.");
 		return FALSE;
 	}
-	PQclear(res);
-	res = PQexecPrepared(conn, STMT_SELECT_LIST, 0, 0, 0, 0, 1);
-	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-		PQclear(res);
+	db = decodeguild(codec);
+	as_database_free_codec(mod->as_database, codec);
+	if (!db) {
+		ERROR("Failed to decode guild.");
 		return FALSE;
 	}
-	ct = time(0);
-	row_count = PQntuples(res);
-	for (i = 0; i < row_count; i++) {
-		struct ap_guild * guild;
-		struct as_guild_db * db;
-		void * data = PQgetvalue(res, i, 0);
-		int len = PQgetlength(res, i, 0);
-		struct as_database_codec * codec;
-		if (!data || len <= 0) {
-			ERROR("Empty guild database blob.");
-			PQclear(res);
-			return FALSE;
-		}
-		codec = as_database_get_decoder(mod->as_database, data, (size_t)len);
-		if (!codec) {
-			ERROR("Failed to create codec.");
-			PQclear(res);
-			return FALSE;
-		}
-		db = decodeguild(codec);
-		as_database_free_codec(mod->as_database, codec);
-		if (!db) {
-			ERROR("Failed to decode guild.");
-			PQclear(res);
-			return FALSE;
-		}
-		INFO("Preprocessing guild (%s).", db->id);
-		guild = ap_guild_add(mod->ap_guild, db->id);
-		if (!guild) {
-			ERROR("Failed to add guild (%s).", db->id);
-			dealloc(db);
-			PQclear(res);
-			return FALSE;
-		}
-		strlcpy(guild->password, db->password, 
-			sizeof(guild->password));
-		strlcpy(guild->notice, db->notice, sizeof(guild->notice));
-		guild->rank = db->rank;
-		guild->creation_date = db->creation_date;
-		guild->max_member_count = db->max_member_count;
-		guild->union_id = db->union_id;
-		guild->guild_mark_tid = db->guild_mark_tid;
-		guild->guild_mark_color = db->guild_mark_color;
-		guild->total_battle_point = db->total_battle_point;
-		as_guild_get(mod, guild)->db = db;
-	}
-	PQclear(res);
-	res = PQexec(conn, "END");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
+	INFO("Preprocessing guild (%s).", db->id);
+	guild = ap_guild_add(mod->ap_guild, db->id);
+	if (!guild) {
+		ERROR("Failed to add guild (%s).", db->id);
+		dealloc(db);
 		return FALSE;
 	}
-	PQclear(res);
+	strlcpy(guild->password, db->password, 
+		sizeof(guild->password));
+	strlcpy(guild->notice, db->notice, sizeof(guild->notice));
+	guild->rank = db->rank;
+	guild->creation_date = db->creation_date;
+	guild->max_member_count = db->max_member_count;
+	guild->union_id = db->union_id;
+	guild->guild_mark_tid = db->guild_mark_tid;
+	guild->guild_mark_color = db->guild_mark_color;
+	guild->total_battle_point = db->total_battle_point;
+	as_guild_get(mod, guild)->db = db;
 	return TRUE;
 }
 
 static boolean cbdatabaseconnect(struct as_guild_module * mod, void * data)
 {
 	struct as_database_cb_connect * d = data;
-	if (!createstatements(d->conn)) {
-		ERROR("Failed to create guild database statements.");
-		return FALSE;
-	}
-	if (!preprocessguilds(mod, d->conn)) {
+	if (!as_storage_load_list(d->storage, AS_STORAGE_TABLE_GUILD, 
+			cbpreprocess, mod)) {
 		ERROR("Failed to preprocess guilds.");
 		return FALSE;
 	}
@@ -502,62 +419,41 @@ static boolean taskdeferred(
 	struct as_database_task_data * task)
 {
 	struct deferred_task * d = task->data;
-	PGresult * res;
-	struct deferred_entry * e = d->entries;
-	res = PQexec(task->conn, "BEGIN");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		res = PQexec(task->conn, "ROLLBACK");
-		PQclear(res);
-		return FALSE;
-	}
-	PQclear(res);
-	while (e) {
-		const char * values[2] = { e->guild_id };
-		int lengths[2] = { (int)strlen(e->guild_id) };
-		const int formats[2] = { 0, 1 };
+	struct deferred_entry * e;
+	struct as_storage_write * writes;
+	uint32_t count = 0;
+	boolean result;
+	for (e = d->entries; e; e = e->next)
+		count++;
+	writes = alloc(count * sizeof(*writes));
+	memset(writes, 0, count * sizeof(*writes));
+	count = 0;
+	for (e = d->entries; e; e = e->next) {
+		struct as_storage_write * w = &writes[count++];
+		w->id = e->guild_id;
 		switch (e->operation) {
 		case DEFERRED_CREATE:
-			values[1] = e->codec->data;
-			lengths[1] = 
-				(int)as_database_get_encoded_length(e->codec);
-			res = PQexecPrepared(task->conn, STMT_INSERT, 
-				2, values, lengths, formats, 0);
+			w->operation = AS_STORAGE_INSERT;
+			w->data = as_database_get_stored_data(
+				d->mod->as_database, e->codec, &w->size);
 			break;
 		case DEFERRED_UPDATE:
-			values[1] = e->codec->data;
-			lengths[1] = 
-				(int)as_database_get_encoded_length(e->codec);
-			res = PQexecPrepared(task->conn, STMT_UPDATE, 
-				2, values, lengths, formats, 0);
+			w->operation = AS_STORAGE_UPDATE;
+			w->data = as_database_get_stored_data(
+				d->mod->as_database, e->codec, &w->size);
 			break;
 		case DEFERRED_DELETE:
-			res = PQexecPrepared(task->conn, STMT_DELETE, 
-				1, values, lengths, formats, 0);
+			w->operation = AS_STORAGE_DELETE;
 			break;
 		default:
-			res = PQexec(task->conn, "ROLLBACK");
-			PQclear(res);
-			return FALSE;
-		}
-		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-			PQclear(res);
-			res = PQexec(task->conn, "ROLLBACK");
-			PQclear(res);
+			dealloc(writes);
 			return FALSE;
 		}
-		PQclear(res);
-		e = e->next;
-	}
-	res = PQexec(task->conn, "END");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		PQclear(res);
-		res = PQexec(task->conn, "ROLLBACK");
-		PQclear(res);
-		return FALSE;
 	}
-	PQclear(res);
-	return TRUE;
+	result = as_storage_write_batch(task->storage, AS_STORAGE_TABLE_GUILD, 
+		writes, count);
+	dealloc(writes);
+	return result;
 }
 
 static void taskdeferredpost(
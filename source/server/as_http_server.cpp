@@ -15,52 +15,194 @@
 #include "public/ap_module_instance.h"
 
 #include <assert.h>
+#include <stdarg.h>
 #include <stdlib.h>
 
+#include <atomic>
+#include <future>
+#include <mutex>
+
+/* Upper bound of requests that can be waiting for
+ * the main thread at the same time. Requests that
+ * arrive while the queue is full are rejected with 503. */
+#define MAX_PENDING_REQUEST_COUNT 256
+/* Upper bound of requests handled by the main thread
+ * in a single poll, so that a burst of requests cannot
+ * stall a frame. */
+#define MAX_REQUEST_PER_POLL 64
+#define MAX_CONCURRENT_HANDLER_COUNT 16
+#define WORKER_THREAD_COUNT 64
+
+struct queued_request {
+	const httplib::Request * request;
+	std::promise<std::string> completion;
+};
+
+struct concurrent_handler {
+	char path[128];
+	ap_module_t callback_module;
+	as_http_server_concurrent_handler_t callback;
+};
+
+struct concurrent_context {
+	const httplib::Request * request;
+	std::string response;
+	std::string content_type;
+};
+
+/*
+ * Bounded multiple-producer single-consumer queue.
+ *
+ * Producers are httplib worker threads and the only
+ * consumer is the main thread.
+ */
+struct request_queue {
+	std::mutex lock;
+	queued_request * entries[MAX_PENDING_REQUEST_COUNT];
+	uint32_t head;
+	uint32_t count;
+};
+
 struct worker_context {
 	char ip[32];
 	uint16_t port;
-	mutex_t lock;
-	const httplib::Request * request;
-	char response[8096];
+	/* Guards `server` so that the server is not stopped 
+	 * while the worker thread destroys it. */
+	std::mutex server_lock;
+	httplib::Server * server;
+	request_queue queue;
+	/* Concurrent handlers are only added during
+	 * registration, before the worker thread is created,
+	 * so they can be read without synchronization. */
+	concurrent_handler concurrent_handlers[MAX_CONCURRENT_HANDLER_COUNT];
+	uint32_t concurrent_handler_count;
+	std::atomic<uint64_t> accepted_count;
+	std::atomic<uint64_t> rejected_count;
+	std::atomic<uint64_t> completed_count;
+	std::atomic<uint64_t> concurrent_count;
+	std::atomic<uint32_t> queue_depth;
+	std::atomic<bool> closed;
 };
 
 struct as_http_server_module {
 	struct ap_module_instance instance;
 	struct ap_config_module * ap_config;
 	struct worker_context * worker_context;
+	queued_request * current;
 	boolean pending_request;
 };
 
+static boolean push_request(
+	struct worker_context * context,
+	queued_request * r)
+{
+	std::lock_guard<std::mutex> guard(context->queue.lock);
+	request_queue * q = &context->queue;
+	if (q->count >= MAX_PENDING_REQUEST_COUNT || context->closed)
+		return FALSE;
+	q->entries[(q->head + q->count++) % MAX_PENDING_REQUEST_COUNT] = r;
+	context->queue_depth = q->count;
+	return TRUE;
+}
+
+static queued_request * pop_request(struct worker_context * context)
+{
+	std::lock_guard<std::mutex> guard(context->queue.lock);
+	request_queue * q = &context->queue;
+	queued_request * r;
+	if (!q->count)
+		return NULL;
+	r = q->entries[q->head];
+	q->head = (q->head + 1) % MAX_PENDING_REQUEST_COUNT;
+	context->queue_depth = --q->count;
+	return r;
+}
+
+static const concurrent_handler * find_concurrent_handler(
+	struct worker_context * context,
+	const std::string & path)
+{
+	uint32_t i;
+	for (i = 0; i < context->concurrent_handler_count; i++) {
+		const concurrent_handler * h = &context->concurrent_handlers[i];
+		if (strcmp(h->path, path.c_str()) == 0)
+			return h;
+	}
+	return NULL;
+}
+
+static boolean handle_status(
+	struct as_http_server_module * mod,
+	struct as_http_server_concurrent_request * request)
+{
+	struct as_http_server_stats stats;
+	as_http_server_get_stats(mod, &stats);
+	as_http_server_append_response(request,
+		"accepted=%llu\nrejected=%llu\ncompleted=%llu\n"
+		"concurrent=%llu\nqueue_depth=%u\n",
+		(unsigned long long)stats.accepted_count,
+		(unsigned long long)stats.rejected_count,
+		(unsigned long long)stats.completed_count,
+		(unsigned long long)stats.concurrent_count,
+		stats.queue_depth);
+	return TRUE;
+}
+
 static int worker(void * arg)
 {
 	struct worker_context * context = (struct worker_context *)arg;
 	httplib::Server srv;
 	if (!srv.is_valid())
 		return 0;
+	srv.new_task_queue = [] {
+		return new httplib::ThreadPool(WORKER_THREAD_COUNT);
+	};
 	srv.set_pre_routing_handler([&](const httplib::Request & req, httplib::Response & res) {
-		lock_mutex(context->lock);
-		while (context->request) {
-			unlock_mutex(context->lock);
-			Sleep(100);
-			lock_mutex(context->lock);
+		const concurrent_handler * h = find_concurrent_handler(context, req.path);
+		if (h) {
+			/* Read-only handlers run on the worker thread
+			 * and never wait for the main thread. */
+			concurrent_context c;
+			struct as_http_server_concurrent_request r = { 0 };
+			c.request = &req;
+			c.content_type = "text/plain";
+			r.path = req.path.c_str();
+			r.internal = &c;
+			if (!h->callback(h->callback_module, &r))
+				res.status = 500;
+			res.set_content(c.response, c.content_type.c_str());
+			context->concurrent_count++;
+			return httplib::Server::HandlerResponse::Handled;
 		}
-		context->request = &req;
-		unlock_mutex(context->lock);
-		while (true) {
-			Sleep(100);
-			lock_mutex(context->lock);
-			if (!context->request) {
-				res.set_content(context->response, "text/plain");
-				unlock_mutex(context->lock);
-				break;
-			}
-			unlock_mutex(context->lock);
+		queued_request p;
+		p.request = &req;
+		std::future<std::string> response = p.completion.get_future();
+		if (!push_request(context, &p)) {
+			context->rejected_count++;
+			res.status = 503;
+			return httplib::Server::HandlerResponse::Handled;
 		}
+		context->accepted_count++;
+		res.set_content(response.get(), "text/plain");
 		return httplib::Server::HandlerResponse::Handled;
 		});
-	if (!srv.listen(context->ip, context->port))
+	if (!srv.bind_to_port(context->ip, context->port)) {
+		ERROR("Failed to bind web server (%s:%u).", context->ip, context->port);
 		return 0;
+	}
+	{
+		std::lock_guard<std::mutex> guard(context->server_lock);
+		if (context->closed)
+			return 0;
+		context->server = &srv;
+	}
+	srv.listen_after_bind();
+	{
+		/* Server is destroyed when the worker returns, 
+		 * wait for a concurrent stop to complete. */
+		std::lock_guard<std::mutex> guard(context->server_lock);
+		context->server = NULL;
+	}
 	return 0;
 }
 
@@ -69,28 +211,45 @@ static boolean onregister(
 	struct ap_module_registry * registry)
 {
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_config, AP_CONFIG_MODULE_NAME);
+	as_http_server_add_concurrent_handler(mod, "/status", mod,
+		(as_http_server_concurrent_handler_t)handle_status);
 	return TRUE;
 }
 
 static boolean oninitialize(struct as_http_server_module * mod)
 {
-	struct worker_context * context = (struct worker_context *)alloc(sizeof(*context));
-	memset(context, 0, sizeof(*context));
-	strlcpy(context->ip, ap_config_get(mod->ap_config, "WebServerIP"), 
+	struct worker_context * context = mod->worker_context;
+	strlcpy(context->ip, ap_config_get(mod->ap_config, "WebServerIP"),
 		sizeof(context->ip));
 	context->port = (uint16_t)strtoul(
 		ap_config_get(mod->ap_config, "WebServerPort"), NULL, 10);
-	context->lock = create_mutex();
 	if (!create_thread(worker, context)) {
 		ERROR("Failed to create worker thread.");
 		return FALSE;
 	}
-	mod->worker_context = context;
 	return TRUE;
 }
 
 static void onclose(struct as_http_server_module * mod)
 {
+	struct worker_context * context = mod->worker_context;
+	queued_request * r;
+	if (!context)
+		return;
+	/* Release worker threads that are still waiting
+	 * for the main thread. */
+	context->closed = true;
+	while ((r = pop_request(context)) != NULL)
+		r->completion.set_value("");
+	{
+		std::lock_guard<std::mutex> guard(context->server_lock);
+		if (context->server) {
+			/* Stopping has no effect until the server 
+			 * begins listening. */
+			context->server->wait_until_ready();
+			context->server->stop();
+		}
+	}
 }
 
 static void onshutdown(struct as_http_server_module * mod)
@@ -100,10 +259,13 @@ static void onshutdown(struct as_http_server_module * mod)
 struct as_http_server_module * as_http_server_create_module()
 {
 	struct as_http_server_module * mod = (struct as_http_server_module *)ap_module_instance_new(AS_HTTP_SERVER_MODULE_NAME,
-		sizeof(*mod), (ap_module_instance_register_t)onregister, 
-		(ap_module_instance_initialize_t)oninitialize, 
-		(ap_module_instance_close_t)onclose, 
+		sizeof(*mod), (ap_module_instance_register_t)onregister,
+		(ap_module_instance_initialize_t)oninitialize,
+		(ap_module_instance_close_t)onclose,
 		(ap_module_instance_shutdown_t)onshutdown);
+	/* Worker context is never released because the
+	 * listening thread is not joined. */
+	mod->worker_context = new worker_context();
 	return mod;
 }
 
@@ -116,20 +278,41 @@ void as_http_server_add_callback(
 	ap_module_add_callback(mod, id, callback_module, callback);
 }
 
+boolean as_http_server_add_concurrent_handler(
+	struct as_http_server_module * mod,
+	const char * path,
+	ap_module_t callback_module,
+	as_http_server_concurrent_handler_t callback)
+{
+	struct worker_context * context = mod->worker_context;
+	concurrent_handler * h;
+	if (context->concurrent_handler_count >= MAX_CONCURRENT_HANDLER_COUNT) {
+		ERROR("Exceeded maximum number of concurrent handlers (%s).", path);
+		return FALSE;
+	}
+	h = &context->concurrent_handlers[context->concurrent_handler_count++];
+	strlcpy(h->path, path, sizeof(h->path));
+	h->callback_module = callback_module;
+	h->callback = callback;
+	return TRUE;
+}
+
 void as_http_server_poll_requests(struct as_http_server_module * mod)
 {
 	static struct as_http_server_cb_request cb = { 0 };
+	uint32_t i;
 	assert(mod->worker_context != NULL);
-	lock_mutex(mod->worker_context->lock);
-	if (!mod->worker_context->request) {
-		unlock_mutex(mod->worker_context->lock);
-		return;
+	for (i = 0; i < MAX_REQUEST_PER_POLL; i++) {
+		queued_request * r = pop_request(mod->worker_context);
+		if (!r)
+			break;
+		strlcpy(cb.request, r->request->path.c_str(), sizeof(cb.request));
+		mod->current = r;
+		mod->pending_request = TRUE;
+		ap_module_enum_callback(mod, AS_HTTP_SERVER_CB_REQUEST, &cb);
+		if (mod->pending_request)
+			as_http_server_set_response(mod, "");
 	}
-	strlcpy(cb.request, mod->worker_context->request->path.c_str(), sizeof(cb.request));
-	mod->pending_request = TRUE;
-	ap_module_enum_callback(mod, AS_HTTP_SERVER_CB_REQUEST, &cb);
-	if (mod->pending_request)
-		as_http_server_set_response(mod, "");
 }
 
 void as_http_server_get_request_param(
@@ -138,9 +321,8 @@ void as_http_server_get_request_param(
 	char * param,
 	size_t maxcount)
 {
-	assert(mod->worker_context != NULL);
-	assert(mod->worker_context->request != NULL);
-	std::string paramvalue = mod->worker_context->request->get_param_value(key);
+	assert(mod->current != NULL);
+	std::string paramvalue = mod->current->request->get_param_value(key);
 	strlcpy(param, paramvalue.c_str(), maxcount);
 }
 
@@ -148,12 +330,70 @@ void as_http_server_set_response(
 	struct as_http_server_module * mod,
 	const char * response)
 {
-	assert(mod->worker_context != NULL);
-	assert(mod->worker_context->request != NULL);
+	assert(mod->current != NULL);
 	assert(mod->pending_request);
-	strlcpy(mod->worker_context->response, response, 
-		sizeof(mod->worker_context->response));
-	mod->worker_context->request = NULL;
-	unlock_mutex(mod->worker_context->lock);
+	/* Worker thread will resume as soon as the value
+	 * is set, request must not be accessed afterwards. */
+	mod->current->completion.set_value(response);
+	mod->worker_context->completed_count++;
+	mod->current = NULL;
 	mod->pending_request = FALSE;
 }
+
+void as_http_server_get_concurrent_param(
+	const struct as_http_server_concurrent_request * request,
+	const char * key,
+	char * param,
+	size_t maxcount)
+{
+	const concurrent_context * c = (const concurrent_context *)request->internal;
+	std::string paramvalue = c->request->get_param_value(key);
+	strlcpy(param, paramvalue.c_str(), maxcount);
+}
+
+void as_http_server_set_content_type(
+	struct as_http_server_concurrent_request * request,
+	const char * content_type)
+{
+	concurrent_context * c = (concurrent_context *)request->internal;
+	c->content_type = content_type;
+}
+
+void as_http_server_append_response(
+	struct as_http_server_concurrent_request * request,
+	const char * fmt,
+	...)
+{
+	concurrent_context * c = (concurrent_context *)request->internal;
+	char buf[1024];
+	va_list ap;
+	int len;
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if ((size_t)len < sizeof(buf)) {
+		c->response.append(buf, (size_t)len);
+	}
+	else {
+		size_t offset = c->response.size();
+		c->response.resize(offset + (size_t)len + 1);
+		va_start(ap, fmt);
+		vsnprintf(&c->response[offset], (size_t)len + 1, fmt, ap);
+		va_end(ap);
+		c->response.resize(offset + (size_t)len);
+	}
+}
+
+void as_http_server_get_stats(
+	struct as_http_server_module * mod,
+	struct as_http_server_stats * stats)
+{
+	struct worker_context * context = mod->worker_context;
+	stats->accepted_count = context->accepted_count;
+	stats->rejected_count = context->rejected_count;
+	stats->completed_count = context->completed_count;
+	stats->concurrent_count = context->concurrent_count;
+	stats->queue_depth = context->queue_depth;
+}
@@ -20,6 +20,41 @@ struct as_http_server_cb_request {
 	char request[AS_HTTP_SERVER_MAX_REQUEST_SIZE];
 };
 
+/**
+ * \brief Request that is handled on a HTTP worker thread.
+ */
+struct as_http_server_concurrent_request {
+	const char * path;
+	void * internal;
+};
+
+/**
+ * \brief Request handler that runs concurrently with the
+ *        main thread.
+ *
+ * Concurrent handlers are called from HTTP worker threads
+ * and multiple requests may be handled at the same time.
+ * Handlers must only read state that has been published
+ * for concurrent access (i.e. snapshots or atomics),
+ * and must never access game state directly.
+ */
+typedef boolean (*as_http_server_concurrent_handler_t)(
+	ap_module_t callback_module,
+	struct as_http_server_concurrent_request * request);
+
+struct as_http_server_stats {
+	/** \brief Requests queued for the main thread. */
+	uint64_t accepted_count;
+	/** \brief Requests rejected because queue was full. */
+	uint64_t rejected_count;
+	/** \brief Requests completed by the main thread. */
+	uint64_t completed_count;
+	/** \brief Requests handled by concurrent handlers. */
+	uint64_t concurrent_count;
+	/** \brief Number of requests waiting for the main thread. */
+	uint32_t queue_depth;
+};
+
 struct as_http_server_module * as_http_server_create_module();
 
 void as_http_server_add_callback(
@@ -28,6 +63,29 @@ void as_http_server_add_callback(
 	ap_module_t callback_module,
 	ap_module_default_t callback);
 
+/**
+ * \brief Add a concurrent request handler.
+ *
+ * Requests with a matching path will not be queued for
+ * the main thread, they will instead be handled by
+ * `callback` on the worker thread that received them.
+ *
+ * Should only be called during module registration.
+ */
+boolean as_http_server_add_concurrent_handler(
+	struct as_http_server_module * mod,
+	const char * path,
+	ap_module_t callback_module,
+	as_http_server_concurrent_handler_t callback);
+
+/**
+ * \brief Handle queued requests.
+ *
+ * Each queued request triggers AS_HTTP_SERVER_CB_REQUEST
+ * and is completed either by a call to
+ * `as_http_server_set_response` or with an empty response
+ * after callbacks return.
+ */
 void as_http_server_poll_requests(struct as_http_server_module * mod);
 
 void as_http_server_get_request_param(
@@ -40,6 +98,30 @@ void as_http_server_set_response(
 	struct as_http_server_module * mod,
 	const char * response);
 
+void as_http_server_get_concurrent_param(
+	const struct as_http_server_concurrent_request * request,
+	const char * key,
+	char * param,
+	size_t maxcount);
+
+void as_http_server_set_content_type(
+	struct as_http_server_concurrent_request * request,
+	const char * content_type);
+
+void as_http_server_append_response(
+	struct as_http_server_concurrent_request * request,
+	const char * fmt,
+	...);
+
+/**
+ * \brief Retrieve request pipeline statistics.
+ *
+ * Can be called from any thread.
+ */
+void as_http_server_get_stats(
+	struct as_http_server_module * mod,
+	struct as_http_server_stats * stats);
+
 END_DECLS
 
 #endif /* _AS_HTTP_SERVER_H_ */
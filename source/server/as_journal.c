@@ -0,0 +1,480 @@
+#include "server/as_journal.h"
+
+#include "core/file_system.h"
+#include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
+#include "core/string.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RECORD_MAGIC 0x4C4E524A
+#define MAX_KEY_LENGTH 255
+#define MAX_RECORD_SIZE ((size_t)1u << 24)
+
+struct record_header {
+	uint32_t magic;
+	uint32_t key_length;
+	uint32_t data_length;
+	uint32_t checksum;
+};
+
+struct buffer {
+	uint8_t * data;
+	size_t size;
+	size_t capacity;
+};
+
+struct as_journal {
+	char dir[512];
+	char name[64];
+	uint32_t sync_interval;
+	thread_handle thread;
+	mutex_t mutex;
+	boolean shutdown;
+	/* Following fields are protected by `mutex`. */
+	struct buffer pending;
+	struct buffer sealed;
+	boolean has_sealed;
+	uint32_t segment;
+	uint32_t release_before;
+	struct as_journal_stats stats;
+	/* Following fields are only accessed by writer thread. */
+	struct buffer writing;
+	file file;
+	uint32_t file_segment;
+	uint32_t oldest_segment;
+};
+
+struct segment_range {
+	const char * name;
+	size_t name_len;
+	uint32_t min;
+	uint32_t max;
+	uint32_t count;
+};
+
+static uint32_t checksum(
+	uint32_t hash,
+	const void * data,
+	size_t size)
+{
+	const uint8_t * p = data;
+	size_t i;
+	for (i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void reserve(struct buffer * b, size_t size)
+{
+	size_t cap = b->capacity ? b->capacity : 4096;
+	if (size <= b->capacity)
+		return;
+	while (cap < size)
+		cap *= 2;
+	b->data = reallocate(b->data, cap);
+	b->capacity = cap;
+}
+
+static void swap(struct buffer * a, struct buffer * b)
+{
+	struct buffer t = *a;
+	*a = *b;
+	*b = t;
+}
+
+static void make_segment_path(
+	char * path,
+	size_t maxcount,
+	const char * dir,
+	const char * name,
+	uint32_t segment)
+{
+	make_path(path, maxcount, "%s/%s_%08u.jnl", dir, name, segment);
+}
+
+static boolean cbenumsegment(
+	char * current_dir,
+	size_t maxcount,
+	const char * name,
+	size_t size,
+	void * user_data)
+{
+	struct segment_range * r = user_data;
+	char * end = NULL;
+	uint32_t index;
+	if (strncmp(name, r->name, r->name_len) != 0 ||
+		name[r->name_len] != '_') {
+		return TRUE;
+	}
+	index = strtoul(name + r->name_len + 1, &end, 10);
+	if (!end || strcmp(end, ".jnl") != 0)
+		return TRUE;
+	if (!r->count || index < r->min)
+		r->min = index;
+	if (!r->count || index > r->max)
+		r->max = index;
+	r->count++;
+	return TRUE;
+}
+
+static boolean find_segments(
+	const char * dir,
+	const char * name,
+	struct segment_range * range)
+{
+	char path[512];
+	memset(range, 0, sizeof(*range));
+	range->name = name;
+	range->name_len = strlen(name);
+	strlcpy(path, dir, sizeof(path));
+	/* Directory may be empty. */
+	enum_dir(path, sizeof(path), FALSE, cbenumsegment, range);
+	return (range->count != 0);
+}
+
+static boolean open_segment(struct as_journal * j, uint32_t segment)
+{
+	char path[512];
+	make_segment_path(path, sizeof(path), j->dir, j->name, segment);
+	j->file = open_file(path, FILE_ACCESS_APPEND);
+	if (!j->file) {
+		ERROR("Failed to open journal segment (%s).", path);
+		return FALSE;
+	}
+	j->file_segment = segment;
+	return TRUE;
+}
+
+static boolean write_buffer(struct as_journal * j, struct buffer * b)
+{
+	if (!b->size)
+		return TRUE;
+	if (!j->file) {
+		ERROR("Journal segment is not open (%s_%08u).",
+			j->name, j->file_segment);
+		return FALSE;
+	}
+	if (!write_file(j->file, b->data, b->size) || !flush_file(j->file)) {
+		ERROR("Failed to write journal segment (%s_%08u).",
+			j->name, j->file_segment);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void remove_released(struct as_journal * j, uint32_t release_before)
+{
+	while (j->oldest_segment < release_before &&
+		j->oldest_segment < j->file_segment) {
+		char path[512];
+		make_segment_path(path, sizeof(path), j->dir, j->name,
+			j->oldest_segment);
+		remove_file(path);
+		j->oldest_segment++;
+	}
+}
+
+/*
+ * Writes buffered records to disk.
+ *
+ * Only called by writer thread, or by main thread
+ * after writer thread is terminated.
+ */
+static void sync_journal(struct as_journal * j)
+{
+	struct buffer sealed = { 0 };
+	boolean has_sealed;
+	uint32_t release_before;
+	boolean result = TRUE;
+	size_t bytes = 0;
+	lock_mutex(j->mutex);
+	swap(&j->pending, &j->writing);
+	has_sealed = j->has_sealed;
+	if (has_sealed) {
+		sealed = j->sealed;
+		memset(&j->sealed, 0, sizeof(j->sealed));
+	}
+	release_before = j->release_before;
+	unlock_mutex(j->mutex);
+	if (has_sealed) {
+		bytes += sealed.size;
+		result &= write_buffer(j, &sealed);
+		close_file(j->file);
+		j->file = NULL;
+		result &= open_segment(j, j->file_segment + 1);
+	}
+	bytes += j->writing.size;
+	result &= write_buffer(j, &j->writing);
+	j->writing.size = 0;
+	remove_released(j, release_before);
+	lock_mutex(j->mutex);
+	if (has_sealed) {
+		/* Reuse sealed buffer if possible. */
+		if (!j->sealed.data) {
+			sealed.size = 0;
+			j->sealed = sealed;
+			sealed.data = NULL;
+		}
+		j->has_sealed = FALSE;
+	}
+	if (bytes) {
+		j->stats.sync_count++;
+		if (result)
+			j->stats.synced_bytes += bytes;
+		else
+			j->stats.failed_sync_count++;
+	}
+	j->stats.oldest_segment = j->oldest_segment;
+	unlock_mutex(j->mutex);
+	if (sealed.data)
+		dealloc(sealed.data);
+}
+
+static int writer(void * param)
+{
+	struct as_journal * j = param;
+	while (TRUE) {
+		boolean shutdown;
+		sleep(j->sync_interval);
+		sync_journal(j);
+		lock_mutex(j->mutex);
+		shutdown = j->shutdown;
+		unlock_mutex(j->mutex);
+		if (shutdown)
+			break;
+	}
+	return 0;
+}
+
+struct as_journal * as_journal_open(
+	const char * dir,
+	const char * name,
+	uint32_t sync_interval)
+{
+	struct as_journal * j;
+	struct segment_range range;
+	if (!create_directory(dir)) {
+		ERROR("Failed to create journal directory (%s).", dir);
+		return NULL;
+	}
+	j = alloc(sizeof(*j));
+	memset(j, 0, sizeof(*j));
+	strlcpy(j->dir, dir, sizeof(j->dir));
+	strlcpy(j->name, name, sizeof(j->name));
+	j->sync_interval = sync_interval ? sync_interval : 1;
+	if (find_segments(dir, name, &range)) {
+		j->segment = range.max + 1;
+		j->oldest_segment = range.min;
+	}
+	j->release_before = j->oldest_segment;
+	j->stats.segment = j->segment;
+	j->stats.oldest_segment = j->oldest_segment;
+	if (!open_segment(j, j->segment)) {
+		dealloc(j);
+		return NULL;
+	}
+	j->mutex = create_mutex();
+	j->thread = create_thread(writer, j);
+	if (!j->thread) {
+		ERROR("Failed to create journal thread.");
+		close_file(j->file);
+		destroy_mutex(j->mutex);
+		dealloc(j);
+		return NULL;
+	}
+	return j;
+}
+
+void as_journal_close(struct as_journal * journal)
+{
+	lock_mutex(journal->mutex);
+	journal->shutdown = TRUE;
+	unlock_mutex(journal->mutex);
+	wait_thread(journal->thread);
+	/* Writer may have exited before last records
+	 * were appended. */
+	sync_journal(journal);
+	close_file(journal->file);
+	destroy_mutex(journal->mutex);
+	dealloc(journal->pending.data);
+	dealloc(journal->sealed.data);
+	dealloc(journal->writing.data);
+	dealloc(journal);
+}
+
+uint32_t as_journal_append(
+	struct as_journal * journal,
+	const char * key,
+	const void * data,
+	size_t size)
+{
+	struct record_header h = { 0 };
+	struct buffer * b = &journal->pending;
+	size_t klen = strlen(key);
+	uint32_t segment;
+	assert(klen <= MAX_KEY_LENGTH);
+	assert(size <= MAX_RECORD_SIZE);
+	h.magic = RECORD_MAGIC;
+	h.key_length = (uint32_t)klen;
+	h.data_length = (uint32_t)size;
+	h.checksum = checksum(checksum(2166136261u, key, klen), data, size);
+	lock_mutex(journal->mutex);
+	reserve(b, b->size + sizeof(h) + klen + size);
+	memcpy(b->data + b->size, &h, sizeof(h));
+	memcpy(b->data + b->size + sizeof(h), key, klen);
+	memcpy(b->data + b->size + sizeof(h) + klen, data, size);
+	b->size += sizeof(h) + klen + size;
+	segment = journal->segment;
+	journal->stats.appended_count++;
+	journal->stats.appended_bytes += sizeof(h) + klen + size;
+	unlock_mutex(journal->mutex);
+	return segment;
+}
+
+boolean as_journal_rotate(
+	struct as_journal * journal,
+	uint32_t * sealed_segment)
+{
+	lock_mutex(journal->mutex);
+	if (journal->has_sealed) {
+		unlock_mutex(journal->mutex);
+		return FALSE;
+	}
+	swap(&journal->pending, &journal->sealed);
+	journal->pending.size = 0;
+	journal->has_sealed = TRUE;
+	*sealed_segment = journal->segment++;
+	journal->stats.segment = journal->segment;
+	unlock_mutex(journal->mutex);
+	return TRUE;
+}
+
+void as_journal_release_segments(
+	struct as_journal * journal,
+	uint32_t segment)
+{
+	lock_mutex(journal->mutex);
+	if (segment > journal->release_before)
+		journal->release_before = segment;
+	unlock_mutex(journal->mutex);
+}
+
+uint32_t as_journal_get_segment(struct as_journal * journal)
+{
+	uint32_t segment;
+	lock_mutex(journal->mutex);
+	segment = journal->segment;
+	unlock_mutex(journal->mutex);
+	return segment;
+}
+
+void as_journal_get_stats(
+	struct as_journal * journal,
+	struct as_journal_stats * stats)
+{
+	lock_mutex(journal->mutex);
+	*stats = journal->stats;
+	stats->pending_bytes = journal->pending.size +
+		(journal->has_sealed ? journal->sealed.size : 0);
+	unlock_mutex(journal->mutex);
+}
+
+static boolean replay_segment(
+	const char * path,
+	as_journal_replay_t cb,
+	void * user_data)
+{
+	file f = open_file(path, FILE_ACCESS_READ);
+	char key[MAX_KEY_LENGTH + 1];
+	void * data = NULL;
+	size_t capacity = 0;
+	uint32_t count = 0;
+	if (!f)
+		return FALSE;
+	while (TRUE) {
+		struct record_header h;
+		if (!read_file(f, &h, sizeof(h)))
+			break;
+		if (h.magic != RECORD_MAGIC ||
+			h.key_length > MAX_KEY_LENGTH ||
+			h.data_length > MAX_RECORD_SIZE) {
+			WARN("Corrupt journal record (%s, record = %u).",
+				path, count);
+			break;
+		}
+		if (h.data_length > capacity) {
+			capacity = h.data_length;
+			data = reallocate(data, capacity);
+		}
+		if ((h.key_length && !read_file(f, key, h.key_length)) ||
+			(h.data_length && !read_file(f, data, h.data_length))) {
+			WARN("Incomplete journal record (%s, record = %u).",
+				path, count);
+			break;
+		}
+		key[h.key_length] = '\0';
+		if (checksum(checksum(2166136261u, key, h.key_length),
+				data, h.data_length) != h.checksum) {
+			WARN("Journal record checksum mismatch (%s, record = %u).",
+				path, count);
+			break;
+		}
+		if (!cb(key, data, h.data_length, user_data)) {
+			close_file(f);
+			dealloc(data);
+			return FALSE;
+		}
+		count++;
+	}
+	close_file(f);
+	dealloc(data);
+	INFO("Replayed journal segment (%s, records = %u).", path, count);
+	return TRUE;
+}
+
+boolean as_journal_replay(
+	const char * dir,
+	const char * name,
+	as_journal_replay_t cb,
+	void * user_data)
+{
+	struct segment_range range;
+	uint32_t i;
+	if (!find_segments(dir, name, &range))
+		return TRUE;
+	for (i = range.min; i <= range.max; i++) {
+		char path[512];
+		size_t size;
+		make_segment_path(path, sizeof(path), dir, name, i);
+		if (!get_file_size(path, &size))
+			continue;
+		if (!replay_segment(path, cb, user_data)) {
+			ERROR("Failed to replay journal segment (%s).", path);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+boolean as_journal_clear(const char * dir, const char * name)
+{
+	struct segment_range range;
+	uint32_t i;
+	boolean result = TRUE;
+	if (!find_segments(dir, name, &range))
+		return TRUE;
+	for (i = range.min; i <= range.max; i++) {
+		char path[512];
+		size_t size;
+		make_segment_path(path, sizeof(path), dir, name, i);
+		if (get_file_size(path, &size) && !remove_file(path))
+			result = FALSE;
+	}
+	return result;
+}
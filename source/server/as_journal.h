@@ -0,0 +1,130 @@
+#ifndef _AS_JOURNAL_H_
+#define _AS_JOURNAL_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+BEGIN_DECLS
+
+/**
+ * \brief Append-only, segmented write-ahead journal.
+ *
+ * Records are buffered in memory and written to the
+ * active segment file by a dedicated thread, which
+ * commits them to disk in groups every sync interval.
+ *
+ * Records are key/value pairs, replaying a journal
+ * yields every record in the order they were appended.
+ */
+struct as_journal;
+
+struct as_journal_stats {
+	uint64_t appended_count;
+	uint64_t appended_bytes;
+	uint64_t synced_bytes;
+	uint64_t sync_count;
+	uint64_t failed_sync_count;
+	/** \brief Number of bytes waiting to be written. */
+	uint64_t pending_bytes;
+	/** \brief Index of active segment. */
+	uint32_t segment;
+	/** \brief Index of oldest segment on disk. */
+	uint32_t oldest_segment;
+};
+
+typedef boolean (*as_journal_replay_t)(
+	const char * key,
+	const void * data,
+	size_t size,
+	void * user_data);
+
+/**
+ * \brief Open journal for appending.
+ * \param[in] dir           Journal directory.
+ * \param[in] name          Journal name, used as segment file prefix.
+ * \param[in] sync_interval Group commit interval in milliseconds.
+ *
+ * New records are always written to a new segment that
+ * follows any segments that are already on disk.
+ *
+ * \return Journal pointer if successful. Otherwise NULL.
+ */
+struct as_journal * as_journal_open(
+	const char * dir,
+	const char * name,
+	uint32_t sync_interval);
+
+/**
+ * \brief Write all buffered records to disk and close journal.
+ */
+void as_journal_close(struct as_journal * journal);
+
+/**
+ * \brief Append a record.
+ *
+ * Record is buffered and will be durable after
+ * the next group commit.
+ *
+ * \return Index of the segment that record is appended to.
+ */
+uint32_t as_journal_append(
+	struct as_journal * journal,
+	const char * key,
+	const void * data,
+	size_t size);
+
+/**
+ * \brief Seal active segment.
+ *
+ * Records appended after this call are written to a new
+ * segment. Fails if the previously sealed segment has
+ * not yet been written to disk.
+ * \param[out] sealed_segment Index of sealed segment.
+ *
+ * \return TRUE if successful. Otherwise FALSE.
+ */
+boolean as_journal_rotate(
+	struct as_journal * journal,
+	uint32_t * sealed_segment);
+
+/**
+ * \brief Mark segments older than `segment` as no longer needed.
+ *
+ * Segment files are removed by the writer thread
+ * once they are closed.
+ */
+void as_journal_release_segments(
+	struct as_journal * journal,
+	uint32_t segment);
+
+uint32_t as_journal_get_segment(struct as_journal * journal);
+
+void as_journal_get_stats(
+	struct as_journal * journal,
+	struct as_journal_stats * stats);
+
+/**
+ * \brief Read every record from segments on disk.
+ *
+ * Reading a segment stops at the first incomplete or
+ * corrupt record, which is expected for the last record
+ * that was being written during a crash.
+ *
+ * \return TRUE if successful. Otherwise FALSE.
+ */
+boolean as_journal_replay(
+	const char * dir,
+	const char * name,
+	as_journal_replay_t cb,
+	void * user_data);
+
+/**
+ * \brief Remove every segment on disk.
+ *
+ * Journal must not be open.
+ */
+boolean as_journal_clear(const char * dir, const char * name);
+
+END_DECLS
+
+#endif /* _AS_JOURNAL_H_ */
@@ -514,7 +514,7 @@ static boolean cbdisconnect(
 		struct as_account * cached = as_account_load_from_cache(mod->as_account,
 			ad->account->account_id, FALSE);
 		assert(cached != NULL);
-		as_account_release(cached);
+		as_account_release(mod->as_account, cached);
 		ad->account = NULL;
 	}
 	return TRUE;
@@ -3,6 +3,7 @@
 #include "core/file_system.h"
 #include "core/log.h"
 #include "core/malloc.h"
+#include "core/os.h"
 #include "core/string.h"
 #include "core/vector.h"
 
@@ -19,9 +20,51 @@
 #include "server/as_player.h"
 #include "server/as_server.h"
 
+#include "task/task.h"
+
 #define SEGMENTCOUNT \
 	(AP_SECTOR_WORLD_INDEX_WIDTH * AP_SECTOR_DEFAULT_DEPTH)
 
+#define SECTOR_SEGMENT_COUNT \
+	(AP_SECTOR_DEFAULT_DEPTH * AP_SECTOR_DEFAULT_DEPTH)
+
+/* Node data records consist of sector index and 
+ * segments of the sector. */
+#define NODE_RECORD_SIZE (8 + SECTOR_SEGMENT_COUNT * 4)
+
+#define SEGMENT_MAP_MAGIC 0x504D4753u
+#define SEGMENT_MAP_VERSION 1
+
+/* Sectors are stored in blocks of 8x8 sectors so that 
+ * nearby sectors share pages. Blocks are 64 KB, which 
+ * matches allocation granularity of mapped views. */
+#define SEGMENT_BLOCK_DEPTH 8
+#define SEGMENT_BLOCK_WIDTH \
+	(AP_SECTOR_WORLD_INDEX_WIDTH / SEGMENT_BLOCK_DEPTH)
+#define SEGMENT_BLOCK_HEIGHT \
+	(AP_SECTOR_WORLD_INDEX_HEIGHT / SEGMENT_BLOCK_DEPTH)
+#define SEGMENT_BLOCK_SIZE \
+	(SEGMENT_BLOCK_DEPTH * SEGMENT_BLOCK_DEPTH * \
+		SECTOR_SEGMENT_COUNT * sizeof(struct as_map_segment))
+
+/*
+ * Segment map layout:
+ * - Header, followed by the block index. Index contains 
+ *   block number of each block in the world, or 0 if 
+ *   the block has no segment data.
+ * - Blocks, starting with block number 1. Segments of 
+ *   a sector are ordered by x, then by z.
+ */
+struct segment_map_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t block_count;
+	uint32_t reserved;
+	/* Node data that the map was built from. */
+	uint64_t source_size;
+	uint64_t source_time;
+};
+
 struct rect {
 	vec2 a;
 	vec2 b;
@@ -48,6 +91,10 @@ struct as_map_module {
 	struct ap_admin object_admin;
 	struct as_map_sector * sectors;
 	struct as_map_sector void_sector;
+	const void * segment_map;
+	size_t segment_map_size;
+	const uint32_t * segment_blocks;
+	struct as_map_segment void_segments[SECTOR_SEGMENT_COUNT];
 	struct ap_character ** character_list;
 	struct ap_character ** tmp_character_list;
 	struct as_map_item_drop ** item_drop_lists[2];
@@ -57,6 +104,27 @@ struct as_map_module {
 	struct as_map_item_drop * free_item_drops;
 };
 
+struct object_load;
+
+struct object_file {
+	struct object_load * load;
+	char path[512];
+	char name[64];
+	uint32_t sx;
+	uint32_t sz;
+	/* One stream for each sector in file. */
+	struct ap_module_stream * streams[AP_SECTOR_DEFAULT_DEPTH * AP_SECTOR_DEFAULT_DEPTH];
+	struct task_descriptor task;
+};
+
+struct object_load {
+	struct as_map_module * mod;
+	struct object_file ** files;
+	uint32_t running;
+	uint32_t object_count;
+	boolean failed;
+};
+
 static inline struct as_map_sector * getsector(
 	struct as_map_module * mod,
 	uint32_t x, 
@@ -82,7 +150,28 @@ struct as_map_sector * getsectorbypos(
 	return getsector(mod, x, z);
 }
 
-struct as_map_segment * getsegmentbypos(
+static const struct as_map_segment * getsegments(
+	struct as_map_module * mod,
+	uint32_t x, 
+	uint32_t z)
+{
+	static const struct as_map_segment empty[SECTOR_SEGMENT_COUNT];
+	uint32_t block;
+	if (!mod->segment_blocks)
+		return empty;
+	block = mod->segment_blocks[(x / SEGMENT_BLOCK_DEPTH) * 
+		SEGMENT_BLOCK_HEIGHT + (z / SEGMENT_BLOCK_DEPTH)];
+	if (!block)
+		return empty;
+	/* Pages are read in by the system when they are 
+	 * accessed for the first time. */
+	return (const struct as_map_segment *)((uintptr_t)mod->segment_map + 
+		block * SEGMENT_BLOCK_SIZE) + 
+		((x % SEGMENT_BLOCK_DEPTH) * SEGMENT_BLOCK_DEPTH + 
+			(z % SEGMENT_BLOCK_DEPTH)) * SECTOR_SEGMENT_COUNT;
+}
+
+const struct as_map_segment * getsegmentbypos(
 	struct as_map_module * mod,
 	const struct au_pos * pos)
 {
@@ -92,15 +181,15 @@ struct as_map_segment * getsegmentbypos(
 	uint32_t sz;
 	struct as_map_sector * s;
 	if (!ap_scr_pos_to_index(&pos->x, &x, &z))
-		return &mod->void_sector.segments[0][0];
+		return &mod->void_segments[0];
 	s = getsector(mod, x, z);
 	sx = (uint32_t)((pos->x - s->begin.x) / AP_SECTOR_STEPSIZE);
 	sz = (uint32_t)((pos->z - s->begin.z) / AP_SECTOR_STEPSIZE);
 	if (sx >= AP_SECTOR_DEFAULT_DEPTH ||
 		sz >= AP_SECTOR_DEFAULT_DEPTH) {
-		return &mod->void_sector.segments[0][0];
+		return &mod->void_segments[0];
 	}
-	return &s->segments[sx][sz];
+	return &getsegments(mod, x, z)[sx * AP_SECTOR_DEFAULT_DEPTH + sz];
 }
 
 static boolean findinlist(
@@ -437,51 +526,119 @@ static boolean eachobject(
 	size_t maxcount,
 	const char * name,
 	size_t size,
-	struct as_map_module * mod)
+	struct object_load * load)
 {
 	uint32_t division = 0;
-	uint32_t sx = 0;
-	uint32_t sz = 0;
-	uint32_t x;
-	uint32_t count = 0;
+	struct object_file * file;
 	if (sscanf(name, "obj%05d.ini", &division) != 1)
 		return TRUE;
-	if (!ap_scr_from_division_index(division, &sx, &sz))
+	file = alloc(sizeof(*file));
+	memset(file, 0, sizeof(*file));
+	if (!ap_scr_from_division_index(division, &file->sx, &file->sz)) {
+		dealloc(file);
 		return TRUE;
-	for (x = 0; x < 16; x++) {
+	}
+	if (!make_path(file->path, sizeof(file->path), "%s%s", 
+			current_dir, name)) {
+		ERROR("Failed to create path (%s%s).", current_dir, name);
+		dealloc(file);
+		return FALSE;
+	}
+	strlcpy(file->name, name, sizeof(file->name));
+	file->load = load;
+	vec_push_back((void **)&load->files, &file);
+	return TRUE;
+}
+
+static boolean readobjectfile(struct object_file * file)
+{
+	uint32_t i;
+	for (i = 0; i < COUNT_OF(file->streams); i++) {
+		struct ap_module_stream * stream = ap_module_stream_create();
+		ap_module_stream_set_mode(stream, 
+			AU_INI_MGR_MODE_NAME_OVERWRITE);
+		ap_module_stream_set_type(stream, 
+			AU_INI_MGR_TYPE_PART_INDEX);
+		file->streams[i] = stream;
+	}
+	return ap_module_stream_open_parts(file->streams, 
+		COUNT_OF(file->streams), file->path, FALSE);
+}
+
+static boolean linkobjectfile(
+	struct as_map_module * mod,
+	struct object_file * file)
+{
+	uint32_t count = 0;
+	uint32_t x;
+	for (x = 0; x < AP_SECTOR_DEFAULT_DEPTH; x++) {
 		uint32_t z;
-		for (z = 0; z < 16; z++) {
+		for (z = 0; z < AP_SECTOR_DEFAULT_DEPTH; z++) {
 			struct as_map_sector * s = 
-				getsector(mod, sx + x, sz + z);
+				getsector(mod, file->sx + x, file->sz + z);
 			uint32_t c = vec_count(s->objects);
 			uint32_t i;
 			if (c != 0) {
-				ERROR("Objects are already loaded for this sector (%s%s).", 
-					current_dir, name);
-				return FALSE;
-			}
-			if (!ap_object_load_sector(mod->ap_object, current_dir, 
-					&s->objects, sx + x, sz + z)) {
-				ERROR("Failed to load objects from (%s%s).", 
-					current_dir, name);
+				ERROR("Objects are already loaded for this sector (%s).", 
+					file->path);
 				return FALSE;
 			}
+			ap_object_read_sector_stream(mod->ap_object, 
+				file->streams[z * AP_SECTOR_DEFAULT_DEPTH + x], 
+				&s->objects);
 			c = vec_count(s->objects);
 			for (i = 0; i < c; i++) {
 				struct ap_object * obj = s->objects[i];
-				if (!processobject(mod, s, name, obj)) {
-					ERROR("Failed to process loaded object (%s%s:%u).",
-						current_dir, name, obj->object_id);
+				if (!processobject(mod, s, file->name, obj)) {
+					ERROR("Failed to process loaded object (%s:%u).",
+						file->path, obj->object_id);
 					return FALSE;
 				}
 			}
 			count += c;
 		}
 	}
-	INFO("Loaded %5u objects (%s).", count, name);
+	file->load->object_count += count;
+	INFO("Loaded %5u objects (%s).", count, file->name);
 	return TRUE;
 }
 
+static void freeobjectfile(struct object_file * file)
+{
+	uint32_t i;
+	for (i = 0; i < COUNT_OF(file->streams); i++) {
+		if (file->streams[i]) {
+			ap_module_stream_destroy(file->streams[i]);
+			file->streams[i] = NULL;
+		}
+	}
+}
+
+static boolean objectfiletask(void * data)
+{
+	return readobjectfile(data);
+}
+
+static void objectfilepost(
+	struct task_descriptor * task,
+	void * data,
+	boolean result)
+{
+	struct object_file * file = data;
+	struct object_load * load = file->load;
+	load->running--;
+	if (!load->failed) {
+		if (!result) {
+			ERROR("Failed to load objects from (%s).", file->path);
+			load->failed = TRUE;
+		}
+		else if (!linkobjectfile(load->mod, file)) {
+			load->failed = TRUE;
+		}
+	}
+	freeobjectfile(file);
+}
+
 static void onchangesector(
 	struct as_map_module * mod,
 	struct ap_character * c,
@@ -984,6 +1141,9 @@ static void onshutdown(struct as_map_module * mod)
 	vec_free(mod->item_drop_lists[1]);
 	vec_free(mod->sector_lists[0]);
 	vec_free(mod->sector_lists[1]);
+	unmap_file(mod->segment_map, mod->segment_map_size);
+	mod->segment_map = NULL;
+	mod->segment_blocks = NULL;
 }
 
 struct as_map_module * as_map_create_module()
@@ -1009,51 +1169,190 @@ struct as_map_module * as_map_create_module()
 	mod->sector_lists[1] = vec_new_reserved(
 		sizeof(*mod->sector_lists[1]), 16);
 	/* Set dummy sector segments as blocking. */
-	for (x = 0; x < AP_SECTOR_DEFAULT_DEPTH; x++) {
-		uint32_t z;
-		for (z = 0; z < AP_SECTOR_DEFAULT_DEPTH; z++) {
-			mod->void_sector.segments[x][z].tile.geometry_block = 
-				AS_MAP_GB_GROUND | AS_MAP_GB_SKY;
-		}
+	for (x = 0; x < SECTOR_SEGMENT_COUNT; x++) {
+		mod->void_segments[x].tile.geometry_block = 
+			AS_MAP_GB_GROUND | AS_MAP_GB_SKY;
 	}
 	return mod;
 }
 
-boolean as_map_read_segments(struct as_map_module * mod)
+static boolean buildsegmentmap(
+	const char * node_path,
+	const char * map_path)
 {
-	const char * file_path = ap_config_get(mod->ap_config, "ServerNodePath");
 	size_t size = 0;
-	void * data;
-	uint32_t * cursor;
-	assert(sizeof(struct as_map_segment) == 4);
-	if (!get_file_size(file_path, &size) || !size) {
-		ERROR("Failed to retrieve file size (%zu).", size);
+	const uint8_t * node = map_file(node_path, &size);
+	const uint8_t * cursor;
+	struct segment_map_header header = { 0 };
+	uint32_t * blocks;
+	uint8_t * image;
+	size_t image_size;
+	size_t remain;
+	uint64_t source_time = 0;
+	uint32_t i;
+	boolean result;
+	if (!node) {
+		ERROR("Failed to map node data (%s).", node_path);
 		return FALSE;
 	}
-	data = alloc(size);
-	if (!load_file(file_path, data, size)) {
-		ERROR("Failed to load file (%zu).", size);
-		dealloc(data);
+	if (!get_file_time(node_path, &source_time)) {
+		ERROR("Failed to retrieve node data time (%s).", node_path);
+		unmap_file(node, size);
 		return FALSE;
 	}
-	cursor = data;
-	while (size >= 1032) {
-		uint32_t x = *cursor++;
-		uint32_t z = *cursor++;
-		assert(x < AP_SECTOR_WORLD_INDEX_WIDTH);
-		assert(z < AP_SECTOR_WORLD_INDEX_HEIGHT);
-		struct as_map_sector * sector = getsector(mod, x, z);
+	blocks = alloc(SEGMENT_BLOCK_WIDTH * SEGMENT_BLOCK_HEIGHT * 
+		sizeof(*blocks));
+	memset(blocks, 0, SEGMENT_BLOCK_WIDTH * SEGMENT_BLOCK_HEIGHT * 
+		sizeof(*blocks));
+	for (cursor = node, remain = size; remain >= NODE_RECORD_SIZE; 
+		cursor += NODE_RECORD_SIZE, remain -= NODE_RECORD_SIZE) {
+		uint32_t x;
+		uint32_t z;
+		memcpy(&x, cursor, 4);
+		memcpy(&z, cursor + 4, 4);
+		if (x >= AP_SECTOR_WORLD_INDEX_WIDTH ||
+			z >= AP_SECTOR_WORLD_INDEX_HEIGHT) {
+			ERROR("Invalid sector index in node data (%u, %u).", x, z);
+			dealloc(blocks);
+			unmap_file(node, size);
+			return FALSE;
+		}
+		blocks[(x / SEGMENT_BLOCK_DEPTH) * SEGMENT_BLOCK_HEIGHT + 
+			(z / SEGMENT_BLOCK_DEPTH)] = 1;
+	}
+	/* Number blocks in world order so that neighbouring 
+	 * blocks are close to each other in file. */
+	for (i = 0; i < SEGMENT_BLOCK_WIDTH * SEGMENT_BLOCK_HEIGHT; i++) {
+		if (blocks[i])
+			blocks[i] = ++header.block_count;
+	}
+	image_size = (size_t)(header.block_count + 1) * SEGMENT_BLOCK_SIZE;
+	image = alloc(image_size);
+	memset(image, 0, image_size);
+	header.magic = SEGMENT_MAP_MAGIC;
+	header.version = SEGMENT_MAP_VERSION;
+	header.source_size = size;
+	header.source_time = source_time;
+	memcpy(image, &header, sizeof(header));
+	memcpy(image + sizeof(header), blocks, 
+		SEGMENT_BLOCK_WIDTH * SEGMENT_BLOCK_HEIGHT * sizeof(*blocks));
+	for (cursor = node, remain = size; remain >= NODE_RECORD_SIZE; 
+		cursor += NODE_RECORD_SIZE, remain -= NODE_RECORD_SIZE) {
+		uint32_t x;
+		uint32_t z;
 		uint32_t sz;
-		for (sz = 0; sz < 16; sz++) {
+		struct as_map_segment * segments;
+		memcpy(&x, cursor, 4);
+		memcpy(&z, cursor + 4, 4);
+		segments = (struct as_map_segment *)(image + 
+			blocks[(x / SEGMENT_BLOCK_DEPTH) * SEGMENT_BLOCK_HEIGHT + 
+				(z / SEGMENT_BLOCK_DEPTH)] * SEGMENT_BLOCK_SIZE) + 
+			((x % SEGMENT_BLOCK_DEPTH) * SEGMENT_BLOCK_DEPTH + 
+				(z % SEGMENT_BLOCK_DEPTH)) * SECTOR_SEGMENT_COUNT;
+		/* Node data orders segments by z, then by x. */
+		for (sz = 0; sz < AP_SECTOR_DEFAULT_DEPTH; sz++) {
 			uint32_t sx;
-			for (sx = 0; sx < 16; sx++) {
-				memcpy(&sector->segments[sx][sz], cursor, 4);
-				cursor++;
+			for (sx = 0; sx < AP_SECTOR_DEFAULT_DEPTH; sx++) {
+				memcpy(&segments[sx * AP_SECTOR_DEFAULT_DEPTH + sz], 
+					cursor + 8 + (sz * AP_SECTOR_DEFAULT_DEPTH + sx) * 4, 
+					4);
 			}
 		}
-		size -= 1032;
 	}
-	dealloc(data);
+	unmap_file(node, size);
+	dealloc(blocks);
+	result = make_file(map_path, image, image_size);
+	dealloc(image);
+	if (!result) {
+		ERROR("Failed to write segment map (%s).", map_path);
+		return FALSE;
+	}
+	INFO("Built segment map with %u blocks (%s).", 
+		header.block_count, map_path);
+	return TRUE;
+}
+
+static boolean opensegmentmap(
+	struct as_map_module * mod,
+	const char * node_path,
+	const char * map_path)
+{
+	size_t size = 0;
+	const void * data = map_file(map_path, &size);
+	struct segment_map_header header;
+	const uint32_t * blocks;
+	size_t node_size;
+	uint64_t node_time;
+	uint32_t i;
+	if (!data)
+		return FALSE;
+	if (size < SEGMENT_BLOCK_SIZE) {
+		WARN("Segment map is truncated (%s).", map_path);
+		unmap_file(data, size);
+		return FALSE;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != SEGMENT_MAP_MAGIC ||
+		header.version != SEGMENT_MAP_VERSION ||
+		size != (size_t)(header.block_count + 1) * SEGMENT_BLOCK_SIZE) {
+		INFO("Segment map version does not match (%s).", map_path);
+		unmap_file(data, size);
+		return FALSE;
+	}
+	/* Segment map can be used without node data. */
+	if (node_path && get_file_size(node_path, &node_size) &&
+		get_file_time(node_path, &node_time) &&
+		(node_size != header.source_size || 
+			node_time != header.source_time)) {
+		INFO("Segment map is stale (%s).", map_path);
+		unmap_file(data, size);
+		return FALSE;
+	}
+	blocks = (const uint32_t *)((uintptr_t)data + sizeof(header));
+	for (i = 0; i < SEGMENT_BLOCK_WIDTH * SEGMENT_BLOCK_HEIGHT; i++) {
+		if (blocks[i] > header.block_count) {
+			WARN("Segment map has an invalid block (%s).", map_path);
+			unmap_file(data, size);
+			return FALSE;
+		}
+	}
+	mod->segment_map = data;
+	mod->segment_map_size = size;
+	mod->segment_blocks = blocks;
+	return TRUE;
+}
+
+boolean as_map_read_segments(struct as_map_module * mod)
+{
+	const char * node_path = ap_config_get(mod->ap_config, "ServerNodePath");
+	const char * map_path = ap_config_get(mod->ap_config, "ServerSegmentMapPath");
+	char path[1024];
+	assert(sizeof(struct as_map_segment) == 4);
+	assert(sizeof(struct segment_map_header) + 
+		SEGMENT_BLOCK_WIDTH * SEGMENT_BLOCK_HEIGHT * sizeof(uint32_t) <= 
+		SEGMENT_BLOCK_SIZE);
+	if (!map_path) {
+		if (!node_path) {
+			ERROR("Failed to retrieve ServerNodePath config.");
+			return FALSE;
+		}
+		if (!make_path(path, sizeof(path), "%s.map", node_path)) {
+			ERROR("Failed to create path (%s.map).", node_path);
+			return FALSE;
+		}
+		map_path = path;
+	}
+	if (opensegmentmap(mod, node_path, map_path))
+		return TRUE;
+	if (!node_path) {
+		ERROR("Failed to open segment map (%s).", map_path);
+		return FALSE;
+	}
+	if (!buildsegmentmap(node_path, map_path) ||
+		!opensegmentmap(mod, node_path, map_path)) {
+		ERROR("Failed to create segment map (%s).", map_path);
+		return FALSE;
+	}
 	return TRUE;
 }
 
@@ -1061,6 +1360,14 @@ boolean as_map_load_objects(struct as_map_module * mod)
 {
 	char path[512];
 	const char * inidir = ap_config_get(mod->ap_config, "ServerIniDir");
+	struct object_load load = { 0 };
+	uint64_t begin = ap_tick_get(mod->ap_tick);
+	/* Parsed object files are held in memory until 
+	 * they are linked, so limit files in flight. */
+	uint32_t max_running = get_cpu_core_count() + 1;
+	uint32_t file_count;
+	uint32_t next = 0;
+	uint32_t i;
 	if (!inidir) {
 		ERROR("Failed to retrieve ServerIniDir configuration.");
 		return FALSE;
@@ -1069,10 +1376,43 @@ boolean as_map_load_objects(struct as_map_module * mod)
 		ERROR("Failed to create path (%s/objects/).", inidir);
 		return FALSE;
 	}
-	if (!enum_dir(path, sizeof(path), FALSE, eachobject, mod)) {
+	load.mod = mod;
+	load.files = vec_new_reserved(sizeof(*load.files), 256);
+	if (!enum_dir(path, sizeof(path), FALSE, eachobject, &load)) {
 		ERROR("Failed to enumerate objects directory.");
+		load.failed = TRUE;
+	}
+	file_count = vec_count(load.files);
+	/* Files are parsed on task threads, objects are 
+	 * created and added to sectors on the main thread 
+	 * when each file is completed. */
+	while (TRUE) {
+		uint32_t running;
+		while (!load.failed && next < file_count && 
+			load.running < max_running) {
+			struct object_file * file = load.files[next++];
+			file->task.work_cb = objectfiletask;
+			file->task.post_cb = objectfilepost;
+			file->task.data = file;
+			load.running++;
+			task_add(&file->task, FALSE);
+		}
+		running = load.running;
+		if (!running)
+			break;
+		task_wait();
+		task_do_post_cb();
+		if (load.running == running)
+			sleep(1);
+	}
+	for (i = 0; i < file_count; i++)
+		dealloc(load.files[i]);
+	vec_free(load.files);
+	if (load.failed)
 		return FALSE;
-	}
+	INFO("Loaded %u objects from %u files in %llu ms.", 
+		load.object_count, file_count, 
+		(unsigned long long)(ap_tick_get(mod->ap_tick) - begin));
 	return TRUE;
 }
 
@@ -1337,6 +1677,7 @@ void as_map_broadcast(struct as_map_module * mod, struct ap_character * characte
 {
 	uint32_t count = 0;
 	uint32_t i;
+	uint32_t sent = 0;
 	struct as_map_character * mc = as_map_get_character_ad(mod, character);
 	if (!mc->sector) {
 		/* Character has not been added to the world. */
@@ -1355,9 +1696,12 @@ void as_map_broadcast(struct as_map_module * mod, struct ap_character * characte
 		struct ap_character * c = mod->character_list[i];
 		struct as_player_character * pc = 
 			as_player_get_character_ad(mod->as_player, c);
-		if (pc->conn)
+		if (pc->conn) {
 			as_server_send_packet(mod->as_server, pc->conn);
+			sent++;
+		}
 	}
+	as_server_count_broadcast(mod->as_server, sent);
 }
 
 void as_map_broadcast_with_exception(
@@ -1367,6 +1711,7 @@ void as_map_broadcast_with_exception(
 {
 	uint32_t count = 0;
 	uint32_t i;
+	uint32_t sent = 0;
 	struct as_map_character * mc = as_map_get_character_ad(mod, character);
 	if (mc->sync_instance_id) {
 		as_map_get_characters_in_instance(mod, &character->pos,
@@ -1383,9 +1728,12 @@ void as_map_broadcast_with_exception(
 		if (c == exception)
 			continue;
 		pc = as_player_get_character_ad(mod->as_player, c);
-		if (pc->conn)
+		if (pc->conn) {
 			as_server_send_packet(mod->as_server, pc->conn);
+			sent++;
+		}
 	}
+	as_server_count_broadcast(mod->as_server, sent);
 }
 
 void as_map_broadcast_around(
@@ -1394,15 +1742,19 @@ void as_map_broadcast_around(
 {
 	uint32_t count = 0;
 	uint32_t i;
+	uint32_t sent = 0;
 	as_map_get_characters(mod, position, &mod->character_list);
 	count = vec_count(mod->character_list);
 	for (i = 0; i < count; i++) {
 		struct ap_character * c = mod->character_list[i];
 		struct as_player_character * pc = 
 			as_player_get_character_ad(mod->as_player, c);
-		if (pc->conn)
+		if (pc->conn) {
 			as_server_send_packet(mod->as_server, pc->conn);
+			sent++;
+		}
 	}
+	as_server_count_broadcast(mod->as_server, sent);
 }
 
 void as_map_inform_nearby(
@@ -1455,7 +1807,7 @@ struct as_map_tile_info as_map_get_tile(
 	struct as_map_module * mod,
 	const struct au_pos * pos)
 {
-	struct as_map_segment * s = getsegmentbypos(mod, pos);
+	const struct as_map_segment * s = getsegmentbypos(mod, pos);
 	return s->tile;
 }
 
@@ -1463,7 +1815,7 @@ struct as_map_region * as_map_get_region_at(
 	struct as_map_module * mod,
 	const struct au_pos * pos)
 {
-	struct as_map_segment * s = getsegmentbypos(mod, pos);
+	const struct as_map_segment * s = getsegmentbypos(mod, pos);
 	if (s->region_id > AP_MAP_MAX_REGION_ID)
 		return NULL;
 	if (!mod->regions[s->region_id].initialized)
@@ -1494,6 +1846,22 @@ struct as_map_sector * as_map_get_sector_at(
 	return getsectorbypos(mod, pos);
 }
 
+void as_map_prefetch_sector(
+	struct as_map_module * mod,
+	const struct as_map_sector * sector)
+{
+	uint32_t block;
+	if (!mod->segment_blocks || sector == &mod->void_sector)
+		return;
+	block = mod->segment_blocks[
+		(sector->index_x / SEGMENT_BLOCK_DEPTH) * SEGMENT_BLOCK_HEIGHT + 
+		(sector->index_z / SEGMENT_BLOCK_DEPTH)];
+	if (block) {
+		prefetch_memory((const void *)((uintptr_t)mod->segment_map + 
+			block * SEGMENT_BLOCK_SIZE), SEGMENT_BLOCK_SIZE);
+	}
+}
+
 boolean as_map_is_in_field_of_vision(
 	struct as_map_module * mod,
 	struct ap_character * character1,
@@ -80,7 +80,6 @@ struct as_map_sector {
 	uint32_t index_z;
 	struct au_pos begin;
 	struct au_pos end;
-	struct as_map_segment segments[AP_SECTOR_DEFAULT_DEPTH][AP_SECTOR_DEFAULT_DEPTH];
 	struct ap_character * characters;
 	struct ap_object ** objects;
 	struct as_map_item_drop * item_drops;
@@ -136,6 +135,19 @@ struct as_map_cb_leave_sector_view {
 
 struct as_map_module * as_map_create_module();
 
+/**
+ * Maps sector segment data into memory.
+ *
+ * Segments are read from a segment map file 
+ * (`ServerSegmentMapPath`, by default `ServerNodePath` 
+ * with ".map" appended). If the segment map does not 
+ * exist or is older than node data, it is built from 
+ * node data first.
+ *
+ * Pages of the segment map are only read when segments 
+ * in them are accessed, and they are shared between 
+ * server processes that map the same file.
+ */
 boolean as_map_read_segments(struct as_map_module * mod);
 
 boolean as_map_load_objects(struct as_map_module * mod);
@@ -261,6 +273,14 @@ struct as_map_sector * as_map_get_sector_at(
 	struct as_map_module * mod,
 	const struct au_pos * pos);
 
+/**
+ * Starts reading segments of sector (and sectors 
+ * that are stored next to it) ahead of time.
+ */
+void as_map_prefetch_sector(
+	struct as_map_module * mod,
+	const struct as_map_sector * sector);
+
 boolean as_map_is_in_field_of_vision(
 	struct as_map_module * mod,
 	struct ap_character * character1,
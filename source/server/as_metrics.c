@@ -0,0 +1,446 @@
+#include "server/as_metrics.h"
+
+#include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
+#include "core/profile.h"
+#include "core/ring_buffer.h"
+#include "core/slab.h"
+
+#include "public/ap_module.h"
+#include "public/ap_module_registry.h"
+#include "public/ap_tick.h"
+
+#include "server/as_database.h"
+#include "server/as_http_server.h"
+#include "server/as_player.h"
+#include "server/as_server.h"
+
+#include "task/task.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ATOMIC_INCREMENT(p) _InterlockedIncrement(p)
+#define ATOMIC_READ(p) _InterlockedCompareExchange(p, 0, 0)
+#else
+#define ATOMIC_INCREMENT(p) __sync_add_and_fetch(p, 1)
+#define ATOMIC_READ(p) __sync_val_compare_and_swap(p, 0, 0)
+#endif
+
+/* Interval of snapshots, in ms. */
+#define PUBLISH_INTERVAL 1000
+/* Number of times a request tries to copy the
+ * snapshot while it is being published. */
+#define MAX_READ_ATTEMPT_COUNT 64
+#define FRAME_BUCKET_COUNT 11
+
+/* Upper bounds of frame time histogram
+ * buckets, in microseconds. */
+static const uint64_t g_FrameBuckets[FRAME_BUCKET_COUNT] = {
+	250, 500, 1000, 2000, 4000, 8000,
+	16000, 32000, 64000, 128000, 256000 };
+
+struct snapshot {
+	/* Number of frames in each bucket, last
+	 * bucket counts frames that exceed all
+	 * bounds (+Inf). */
+	uint64_t frame_buckets[FRAME_BUCKET_COUNT + 1];
+	uint64_t frame_count;
+	uint64_t frame_time_sum;
+	uint64_t max_frame_time;
+	uint32_t conn_count[AS_SERVER_COUNT];
+	uint32_t character_count;
+	struct as_database_task_stats db;
+	uint64_t send_buffer_usage;
+	uint64_t max_send_buffer_usage;
+	uint64_t packets_in;
+	uint64_t bytes_in;
+	uint64_t packets_out;
+	uint64_t bytes_out;
+	uint64_t broadcast_count;
+	uint64_t broadcast_receiver_count;
+	uint32_t max_broadcast_receiver_count;
+};
+
+struct as_metrics_module {
+	struct ap_module_instance instance;
+	struct ap_tick_module * ap_tick;
+	struct as_database_module * as_database;
+	struct as_http_server_module * as_http_server;
+	struct as_player_module * as_player;
+	struct as_server_module * as_server;
+	struct as_server_packet_stats * packets;
+	double ticks_per_us;
+	uint64_t frame_begin;
+	uint64_t next_publish_tick;
+	/* Accumulated by the main thread and copied
+	 * to `published` when a snapshot is published. */
+	struct snapshot current;
+	/* Odd while `published` is being written. */
+	volatile long seq;
+	struct snapshot published;
+};
+
+/*
+ * Copies the last published snapshot.
+ *
+ * Snapshot is written by the main thread without
+ * waiting for readers, readers retry if the
+ * snapshot was written while it was copied.
+ */
+static boolean readsnapshot(
+	struct as_metrics_module * mod,
+	struct snapshot * s)
+{
+	uint32_t i;
+	for (i = 0; i < MAX_READ_ATTEMPT_COUNT; i++) {
+		long seq = ATOMIC_READ(&mod->seq);
+		if (!(seq & 1)) {
+			memcpy(s, &mod->published, sizeof(*s));
+			if (ATOMIC_READ(&mod->seq) == seq)
+				return TRUE;
+		}
+		sleep(0);
+	}
+	return FALSE;
+}
+
+static void publish(struct as_metrics_module * mod)
+{
+	struct snapshot * s = &mod->current;
+	uint32_t count;
+	uint32_t i;
+	size_t index = 0;
+	struct as_server_conn * conn;
+	for (i = 0; i < AS_SERVER_COUNT; i++)
+		s->conn_count[i] = as_server_get_conn_count(mod->as_server, i);
+	s->character_count = as_player_get_count(mod->as_player);
+	as_database_get_task_stats(mod->as_database, &s->db);
+	s->send_buffer_usage = 0;
+	s->max_send_buffer_usage = 0;
+	while (as_server_iterate_conn(mod->as_server, AS_SERVER_GAME, &index, &conn)) {
+		uint64_t usage = conn->send_buffer->usage;
+		s->send_buffer_usage += usage;
+		if (usage > s->max_send_buffer_usage)
+			s->max_send_buffer_usage = usage;
+	}
+	count = as_server_get_packet_stats(mod->as_server, mod->packets,
+		AS_SERVER_MAX_PACKET_STATS_COUNT);
+	s->packets_in = 0;
+	s->bytes_in = 0;
+	s->packets_out = 0;
+	s->bytes_out = 0;
+	s->broadcast_count = 0;
+	s->broadcast_receiver_count = 0;
+	s->max_broadcast_receiver_count = 0;
+	for (i = 0; i < count; i++) {
+		const struct as_server_packet_stats * p = &mod->packets[i];
+		s->packets_in += p->in_count;
+		s->bytes_in += p->in_bytes;
+		s->packets_out += p->out_count;
+		s->bytes_out += p->out_bytes;
+		s->broadcast_count += p->broadcast_count;
+		s->broadcast_receiver_count += p->broadcast_receiver_count;
+		if (p->max_broadcast_receiver_count > s->max_broadcast_receiver_count)
+			s->max_broadcast_receiver_count = p->max_broadcast_receiver_count;
+	}
+	ATOMIC_INCREMENT(&mod->seq);
+	memcpy(&mod->published, s, sizeof(*s));
+	ATOMIC_INCREMENT(&mod->seq);
+}
+
+static void writemetric(
+	struct as_http_server_concurrent_request * request,
+	const char * name,
+	const char * type,
+	const char * help,
+	uint64_t value)
+{
+	as_http_server_append_response(request,
+		"# HELP archlord_%s %s\n"
+		"# TYPE archlord_%s %s\n"
+		"archlord_%s %llu\n",
+		name, help, name, type, name, (unsigned long long)value);
+}
+
+static void writeheader(
+	struct as_http_server_concurrent_request * request,
+	const char * name,
+	const char * type,
+	const char * help)
+{
+	as_http_server_append_response(request,
+		"# HELP archlord_%s %s\n"
+		"# TYPE archlord_%s %s\n",
+		name, help, name, type);
+}
+
+/*
+ * Copies `name` to `label`, escaping characters
+ * as required by label values.
+ */
+static void escapelabel(char * label, size_t size, const char * name)
+{
+	size_t len = 0;
+	while (*name && len + 3 < size) {
+		char c = *name++;
+		if (c == '"' || c == '\\') {
+			label[len++] = '\\';
+		}
+		else if (c == '\n') {
+			label[len++] = '\\';
+			c = 'n';
+		}
+		label[len++] = c;
+	}
+	label[len] = '\0';
+}
+
+static void writeframes(
+	struct as_http_server_concurrent_request * request,
+	const struct snapshot * s)
+{
+	uint64_t cumulative = 0;
+	uint32_t i;
+	writeheader(request, "frame_duration_seconds", "histogram",
+		"Duration of main loop frames.");
+	for (i = 0; i < FRAME_BUCKET_COUNT; i++) {
+		cumulative += s->frame_buckets[i];
+		as_http_server_append_response(request,
+			"archlord_frame_duration_seconds_bucket{le=\"%g\"} %llu\n",
+			(double)g_FrameBuckets[i] / 1e6, (unsigned long long)cumulative);
+	}
+	as_http_server_append_response(request,
+		"archlord_frame_duration_seconds_bucket{le=\"+Inf\"} %llu\n"
+		"archlord_frame_duration_seconds_sum %.6f\n"
+		"archlord_frame_duration_seconds_count %llu\n",
+		(unsigned long long)s->frame_count,
+		(double)s->frame_time_sum / 1e6,
+		(unsigned long long)s->frame_count);
+	writeheader(request, "frame_duration_max_seconds", "gauge",
+		"Longest main loop frame.");
+	as_http_server_append_response(request,
+		"archlord_frame_duration_max_seconds %.6f\n",
+		(double)s->max_frame_time / 1e6);
+}
+
+static void writegame(
+	struct as_http_server_concurrent_request * request,
+	const struct snapshot * s)
+{
+	writeheader(request, "connections", "gauge",
+		"Number of client connections.");
+	as_http_server_append_response(request,
+		"archlord_connections{server=\"login\"} %u\n"
+		"archlord_connections{server=\"game\"} %u\n",
+		s->conn_count[AS_SERVER_LOGIN], s->conn_count[AS_SERVER_GAME]);
+	writemetric(request, "online_characters", "gauge",
+		"Number of characters in game.", s->character_count);
+	writemetric(request, "send_buffer_bytes", "gauge",
+		"Bytes waiting in send buffers of game connections.",
+		s->send_buffer_usage);
+	writemetric(request, "send_buffer_max_bytes", "gauge",
+		"Largest send buffer usage of a game connection.",
+		s->max_send_buffer_usage);
+	writemetric(request, "packets_received_total", "counter",
+		"Number of packets that were received.", s->packets_in);
+	writemetric(request, "packet_received_bytes_total", "counter",
+		"Number of packet bytes that were received.", s->bytes_in);
+	writemetric(request, "packets_sent_total", "counter",
+		"Number of packets that were sent.", s->packets_out);
+	writemetric(request, "packet_sent_bytes_total", "counter",
+		"Number of packet bytes that were sent.", s->bytes_out);
+	writemetric(request, "broadcasts_total", "counter",
+		"Number of packets that were broadcast.", s->broadcast_count);
+	writemetric(request, "broadcast_receivers_total", "counter",
+		"Number of connections that broadcast packets were sent to.",
+		s->broadcast_receiver_count);
+	writemetric(request, "broadcast_max_receivers", "gauge",
+		"Largest number of receivers of a broadcast.",
+		s->max_broadcast_receiver_count);
+	writemetric(request, "database_queued_tasks", "gauge",
+		"Database tasks waiting to be submitted.", s->db.queued_count);
+	writemetric(request, "database_active_tasks", "gauge",
+		"Database tasks that are being processed.", s->db.active_count);
+	writemetric(request, "database_completed_tasks_total", "counter",
+		"Number of completed database tasks.", s->db.completed_count);
+	writeheader(request, "database_task_latency_seconds_total", "counter",
+		"Cumulative time between adding and completing database tasks.");
+	as_http_server_append_response(request,
+		"archlord_database_task_latency_seconds_total %.6f\n",
+		(double)s->db.total_latency / 1e6);
+	writeheader(request, "database_task_max_latency_seconds", "gauge",
+		"Longest time between adding and completing a database task.");
+	as_http_server_append_response(request,
+		"archlord_database_task_max_latency_seconds %.6f\n",
+		(double)s->db.max_latency / 1e6);
+}
+
+static void writetasks(struct as_http_server_concurrent_request * request)
+{
+	struct task_stats stats;
+	task_get_stats(&stats);
+	writemetric(request, "task_threads", "gauge",
+		"Number of task threads.", stats.thread_count);
+	writeheader(request, "task_queued", "gauge",
+		"Tasks waiting for a task thread.");
+	as_http_server_append_response(request,
+		"archlord_task_queued{priority=\"normal\"} %u\n"
+		"archlord_task_queued{priority=\"low\"} %u\n",
+		stats.queued_count, stats.low_priority_queued_count);
+	writemetric(request, "task_pending_callbacks", "gauge",
+		"Completed tasks waiting for their callbacks.",
+		stats.done_count);
+}
+
+static void writememory(struct as_http_server_concurrent_request * request)
+{
+	struct alloc_stats allocs;
+	uint64_t rss = 0;
+	uint64_t peak_rss = 0;
+	uint32_t count = get_alloc_tag_count();
+	uint32_t i;
+	size_t index = 0;
+	struct slab_pool * pool;
+	get_alloc_stats(&allocs);
+	if (get_memory_usage(&rss, &peak_rss)) {
+		writemetric(request, "resident_memory_bytes", "gauge",
+			"Resident memory of the process.", rss);
+		writemetric(request, "resident_memory_peak_bytes", "gauge",
+			"Peak resident memory of the process.", peak_rss);
+	}
+	writemetric(request, "allocations_total", "counter",
+		"Number of allocations.", allocs.count);
+	writemetric(request, "allocated_bytes_total", "counter",
+		"Number of bytes that were allocated.", allocs.size);
+	writeheader(request, "alloc_tag_bytes", "gauge",
+		"Live bytes that are owned by an allocation tag.");
+	for (i = 0; i < count; i++) {
+		struct alloc_tag_stats stats;
+		char label[128];
+		get_alloc_tag_stats(i, &stats);
+		if (!stats.count)
+			continue;
+		escapelabel(label, sizeof(label), stats.name);
+		as_http_server_append_response(request,
+			"archlord_alloc_tag_bytes{tag=\"%s\"} %lld\n",
+			label, (long long)stats.size);
+	}
+	writeheader(request, "slab_reserved_bytes", "gauge",
+		"Bytes that are reserved for slabs of a pool.");
+	while (slab_iterate(&index, &pool)) {
+		struct slab_stats stats;
+		char label[128];
+		slab_get_stats(pool, &stats);
+		escapelabel(label, sizeof(label), stats.name);
+		as_http_server_append_response(request,
+			"archlord_slab_reserved_bytes{pool=\"%s\"} %llu\n",
+			label, (unsigned long long)stats.reserved_size);
+	}
+}
+
+static void writeservices(
+	struct as_metrics_module * mod,
+	struct as_http_server_concurrent_request * request)
+{
+	struct log_stats logs;
+	struct as_http_server_stats http;
+	log_get_stats(&logs);
+	as_http_server_get_stats(mod->as_http_server, &http);
+	writemetric(request, "log_messages_total", "counter",
+		"Number of log messages that were written.", logs.written_count);
+	writemetric(request, "log_dropped_messages_total", "counter",
+		"Number of log messages that were dropped.", logs.dropped_count);
+	writemetric(request, "log_suppressed_messages_total", "counter",
+		"Number of log messages that were rate limited.",
+		logs.suppressed_count);
+	writemetric(request, "http_requests_total", "counter",
+		"Number of HTTP requests that were handled.",
+		http.completed_count + http.concurrent_count);
+	writemetric(request, "http_rejected_requests_total", "counter",
+		"Number of HTTP requests that were rejected.",
+		http.rejected_count);
+}
+
+static boolean cbmetrics(
+	struct as_metrics_module * mod,
+	struct as_http_server_concurrent_request * request)
+{
+	struct snapshot s;
+	if (!readsnapshot(mod, &s))
+		return FALSE;
+	as_http_server_set_content_type(request, "text/plain; version=0.0.4");
+	writeframes(request, &s);
+	writegame(request, &s);
+	writetasks(request);
+	writememory(request);
+	writeservices(mod, request);
+	return TRUE;
+}
+
+static boolean onregister(
+	struct as_metrics_module * mod,
+	struct ap_module_registry * registry)
+{
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_tick, AP_TICK_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_database, AS_DATABASE_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_http_server, AS_HTTP_SERVER_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_player, AS_PLAYER_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_server, AS_SERVER_MODULE_NAME);
+	if (!as_http_server_add_concurrent_handler(mod->as_http_server, "/metrics",
+			mod, cbmetrics)) {
+		ERROR("Failed to add metrics handler.");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void onshutdown(struct as_metrics_module * mod)
+{
+	dealloc(mod->packets);
+}
+
+struct as_metrics_module * as_metrics_create_module()
+{
+	struct as_metrics_module * mod = ap_module_instance_new(AS_METRICS_MODULE_NAME,
+		sizeof(*mod), onregister, NULL, NULL, onshutdown);
+	mod->packets = alloc(AS_SERVER_MAX_PACKET_STATS_COUNT * sizeof(*mod->packets));
+	return mod;
+}
+
+void as_metrics_begin_frame(struct as_metrics_module * mod)
+{
+	mod->frame_begin = profile_get_timestamp();
+}
+
+void as_metrics_end_frame(struct as_metrics_module * mod)
+{
+	struct snapshot * s = &mod->current;
+	uint64_t tick = ap_tick_get(mod->ap_tick);
+	uint64_t us;
+	uint32_t i;
+	if (mod->ticks_per_us <= 0.0)
+		mod->ticks_per_us = profile_get_timestamp_frequency();
+	us = (uint64_t)((double)(profile_get_timestamp() - mod->frame_begin) /
+		mod->ticks_per_us);
+	for (i = 0; i < FRAME_BUCKET_COUNT; i++) {
+		if (us <= g_FrameBuckets[i])
+			break;
+	}
+	s->frame_buckets[i]++;
+	s->frame_count++;
+	s->frame_time_sum += us;
+	if (us > s->max_frame_time)
+		s->max_frame_time = us;
+	if (tick >= mod->next_publish_tick) {
+		/* Timestamp frequency is measured against the
+		 * system timer and becomes more accurate over time. */
+		mod->ticks_per_us = profile_get_timestamp_frequency();
+		publish(mod);
+		mod->next_publish_tick = tick + PUBLISH_INTERVAL;
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef _AS_METRICS_H_
+#define _AS_METRICS_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+#include "public/ap_module.h"
+
+#define AS_METRICS_MODULE_NAME "AgsmMetrics"
+
+BEGIN_DECLS
+
+/*
+ * Serves server metrics in Prometheus text format
+ * at `/metrics` on the HTTP server.
+ *
+ * Game state is read by the main thread and
+ * published once per second, requests are handled
+ * on HTTP worker threads from the last published
+ * snapshot and never wait for the main thread.
+ */
+struct as_metrics_module * as_metrics_create_module();
+
+/*
+ * Should be called at the start of each
+ * main loop frame.
+ */
+void as_metrics_begin_frame(struct as_metrics_module * mod);
+
+/*
+ * Should be called at the end of each main loop
+ * frame, before the main thread sleeps.
+ *
+ * Publishes a snapshot if a second has passed
+ * since the last one.
+ */
+void as_metrics_end_frame(struct as_metrics_module * mod);
+
+END_DECLS
+
+#endif /* _AS_METRICS_H_ */
@@ -180,6 +180,11 @@ struct ap_character * as_player_iterate(
 	return *c;
 }
 
+uint32_t as_player_get_count(struct as_player_module * mod)
+{
+	return ap_admin_get_object_count(&mod->player_admin);
+}
+
 struct as_player_session * as_player_get_session(
 	struct as_player_module * mod,
 	const char * character_name)
@@ -76,6 +76,11 @@ boolean as_player_remove(struct as_player_module * mod, struct ap_character * ch
 
 struct ap_character * as_player_iterate(struct as_player_module * mod, size_t * index);
 
+/*
+ * Returns the number of characters that are in game.
+ */
+uint32_t as_player_get_count(struct as_player_module * mod);
+
 struct as_player_session * as_player_get_session(
 	struct as_player_module * mod,
 	const char * character_name);
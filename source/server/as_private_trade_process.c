@@ -9,6 +9,7 @@
 #include "public/ap_module_instance.h"
 #include "public/ap_private_trade.h"
 
+#include "server/as_account.h"
 #include "server/as_item.h"
 #include "server/as_player.h"
 
@@ -23,6 +24,7 @@ struct as_private_trade_process_module {
 	struct ap_item_module * ap_item;
 	struct ap_item_convert_module * ap_item_convert;
 	struct ap_private_trade_module * ap_private_trade;
+	struct as_account_module * as_account;
 	struct as_character_module * as_character;
 	struct as_item_module * as_item;
 	struct as_player_module * as_player;
@@ -531,7 +533,7 @@ static boolean cbreceive(
 			characters[self]->inventory_gold += attachments[peer]->gold_amount;
 			accounts[self]->chantra_coins -= attachments[self]->chantra_coin_amount;
 			accounts[self]->chantra_coins += attachments[peer]->chantra_coin_amount;
-			accounts[self]->commit_linked = TRUE;
+			as_account_link_commit(mod->as_account, accounts[self]);
 			characters[self]->chantra_coins = accounts[self]->chantra_coins;
 			ap_bill_info_make_cash_info_packet(mod->ap_bill_info, 
 				characters[self]->id, 0, accounts[self]->chantra_coins);
@@ -719,6 +721,7 @@ static boolean onregister(
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_item, AP_ITEM_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_item_convert, AP_ITEM_CONVERT_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_private_trade, AP_PRIVATE_TRADE_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_account, AS_ACCOUNT_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_character, AS_CHARACTER_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_item, AS_ITEM_MODULE_NAME);
 	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_player, AS_PLAYER_MODULE_NAME);
@@ -0,0 +1,263 @@
+#include "server/as_reload.h"
+
+#include "core/file_system.h"
+#include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
+#include "core/string.h"
+
+#include "public/ap_chat.h"
+#include "public/ap_config.h"
+#include "public/ap_drop_item.h"
+#include "public/ap_item.h"
+#include "public/ap_module.h"
+#include "public/ap_skill.h"
+
+#include "task/task.h"
+
+#include <assert.h>
+
+struct reload_task {
+	struct task_descriptor task;
+	struct as_reload_module * mod;
+	uint32_t tables;
+	char item_import_path[512];
+	char skill_const_path[512];
+	char skill_const2_path[512];
+	char option_num_drop_rate_path[512];
+	char socket_num_drop_rate_path[512];
+	char drop_rank_rate_path[512];
+	char drop_group_rate_path[512];
+	struct ap_item_import_stage * item;
+	struct ap_skill_const_stage * skill;
+	struct ap_drop_item_rate_stage * drop;
+	uint64_t read_duration;
+};
+
+struct as_reload_module {
+	struct ap_module_instance instance;
+	struct ap_chat_module * ap_chat;
+	struct ap_config_module * ap_config;
+	struct ap_drop_item_module * ap_drop_item;
+	struct ap_item_module * ap_item;
+	struct ap_skill_module * ap_skill;
+	timer_t timer;
+	/* Only one reload is allowed at a time. */
+	struct reload_task * running;
+};
+
+static void freestages(struct reload_task * t)
+{
+	if (t->item)
+		ap_item_free_import_stage(t->mod->ap_item, t->item);
+	if (t->skill)
+		ap_skill_free_const_stage(t->skill);
+	if (t->drop)
+		ap_drop_item_free_rate_stage(t->drop);
+	t->item = NULL;
+	t->skill = NULL;
+	t->drop = NULL;
+}
+
+/*
+ * Runs on a task thread.
+ *
+ * Templates are only read here, they are
+ * modified in `reloadpost` on the main thread.
+ */
+static boolean reloadtask(void * data)
+{
+	struct reload_task * t = data;
+	struct as_reload_module * mod = t->mod;
+	uint64_t begin = timer_delta_no_reset(mod->timer);
+	if (t->tables & AS_RELOAD_TABLE_ITEM) {
+		t->item = ap_item_read_import_stage(mod->ap_item,
+			t->item_import_path, FALSE);
+		if (!t->item ||
+			!ap_item_validate_import_stage(mod->ap_item, t->item)) {
+			ERROR("Failed to reload item templates.");
+			return FALSE;
+		}
+	}
+	if (t->tables & AS_RELOAD_TABLE_SKILL) {
+		t->skill = ap_skill_read_const_stage(mod->ap_skill,
+			t->skill_const_path, t->skill_const2_path, FALSE);
+		if (!t->skill) {
+			ERROR("Failed to reload skill const tables.");
+			return FALSE;
+		}
+	}
+	if (t->tables & AS_RELOAD_TABLE_DROP) {
+		t->drop = ap_drop_item_read_rate_stage(mod->ap_drop_item,
+			t->option_num_drop_rate_path,
+			t->socket_num_drop_rate_path,
+			t->drop_rank_rate_path,
+			t->drop_group_rate_path, FALSE);
+		if (!t->drop) {
+			ERROR("Failed to reload item drop rates.");
+			return FALSE;
+		}
+	}
+	t->read_duration = timer_delta_no_reset(mod->timer) - begin;
+	return TRUE;
+}
+
+/*
+ * Runs on the main thread between frames, so that
+ * no packet or character is being processed while
+ * staged tables are applied.
+ */
+static void reloadpost(
+	struct task_descriptor * task,
+	void * data,
+	boolean result)
+{
+	struct reload_task * t = data;
+	struct as_reload_module * mod = t->mod;
+	uint64_t begin;
+	assert(mod->running == t);
+	mod->running = NULL;
+	if (!result) {
+		WARN("Reload was cancelled, current data tables are kept.");
+		freestages(t);
+		dealloc(t);
+		return;
+	}
+	begin = timer_delta_no_reset(mod->timer);
+	if (t->item) {
+		ap_item_apply_import_stage(mod->ap_item, t->item);
+		t->item = NULL;
+	}
+	if (t->skill) {
+		ap_skill_apply_const_stage(mod->ap_skill, t->skill);
+		t->skill = NULL;
+	}
+	if (t->drop) {
+		ap_drop_item_apply_rate_stage(mod->ap_drop_item, t->drop);
+		t->drop = NULL;
+	}
+	INFO("Reloaded data tables (read %llu ms, apply %llu us, %u retired skill const generations).",
+		(unsigned long long)(t->read_duration / 1000),
+		(unsigned long long)(timer_delta_no_reset(mod->timer) - begin),
+		ap_skill_get_retired_const_generation_count(mod->ap_skill));
+	dealloc(t);
+}
+
+static boolean makepath(
+	char * dst,
+	size_t maxcount,
+	const char * dir,
+	const char * file_name)
+{
+	if (!make_path(dst, maxcount, "%s/%s", dir, file_name)) {
+		ERROR("Failed to create path (%s/%s).", dir, file_name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void cbchatreload(
+	struct as_reload_module * mod,
+	struct ap_character * c,
+	uint32_t argc,
+	const char * const * argv)
+{
+	uint32_t tables = AS_RELOAD_TABLE_ALL;
+	if (argc >= 1) {
+		if (strcmp(argv[0], "item") == 0)
+			tables = AS_RELOAD_TABLE_ITEM;
+		else if (strcmp(argv[0], "skill") == 0)
+			tables = AS_RELOAD_TABLE_SKILL;
+		else if (strcmp(argv[0], "drop") == 0)
+			tables = AS_RELOAD_TABLE_DROP;
+		else if (strcmp(argv[0], "all") != 0)
+			return;
+	}
+	INFO("Data table reload was requested by %s.", c->name);
+	as_reload_tables(mod, tables);
+}
+
+static boolean onregister(
+	struct as_reload_module * mod,
+	struct ap_module_registry * registry)
+{
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_chat, AP_CHAT_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_config, AP_CONFIG_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_drop_item, AP_DROP_ITEM_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_item, AP_ITEM_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_skill, AP_SKILL_MODULE_NAME);
+	ap_chat_add_command(mod->ap_chat, "/reload", mod, cbchatreload);
+	return TRUE;
+}
+
+static void onshutdown(struct as_reload_module * mod)
+{
+	/* A reload task may still be using other modules,
+	 * wait for it to complete before they are shutdown. */
+	while (mod->running) {
+		task_wait_all();
+		task_do_post_cb();
+		if (mod->running)
+			sleep(1);
+	}
+}
+
+struct as_reload_module * as_reload_create_module()
+{
+	struct as_reload_module * mod = ap_module_instance_new(AS_RELOAD_MODULE_NAME,
+		sizeof(*mod), onregister, NULL, NULL, onshutdown);
+	mod->timer = create_timer();
+	return mod;
+}
+
+boolean as_reload_tables(struct as_reload_module * mod, uint32_t tables)
+{
+	const char * inidir = ap_config_get(mod->ap_config, "ServerIniDir");
+	struct reload_task * t;
+	if (mod->running) {
+		WARN("A data table reload is already in progress.");
+		return FALSE;
+	}
+	if (!inidir) {
+		ERROR("Failed to retrieve ServerIniDir config.");
+		return FALSE;
+	}
+	t = alloc(sizeof(*t));
+	memset(t, 0, sizeof(*t));
+	t->mod = mod;
+	t->tables = tables;
+	if (!makepath(t->item_import_path, sizeof(t->item_import_path),
+			inidir, "itemdatatable.txt") ||
+		!makepath(t->skill_const_path, sizeof(t->skill_const_path),
+			inidir, "skillconst.txt") ||
+		!makepath(t->skill_const2_path, sizeof(t->skill_const2_path),
+			inidir, "skillconst2.txt") ||
+		!makepath(t->option_num_drop_rate_path,
+			sizeof(t->option_num_drop_rate_path),
+			inidir, "optionnumdroprate.txt") ||
+		!makepath(t->socket_num_drop_rate_path,
+			sizeof(t->socket_num_drop_rate_path),
+			inidir, "socketnumdroprate.txt") ||
+		!makepath(t->drop_rank_rate_path,
+			sizeof(t->drop_rank_rate_path),
+			inidir, "droprankrate.txt") ||
+		!makepath(t->drop_group_rate_path,
+			sizeof(t->drop_group_rate_path),
+			inidir, "groupdroprate.txt")) {
+		dealloc(t);
+		return FALSE;
+	}
+	t->task.work_cb = reloadtask;
+	t->task.post_cb = reloadpost;
+	t->task.data = t;
+	mod->running = t;
+	/* Low priority so that database and map tasks
+	 * are not delayed. */
+	task_add(&t->task, TRUE);
+	return TRUE;
+}
+
+boolean as_reload_is_in_progress(struct as_reload_module * mod)
+{
+	return (mod->running != NULL);
+}
@@ -0,0 +1,42 @@
+#ifndef _AS_RELOAD_H_
+#define _AS_RELOAD_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+#include "public/ap_module.h"
+
+#define AS_RELOAD_MODULE_NAME "AgsmReload"
+
+BEGIN_DECLS
+
+enum as_reload_table_bits {
+	AS_RELOAD_TABLE_ITEM = 1u << 0,
+	AS_RELOAD_TABLE_SKILL = 1u << 1,
+	AS_RELOAD_TABLE_DROP = 1u << 2,
+	AS_RELOAD_TABLE_ALL = AS_RELOAD_TABLE_ITEM |
+		AS_RELOAD_TABLE_SKILL | AS_RELOAD_TABLE_DROP,
+};
+
+struct as_reload_module * as_reload_create_module();
+
+/*
+ * Starts reloading data tables.
+ *
+ * Tables are read and validated on a task thread.
+ * If all of them are valid, they are applied together
+ * on the main thread when post task callbacks are
+ * triggered, otherwise current data is kept.
+ *
+ * Returns FALSE if a reload is already in progress.
+ */
+boolean as_reload_tables(struct as_reload_module * mod, uint32_t tables);
+
+/*
+ * Returns TRUE if a reload is in progress.
+ */
+boolean as_reload_is_in_progress(struct as_reload_module * mod);
+
+END_DECLS
+
+#endif /* _AS_RELOAD_H_ */
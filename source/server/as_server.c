@@ -3,6 +3,7 @@
 
 #include "core/log.h"
 #include "core/malloc.h"
+#include "core/profile.h"
 #include "core/ring_buffer.h"
 #include "core/vector.h"
 
@@ -24,6 +25,11 @@
 #include "server/as_server.h"
 
 #define MAX_PACKET_SIZE (1u << 15)
+/* Packet stats are indexed by packet type and 
+ * operation, operation 256 is used for packets 
+ * whose operation cannot be read. */
+#define PACKET_STATS_KEY(type, op) ((uint32_t)(type) * 257 + (op))
+#define PACKET_STATS_KEY_COUNT (256 * 257)
 
 struct srv_module {
 	enum as_server_type type;
@@ -40,8 +46,73 @@ struct as_server_module {
 	struct srv_module * servers[AS_SERVER_COUNT];
 	uint64_t * traverse_buffer;
 	void * parse_buffer;
+	/* Handler durations are accumulated in 
+	 * profiler timestamp ticks. */
+	struct as_server_packet_stats * packet_stats;
+	uint32_t packet_stats_count;
+	/* Index + 1 of packet stats by key. */
+	uint16_t * packet_stats_index;
+	double ticks_per_us;
 };
 
+static struct as_server_packet_stats * getpacketstats(
+	struct as_server_module * mod,
+	const void * data,
+	uint16_t length)
+{
+	uint8_t type = ((const uint8_t *)data)[3];
+	uint8_t op;
+	boolean has_op = au_packet_get_operation(data, length, &op);
+	uint32_t key = PACKET_STATS_KEY(type, has_op ? op : 256);
+	uint32_t index = mod->packet_stats_index[key];
+	struct as_server_packet_stats * stats;
+	if (index)
+		return &mod->packet_stats[index - 1];
+	if (mod->packet_stats_count >= AS_SERVER_MAX_PACKET_STATS_COUNT)
+		return NULL;
+	index = ++mod->packet_stats_count;
+	mod->packet_stats_index[key] = (uint16_t)index;
+	stats = &mod->packet_stats[index - 1];
+	memset(stats, 0, sizeof(*stats));
+	stats->packet_type = type;
+	stats->operation = has_op ? op : -1;
+	return stats;
+}
+
+static void counthandler(
+	struct as_server_module * mod,
+	struct as_server_packet_stats * stats,
+	uint64_t duration)
+{
+	uint64_t us = (uint64_t)((double)duration / mod->ticks_per_us);
+	uint32_t bucket = 0;
+	while (bucket < AS_SERVER_HANDLER_HISTOGRAM_BUCKET_COUNT - 1 &&
+		us >= (1ull << bucket)) {
+		bucket++;
+	}
+	stats->handler_time += duration;
+	if (duration > stats->max_handler_time)
+		stats->max_handler_time = duration;
+	stats->handler_histogram[bucket]++;
+}
+
+/*
+ * Counts a packet that was written to a send buffer, 
+ * `length` is the length of the encrypted packet.
+ */
+static void countsend(
+	struct as_server_module * mod,
+	const void * packet,
+	uint16_t length)
+{
+	struct as_server_packet_stats * stats = getpacketstats(mod, packet, 
+		((const struct au_packet_header *)packet)->length);
+	if (stats) {
+		stats->out_count++;
+		stats->out_bytes += length;
+	}
+}
+
 static struct as_server_conn * find_conn(
 	struct srv_module * srv,
 	uint64_t id)
@@ -141,6 +212,10 @@ static boolean process_read_buffer(
 	switch (conn->stage) {
 	case AS_SERVER_CONN_STAGE_READY: {
 		struct as_server_cb_receive cb = { 0 };
+		struct as_server_packet_stats * stats;
+		uint16_t wire_length = length;
+		uint64_t begin;
+		boolean result;
 		if (data[0] != AU_PACKET_FRONT_PRIVATE_BYTE)
 			return FALSE;
 		if (!au_blowfish_decrypt_private(&conn->blowfish, 
@@ -153,7 +228,15 @@ static boolean process_read_buffer(
 		cb.packet_type = data[3];
 		cb.data = data;
 		cb.length = length;
-		if (!ap_module_enum_callback(mod, AS_SERVER_CB_RECEIVE, &cb)) {
+		stats = getpacketstats(mod, data, length);
+		begin = profile_get_timestamp();
+		result = ap_module_enum_callback(mod, AS_SERVER_CB_RECEIVE, &cb);
+		if (stats) {
+			stats->in_count++;
+			stats->in_bytes += wire_length;
+			counthandler(mod, stats, profile_get_timestamp() - begin);
+		}
+		if (!result) {
 			as_server_disconnect(mod, conn);
 			return FALSE;
 		}
@@ -328,6 +411,8 @@ static void onclose(struct as_server_module * mod)
 static void onshutdown(struct as_server_module * mod)
 {
 	vec_free(mod->traverse_buffer);
+	dealloc(mod->packet_stats);
+	dealloc(mod->packet_stats_index);
 }
 
 struct as_server_module * as_server_create_module()
@@ -340,11 +425,19 @@ struct as_server_module * as_server_create_module()
 		conn_ctor, conn_dtor);
 	mod->traverse_buffer = vec_new_reserved(sizeof(uint64_t), 128);
 	mod->parse_buffer = alloc(MAX_PACKET_SIZE);
+	mod->packet_stats = alloc(AS_SERVER_MAX_PACKET_STATS_COUNT * 
+		sizeof(*mod->packet_stats));
+	mod->packet_stats_index = alloc(PACKET_STATS_KEY_COUNT * 
+		sizeof(*mod->packet_stats_index));
+	memset(mod->packet_stats_index, 0, PACKET_STATS_KEY_COUNT * 
+		sizeof(*mod->packet_stats_index));
+	mod->ticks_per_us = 1.0;
 	return mod;
 }
 
 boolean as_server_create_servers(struct as_server_module * mod, uint32_t flags)
 {
+	mod->ticks_per_us = profile_get_timestamp_frequency();
 	if (flags & AS_SERVER_CREATE_LOGIN) {
 		mod->servers[AS_SERVER_LOGIN] = 
 			create_server(mod, AS_SERVER_LOGIN);
@@ -507,6 +600,7 @@ void as_server_send_packet(
 		return;
 	}
 	rb_write(conn->send_buffer, data, length);
+	countsend(mod, packet, length);
 }
 
 void as_server_send_custom_packet(
@@ -532,6 +626,7 @@ void as_server_send_custom_packet(
 		data = buffer;
 	}
 	rb_write(conn->send_buffer, data, length);
+	countsend(mod, buffer, length);
 }
 
 void as_server_send_packet_by_id(
@@ -556,6 +651,68 @@ size_t as_server_attach_data(
 		callback_module, constructor, destructor);
 }
 
+void as_server_count_broadcast(
+	struct as_server_module * mod,
+	uint32_t receiver_count)
+{
+	struct as_server_packet_stats * stats;
+	if (!receiver_count)
+		return;
+	stats = getpacketstats(mod, ap_packet_get_buffer(mod->ap_packet),
+		ap_packet_get_length(mod->ap_packet));
+	if (!stats)
+		return;
+	stats->broadcast_count++;
+	stats->broadcast_receiver_count += receiver_count;
+	if (receiver_count > stats->max_broadcast_receiver_count)
+		stats->max_broadcast_receiver_count = receiver_count;
+}
+
+uint32_t as_server_get_packet_stats(
+	struct as_server_module * mod,
+	struct as_server_packet_stats * stats,
+	uint32_t max_count)
+{
+	uint32_t count = MIN(mod->packet_stats_count, max_count);
+	uint32_t i;
+	double ticks_per_us;
+	/* Frequency is calibrated more accurately 
+	 * as time passes. */
+	mod->ticks_per_us = profile_get_timestamp_frequency();
+	ticks_per_us = mod->ticks_per_us;
+	memcpy(stats, mod->packet_stats, count * sizeof(*stats));
+	for (i = 0; i < count; i++) {
+		stats[i].handler_time = 
+			(uint64_t)((double)stats[i].handler_time / ticks_per_us);
+		stats[i].max_handler_time = 
+			(uint64_t)((double)stats[i].max_handler_time / ticks_per_us);
+	}
+	return count;
+}
+
+void as_server_reset_packet_stats(struct as_server_module * mod)
+{
+	uint32_t i;
+	for (i = 0; i < mod->packet_stats_count; i++) {
+		struct as_server_packet_stats * s = &mod->packet_stats[i];
+		uint8_t type = s->packet_type;
+		int32_t op = s->operation;
+		/* Packet type and operation are kept so that 
+		 * indices do not change. */
+		memset(s, 0, sizeof(*s));
+		s->packet_type = type;
+		s->operation = op;
+	}
+}
+
+uint32_t as_server_get_conn_count(
+	struct as_server_module * mod,
+	enum as_server_type type)
+{
+	struct srv_module * srv = mod->servers[type];
+	return srv ? ap_admin_get_object_count(&srv->conn_admin) : 0;
+}
+
 uint64_t * as_server_iterate_conn(
 	struct as_server_module * mod,
 	enum as_server_type type,
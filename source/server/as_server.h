@@ -10,6 +10,13 @@
 
 #define AS_SERVER_MODULE_NAME "AgsmServer"
 
+/* Maximum number of packet type and operation 
+ * pairs that are counted, the rest are not. */
+#define AS_SERVER_MAX_PACKET_STATS_COUNT 1024
+/* Bucket `i` counts handlers that took less than 
+ * 2^i microseconds, last bucket counts the rest. */
+#define AS_SERVER_HANDLER_HISTOGRAM_BUCKET_COUNT 16
+
 enum as_server_type {
 	AS_SERVER_LOGIN,
 	AS_SERVER_GAME,
@@ -61,6 +68,32 @@ struct as_server_cb_receive {
 	uint16_t length;
 };
 
+/*
+ * Traffic of a packet type and operation.
+ *
+ * Operation is read from the first field of packets 
+ * (see `au_packet_get_operation`), it is -1 if it 
+ * could not be read.
+ */
+struct as_server_packet_stats {
+	uint8_t packet_type;
+	int32_t operation;
+	uint64_t in_count;
+	uint64_t in_bytes;
+	uint64_t out_count;
+	uint64_t out_bytes;
+	/* Number of times packets were broadcast, 
+	 * and total and maximum number of receivers. */
+	uint64_t broadcast_count;
+	uint64_t broadcast_receiver_count;
+	uint32_t max_broadcast_receiver_count;
+	/* Cumulative and maximum duration of receive 
+	 * handlers, in microseconds. */
+	uint64_t handler_time;
+	uint64_t max_handler_time;
+	uint64_t handler_histogram[AS_SERVER_HANDLER_HISTOGRAM_BUCKET_COUNT];
+};
+
 struct as_server_module * as_server_create_module();
 
 boolean as_server_create_servers(struct as_server_module * mod, uint32_t flags);
@@ -123,6 +156,37 @@ size_t as_server_attach_data(
 	ap_module_default_t constructor,
 	ap_module_default_t destructor);
 
+/*
+ * Counts a broadcast of the current packet 
+ * (see `ap_packet_get_buffer`).
+ *
+ * Should be called after the packet is sent 
+ * to `receiver_count` connections.
+ */
+void as_server_count_broadcast(
+	struct as_server_module * mod,
+	uint32_t receiver_count);
+
+/*
+ * Retrieves traffic of packet types and operations.
+ *
+ * Stats are retrieved in the order packet types 
+ * and operations were first seen, so that indices 
+ * do not change between calls.
+ *
+ * Returns the number of stats that were retrieved.
+ */
+uint32_t as_server_get_packet_stats(
+	struct as_server_module * mod,
+	struct as_server_packet_stats * stats,
+	uint32_t max_count);
+
+void as_server_reset_packet_stats(struct as_server_module * mod);
+
+uint32_t as_server_get_conn_count(
+	struct as_server_module * mod,
+	enum as_server_type type);
+
 uint64_t * as_server_iterate_conn(
 	struct as_server_module * mod,
 	enum as_server_type type,
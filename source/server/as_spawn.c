@@ -273,6 +273,9 @@ static boolean cbmapentersectorview(
 			case AS_SPAWN_MAP_SECTOR_STATUS_DEACTIVE: {
 				struct sector_id id = { cb->sector->index_x,
 					cb->sector->index_z };
+				/* Monsters will be moving around in this 
+				 * sector, read its segments ahead of time. */
+				as_map_prefetch_sector(mod->as_map, cb->sector);
 				vec_push_back(&mod->activate, &id);
 				s->status = AS_SPAWN_MAP_SECTOR_STATUS_AWAIT_ACTIVATION;
 				break;
@@ -0,0 +1,441 @@
+#include "server/as_stats.h"
+
+#include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
+#include "core/profile.h"
+#include "core/string.h"
+#include "core/vector.h"
+
+#include "public/ap_character.h"
+#include "public/ap_chat.h"
+#include "public/ap_module.h"
+#include "public/ap_module_registry.h"
+#include "public/ap_tick.h"
+
+#include "server/as_server.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Interval of packet statistics snapshots 
+ * that are written to server log, in ms. */
+#define PACKET_SNAPSHOT_INTERVAL 300000
+#define PACKET_SNAPSHOT_COUNT 10
+
+enum packet_sort {
+	PACKET_SORT_BYTES,
+	PACKET_SORT_TIME,
+};
+
+struct as_stats_module {
+	struct ap_module_instance instance;
+	struct ap_module_registry * registry;
+	struct ap_chat_module * ap_chat;
+	struct ap_tick_module * ap_tick;
+	struct as_server_module * as_server;
+	struct as_server_packet_stats * packets;
+	/* Packet statistics at the time of 
+	 * the last snapshot. */
+	struct as_server_packet_stats * prev_packets;
+	uint32_t prev_packet_count;
+	uint64_t next_snapshot_tick;
+};
+
+struct callback_entry {
+	struct ap_module * module_;
+	uint32_t id;
+	uint32_t index;
+	struct ap_module_callback_stats stats;
+	/* Total time, extrapolated from sampled calls. */
+	double estimated_time;
+};
+
+static int sorttags(const void * a, const void * b)
+{
+	const struct alloc_tag_stats * ta = a;
+	const struct alloc_tag_stats * tb = b;
+	if (ta->size != tb->size)
+		return (ta->size < tb->size) ? 1 : -1;
+	return (ta->count < tb->count) ? 1 : (ta->count > tb->count) ? -1 : 0;
+}
+
+static int sortcallbacks(const void * a, const void * b)
+{
+	const struct callback_entry * ca = a;
+	const struct callback_entry * cb = b;
+	if (ca->estimated_time != cb->estimated_time)
+		return (ca->estimated_time < cb->estimated_time) ? 1 : -1;
+	return (ca->stats.call_count < cb->stats.call_count) ? 1 : 
+		(ca->stats.call_count > cb->stats.call_count) ? -1 : 0;
+}
+
+static int sortpacketsbybytes(const void * a, const void * b)
+{
+	const struct as_server_packet_stats * pa = a;
+	const struct as_server_packet_stats * pb = b;
+	uint64_t ba = pa->in_bytes + pa->out_bytes;
+	uint64_t bb = pb->in_bytes + pb->out_bytes;
+	return (ba < bb) ? 1 : (ba > bb) ? -1 : 0;
+}
+
+static int sortpacketsbytime(const void * a, const void * b)
+{
+	const struct as_server_packet_stats * pa = a;
+	const struct as_server_packet_stats * pb = b;
+	return (pa->handler_time < pb->handler_time) ? 1 : 
+		(pa->handler_time > pb->handler_time) ? -1 : 0;
+}
+
+/*
+ * Returns the upper bound of handler duration, in 
+ * microseconds, of the given fraction of handlers.
+ */
+static uint64_t gethandlerpercentile(
+	const struct as_server_packet_stats * s,
+	double fraction)
+{
+	uint64_t total = 0;
+	uint64_t sum = 0;
+	uint32_t i;
+	for (i = 0; i < AS_SERVER_HANDLER_HISTOGRAM_BUCKET_COUNT; i++)
+		total += s->handler_histogram[i];
+	for (i = 0; i < AS_SERVER_HANDLER_HISTOGRAM_BUCKET_COUNT - 1; i++) {
+		sum += s->handler_histogram[i];
+		if ((double)sum >= fraction * (double)total)
+			break;
+	}
+	return 1ull << i;
+}
+
+static void logpackets(
+	const char * prefix,
+	struct as_server_packet_stats * stats,
+	uint32_t count,
+	enum packet_sort sort,
+	uint32_t max_count)
+{
+	uint32_t i;
+	qsort(stats, count, sizeof(*stats), 
+		(sort == PACKET_SORT_TIME) ? sortpacketsbytime : sortpacketsbybytes);
+	if (max_count && max_count < count)
+		count = max_count;
+	for (i = 0; i < count; i++) {
+		const struct as_server_packet_stats * s = &stats[i];
+		char op[16];
+		if (!s->in_count && !s->out_count)
+			break;
+		if (s->operation >= 0)
+			snprintf(op, sizeof(op), "%3d", s->operation);
+		else
+			strlcpy(op, "  -", sizeof(op));
+		INFO("%s: 0x%02X/%s out %8llu KB (%8llu), in %8llu KB (%8llu), broadcast %6llu x %5.1f (max %4u), handler %9.2f ms (max %6llu us, p50 < %llu us, p99 < %llu us).",
+			prefix,
+			s->packet_type,
+			op,
+			(unsigned long long)(s->out_bytes / 1024),
+			(unsigned long long)s->out_count,
+			(unsigned long long)(s->in_bytes / 1024),
+			(unsigned long long)s->in_count,
+			(unsigned long long)s->broadcast_count,
+			s->broadcast_count ? 
+				(double)s->broadcast_receiver_count / (double)s->broadcast_count : 0.0,
+			s->max_broadcast_receiver_count,
+			(double)s->handler_time / 1000.0,
+			(unsigned long long)s->max_handler_time,
+			(unsigned long long)gethandlerpercentile(s, 0.5),
+			(unsigned long long)gethandlerpercentile(s, 0.99));
+	}
+}
+
+/*
+ * Subtracts statistics of the last snapshot, 
+ * maximums are not subtracted.
+ */
+static void subtractpackets(
+	struct as_server_packet_stats * s,
+	const struct as_server_packet_stats * prev)
+{
+	uint32_t i;
+	if (s->in_count < prev->in_count || s->out_count < prev->out_count) {
+		/* Statistics were reset since last snapshot. */
+		return;
+	}
+	s->in_count -= prev->in_count;
+	s->in_bytes -= prev->in_bytes;
+	s->out_count -= prev->out_count;
+	s->out_bytes -= prev->out_bytes;
+	s->broadcast_count -= prev->broadcast_count;
+	s->broadcast_receiver_count -= prev->broadcast_receiver_count;
+	s->handler_time -= prev->handler_time;
+	for (i = 0; i < AS_SERVER_HANDLER_HISTOGRAM_BUCKET_COUNT; i++)
+		s->handler_histogram[i] -= prev->handler_histogram[i];
+}
+
+static void cbchatmemory(
+	struct as_stats_module * mod,
+	struct ap_character * c,
+	uint32_t argc,
+	const char * const * argv)
+{
+	uint32_t count = 20;
+	if (argc >= 1)
+		count = strtoul(argv[0], NULL, 10);
+	INFO("Memory statistics were requested by %s.", c->name);
+	as_stats_log_memory(mod, count);
+}
+
+static void cbchatprofile(
+	struct as_stats_module * mod,
+	struct ap_character * c,
+	uint32_t argc,
+	const char * const * argv)
+{
+	uint32_t seconds = 10;
+	char path[128];
+	if (argc >= 1)
+		seconds = strtoul(argv[0], NULL, 10);
+	snprintf(path, sizeof(path), "profile-%llu.json",
+		(unsigned long long)time(NULL));
+	if (profile_export_trace(path, seconds)) {
+		INFO("Profile of last %u seconds was written to %s (requested by %s).",
+			seconds, path, c->name);
+	}
+}
+
+static void cbchatcallbacks(
+	struct as_stats_module * mod,
+	struct ap_character * c,
+	uint32_t argc,
+	const char * const * argv)
+{
+	if (argc >= 1 && strcmp(argv[0], "full") == 0) {
+		ap_module_set_callback_profiling(AP_MODULE_CALLBACK_PROFILING_FULL);
+		INFO("Callback profiling was enabled by %s.", c->name);
+	}
+	else if (argc >= 1 && strcmp(argv[0], "sample") == 0) {
+		ap_module_set_callback_profiling(AP_MODULE_CALLBACK_PROFILING_SAMPLED);
+		INFO("Sampled callback profiling was enabled by %s.", c->name);
+	}
+	else if (argc >= 1 && strcmp(argv[0], "off") == 0) {
+		ap_module_set_callback_profiling(AP_MODULE_CALLBACK_PROFILING_DISABLED);
+		INFO("Callback profiling was disabled by %s.", c->name);
+	}
+	else if (argc >= 1 && strcmp(argv[0], "reset") == 0) {
+		uint32_t count = vec_count(mod->registry->list);
+		uint32_t i;
+		for (i = 0; i < count; i++)
+			ap_module_reset_callback_stats(mod->registry->list[i]);
+		INFO("Callback statistics were reset by %s.", c->name);
+	}
+	else {
+		uint32_t count = 20;
+		if (argc >= 1)
+			count = strtoul(argv[0], NULL, 10);
+		INFO("Callback statistics were requested by %s.", c->name);
+		as_stats_log_callbacks(mod, count);
+	}
+}
+
+static void cbchatpackets(
+	struct as_stats_module * mod,
+	struct ap_character * c,
+	uint32_t argc,
+	const char * const * argv)
+{
+	enum packet_sort sort = PACKET_SORT_BYTES;
+	uint32_t count = 20;
+	uint32_t i = 0;
+	if (argc >= 1 && strcmp(argv[0], "reset") == 0) {
+		as_server_reset_packet_stats(mod->as_server);
+		mod->prev_packet_count = 0;
+		INFO("Packet statistics were reset by %s.", c->name);
+		return;
+	}
+	if (argc >= 1 && strcmp(argv[0], "time") == 0) {
+		sort = PACKET_SORT_TIME;
+		i++;
+	}
+	else if (argc >= 1 && strcmp(argv[0], "bytes") == 0) {
+		i++;
+	}
+	if (argc > i)
+		count = strtoul(argv[i], NULL, 10);
+	INFO("Packet statistics were requested by %s.", c->name);
+	as_stats_log_packets(mod, sort == PACKET_SORT_TIME, count);
+}
+
+static boolean onregister(
+	struct as_stats_module * mod,
+	struct ap_module_registry * registry)
+{
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_chat, AP_CHAT_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->ap_tick, AP_TICK_MODULE_NAME);
+	AP_MODULE_INSTANCE_FIND_IN_REGISTRY(registry, mod->as_server, AS_SERVER_MODULE_NAME);
+	mod->registry = registry;
+	ap_chat_add_command(mod->ap_chat, "/memory", mod, cbchatmemory);
+	ap_chat_add_command(mod->ap_chat, "/profile", mod, cbchatprofile);
+	ap_chat_add_command(mod->ap_chat, "/callbacks", mod, cbchatcallbacks);
+	ap_chat_add_command(mod->ap_chat, "/packets", mod, cbchatpackets);
+	return TRUE;
+}
+
+static void onshutdown(struct as_stats_module * mod)
+{
+	dealloc(mod->packets);
+	dealloc(mod->prev_packets);
+}
+
+struct as_stats_module * as_stats_create_module()
+{
+	struct as_stats_module * mod = ap_module_instance_new(AS_STATS_MODULE_NAME,
+		sizeof(*mod), onregister, NULL, NULL, onshutdown);
+	size_t size = AS_SERVER_MAX_PACKET_STATS_COUNT * sizeof(*mod->packets);
+	mod->packets = alloc(size);
+	mod->prev_packets = alloc(size);
+	return mod;
+}
+
+void as_stats_log_memory(struct as_stats_module * mod, uint32_t max_count)
+{
+	uint32_t count = get_alloc_tag_count();
+	struct alloc_tag_stats * tags;
+	struct alloc_stats allocs;
+	uint64_t rss = 0;
+	uint64_t peak_rss = 0;
+	int64_t live = 0;
+	uint32_t i;
+	/* Allocating the list would change statistics of 
+	 * current tag, so it is allocated untagged. */
+	tags = alloc_tagged(count * sizeof(*tags), ALLOC_TAG_UNTAGGED);
+	for (i = 0; i < count; i++) {
+		get_alloc_tag_stats(i, &tags[i]);
+		live += tags[i].size;
+	}
+	qsort(tags, count, sizeof(*tags), sorttags);
+	get_alloc_stats(&allocs);
+	get_memory_usage(&rss, &peak_rss);
+	INFO("Memory: %llu KB resident (peak %llu KB), %lld KB allocated, %llu allocations since startup.",
+		(unsigned long long)(rss / 1024),
+		(unsigned long long)(peak_rss / 1024),
+		(long long)(live / 1024),
+		(unsigned long long)allocs.count);
+	if (max_count && max_count < count)
+		count = max_count;
+	for (i = 0; i < count; i++) {
+		const struct alloc_tag_stats * t = &tags[i];
+		if (!t->size && !t->count)
+			break;
+		INFO("Memory: %-40s %10lld KB in %10lld allocations (%llu since startup).",
+			t->name,
+			(long long)(t->size / 1024),
+			(long long)t->count,
+			(unsigned long long)t->total_count);
+	}
+	dealloc(tags);
+}
+
+void as_stats_log_callbacks(struct as_stats_module * mod, uint32_t max_count)
+{
+	uint32_t module_count = vec_count(mod->registry->list);
+	struct callback_entry * entries = NULL;
+	uint32_t count = 0;
+	double frequency = profile_get_timestamp_frequency();
+	uint32_t i;
+	if (ap_module_get_callback_profiling() == AP_MODULE_CALLBACK_PROFILING_DISABLED)
+		WARN("Callback profiling is disabled (enable with /callbacks full|sample).");
+	for (i = 0; i < module_count; i++) {
+		struct ap_module * m = mod->registry->list[i];
+		uint32_t id;
+		for (id = 0; id < AP_MODULE_MAX_CALLBACK_ID; id++)
+			count += m->callback_count[id];
+	}
+	if (!count)
+		return;
+	entries = alloc_tagged(count * sizeof(*entries), ALLOC_TAG_UNTAGGED);
+	count = 0;
+	for (i = 0; i < module_count; i++) {
+		struct ap_module * m = mod->registry->list[i];
+		uint32_t id;
+		for (id = 0; id < AP_MODULE_MAX_CALLBACK_ID; id++) {
+			uint32_t j;
+			for (j = 0; j < m->callback_count[id]; j++) {
+				struct callback_entry * e = &entries[count];
+				ap_module_get_callback_stats(m, id, j, &e->stats);
+				if (!e->stats.call_count)
+					continue;
+				e->module_ = m;
+				e->id = id;
+				e->index = j;
+				e->estimated_time = (double)e->stats.total_time;
+				if (e->stats.sample_count) {
+					e->estimated_time *= (double)e->stats.call_count / 
+						(double)e->stats.sample_count;
+				}
+				count++;
+			}
+		}
+	}
+	qsort(entries, count, sizeof(*entries), sortcallbacks);
+	if (max_count && max_count < count)
+		count = max_count;
+	for (i = 0; i < count; i++) {
+		const struct callback_entry * e = &entries[i];
+		const struct ap_module * handler = 
+			e->module_->callback_modules[e->id][e->index];
+		INFO("Callback: %s[%u][%u] -> %-28s %10.2f ms total, %8.2f us max, %10llu calls (%llu timed).",
+			e->module_->name,
+			e->id,
+			e->index,
+			handler->name,
+			e->estimated_time / frequency / 1000.0,
+			(double)e->stats.max_time / frequency,
+			(unsigned long long)e->stats.call_count,
+			(unsigned long long)e->stats.sample_count);
+	}
+	dealloc(entries);
+}
+
+void as_stats_log_packets(
+	struct as_stats_module * mod, 
+	boolean sort_by_time,
+	uint32_t max_count)
+{
+	uint32_t count = as_server_get_packet_stats(mod->as_server,
+		mod->packets, AS_SERVER_MAX_PACKET_STATS_COUNT);
+	logpackets("Packets", mod->packets, count, 
+		sort_by_time ? PACKET_SORT_TIME : PACKET_SORT_BYTES, max_count);
+}
+
+void as_stats_process(struct as_stats_module * mod)
+{
+	uint64_t tick = ap_tick_get(mod->ap_tick);
+	uint32_t count;
+	uint32_t i;
+	if (tick < mod->next_snapshot_tick)
+		return;
+	if (!mod->next_snapshot_tick) {
+		/* First snapshot is taken after an interval. */
+		mod->next_snapshot_tick = tick + PACKET_SNAPSHOT_INTERVAL;
+		return;
+	}
+	mod->next_snapshot_tick = tick + PACKET_SNAPSHOT_INTERVAL;
+	count = as_server_get_packet_stats(mod->as_server,
+		mod->packets, AS_SERVER_MAX_PACKET_STATS_COUNT);
+	/* Stats of the same packet type and operation 
+	 * have the same index in both snapshots. */
+	for (i = 0; i < count; i++) {
+		struct as_server_packet_stats current = mod->packets[i];
+		if (i < mod->prev_packet_count)
+			subtractpackets(&mod->packets[i], &mod->prev_packets[i]);
+		mod->prev_packets[i] = current;
+	}
+	mod->prev_packet_count = count;
+	logpackets("Packet snapshot (bytes)", mod->packets, count, 
+		PACKET_SORT_BYTES, PACKET_SNAPSHOT_COUNT);
+	logpackets("Packet snapshot (handler time)", mod->packets, count, 
+		PACKET_SORT_TIME, PACKET_SNAPSHOT_COUNT);
+}
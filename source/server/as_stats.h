@@ -0,0 +1,59 @@
+#ifndef _AS_STATS_H_
+#define _AS_STATS_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+#include "public/ap_module.h"
+
+#define AS_STATS_MODULE_NAME "AgsmStats"
+
+BEGIN_DECLS
+
+/*
+ * Adds admin commands that write runtime 
+ * statistics to server log, and profiling 
+ * zones to trace files.
+ */
+struct as_stats_module * as_stats_create_module();
+
+/*
+ * Writes memory usage of allocation tags to 
+ * server log, in descending order of live bytes.
+ *
+ * If `max_count` is not zero, only the first 
+ * `max_count` tags are written.
+ */
+void as_stats_log_memory(struct as_stats_module * mod, uint32_t max_count);
+
+/*
+ * Writes the cost of module callback handlers to 
+ * server log, in descending order of total time.
+ *
+ * If `max_count` is not zero, only the first 
+ * `max_count` handlers are written.
+ */
+void as_stats_log_callbacks(struct as_stats_module * mod, uint32_t max_count);
+
+/*
+ * Writes traffic and handler time of packet types and 
+ * operations to server log, in descending order of 
+ * total bytes or handler time.
+ *
+ * If `max_count` is not zero, only the first 
+ * `max_count` packet types are written.
+ */
+void as_stats_log_packets(
+	struct as_stats_module * mod, 
+	boolean sort_by_time,
+	uint32_t max_count);
+
+/*
+ * Periodically writes packet statistics of 
+ * the last interval to server log.
+ */
+void as_stats_process(struct as_stats_module * mod);
+
+END_DECLS
+
+#endif /* _AS_STATS_H_ */
@@ -0,0 +1,78 @@
+#include "server/as_storage.h"
+
+#include "core/os.h"
+
+#include <assert.h>
+
+static void inject_latency(struct as_storage * storage)
+{
+	if (storage->latency)
+		sleep(storage->latency);
+}
+
+void as_storage_destroy(struct as_storage * storage)
+{
+	storage->backend->destroy(storage);
+}
+
+const char * as_storage_get_backend_name(struct as_storage * storage)
+{
+	return storage->backend->name;
+}
+
+void as_storage_set_latency(struct as_storage * storage, uint32_t ms)
+{
+	storage->latency = ms;
+}
+
+boolean as_storage_load(
+	struct as_storage * storage,
+	enum as_storage_table table,
+	const char * id,
+	as_storage_load_t cb,
+	void * user_data)
+{
+	assert(table < AS_STORAGE_TABLE_COUNT);
+	inject_latency(storage);
+	return storage->backend->load(storage, table, id, cb, user_data);
+}
+
+boolean as_storage_load_list(
+	struct as_storage * storage,
+	enum as_storage_table table,
+	as_storage_load_t cb,
+	void * user_data)
+{
+	assert(table < AS_STORAGE_TABLE_COUNT);
+	inject_latency(storage);
+	return storage->backend->load_list(storage, table, cb, user_data);
+}
+
+boolean as_storage_insert(
+	struct as_storage * storage,
+	enum as_storage_table table,
+	const char * id,
+	const void * data,
+	size_t size)
+{
+	struct as_storage_write w = { 0 };
+	w.operation = AS_STORAGE_INSERT;
+	w.id = id;
+	w.data = data;
+	w.size = size;
+	return as_storage_write_batch(storage, table, &w, 1);
+}
+
+boolean as_storage_write_batch(
+	struct as_storage * storage,
+	enum as_storage_table table,
+	struct as_storage_write * writes,
+	uint32_t count)
+{
+	uint32_t i;
+	assert(table < AS_STORAGE_TABLE_COUNT);
+	for (i = 0; i < count; i++)
+		writes[i].applied = FALSE;
+	inject_latency(storage);
+	return storage->backend->write_batch(storage, table, writes, count);
+}
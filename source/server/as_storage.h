@@ -0,0 +1,165 @@
+#ifndef _AS_STORAGE_H_
+#define _AS_STORAGE_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+BEGIN_DECLS
+
+/**
+ * \brief Persistent storage of encoded blobs.
+ *
+ * Every table maps a text id to a single blob.
+ * Storage is accessed by the main thread while the
+ * database is in blocking mode and by database tasks
+ * afterwards, never by both at the same time.
+ */
+struct as_storage;
+
+enum as_storage_table {
+	AS_STORAGE_TABLE_ACCOUNT,
+	AS_STORAGE_TABLE_GUILD,
+	AS_STORAGE_TABLE_COUNT
+};
+
+enum as_storage_operation {
+	AS_STORAGE_INSERT,
+	AS_STORAGE_UPDATE,
+	AS_STORAGE_DELETE,
+};
+
+struct as_storage_write {
+	enum as_storage_operation operation;
+	const char * id;
+	const void * data;
+	size_t size;
+	/** \brief Set to TRUE if a record was affected. */
+	boolean applied;
+};
+
+/**
+ * \brief Called once for each loaded record.
+ *
+ * Data is only valid for the duration of the call.
+ *
+ * \return TRUE to continue loading. Otherwise FALSE.
+ */
+typedef boolean (*as_storage_load_t)(
+	const void * data,
+	size_t size,
+	void * user_data);
+
+struct as_storage_backend {
+	const char * name;
+	boolean (*load)(
+		struct as_storage * storage,
+		enum as_storage_table table,
+		const char * id,
+		as_storage_load_t cb,
+		void * user_data);
+	boolean (*load_list)(
+		struct as_storage * storage,
+		enum as_storage_table table,
+		as_storage_load_t cb,
+		void * user_data);
+	boolean (*write_batch)(
+		struct as_storage * storage,
+		enum as_storage_table table,
+		struct as_storage_write * writes,
+		uint32_t count);
+	void (*destroy)(struct as_storage * storage);
+};
+
+/**
+ * \brief Common storage header.
+ *
+ * Backends embed this structure as their first member.
+ */
+struct as_storage {
+	const struct as_storage_backend * backend;
+	/** \brief Latency injected into each operation, in milliseconds. */
+	uint32_t latency;
+};
+
+/**
+ * \brief Connect to a PostgreSQL database.
+ * \param[in] conn_info libpq connection string.
+ *
+ * \return Storage pointer if successful. Otherwise NULL.
+ */
+struct as_storage * as_storage_create_postgresql(const char * conn_info);
+
+/**
+ * \brief Create an in-memory storage.
+ * \param[in] path File that records are loaded from and
+ *                 saved to when storage is destroyed.
+ *                 Can be NULL, in which case records are
+ *                 lost when storage is destroyed.
+ *
+ * \return Storage pointer if successful. Otherwise NULL.
+ */
+struct as_storage * as_storage_create_memory(const char * path);
+
+void as_storage_destroy(struct as_storage * storage);
+
+const char * as_storage_get_backend_name(struct as_storage * storage);
+
+/**
+ * \brief Set deterministic latency that is injected
+ *        into every storage operation.
+ */
+void as_storage_set_latency(struct as_storage * storage, uint32_t ms);
+
+/**
+ * \brief Load a single record.
+ *
+ * \return TRUE if record exists and was loaded. Otherwise FALSE.
+ */
+boolean as_storage_load(
+	struct as_storage * storage,
+	enum as_storage_table table,
+	const char * id,
+	as_storage_load_t cb,
+	void * user_data);
+
+/**
+ * \brief Load every record in table.
+ *
+ * \return TRUE if successful. Otherwise FALSE.
+ */
+boolean as_storage_load_list(
+	struct as_storage * storage,
+	enum as_storage_table table,
+	as_storage_load_t cb,
+	void * user_data);
+
+/**
+ * \brief Insert a single record.
+ *
+ * \return TRUE if successful. Otherwise FALSE.
+ */
+boolean as_storage_insert(
+	struct as_storage * storage,
+	enum as_storage_table table,
+	const char * id,
+	const void * data,
+	size_t size);
+
+/**
+ * \brief Apply writes atomically.
+ *
+ * Either every write is applied or none of them are.
+ * Updates and deletes that do not match a record are
+ * not treated as failures, see `applied`.
+ *
+ * \return TRUE if successful. Otherwise FALSE.
+ */
+boolean as_storage_write_batch(
+	struct as_storage * storage,
+	enum as_storage_table table,
+	struct as_storage_write * writes,
+	uint32_t count);
+
+END_DECLS
+
+#endif /* _AS_STORAGE_H_ */
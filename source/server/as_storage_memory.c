@@ -0,0 +1,316 @@
+#include "server/as_storage.h"
+
+#include "core/file_system.h"
+#include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
+#include "core/string.h"
+
+#include "public/ap_admin.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define FILE_MAGIC 0x4D545341u
+#define FILE_VERSION 1
+/* Ids are written to and read back from 
+ * storage file with this limit. */
+#define MAX_ID_LENGTH 127
+
+struct record {
+	void * data;
+	size_t size;
+};
+
+struct file_header {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct record_header {
+	uint32_t table;
+	uint32_t id_length;
+	uint32_t size;
+};
+
+struct memory_storage {
+	struct as_storage base;
+	/* Database tasks may run on several threads at once. */
+	mutex_t mutex;
+	struct ap_admin tables[AS_STORAGE_TABLE_COUNT];
+	char path[512];
+};
+
+static boolean set_record(
+	struct memory_storage * storage,
+	enum as_storage_table table,
+	const char * id,
+	const void * data,
+	size_t size)
+{
+	struct record * r = ap_admin_get_object_by_name(&storage->tables[table], id);
+	if (!r) {
+		r = ap_admin_add_object_by_name(&storage->tables[table], id);
+		if (!r)
+			return FALSE;
+		r->data = NULL;
+	}
+	r->data = reallocate(r->data, size);
+	r->size = size;
+	memcpy(r->data, data, size);
+	return TRUE;
+}
+
+static boolean read_records(
+	struct memory_storage * storage,
+	const uint8_t * data,
+	size_t size)
+{
+	struct file_header header;
+	size_t offset = sizeof(header);
+	if (size < sizeof(header))
+		return FALSE;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != FILE_MAGIC || header.version != FILE_VERSION)
+		return FALSE;
+	while (offset < size) {
+		struct record_header rh;
+		char id[MAX_ID_LENGTH + 1];
+		if (size - offset < sizeof(rh))
+			return FALSE;
+		memcpy(&rh, data + offset, sizeof(rh));
+		offset += sizeof(rh);
+		if (rh.table >= AS_STORAGE_TABLE_COUNT ||
+			rh.id_length >= sizeof(id) ||
+			size - offset < (size_t)rh.id_length + rh.size) {
+			return FALSE;
+		}
+		memcpy(id, data + offset, rh.id_length);
+		id[rh.id_length] = '\0';
+		offset += rh.id_length;
+		if (!set_record(storage, rh.table, id, data + offset, rh.size))
+			return FALSE;
+		offset += rh.size;
+	}
+	return TRUE;
+}
+
+static boolean load_records(struct memory_storage * storage)
+{
+	size_t size;
+	void * data;
+	boolean result;
+	if (!get_file_size(storage->path, &size)) {
+		/* Storage file is created when storage is destroyed. */
+		return TRUE;
+	}
+	data = alloc(size ? size : 1);
+	result = load_file(storage->path, data, size) &&
+		read_records(storage, data, size);
+	dealloc(data);
+	if (!result)
+		ERROR("Invalid storage file (%s).", storage->path);
+	return result;
+}
+
+static boolean save_records(struct memory_storage * storage)
+{
+	struct file_header header = { FILE_MAGIC, FILE_VERSION };
+	file f = open_file(storage->path, FILE_ACCESS_WRITE);
+	uint32_t i;
+	if (!f) {
+		ERROR("Failed to open storage file (%s).", storage->path);
+		return FALSE;
+	}
+	if (!write_file(f, &header, sizeof(header))) {
+		close_file(f);
+		return FALSE;
+	}
+	for (i = 0; i < AS_STORAGE_TABLE_COUNT; i++) {
+		size_t index = 0;
+		struct record * r = NULL;
+		const char * id;
+		while ((id = ap_admin_iterate_name(&storage->tables[i], &index,
+				(void **)&r)) != NULL) {
+			struct record_header rh;
+			rh.table = i;
+			rh.id_length = (uint32_t)strlen(id);
+			rh.size = (uint32_t)r->size;
+			if (!write_file(f, &rh, sizeof(rh)) ||
+				!write_file(f, id, rh.id_length) ||
+				!write_file(f, r->data, r->size)) {
+				ERROR("Failed to write storage file (%s).", storage->path);
+				close_file(f);
+				return FALSE;
+			}
+		}
+	}
+	close_file(f);
+	return TRUE;
+}
+
+/*
+ * Returns TRUE if a record with `id` exists after 
+ * writes that precede `writes[index]` are applied.
+ */
+static boolean existsbefore(
+	struct ap_admin * admin,
+	const struct as_storage_write * writes,
+	uint32_t index)
+{
+	const char * id = writes[index].id;
+	boolean exists = (ap_admin_get_object_by_name(admin, id) != NULL);
+	uint32_t i;
+	for (i = 0; i < index; i++) {
+		if (strcmp(writes[i].id, id) != 0)
+			continue;
+		switch (writes[i].operation) {
+		case AS_STORAGE_INSERT:
+			exists = TRUE;
+			break;
+		case AS_STORAGE_UPDATE:
+			break;
+		case AS_STORAGE_DELETE:
+			exists = FALSE;
+			break;
+		}
+	}
+	return exists;
+}
+
+static boolean load(
+	struct as_storage * base,
+	enum as_storage_table table,
+	const char * id,
+	as_storage_load_t cb,
+	void * user_data)
+{
+	struct memory_storage * storage = (struct memory_storage *)base;
+	struct record * r;
+	boolean result = FALSE;
+	lock_mutex(storage->mutex);
+	r = ap_admin_get_object_by_name(&storage->tables[table], id);
+	if (r)
+		result = cb(r->data, r->size, user_data);
+	unlock_mutex(storage->mutex);
+	return result;
+}
+
+static boolean load_list(
+	struct as_storage * base,
+	enum as_storage_table table,
+	as_storage_load_t cb,
+	void * user_data)
+{
+	struct memory_storage * storage = (struct memory_storage *)base;
+	size_t index = 0;
+	struct record * r = NULL;
+	boolean result = TRUE;
+	lock_mutex(storage->mutex);
+	while (ap_admin_iterate_name(&storage->tables[table], &index,
+			(void **)&r)) {
+		if (!cb(r->data, r->size, user_data)) {
+			result = FALSE;
+			break;
+		}
+	}
+	unlock_mutex(storage->mutex);
+	return result;
+}
+
+static boolean write_batch(
+	struct as_storage * base,
+	enum as_storage_table table,
+	struct as_storage_write * writes,
+	uint32_t count)
+{
+	struct memory_storage * storage = (struct memory_storage *)base;
+	struct ap_admin * admin = &storage->tables[table];
+	uint32_t i;
+	lock_mutex(storage->mutex);
+	/* Validate the whole batch first so that
+	 * it is applied either completely or not at all. */
+	for (i = 0; i < count; i++) {
+		const struct as_storage_write * w = &writes[i];
+		if (strnlen(w->id, MAX_ID_LENGTH + 1) > MAX_ID_LENGTH ||
+			(w->operation == AS_STORAGE_INSERT && 
+				existsbefore(admin, writes, i))) {
+			unlock_mutex(storage->mutex);
+			return FALSE;
+		}
+	}
+	for (i = 0; i < count; i++) {
+		struct as_storage_write * w = &writes[i];
+		struct record * r = ap_admin_get_object_by_name(admin, w->id);
+		switch (w->operation) {
+		case AS_STORAGE_INSERT:
+		case AS_STORAGE_UPDATE:
+			if (!r && w->operation == AS_STORAGE_UPDATE)
+				break;
+			if (!set_record(storage, table, w->id, w->data, w->size)) {
+				/* Batch was validated, this is unreachable 
+				 * unless the table itself rejects the id. */
+				ERROR("Failed to store record (%s).", w->id);
+				unlock_mutex(storage->mutex);
+				return FALSE;
+			}
+			w->applied = TRUE;
+			break;
+		case AS_STORAGE_DELETE:
+			if (r) {
+				dealloc(r->data);
+				ap_admin_remove_object_by_name(admin, w->id);
+				w->applied = TRUE;
+			}
+			break;
+		}
+	}
+	unlock_mutex(storage->mutex);
+	return TRUE;
+}
+
+static void destroy(struct as_storage * base)
+{
+	struct memory_storage * storage = (struct memory_storage *)base;
+	uint32_t i;
+	if (storage->path[0])
+		save_records(storage);
+	for (i = 0; i < AS_STORAGE_TABLE_COUNT; i++) {
+		size_t index = 0;
+		struct record * r = NULL;
+		while (ap_admin_iterate_name(&storage->tables[i], &index,
+				(void **)&r)) {
+			dealloc(r->data);
+		}
+		ap_admin_destroy(&storage->tables[i]);
+	}
+	destroy_mutex(storage->mutex);
+	dealloc(storage);
+}
+
+static const struct as_storage_backend BACKEND = {
+	"memory",
+	load,
+	load_list,
+	write_batch,
+	destroy };
+
+struct as_storage * as_storage_create_memory(const char * path)
+{
+	struct memory_storage * storage = alloc(sizeof(*storage));
+	uint32_t i;
+	memset(storage, 0, sizeof(*storage));
+	storage->base.backend = &BACKEND;
+	storage->mutex = create_mutex();
+	for (i = 0; i < AS_STORAGE_TABLE_COUNT; i++)
+		ap_admin_init(&storage->tables[i], sizeof(struct record), 1024);
+	if (path) {
+		strlcpy(storage->path, path, sizeof(storage->path));
+		if (!load_records(storage)) {
+			storage->path[0] = '\0';
+			destroy(&storage->base);
+			return NULL;
+		}
+	}
+	return &storage->base;
+}
@@ -0,0 +1,232 @@
+#include "server/as_storage.h"
+
+#include "core/log.h"
+#include "core/malloc.h"
+
+#include "vendor/PostgreSQL/libpq-fe.h"
+
+#include <assert.h>
+#include <string.h>
+
+enum statement_id {
+	STMT_INSERT,
+	STMT_SELECT_LIST,
+	STMT_SELECT,
+	STMT_UPDATE,
+	STMT_DELETE,
+	STMT_COUNT
+};
+
+struct statement {
+	const char * name;
+	const char * query;
+	int param_count;
+};
+
+struct postgresql_storage {
+	struct as_storage base;
+	PGconn * conn;
+};
+
+static const struct statement STATEMENTS[AS_STORAGE_TABLE_COUNT][STMT_COUNT] = {
+	{
+		{ "INSERT_ACCOUNT", "INSERT INTO accounts VALUES ($1,$2);", 2 },
+		{ "SELECT_ACCOUNT_LIST", "SELECT data FROM accounts;", 0 },
+		{ "SELECT_ACCOUNT", "SELECT data FROM accounts WHERE account_id=$1;", 1 },
+		{ "UPDATE_ACCOUNT", "UPDATE accounts SET data=$2 WHERE account_id=$1;", 2 },
+		{ "DELETE_ACCOUNT", "DELETE FROM accounts WHERE account_id=$1;", 1 } },
+	{
+		{ "INSERT_GUILD", "INSERT INTO guilds VALUES ($1,$2);", 2 },
+		{ "SELECT_GUILD_LIST", "SELECT data FROM guilds;", 0 },
+		{ "SELECT_GUILD", "SELECT data FROM guilds WHERE guild_id=$1;", 1 },
+		{ "UPDATE_GUILD", "UPDATE guilds SET data=$2 WHERE guild_id=$1;", 2 },
+		{ "DELETE_GUILD", "DELETE FROM guilds WHERE guild_id=$1;", 1 } } };
+
+static boolean exec_command(PGconn * conn, const char * command)
+{
+	PGresult * res = PQexec(conn, command);
+	boolean result = (PQresultStatus(res) == PGRES_COMMAND_OK);
+	PQclear(res);
+	return result;
+}
+
+static boolean create_statements(PGconn * conn)
+{
+	uint32_t i;
+	uint32_t j;
+	for (i = 0; i < AS_STORAGE_TABLE_COUNT; i++) {
+		for (j = 0; j < STMT_COUNT; j++) {
+			const struct statement * s = &STATEMENTS[i][j];
+			PGresult * res = PQprepare(conn, s->name, s->query,
+				s->param_count, NULL);
+			if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+				ERROR("Failed to prepare statement (%s): %s",
+					s->name, PQerrorMessage(conn));
+				PQclear(res);
+				return FALSE;
+			}
+			PQclear(res);
+		}
+	}
+	return TRUE;
+}
+
+static boolean load(
+	struct as_storage * base,
+	enum as_storage_table table,
+	const char * id,
+	as_storage_load_t cb,
+	void * user_data)
+{
+	struct postgresql_storage * storage = (struct postgresql_storage *)base;
+	PGresult * res;
+	const char * values[1] = { id };
+	const int lengths[1] = { (int)strlen(id) };
+	const int formats[1] = { 0 };
+	const void * data;
+	int len;
+	boolean result;
+	res = PQexecPrepared(storage->conn, STATEMENTS[table][STMT_SELECT].name,
+		1, values, lengths, formats, 1);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK ||
+		PQntuples(res) != 1) {
+		PQclear(res);
+		return FALSE;
+	}
+	data = PQgetvalue(res, 0, 0);
+	len = PQgetlength(res, 0, 0);
+	if (!data || len <= 0) {
+		PQclear(res);
+		return FALSE;
+	}
+	result = cb(data, (size_t)len, user_data);
+	PQclear(res);
+	return result;
+}
+
+static boolean load_list(
+	struct as_storage * base,
+	enum as_storage_table table,
+	as_storage_load_t cb,
+	void * user_data)
+{
+	struct postgresql_storage * storage = (struct postgresql_storage *)base;
+	PGresult * res;
+	int row_count;
+	int i;
+	if (!exec_command(storage->conn, "BEGIN"))
+		return FALSE;
+	res = PQexecPrepared(storage->conn,
+		STATEMENTS[table][STMT_SELECT_LIST].name, 0, 0, 0, 0, 1);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+		PQclear(res);
+		exec_command(storage->conn, "ROLLBACK");
+		return FALSE;
+	}
+	row_count = PQntuples(res);
+	for (i = 0; i < row_count; i++) {
+		const void * data = PQgetvalue(res, i, 0);
+		int len = PQgetlength(res, i, 0);
+		if (!data || len <= 0) {
+			ERROR("Empty database blob.");
+			PQclear(res);
+			exec_command(storage->conn, "ROLLBACK");
+			return FALSE;
+		}
+		if (!cb(data, (size_t)len, user_data)) {
+			PQclear(res);
+			exec_command(storage->conn, "ROLLBACK");
+			return FALSE;
+		}
+	}
+	PQclear(res);
+	return exec_command(storage->conn, "END");
+}
+
+static boolean write_batch(
+	struct as_storage * base,
+	enum as_storage_table table,
+	struct as_storage_write * writes,
+	uint32_t count)
+{
+	struct postgresql_storage * storage = (struct postgresql_storage *)base;
+	uint32_t i;
+	if (!exec_command(storage->conn, "BEGIN")) {
+		exec_command(storage->conn, "ROLLBACK");
+		return FALSE;
+	}
+	for (i = 0; i < count; i++) {
+		struct as_storage_write * w = &writes[i];
+		const char * values[2] = { w->id, w->data };
+		int lengths[2] = { (int)strlen(w->id), (int)w->size };
+		const int formats[2] = { 0, 1 };
+		PGresult * res;
+		switch (w->operation) {
+		case AS_STORAGE_INSERT:
+			res = PQexecPrepared(storage->conn,
+				STATEMENTS[table][STMT_INSERT].name,
+				2, values, lengths, formats, 0);
+			break;
+		case AS_STORAGE_UPDATE:
+			res = PQexecPrepared(storage->conn,
+				STATEMENTS[table][STMT_UPDATE].name,
+				2, values, lengths, formats, 0);
+			break;
+		case AS_STORAGE_DELETE:
+			res = PQexecPrepared(storage->conn,
+				STATEMENTS[table][STMT_DELETE].name,
+				1, values, lengths, formats, 0);
+			break;
+		default:
+			assert(0);
+			exec_command(storage->conn, "ROLLBACK");
+			return FALSE;
+		}
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			PQclear(res);
+			exec_command(storage->conn, "ROLLBACK");
+			return FALSE;
+		}
+		w->applied = (strcmp(PQcmdTuples(res), "0") != 0);
+		PQclear(res);
+	}
+	if (!exec_command(storage->conn, "END")) {
+		exec_command(storage->conn, "ROLLBACK");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void destroy(struct as_storage * base)
+{
+	struct postgresql_storage * storage = (struct postgresql_storage *)base;
+	PQfinish(storage->conn);
+	dealloc(storage);
+}
+
+static const struct as_storage_backend BACKEND = {
+	"postgresql",
+	load,
+	load_list,
+	write_batch,
+	destroy };
+
+struct as_storage * as_storage_create_postgresql(const char * conn_info)
+{
+	struct postgresql_storage * storage;
+	PGconn * conn = PQconnectdb(conn_info);
+	if (PQstatus(conn) != CONNECTION_OK) {
+		ERROR("Failed to connect to database: %s", PQerrorMessage(conn));
+		PQfinish(conn);
+		return NULL;
+	}
+	if (!create_statements(conn)) {
+		PQfinish(conn);
+		return NULL;
+	}
+	storage = alloc(sizeof(*storage));
+	memset(storage, 0, sizeof(*storage));
+	storage->base.backend = &BACKEND;
+	storage->conn = conn;
+	return &storage->base;
+}
@@ -1,5 +1,7 @@
+#include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
 #ifdef _WIN32
@@ -13,8 +15,14 @@
 
 #include "core/core.h"
 #include "core/file_system.h"
+#include "core/getopt.h"
+#include "core/intern.h"
 #include "core/log.h"
+#include "core/malloc.h"
 #include "core/os.h"
+#include "core/profile.h"
+#include "core/slab.h"
+#include "core/string.h"
 
 #include "task/task.h"
 
@@ -103,12 +111,15 @@
 #include "server/as_login.h"
 #include "server/as_login_admin.h"
 #include "server/as_map.h"
+#include "server/as_metrics.h"
 #include "server/as_party.h"
 #include "server/as_party_process.h"
 #include "server/as_player.h"
 #include "server/as_private_trade_process.h"
 #include "server/as_pvp_process.h"
 #include "server/as_refinery_process.h"
+#include "server/as_reload.h"
+#include "server/as_stats.h"
 #include "server/as_ride_process.h"
 #include "server/as_server.h"
 #include "server/as_service_npc.h"
@@ -120,6 +131,8 @@
 #include "server/as_ui_status_process.h"
 #include "server/as_world.h"
 
+#include "utility/au_snapshot.h"
+
 /* 20 FPS */
 #define STEPTIME (1.0f / 50.0f)
 
@@ -221,6 +234,9 @@ static ap_module_t g_AsPlayer;
 static struct as_private_trade_process_module * g_AsPrivateTradeProcess;
 static ap_module_t g_AsPvPProcess;
 static ap_module_t g_AsRefineryProcess;
+static ap_module_t g_AsReload;
+static ap_module_t g_AsStats;
+static ap_module_t g_AsMetrics;
 static struct as_ride_process_module * g_AsRideProcess;
 static ap_module_t g_AsServer;
 static ap_module_t g_AsServiceNpc;
@@ -332,6 +348,9 @@ static struct module_desc g_Modules[] = {
 	{ AS_CHAT_PROCESS_MODULE_NAME, as_chat_process_create_module, NULL, &g_AsChatProcess },
 	{ AS_LOGIN_ADMIN_MODULE_NAME, as_login_admin_create_module, NULL, &g_AsLoginAdmin },
 	{ AS_GAME_ADMIN_MODULE_NAME, as_game_admin_create_module, NULL, &g_AsGameAdmin },
+	{ AS_RELOAD_MODULE_NAME, as_reload_create_module, NULL, &g_AsReload },
+	{ AS_STATS_MODULE_NAME, as_stats_create_module, NULL, &g_AsStats },
+	{ AS_METRICS_MODULE_NAME, as_metrics_create_module, NULL, &g_AsMetrics },
 };
 
 /* With this definition added, any module context 
@@ -345,7 +364,9 @@ static boolean create_modules()
 	INFO("Creating modules..");
 	for (i = 0; i < COUNT_OF(g_Modules); i++) {
 		struct module_desc * m = &g_Modules[i];
+		uint32_t tag = set_alloc_tag(create_alloc_tag(m->name));
 		m->module_ = ((ap_module_t *(*)())m->cb_create)();
+		set_alloc_tag(tag);
 		if (!m->module_) {
 			ERROR("Failed to create module (%s).", m->name);
 			return FALSE;
@@ -364,11 +385,17 @@ static boolean register_modules(struct ap_module_registry * registry)
 	for (i = 0; i < COUNT_OF(g_Modules); i++) {
 		struct module_desc * m = &g_Modules[i];
 		struct ap_module_instance * instance = (struct ap_module_instance *)m->module_;
+		uint32_t tag;
+		boolean result;
 		if (!ap_module_registry_register(registry, m->module_)) {
 			ERROR("Module registration failed (%s).", m->name);
 			return FALSE;
 		}
-		if (instance->cb_register && !instance->cb_register(instance, registry)) {
+		tag = set_alloc_tag(instance->context.alloc_tag);
+		result = !instance->cb_register || 
+			instance->cb_register(instance, registry);
+		set_alloc_tag(tag);
+		if (!result) {
 			ERROR("Module registration callback failed (%s).", m->name);
 			return FALSE;
 		}
@@ -407,6 +434,25 @@ static void close()
 	INFO("Closed all modules.");
 }
 
+static void log_pool_stats()
+{
+	size_t index = 0;
+	struct slab_pool * pool;
+	while (slab_iterate(&index, &pool)) {
+		struct slab_stats stats;
+		slab_get_stats(pool, &stats);
+		if (!stats.alloc_count)
+			continue;
+		INFO("Pool %-32s %6u bytes, %8llu in use (peak %8llu), %6u slabs, %8llu KB reserved, %10llu allocations.",
+			stats.name, (uint32_t)stats.object_size,
+			(unsigned long long)stats.used_count,
+			(unsigned long long)stats.peak_used_count,
+			stats.slab_count,
+			(unsigned long long)(stats.reserved_size / 1024),
+			(unsigned long long)stats.alloc_count);
+	}
+}
+
 static void shutdown()
 {
 	int32_t i;
@@ -424,16 +470,555 @@ static void shutdown()
 	INFO("All modules are shutdown.");
 }
 
-static boolean initialize()
-{
+/*
+ * Data tables are read by loaders that declare which 
+ * other loaders they depend on.
+ *
+ * A loader depends on another if it uses data read by 
+ * it, or if both modify the same module state (this 
+ * includes data written by callbacks that are triggered 
+ * while reading). Loaders of the same module are always 
+ * chained in the order they were originally read.
+ *
+ * Loaders are run on task threads as soon as their 
+ * dependencies are completed. Serial loaders link data 
+ * across modules and are run in order on the main thread 
+ * after every other loader is completed.
+ */
+enum loader_id {
+	LOADER_CHAR_TYPE,
+	LOADER_OBJECT_TEMPLATE,
+	LOADER_CHARACTER_TEMPLATE,
+	LOADER_CHARACTER_IMPORT,
+	LOADER_GROW_UP_FACTOR,
+	LOADER_LEVEL_UP_EXP,
+	LOADER_SKILL_TEMPLATE,
+	LOADER_SKILL_SPEC,
+	LOADER_SKILL_CONST,
+	LOADER_SKILL_CONST2,
+	LOADER_ITEM_OPTION,
+	LOADER_ITEM_IMPORT,
+	LOADER_ITEM_LOTTERY_BOX,
+	LOADER_ITEM_AVATAR_SET,
+	LOADER_ITEM_CONVERT,
+	LOADER_ITEM_RUNE_ATTRIBUTE,
+	LOADER_REFINERY_RECIPE,
+	LOADER_GACHA_TYPE,
+	LOADER_AI_DATA,
+	LOADER_OPTION_NUM_DROP_RATE,
+	LOADER_SOCKET_NUM_DROP_RATE,
+	LOADER_DROP_RANK_RATE,
+	LOADER_DROP_GROUP_RATE,
+	LOADER_DROP_TABLE,
+	LOADER_LEVEL_UP_REWARD,
+	LOADER_CASH_MALL,
+	LOADER_TELEPORT_POINT,
+	LOADER_NPC_TRADE_LIST,
+	LOADER_MAP_SEGMENT,
+	LOADER_SPAWN_DATA,
+	LOADER_OBJECT,
+	LOADER_STATIC_CHARACTER,
+	LOADER_SPAWN_INSTANCE,
+	LOADER_COUNT
+};
+
+#define DEP(ID) (1ull << (ID))
+
+struct loader {
+	enum loader_id id;
+	const char * name;
+	/* Relative to `ServerIniDir`, NULL if loader 
+	 * does not read a single table. */
+	const char * file;
+	boolean (*load)(const char * path);
+	uint64_t dependencies;
+	boolean serial;
 	char path[1024];
+	struct task_descriptor task;
+	boolean submitted;
+	boolean completed;
+	/* In microseconds. */
+	uint64_t duration;
+	/* Time it takes to complete the loader if every 
+	 * loader is started as soon as its dependencies 
+	 * are completed. */
+	uint64_t critical_path;
+	/* Number of bytes read from files. */
+	uint64_t read_size;
+	struct alloc_stats allocs;
+};
+
+static boolean load_char_type(const char * path)
+{
+	return ap_factors_read_char_type(g_ApFactors, path, FALSE);
+}
+
+static boolean load_object_templates(const char * path)
+{
+	return ap_object_load_templates(g_ApObject, path, FALSE);
+}
+
+static boolean load_character_templates(const char * path)
+{
+	return ap_character_read_templates(g_ApCharacter, path, FALSE);
+}
+
+static boolean load_character_import(const char * path)
+{
+	return ap_character_read_import_data(g_ApCharacter, path, FALSE);
+}
+
+static boolean load_grow_up_factor(const char * path)
+{
+	return ap_character_read_grow_up_table(g_ApCharacter, path, FALSE);
+}
+
+static boolean load_level_up_exp(const char * path)
+{
+	return ap_character_read_level_up_exp(g_ApCharacter, path, FALSE);
+}
+
+static boolean load_skill_templates(const char * path)
+{
+	return ap_skill_read_templates(g_ApSkill, path, FALSE);
+}
+
+static boolean load_skill_spec(const char * path)
+{
+	return ap_skill_read_spec(g_ApSkill, path, FALSE);
+}
+
+static boolean load_skill_const(const char * path)
+{
+	return ap_skill_read_const(g_ApSkill, path, FALSE);
+}
+
+static boolean load_skill_const2(const char * path)
+{
+	return ap_skill_read_const2(g_ApSkill, path, FALSE);
+}
+
+static boolean load_item_options(const char * path)
+{
+	return ap_item_read_option_data(g_ApItem, path, FALSE);
+}
+
+static boolean load_item_import(const char * path)
+{
+	return ap_item_read_import_data(g_ApItem, path, FALSE);
+}
+
+static boolean load_item_lottery_box(const char * path)
+{
+	return ap_item_read_lottery_box(g_ApItem, path, FALSE);
+}
+
+static boolean load_item_avatar_set(const char * path)
+{
+	return ap_item_read_avatar_set(g_ApItem, path, FALSE);
+}
+
+static boolean load_item_convert(const char * path)
+{
+	return ap_item_convert_read_convert_table(g_ApItemConvert, path);
+}
+
+static boolean load_item_rune_attribute(const char * path)
+{
+	return ap_item_convert_read_rune_attribute_table(g_ApItemConvert, 
+		path, FALSE);
+}
+
+static boolean load_refinery_recipe(const char * path)
+{
+	return ap_refinery_read_recipe_table(g_ApRefinery, path, FALSE);
+}
+
+static boolean load_gacha_types(const char * path)
+{
+	return ap_event_gacha_read_types(g_ApEventGacha, path);
+}
+
+static boolean load_ai_data(const char * path)
+{
+	return ap_ai2_read_data_table(g_ApAi2, path, FALSE);
+}
+
+static boolean load_option_num_drop_rate(const char * path)
+{
+	return ap_drop_item_read_option_num_drop_rate(g_ApDropItem, path, FALSE);
+}
+
+static boolean load_socket_num_drop_rate(const char * path)
+{
+	return ap_drop_item_read_socket_num_drop_rate(g_ApDropItem, path, FALSE);
+}
+
+static boolean load_drop_rank_rate(const char * path)
+{
+	return ap_drop_item_read_drop_rank_rate(g_ApDropItem, path, FALSE);
+}
+
+static boolean load_drop_group_rate(const char * path)
+{
+	return ap_drop_item_read_drop_group_rate(g_ApDropItem, path, FALSE);
+}
+
+static boolean load_drop_table(const char * path)
+{
+	return ap_drop_item_read_drop_table(g_ApDropItem, path, FALSE);
+}
+
+static boolean load_level_up_reward(const char * path)
+{
+	return ap_service_npc_read_level_up_reward_table(g_ApServiceNpc, 
+		path, FALSE);
+}
+
+static boolean load_cash_mall(const char * path)
+{
+	return ap_cash_mall_read_import_data(g_ApCashMall, path, FALSE);
+}
+
+static boolean load_teleport_points(const char * path)
+{
+	return ap_event_teleport_read_teleport_points(g_ApEventTeleport, 
+		path, FALSE);
+}
+
+static boolean load_npc_trade_lists(const char * path)
+{
+	return ap_event_npc_trade_read_trade_lists(g_ApEventNpcTrade, path);
+}
+
+static boolean load_map_segments(const char * path)
+{
+	return as_map_read_segments(g_AsMap);
+}
+
+static boolean load_spawn_data(const char * path)
+{
+	return ap_spawn_read_data(g_ApSpawn, path, FALSE);
+}
+
+static boolean load_objects(const char * path)
+{
+	return as_map_load_objects(g_AsMap);
+}
+
+static boolean load_static_characters(const char * path)
+{
+	return ap_character_read_static(g_ApCharacter, path, FALSE);
+}
+
+static boolean load_spawn_instances(const char * path)
+{
+	return ap_spawn_read_instances(g_ApSpawn, path, FALSE);
+}
+
+static struct loader g_Loaders[LOADER_COUNT] = {
+	{ LOADER_CHAR_TYPE, "character types", "chartype.ini", 
+		load_char_type, 0 },
+	{ LOADER_OBJECT_TEMPLATE, "object templates", "objecttemplate.ini", 
+		load_object_templates, 0 },
+	{ LOADER_CHARACTER_TEMPLATE, "character templates", "charactertemplatepublic.ini", 
+		load_character_templates, 
+		DEP(LOADER_CHAR_TYPE) },
+	{ LOADER_CHARACTER_IMPORT, "character import data", "characterdatatable.txt", 
+		load_character_import, 
+		DEP(LOADER_CHARACTER_TEMPLATE) },
+	{ LOADER_GROW_UP_FACTOR, "character grow up factor", "growupfactor.ini", 
+		load_grow_up_factor, 
+		DEP(LOADER_CHARACTER_IMPORT) },
+	{ LOADER_LEVEL_UP_EXP, "character level up exp", "levelupexp.ini", 
+		load_level_up_exp, 
+		DEP(LOADER_GROW_UP_FACTOR) },
+	{ LOADER_SKILL_TEMPLATE, "skill templates", "skilltemplate.ini", 
+		load_skill_templates, 0 },
+	{ LOADER_SKILL_SPEC, "skill specialization", "skillspec.txt", 
+		load_skill_spec, 
+		DEP(LOADER_SKILL_TEMPLATE) },
+	{ LOADER_SKILL_CONST, "skill const", "skillconst.txt", 
+		load_skill_const, 
+		DEP(LOADER_SKILL_SPEC) },
+	{ LOADER_SKILL_CONST2, "skill const2", "skillconst2.txt", 
+		load_skill_const2, 
+		DEP(LOADER_SKILL_CONST) },
+	/* Item option callbacks build drop item option pools. */
+	{ LOADER_ITEM_OPTION, "item option data", "itemoptiontable.txt", 
+		load_item_options, 0 },
+	/* Item import callbacks build drop groups from 
+	 * character templates and fill in gacha item lists. */
+	{ LOADER_ITEM_IMPORT, "item import data", "itemdatatable.txt", 
+		load_item_import, 
+		DEP(LOADER_ITEM_OPTION) | DEP(LOADER_LEVEL_UP_EXP) },
+	{ LOADER_ITEM_LOTTERY_BOX, "item lottery box", "itemlotterybox.txt", 
+		load_item_lottery_box, 
+		DEP(LOADER_ITEM_IMPORT) },
+	{ LOADER_ITEM_AVATAR_SET, "item avatar sets", "avatarset.ini", 
+		load_item_avatar_set, 
+		DEP(LOADER_ITEM_LOTTERY_BOX) },
+	{ LOADER_ITEM_CONVERT, "item convert table", "itemconverttable.txt", 
+		load_item_convert, 0 },
+	{ LOADER_ITEM_RUNE_ATTRIBUTE, "item rune attribute table", "itemruneattributetable.txt", 
+		load_item_rune_attribute, 
+		DEP(LOADER_ITEM_CONVERT) | DEP(LOADER_ITEM_IMPORT) | 
+		DEP(LOADER_SKILL_TEMPLATE) },
+	{ LOADER_REFINERY_RECIPE, "refinery recipe table", "refineryrecipetable.txt", 
+		load_refinery_recipe, 0 },
+	{ LOADER_GACHA_TYPE, "gacha types", "gachatypetemplate.ini", 
+		load_gacha_types, 0 },
+	{ LOADER_AI_DATA, "ai data table", "aidatatable.txt", 
+		load_ai_data, 
+		DEP(LOADER_SKILL_TEMPLATE) },
+	{ LOADER_OPTION_NUM_DROP_RATE, "option number drop rates", "optionnumdroprate.txt", 
+		load_option_num_drop_rate, 
+		DEP(LOADER_ITEM_IMPORT) },
+	{ LOADER_SOCKET_NUM_DROP_RATE, "socket number drop rates", "socketnumdroprate.txt", 
+		load_socket_num_drop_rate, 
+		DEP(LOADER_OPTION_NUM_DROP_RATE) },
+	{ LOADER_DROP_RANK_RATE, "item drop rank rates", "droprankrate.txt", 
+		load_drop_rank_rate, 
+		DEP(LOADER_SOCKET_NUM_DROP_RATE) },
+	{ LOADER_DROP_GROUP_RATE, "item drop group rates", "groupdroprate.txt", 
+		load_drop_group_rate, 
+		DEP(LOADER_DROP_RANK_RATE) },
+	{ LOADER_DROP_TABLE, "item drop table", "itemdroptable.txt", 
+		load_drop_table, 
+		DEP(LOADER_DROP_GROUP_RATE) },
+	{ LOADER_LEVEL_UP_REWARD, "level up reward table", "leveluprewardtable.txt", 
+		load_level_up_reward, 
+		DEP(LOADER_ITEM_IMPORT) },
+	{ LOADER_CASH_MALL, "cash mall data", "cashmall.txt", 
+		load_cash_mall, 0 },
+	/* Event data of object templates is read by 
+	 * event modules. */
+	{ LOADER_TELEPORT_POINT, "teleport points", "teleportpoint.ini", 
+		load_teleport_points, 
+		DEP(LOADER_OBJECT_TEMPLATE) },
+	{ LOADER_NPC_TRADE_LIST, "npc trade lists", "npctradelist.txt", 
+		load_npc_trade_lists, 
+		DEP(LOADER_OBJECT_TEMPLATE) },
+	{ LOADER_MAP_SEGMENT, "map segments", NULL, 
+		load_map_segments, 0 },
+	{ LOADER_SPAWN_DATA, "spawn data", "spawndatatable.txt", 
+		load_spawn_data, 0 },
+	{ LOADER_OBJECT, "objects", NULL, 
+		load_objects, 0, TRUE },
+	{ LOADER_STATIC_CHARACTER, "static characters", "npc.ini", 
+		load_static_characters, 0, TRUE },
+	{ LOADER_SPAWN_INSTANCE, "spawn instances", "spawninstancetable.txt", 
+		load_spawn_instances, 0, TRUE },
+};
+
+static timer_t g_LoaderTimer;
+static uint32_t g_RunningLoaderCount;
+static boolean g_LoaderFailed;
+/* In microseconds. */
+static uint64_t g_LoadDuration;
+static uint64_t g_LoadCriticalPath;
+static const char * g_LoadSource = "text";
+
+static void get_loader_counters(
+	const struct loader * loader,
+	uint64_t * read_size,
+	struct alloc_stats * allocs)
+{
+	/* Serial loaders are run alone and may use task 
+	 * threads themselves, other loaders are run on 
+	 * a single thread in parallel with each other. */
+	if (loader->serial) {
+		*read_size = get_read_size();
+		get_alloc_stats(allocs);
+	}
+	else {
+		*read_size = get_thread_read_size();
+		get_thread_alloc_stats(allocs);
+	}
+}
+
+static boolean run_loader(struct loader * loader)
+{
+	uint64_t begin = timer_delta_no_reset(g_LoaderTimer);
+	uint64_t read_size;
+	struct alloc_stats allocs;
+	boolean result;
+	uint32_t tag = set_alloc_tag(create_alloc_tag(loader->name));
+	get_loader_counters(loader, &read_size, &allocs);
+	result = loader->load(loader->path);
+	set_alloc_tag(tag);
+	loader->duration = timer_delta_no_reset(g_LoaderTimer) - begin;
+	get_loader_counters(loader, &loader->read_size, &loader->allocs);
+	loader->read_size -= read_size;
+	loader->allocs.count -= allocs.count;
+	loader->allocs.size -= allocs.size;
+	if (!result) {
+		if (loader->file)
+			ERROR("Failed to read %s (%s).", loader->name, loader->path);
+		else
+			ERROR("Failed to read %s.", loader->name);
+	}
+	return result;
+}
+
+static boolean loader_work(void * data)
+{
+	return run_loader(data);
+}
+
+static void loader_post(
+	struct task_descriptor * task,
+	void * data,
+	boolean result)
+{
+	struct loader * loader = data;
+	uint32_t i;
+	loader->completed = TRUE;
+	g_RunningLoaderCount--;
+	if (!result) {
+		g_LoaderFailed = TRUE;
+		return;
+	}
+	for (i = 0; i < LOADER_COUNT; i++) {
+		if ((loader->dependencies & DEP(i)) &&
+			g_Loaders[i].critical_path > loader->critical_path) {
+			loader->critical_path = g_Loaders[i].critical_path;
+		}
+	}
+	loader->critical_path += loader->duration;
+}
+
+static boolean is_loader_ready(const struct loader * loader)
+{
+	uint32_t i;
+	if (loader->serial || loader->submitted)
+		return FALSE;
+	for (i = 0; i < LOADER_COUNT; i++) {
+		if ((loader->dependencies & DEP(i)) && !g_Loaders[i].completed)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void submit_ready_loaders()
+{
+	uint32_t i;
+	for (i = 0; i < LOADER_COUNT; i++) {
+		struct loader * loader = &g_Loaders[i];
+		if (!is_loader_ready(loader))
+			continue;
+		loader->submitted = TRUE;
+		loader->task.work_cb = loader_work;
+		loader->task.post_cb = loader_post;
+		loader->task.data = loader;
+		g_RunningLoaderCount++;
+		task_add(&loader->task, FALSE);
+	}
+}
+
+static boolean load_tables(const char * inidir)
+{
+	uint32_t i;
+	uint64_t critical_path = 0;
+	uint64_t total = 0;
+	struct intern_stats intern;
+	g_LoaderTimer = create_timer();
+	if (!g_LoaderTimer) {
+		ERROR("Failed to create loader timer.");
+		return FALSE;
+	}
+	for (i = 0; i < LOADER_COUNT; i++) {
+		struct loader * loader = &g_Loaders[i];
+		assert(loader->id == i);
+		if (loader->file && !make_path(loader->path, 
+				sizeof(loader->path), "%s/%s", inidir, loader->file)) {
+			ERROR("Failed to create path (%s).", loader->file);
+			return FALSE;
+		}
+	}
+	while (TRUE) {
+		uint32_t running;
+		if (!g_LoaderFailed)
+			submit_ready_loaders();
+		running = g_RunningLoaderCount;
+		if (!running)
+			break;
+		/* Main thread takes part in loading until 
+		 * queue is empty, then waits for task threads. */
+		task_wait();
+		task_do_post_cb();
+		if (g_RunningLoaderCount == running)
+			sleep(1);
+	}
+	if (g_LoaderFailed)
+		return FALSE;
+	for (i = 0; i < LOADER_COUNT; i++) {
+		const struct loader * loader = &g_Loaders[i];
+		if (!loader->serial && !loader->completed) {
+			ERROR("Loader dependencies cannot be resolved (%s).", 
+				loader->name);
+			return FALSE;
+		}
+		if (loader->critical_path > critical_path)
+			critical_path = loader->critical_path;
+	}
+	for (i = 0; i < LOADER_COUNT; i++) {
+		struct loader * loader = &g_Loaders[i];
+		if (!loader->serial)
+			continue;
+		if (!run_loader(loader))
+			return FALSE;
+		loader->completed = TRUE;
+		critical_path += loader->duration;
+		loader->critical_path = critical_path;
+	}
+	for (i = 0; i < LOADER_COUNT; i++) {
+		const struct loader * loader = &g_Loaders[i];
+		total += loader->duration;
+		INFO("Loaded %-28s %6llu ms (critical path %6llu ms).", 
+			loader->name, 
+			(unsigned long long)(loader->duration / 1000), 
+			(unsigned long long)(loader->critical_path / 1000));
+	}
+	INFO("Loaders took %llu ms in total, %llu ms on critical path.", 
+		(unsigned long long)(total / 1000),
+		(unsigned long long)(critical_path / 1000));
+	g_LoadDuration = timer_delta_no_reset(g_LoaderTimer);
+	g_LoadCriticalPath = critical_path;
+	get_intern_stats(&intern);
+	INFO("Interned %llu names in %llu bytes (%llu bytes without interning).", 
+		(unsigned long long)intern.count,
+		(unsigned long long)intern.size,
+		(unsigned long long)intern.intern_size);
+	return TRUE;
+}
+
+/*
+ * In headless mode, modules are initialized and data 
+ * tables are loaded, but network servers are not 
+ * created and database is not used.
+ */
+static boolean initialize(boolean headless)
+{
 	uint32_t i;
 	const char * inidir = NULL;
+	const char * snapshot = NULL;
+	uint64_t begin;
+	boolean from_snapshot;
 	INFO("Initializing..");
 	for (i = 0; i < COUNT_OF(g_Modules); i++) {
 		const struct module_desc * m = &g_Modules[i];
 		const struct ap_module_instance * instance = (struct ap_module_instance *)m->module_;
-		if (instance->cb_initialize && !instance->cb_initialize(m->module_)) {
+		uint32_t tag;
+		boolean result;
+		/* Web server starts listening when initialized. */
+		if (headless && m->module_ == g_AsHttpServer)
+			continue;
+		tag = set_alloc_tag(instance->context.alloc_tag);
+		result = !instance->cb_initialize || 
+			instance->cb_initialize(m->module_);
+		set_alloc_tag(tag);
+		if (!result) {
 			ERROR("Module initialization failed (%s).", m->name);
 			return FALSE;
 		}
@@ -443,289 +1028,265 @@ static boolean initialize()
 		ERROR("Failed to retrieve ServerIniDir config.");
 		return FALSE;
 	}
-	if (!make_path(path, sizeof(path), 
-			"%s/chartype.ini", inidir)) {
-		ERROR("Failed to create path (chartype.ini).");
-		return FALSE;
-	}
-	if (!ap_factors_read_char_type(g_ApFactors, path, FALSE)) {
-		ERROR("Failed to load character type names.");
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), 
-			"%s/objecttemplate.ini", inidir)) {
-		ERROR("Failed to create path (objecttemplate.ini).");
-		return FALSE;
-	}
-	if (!ap_object_load_templates(g_ApObject, path, FALSE)) {
-		ERROR("Failed to load object templates.");
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), 
-			"%s/charactertemplatepublic.ini", inidir)) {
-		ERROR("Failed to create path (charactertemplatepublic.ini).");
-		return FALSE;
-	}
-	if (!ap_character_read_templates(g_ApCharacter, path, FALSE)) {
-		ERROR("Failed to read character templates (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), 
-			"%s/characterdatatable.txt", inidir)) {
-		ERROR("Failed to create path (characterdatatable.txt).");
-		return FALSE;
-	}
-	if (!ap_character_read_import_data(g_ApCharacter, path, FALSE)) {
-		ERROR("Failed to read character import data (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/growupfactor.ini", inidir)) {
-		ERROR("Failed to create path (growupfactor.ini).");
-		return FALSE;
-	}
-	if (!ap_character_read_grow_up_table(g_ApCharacter, path, FALSE)) {
-		ERROR("Failed to read character grow up factor (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/levelupexp.ini", inidir)) {
-		ERROR("Failed to create path (levelupexp.ini).");
-		return FALSE;
-	}
-	if (!ap_character_read_level_up_exp(g_ApCharacter, path, FALSE)) {
-		ERROR("Failed to read character level up exp (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/skilltemplate.ini", inidir)) {
-		ERROR("Failed to create path (skilltemplate.ini).");
-		return FALSE;
-	}
-	if (!ap_skill_read_templates(g_ApSkill, path, FALSE)) {
-		ERROR("Failed to read skill templates (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/skillspec.txt", inidir)) {
-		ERROR("Failed to create path (skillspec.txt).");
-		return FALSE;
-	}
-	if (!ap_skill_read_spec(g_ApSkill, path, FALSE)) {
-		ERROR("Failed to read skill specialization (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/skillconst.txt", inidir)) {
-		ERROR("Failed to create path (skillconst.txt).");
-		return FALSE;
-	}
-	if (!ap_skill_read_const(g_ApSkill, path, FALSE)) {
-		ERROR("Failed to read skill const (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/skillconst2.txt", inidir)) {
-		ERROR("Failed to create path (skillconst2.txt).");
-		return FALSE;
-	}
-	if (!ap_skill_read_const2(g_ApSkill, path, FALSE)) {
-		ERROR("Failed to read skill const2 (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/itemoptiontable.txt", inidir)) {
-		ERROR("Failed to create path (itemoptiontable.txt).");
-		return FALSE;
-	}
-	if (!ap_item_read_option_data(g_ApItem, path, FALSE)) {
-		ERROR("Failed to read item option data (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/itemdatatable.txt", inidir)) {
-		ERROR("Failed to create path (%s/itemdatatable.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_item_read_import_data(g_ApItem, path, FALSE)) {
-		ERROR("Failed to read item import data (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/itemlotterybox.txt", inidir)) {
-		ERROR("Failed to create path (%s/itemlotterybox.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_item_read_lottery_box(g_ApItem, path, FALSE)) {
-		ERROR("Failed to read item lottery box (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/avatarset.ini", inidir)) {
-		ERROR("Failed to create path (%s/avatarset.ini).", inidir);
-		return FALSE;
-	}
-	if (!ap_item_read_avatar_set(g_ApItem, path, FALSE)) {
-		ERROR("Failed to read item avatar sets (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/itemconverttable.txt", inidir)) {
-		ERROR("Failed to create path (%s/itemconverttable.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_item_convert_read_convert_table(g_ApItemConvert, path)) {
-		ERROR("Failed to read item convert table (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/itemruneattributetable.txt", inidir)) {
-		ERROR("Failed to create path (%s/itemruneattributetable.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_item_convert_read_rune_attribute_table(g_ApItemConvert, path, FALSE)) {
-		ERROR("Failed to read item rune attribute table (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/refineryrecipetable.txt", inidir)) {
-		ERROR("Failed to create path (%s/refineryrecipetable.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_refinery_read_recipe_table(g_ApRefinery, path, FALSE)) {
-		ERROR("Failed to read refinery recipe table (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/gachatypetemplate.ini", inidir)) {
-		ERROR("Failed to create path (%s/gachatypetemplate.ini).", inidir);
-		return FALSE;
-	}
-	if (!ap_event_gacha_read_types(g_ApEventGacha, path)) {
-		ERROR("Failed to read gacha types (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/aidatatable.txt", inidir)) {
-		ERROR("Failed to create path (%s/aidatatable.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_ai2_read_data_table(g_ApAi2, path, FALSE)) {
-		ERROR("Failed to read ai data table (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/optionnumdroprate.txt", inidir)) {
-		ERROR("Failed to create path (%s/optionnumdroprate.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_drop_item_read_option_num_drop_rate(g_ApDropItem, path, FALSE)) {
-		ERROR("Failed to read option number drop rates (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/socketnumdroprate.txt", inidir)) {
-		ERROR("Failed to create path (%s/socketnumdroprate.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_drop_item_read_socket_num_drop_rate(g_ApDropItem, path, FALSE)) {
-		ERROR("Failed to read socket number drop rates (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/droprankrate.txt", inidir)) {
-		ERROR("Failed to create path (%s/droprankrate.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_drop_item_read_drop_rank_rate(g_ApDropItem, path, FALSE)) {
-		ERROR("Failed to read item drop rank rates (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/groupdroprate.txt", inidir)) {
-		ERROR("Failed to create path (%s/groupdroprate.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_drop_item_read_drop_group_rate(g_ApDropItem, path, FALSE)) {
-		ERROR("Failed to read item drop group rates (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/itemdroptable.txt", inidir)) {
-		ERROR("Failed to create path (%s/itemdroptable.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_drop_item_read_drop_table(g_ApDropItem, path, FALSE)) {
-		ERROR("Failed to read item drop table (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/leveluprewardtable.txt", inidir)) {
-		ERROR("Failed to create path (%s/leveluprewardtable.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_service_npc_read_level_up_reward_table(g_ApServiceNpc, path, FALSE)) {
-		ERROR("Failed to read level up reward table (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/cashmall.txt", inidir)) {
-		ERROR("Failed to create path (%s/cashmall.txt).", inidir);
-		return FALSE;
-	}
-	if (!ap_cash_mall_read_import_data(g_ApCashMall, path, FALSE)) {
-		ERROR("Failed to read cash mall data (%s).", path);
-		return FALSE;
-	}
-	if (!make_path(path, sizeof(path), "%s/teleportpoint.ini", inidir)) {
-		ERROR("Failed to create path (%s/teleportpoint.ini).", inidir);
-		return FALSE;
-	}
-	if (!ap_event_teleport_read_teleport_points(g_ApEventTeleport, path, FALSE)) {
-		ERROR("Failed to read teleport points (%s).", path);
-		return FALSE;
-	}
-	if (!as_map_read_segments(g_AsMap)) {
-		ERROR("Failed to read map segments.");
-		return FALSE;
-	}
-	if (!as_map_load_objects(g_AsMap)) {
-		ERROR("Failed to load objects.");
+	snapshot = ap_config_get(g_ApConfig, "DataSnapshot");
+	if (snapshot) {
+		/* If snapshot cannot be used, tables are parsed 
+		 * and captured to create a new snapshot. */
+		if (au_snapshot_open(snapshot))
+			INFO("Reading data tables from snapshot (%s).", snapshot);
+		else
+			au_snapshot_begin_capture();
+	}
+	from_snapshot = au_snapshot_is_loaded();
+	if (from_snapshot)
+		g_LoadSource = "snapshot";
+	else if (au_snapshot_is_capturing())
+		g_LoadSource = "capture";
+	begin = ap_tick_get(g_ApTick);
+	if (!load_tables(inidir))
+		return FALSE;
+	INFO("Loaded data tables in %llu ms (%s).", 
+		(unsigned long long)(ap_tick_get(g_ApTick) - begin), 
+		from_snapshot ? "snapshot" : "text");
+	if (snapshot)
+		au_snapshot_finish(snapshot);
+	if (!as_drop_item_process_create_gold(g_AsDropItemProcess)) {
+		ERROR("Failed to create gold preset.");
 		return FALSE;
 	}
-	if (!make_path(path, sizeof(path), "%s/npctradelist.txt", inidir)) {
-		ERROR("Failed to create path (%s/npctradelist.txt).", inidir);
+	if (!as_login_init_presets(g_AsLogin)) {
+		ERROR("Failed to initialize login presets.");
 		return FALSE;
 	}
-	if (!ap_event_npc_trade_read_trade_lists(g_ApEventNpcTrade, path)) {
-		ERROR("Failed to read npc trade list templates.");
-		return FALSE;
+	if (headless) {
+		INFO("Completed headless initialization.");
+		return TRUE;
 	}
-	if (!make_path(path, sizeof(path), "%s/npc.ini", inidir)) {
-		ERROR("Failed to create path (npc.ini).");
+	if (!as_database_connect(g_AsDatabase)) {
+		ERROR("Failed to connect to database.");
 		return FALSE;
 	}
-	if (!ap_character_read_static(g_ApCharacter, path, FALSE)) {
-		ERROR("Failed to read static characters (%s).", path);
+	if (!as_account_preprocess(g_AsAccount)) {
+		ERROR("Failed to preprocess accounts.");
 		return FALSE;
 	}
-	if (!make_path(path, sizeof(path), "%s/spawndatatable.txt", inidir)) {
-		ERROR("Failed to create path (spawndatatable.txt).");
+	if (!as_server_create_servers(g_AsServer,
+			AS_SERVER_CREATE_LOGIN | AS_SERVER_CREATE_GAME)) {
+		ERROR("Failed to create servers.");
 		return FALSE;
 	}
-	if (!ap_spawn_read_data(g_ApSpawn, path, FALSE)) {
-		ERROR("Failed to read spawn data (%s).", path);
+	as_database_set_blocking(g_AsDatabase, FALSE);
+	INFO("Completed initialization.");
+	return TRUE;
+}
+
+/*
+ * Startup benchmark.
+ *
+ * `-b <report>` runs headless startup `-n <count>` times, 
+ * each time in a new process, and writes a JSON report 
+ * with the results of every run. With `-c`, files under 
+ * `ServerIniDir` are evicted from file system cache 
+ * before each run. Otherwise, an untimed run is done 
+ * first so that every run reads from cache.
+ *
+ * `-B <report>` does a single run in current process.
+ */
+struct bench_times {
+	/* In microseconds. */
+	uint64_t create;
+	uint64_t register_;
+	uint64_t initialize;
+};
+
+static boolean write_bench_run(
+	const char * path,
+	const struct bench_times * times)
+{
+	file f = open_file(path, FILE_ACCESS_WRITE);
+	uint64_t rss = 0;
+	uint64_t peak_rss = 0;
+	struct alloc_stats allocs;
+	struct intern_stats intern;
+	uint32_t i;
+	if (!f) {
+		ERROR("Failed to create benchmark report (%s).", path);
+		return FALSE;
+	}
+	get_memory_usage(&rss, &peak_rss);
+	get_alloc_stats(&allocs);
+	get_intern_stats(&intern);
+	print_file(f, "{\n\t\"source\": \"%s\",\n", g_LoadSource);
+	print_file(f, "\t\"create_us\": %llu,\n", 
+		(unsigned long long)times->create);
+	print_file(f, "\t\"register_us\": %llu,\n", 
+		(unsigned long long)times->register_);
+	print_file(f, "\t\"initialize_us\": %llu,\n", 
+		(unsigned long long)times->initialize);
+	print_file(f, "\t\"load_us\": %llu,\n", 
+		(unsigned long long)g_LoadDuration);
+	print_file(f, "\t\"critical_path_us\": %llu,\n", 
+		(unsigned long long)g_LoadCriticalPath);
+	print_file(f, "\t\"read_bytes\": %llu,\n", 
+		(unsigned long long)get_read_size());
+	print_file(f, "\t\"alloc_count\": %llu,\n", 
+		(unsigned long long)allocs.count);
+	print_file(f, "\t\"alloc_bytes\": %llu,\n", 
+		(unsigned long long)allocs.size);
+	print_file(f, "\t\"rss_bytes\": %llu,\n", 
+		(unsigned long long)rss);
+	print_file(f, "\t\"peak_rss_bytes\": %llu,\n", 
+		(unsigned long long)peak_rss);
+	print_file(f, "\t\"interned_count\": %llu,\n", 
+		(unsigned long long)intern.count);
+	print_file(f, "\t\"interned_bytes\": %llu,\n", 
+		(unsigned long long)intern.size);
+	print_file(f, "\t\"uninterned_bytes\": %llu,\n", 
+		(unsigned long long)intern.intern_size);
+	print_file(f, "\t\"alloc_tags\": [\n");
+	for (i = 0; i < get_alloc_tag_count(); i++) {
+		struct alloc_tag_stats tag;
+		get_alloc_tag_stats(i, &tag);
+		print_file(f, "\t\t{ \"name\": \"%s\", \"live_count\": %lld, "
+			"\"live_bytes\": %lld, \"alloc_count\": %llu }%s\n",
+			tag.name, 
+			(long long)tag.count,
+			(long long)tag.size,
+			(unsigned long long)tag.total_count,
+			(i + 1 < get_alloc_tag_count()) ? "," : "");
+	}
+	print_file(f, "\t],\n");
+	print_file(f, "\t\"loaders\": [\n");
+	for (i = 0; i < LOADER_COUNT; i++) {
+		const struct loader * loader = &g_Loaders[i];
+		print_file(f, "\t\t{ \"name\": \"%s\", \"serial\": %s, "
+			"\"wall_us\": %llu, \"critical_path_us\": %llu, "
+			"\"read_bytes\": %llu, \"alloc_count\": %llu, "
+			"\"alloc_bytes\": %llu }%s\n",
+			loader->name, 
+			loader->serial ? "true" : "false",
+			(unsigned long long)loader->duration,
+			(unsigned long long)loader->critical_path,
+			(unsigned long long)loader->read_size,
+			(unsigned long long)loader->allocs.count,
+			(unsigned long long)loader->allocs.size,
+			(i + 1 < LOADER_COUNT) ? "," : "");
+	}
+	print_file(f, "\t]\n}\n");
+	close_file(f);
+	return TRUE;
+}
+
+static boolean evict_file(
+	char * current_dir,
+	size_t maxcount,
+	const char * name,
+	size_t size,
+	void * user_data)
+{
+	char path[1024];
+	uint32_t * count = user_data;
+	int r = make_path(path, sizeof(path), "%s/%s", current_dir, name);
+	if (r > 0 && r < (int)sizeof(path) && evict_file_cache(path))
+		(*count)++;
+	return TRUE;
+}
+
+static boolean evict_tables()
+{
+	const char * inidir = ap_config_get(g_ApConfig, "ServerIniDir");
+	const char * snapshot = ap_config_get(g_ApConfig, "DataSnapshot");
+	char dir[1024];
+	uint32_t count = 0;
+	if (!inidir) {
+		ERROR("Failed to retrieve ServerIniDir config.");
 		return FALSE;
 	}
-	if (!make_path(path, sizeof(path), "%s/spawninstancetable.txt", inidir)) {
-		ERROR("Failed to create path (spawninstancetable.txt).");
+	if (strlcpy(dir, inidir, sizeof(dir)) >= sizeof(dir) ||
+		!enum_dir(dir, sizeof(dir), TRUE, evict_file, &count)) {
+		ERROR("Failed to enumerate data tables (%s).", inidir);
 		return FALSE;
 	}
-	if (!ap_spawn_read_instances(g_ApSpawn, path, FALSE)) {
-		ERROR("Failed to read spawn instances (%s).", path);
+	if (snapshot && evict_file_cache(snapshot))
+		count++;
+	INFO("Evicted %u files from file system cache.", count);
+	return TRUE;
+}
+
+static boolean run_bench_process(const char * exe, const char * run_path)
+{
+	char cmd[1100];
+	uint32_t code = 0;
+	snprintf(cmd, sizeof(cmd), "-B \"%s\"", run_path);
+	if (!run_process(exe, cmd, NULL, &code)) {
+		ERROR("Failed to create benchmark process.");
 		return FALSE;
 	}
-	if (!as_drop_item_process_create_gold(g_AsDropItemProcess)) {
-		ERROR("Failed to create gold preset.");
+	if (code != 0) {
+		ERROR("Benchmark run failed (exit code = %u).", code);
 		return FALSE;
 	}
-	if (!as_login_init_presets(g_AsLogin)) {
-		ERROR("Failed to initialize login presets.");
+	return TRUE;
+}
+
+static boolean append_bench_run(file f, const char * run_path)
+{
+	size_t size = 0;
+	void * data;
+	boolean result;
+	if (!get_file_size(run_path, &size) || !size) {
+		ERROR("Failed to read benchmark run (%s).", run_path);
+		return FALSE;
+	}
+	data = alloc(size);
+	result = load_file(run_path, data, size) && write_file(f, data, size);
+	dealloc(data);
+	remove_file(run_path);
+	if (!result)
+		ERROR("Failed to append benchmark run (%s).", run_path);
+	return result;
+}
+
+static boolean bench(
+	const char * exe,
+	const char * report_path,
+	uint32_t run_count,
+	boolean cold)
+{
+	char run_path[1024];
+	file f;
+	uint32_t i;
+	if (!make_path(run_path, sizeof(run_path), "%s.run", report_path)) {
+		ERROR("Failed to create path (%s.run).", report_path);
 		return FALSE;
 	}
-	if (!as_database_connect(g_AsDatabase)) {
-		ERROR("Failed to connect to database.");
-		return FALSE;
+	if (!cold) {
+		INFO("Warming up file system cache..");
+		if (!run_bench_process(exe, run_path))
+			return FALSE;
+		remove_file(run_path);
 	}
-	if (!as_account_preprocess(g_AsAccount)) {
-		ERROR("Failed to preprocess accounts.");
+	f = open_file(report_path, FILE_ACCESS_WRITE);
+	if (!f) {
+		ERROR("Failed to create benchmark report (%s).", report_path);
 		return FALSE;
 	}
-	if (!as_server_create_servers(g_AsServer,
-			AS_SERVER_CREATE_LOGIN | AS_SERVER_CREATE_GAME)) {
-		ERROR("Failed to create servers.");
-		return FALSE;
+	print_file(f, "{\n\"cache\": \"%s\",\n\"runs\": [\n", 
+		cold ? "cold" : "warm");
+	for (i = 0; i < run_count; i++) {
+		INFO("Benchmark run %u/%u..", i + 1, run_count);
+		if ((cold && !evict_tables()) ||
+			!run_bench_process(exe, run_path) ||
+			!append_bench_run(f, run_path)) {
+			close_file(f);
+			return FALSE;
+		}
+		if (i + 1 < run_count)
+			print_file(f, ",\n");
 	}
-	as_database_set_blocking(g_AsDatabase, FALSE);
-	INFO("Completed initialization.");
+	print_file(f, "]\n}\n");
+	close_file(f);
+	INFO("Wrote benchmark report (%s).", report_path);
 	return TRUE;
 }
 
@@ -761,11 +1322,42 @@ int main(int argc, char * argv[])
 	float dt = 0.0f;
 	float accum = 0.0f;
 	struct ap_module_registry * registry = NULL;
+	const char * bench_report = NULL;
+	const char * run_report = NULL;
+	uint32_t run_count = 1;
+	boolean cold = FALSE;
+	struct bench_times times = { 0 };
+	timer_t timer = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:B:n:c")) != -1) {
+		switch (opt) {
+		case 'b':
+			bench_report = optarg;
+			break;
+		case 'B':
+			run_report = optarg;
+			break;
+		case 'n':
+			run_count = strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			cold = TRUE;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-b report [-n count] [-c]]\n", 
+				argv[0]);
+			return -1;
+		}
+	}
 	if (!log_init()) {
 		fprintf(stderr, "log_init() failed.\n");
 		return -1;
 	}
 	log_set_callback(logcb);
+	if (!log_start_writer()) {
+		fprintf(stderr, "log_start_writer() failed.\n");
+		return -1;
+	}
 	if (!core_startup()) {
 		ERROR("Failed to startup core module.");
 		return -1;
@@ -774,43 +1366,87 @@ int main(int argc, char * argv[])
 		ERROR("Failed to startup task module.");
 		return -1;
 	}
+	timer = create_timer();
 	if (!create_modules()) {
 		ERROR("Module creation failed.");
 		return -1;
 	}
+	times.create = timer_delta(timer, TRUE);
 	registry = ap_module_registry_new();
 	if (!register_modules(registry)) {
 		ERROR("Failed to register modules.");
 		return -1;
 	}
-	if (!initialize()) {
+	times.register_ = timer_delta(timer, TRUE);
+	/* Modules are registered so that configuration 
+	 * can be used, data tables are loaded by each run. */
+	if (bench_report)
+		return bench(argv[0], bench_report, run_count, cold) ? 0 : -1;
+	if (!initialize(run_report != NULL)) {
 		ERROR("Failed to initialize.");
 		return -1;
 	}
+	times.initialize = timer_delta(timer, TRUE);
+	if (run_report) {
+		/* Teardown is not measured, process exits 
+		 * without shutting down modules. */
+		return write_bench_run(run_report, &times) ? 0 : -1;
+	}
 	last = ap_tick_get(g_ApTick);
+	profile_set_thread_name("Main");
 	INFO("Entering main loop..");
 	while (!core_should_shutdown()) {
 		uint64_t tick = ap_tick_get(g_ApTick);
+		PROFILE_BEGIN("Frame");
+		as_metrics_begin_frame(g_AsMetrics);
 		updatetick(&last, &dt);
+		PROFILE_BEGIN("as_server_poll_server");
 		as_server_poll_server(g_AsServer);
+		PROFILE_END();
+		PROFILE_BEGIN("as_database_process");
 		as_database_process(g_AsDatabase);
+		PROFILE_END();
+		PROFILE_BEGIN("as_character_process_iterate_all");
 		as_character_process_iterate_all(g_AsCharacterProcess, dt);
+		PROFILE_END();
+		PROFILE_BEGIN("as_account_commit");
 		as_account_commit(g_AsAccount, FALSE);
+		PROFILE_END();
+		PROFILE_BEGIN("as_guild_commit");
 		as_guild_commit(g_AsGuild, FALSE);
+		PROFILE_END();
+		PROFILE_BEGIN("as_spawn_process");
 		as_spawn_process(g_AsSpawn, tick);
+		PROFILE_END();
+		PROFILE_BEGIN("as_ai2_process_end_frame");
 		as_ai2_process_end_frame(g_AsAI2Process);
+		PROFILE_END();
+		PROFILE_BEGIN("as_map_clear_expired_item_drops");
 		as_map_clear_expired_item_drops(g_AsMap, tick);
+		PROFILE_END();
+		PROFILE_BEGIN("as_http_server_poll_requests");
 		as_http_server_poll_requests(g_AsHttpServer);
+		PROFILE_END();
+		PROFILE_BEGIN("as_event_gacha_process_handle_pending_rolls");
 		as_event_gacha_process_handle_pending_rolls(g_AsEventGachaProcess);
+		PROFILE_END();
 		accum += dt;
 		while (accum >= STEPTIME) {
 			/* Fixed-step updates should be done here (i.e. character movement). */
 			accum -= STEPTIME;
 		}
+		PROFILE_BEGIN("as_stats_process");
+		as_stats_process(g_AsStats);
+		PROFILE_END();
+		PROFILE_BEGIN("task_do_post_cb");
 		task_do_post_cb();
+		PROFILE_END();
+		as_metrics_end_frame(g_AsMetrics);
+		PROFILE_END();
 		sleep(1);
 	}
 	INFO("Exited main loop.");
+	log_pool_stats();
 	close();
 	shutdown();
 	return 0;
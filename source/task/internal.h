@@ -12,6 +12,9 @@ BEGIN_DECLS
 
 struct task_pool {
 	struct task_descriptor * list;
+	/* Number of tasks in list, updated while 
+	 * mutex is locked. */
+	volatile uint32_t count;
 	mutex_t mutex;
 };
 
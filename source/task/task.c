@@ -4,20 +4,31 @@
 #include "core/core.h"
 #include "core/log.h"
 #include "core/malloc.h"
+#include "core/profile.h"
 #include <string.h>
 
 static struct task_ctx * g_Ctx;
 
+static void runtask(struct task_descriptor * task)
+{
+	uint32_t tag = set_alloc_tag(task->alloc_tag);
+	PROFILE_BEGIN("Task");
+	task->result = task->work_cb(task->data);
+	PROFILE_END();
+	set_alloc_tag(tag);
+}
+
 static int task_thread_routine(void * param)
 {
 	struct task_thread * tt = param;
 	boolean shutdown = FALSE;
+	profile_set_thread_name("Task");
 	while(!shutdown) {
 		struct task_descriptor * task = dequeue_task(tt->in_queue);
 		if (!task)
 			task = dequeue_task(tt->in_queue_low_priority);
 		if (task) {
-			task->result = task->work_cb(task->data);
+			runtask(task);
 			if (task->post_cb)
 				add_task_to_pool(tt->done, task, FALSE);
 		}
@@ -71,8 +82,10 @@ static struct task_descriptor * dequeue_task(
 	struct task_descriptor * task = NULL;
 	lock_mutex(pool->mutex);
 	task = pool->list;
-	if (task)
+	if (task) {
 		pool->list = task->next;
+		pool->count--;
+	}
 	unlock_mutex(pool->mutex);
 	return task;
 }
@@ -94,6 +107,7 @@ static void complete_task(
 		ctx->done.list = task;
 	else
 		last->next = task;
+	ctx->done.count++;
 	unlock_mutex(ctx->done.mutex);
 }
 
@@ -104,8 +118,14 @@ static void add_task_to_pool(
 {
 	struct task_descriptor * cur;
 	struct task_descriptor * last = NULL;
-	if (!is_list)
+	uint32_t count = 1;
+	if (!is_list) {
 		task->next = NULL;
+	}
+	else {
+		for (cur = task->next; cur; cur = cur->next)
+			count++;
+	}
 	lock_mutex(pool->mutex);
 	cur = pool->list;
 	while (cur) {
@@ -116,6 +136,7 @@ static void add_task_to_pool(
 		pool->list = task;
 	else
 		last->next = task;
+	pool->count += count;
 	unlock_mutex(pool->mutex);
 }
 
@@ -127,7 +148,7 @@ static void consume_queue(
 		struct task_descriptor * task = dequeue_task(pool);
 		if (!task)
 			break;
-		task->result = task->work_cb(task->data);
+		runtask(task);
 		if (task->post_cb)
 			add_task_to_pool(&ctx->done, task, FALSE);
 	}
@@ -163,6 +184,7 @@ void task_shutdown()
 
 void task_add(struct task_descriptor * task, boolean low_priority)
 {
+	task->alloc_tag = get_alloc_tag();
 	if (low_priority) {
 		add_task_to_pool(&g_Ctx->in_queue_low_priority, task,
 			FALSE);
@@ -176,6 +198,12 @@ void task_add_list(
 	struct task_descriptor * task,
 	boolean low_priority)
 {
+	struct task_descriptor * cur = task;
+	uint32_t tag = get_alloc_tag();
+	while (cur) {
+		cur->alloc_tag = tag;
+		cur = cur->next;
+	}
 	if (low_priority) {
 		add_task_to_pool(&g_Ctx->in_queue_low_priority, task,
 			TRUE);
@@ -213,3 +241,12 @@ void task_do_post_cb()
 		task->post_cb(task, task->data, task->result);
 	}
 }
+
+void task_get_stats(struct task_stats * stats)
+{
+	struct task_ctx * ctx = g_Ctx;
+	stats->thread_count = ctx->thread_count;
+	stats->queued_count = ctx->in_queue.count;
+	stats->low_priority_queued_count = ctx->in_queue_low_priority.count;
+	stats->done_count = ctx->done.count;
+}
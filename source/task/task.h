@@ -18,9 +18,21 @@ struct task_descriptor {
 	task_post_t post_cb;
 	void * data;
 	boolean result;
+	/* Allocation tag of the thread that added the task, 
+	 * work callback is run with the same tag. */
+	uint32_t alloc_tag;
 	struct task_descriptor * next;
 };
 
+struct task_stats {
+	uint32_t thread_count;
+	/* Number of tasks waiting to be run. */
+	uint32_t queued_count;
+	uint32_t low_priority_queued_count;
+	/* Number of tasks waiting for post callbacks. */
+	uint32_t done_count;
+};
+
 boolean task_startup();
 
 void task_shutdown();
@@ -60,6 +72,14 @@ void task_wait_all();
  */
 void task_do_post_cb();
 
+/*
+ * Retrieves the number of queued tasks.
+ *
+ * Can be called from any thread, counts are 
+ * read without locking queues.
+ */
+void task_get_stats(struct task_stats * stats);
+
 END_DECLS
 
 #endif /* _TASK_H_ */
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include <stdio.h>
+
+#include "core/core.h"
+#include "core/log.h"
+
+#include "task/task.h"
+
+#include "test/test.h"
+
+struct test_desc {
+	const char * name;
+	boolean (*run)();
+};
+
+static struct test_desc g_Tests[] = {
+	{ "au_md5", test_au_md5 },
+	{ "ap_skill_const", test_ap_skill_const },
+};
+
+int main(int argc, char * argv[])
+{
+	uint32_t failed = 0;
+	uint32_t i;
+	if (!log_init()) {
+		fprintf(stderr, "log_init() failed.\n");
+		return -1;
+	}
+	if (!core_startup()) {
+		ERROR("Failed to startup core module.");
+		return -1;
+	}
+	if (!task_startup()) {
+		ERROR("Failed to startup task module.");
+		return -1;
+	}
+	for (i = 0; i < COUNT_OF(g_Tests); i++) {
+		const struct test_desc * t = &g_Tests[i];
+		if (t->run()) {
+			INFO("Test passed (%s).", t->name);
+		}
+		else {
+			ERROR("Test failed (%s).", t->name);
+			failed++;
+		}
+	}
+	INFO("%u/%u tests passed.", (uint32_t)COUNT_OF(g_Tests) - failed,
+		(uint32_t)COUNT_OF(g_Tests));
+	task_shutdown();
+	return failed ? -1 : 0;
+}
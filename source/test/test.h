@@ -0,0 +1,26 @@
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+BEGIN_DECLS
+
+/*
+ * Checks MD5 and RC4 against known answer tests,
+ * and decryption of content files with the content
+ * key against vectors of a reference implementation.
+ */
+boolean test_au_md5();
+
+/*
+ * Reloads skill const tables while buffs are added
+ * and removed, and checks that buffs keep the const
+ * factors they were added with and that retired const
+ * generations are released.
+ */
+boolean test_ap_skill_const();
+
+END_DECLS
+
+#endif /* _TEST_H_ */
@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/file_system.h"
+#include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
+
+#include "task/task.h"
+
+#include "public/ap_character.h"
+#include "public/ap_factors.h"
+#include "public/ap_module_instance.h"
+#include "public/ap_packet.h"
+#include "public/ap_random.h"
+#include "public/ap_skill.h"
+#include "public/ap_tick.h"
+
+#include "test/test.h"
+
+#define TEMPLATE_FILE_PATH "test_ap_skill_template.tmp"
+#define CONST_FILE_PATH "test_ap_skill_const.tmp"
+#define CONST2_FILE_PATH "test_ap_skill_const2.tmp"
+
+#define TEMPLATE_COUNT 32
+#define CHARACTER_COUNT 64
+#define ROUND_COUNT 64
+/* Number of buff changes in each frame. */
+#define FRAME_CHANGE_COUNT 32
+/* Const factors are set to `round * ROUND_MARKER + level`. */
+#define ROUND_MARKER 100
+
+enum module_index {
+	MODULE_PACKET,
+	MODULE_TICK,
+	MODULE_RANDOM,
+	MODULE_FACTORS,
+	MODULE_CHARACTER,
+	MODULE_SKILL,
+	MODULE_COUNT
+};
+
+struct skill_test {
+	ap_module_t modules[MODULE_COUNT];
+	struct ap_character_module * ap_character;
+	struct ap_skill_module * ap_skill;
+	struct ap_module_registry * registry;
+	struct ap_character_template character_template;
+	struct ap_character * characters[CHARACTER_COUNT];
+	struct ap_skill_template * skills[TEMPLATE_COUNT];
+	/* Round in which const factors of each template
+	 * were last read, by const generation. */
+	uint32_t const_round[ROUND_COUNT + 1][TEMPLATE_COUNT];
+	uint32_t round;
+	struct task_descriptor task;
+	struct ap_skill_const_stage * stage;
+	boolean reloading;
+	boolean reload_failed;
+	uint32_t seed;
+	uint64_t added_buff_count;
+	uint64_t removed_buff_count;
+	uint64_t frame_count;
+	uint32_t max_retired_count;
+};
+
+static uint32_t testrandom(struct skill_test * t)
+{
+	t->seed = t->seed * 1103515245 + 12345;
+	return (t->seed >> 16);
+}
+
+/*
+ * Template `i` is left out of every fourth reload,
+ * so that generations retire only some templates.
+ */
+static boolean isreloaded(uint32_t round, uint32_t index)
+{
+	return (!round || (index + round) % 4 != 0);
+}
+
+static boolean writetemplates()
+{
+	char * buffer = alloc(TEMPLATE_COUNT * 64);
+	size_t length;
+	boolean result;
+	uint32_t i;
+	/* Stream files start with names of value indices. */
+	length = snprintf(buffer, TEMPLATE_COUNT * 64, "0=ModuleData1\n1=Name\n");
+	for (i = 0; i < TEMPLATE_COUNT; i++) {
+		length += snprintf(buffer + length, TEMPLATE_COUNT * 64 - length,
+			"[%u]\n0=AgpmSkill\n1=Skill%u\n", i + 1, i + 1);
+	}
+	result = make_file(TEMPLATE_FILE_PATH, buffer, length);
+	dealloc(buffer);
+	return result;
+}
+
+static boolean writeconst(
+	const char * file_path,
+	const char * header,
+	uint32_t round)
+{
+	size_t size = (size_t)TEMPLATE_COUNT * AP_SKILL_MAX_SKILL_CAP * 64;
+	char * buffer = alloc(size);
+	size_t length;
+	boolean result;
+	uint32_t i;
+	length = snprintf(buffer, size, "%s\n", header);
+	for (i = 0; i < TEMPLATE_COUNT; i++) {
+		uint32_t level;
+		if (!isreloaded(round, i))
+			continue;
+		for (level = 1; level < AP_SKILL_MAX_SKILL_CAP; level++) {
+			length += snprintf(buffer + length, size - length,
+				"Skill%u\t%u\t%u\n", i + 1, level,
+				round * ROUND_MARKER + level);
+		}
+	}
+	result = make_file(file_path, buffer, length);
+	dealloc(buffer);
+	return result;
+}
+
+static boolean writeconsttables(uint32_t round)
+{
+	return (writeconst(CONST_FILE_PATH, "name\tskill_level\tstr", round) &&
+		writeconst(CONST2_FILE_PATH, "name2\tskill_level2\tstr2", round));
+}
+
+static void removefiles()
+{
+	remove_file(TEMPLATE_FILE_PATH);
+	remove_file(CONST_FILE_PATH);
+	remove_file(CONST2_FILE_PATH);
+}
+
+static boolean createmodules(struct skill_test * t)
+{
+	uint32_t i;
+	t->modules[MODULE_PACKET] = ap_packet_create_module();
+	t->modules[MODULE_TICK] = ap_tick_create_module();
+	t->modules[MODULE_RANDOM] = ap_random_create_module();
+	t->modules[MODULE_FACTORS] = ap_factors_create_module();
+	t->modules[MODULE_CHARACTER] = ap_character_create_module();
+	t->modules[MODULE_SKILL] = ap_skill_create_module();
+	t->ap_character = t->modules[MODULE_CHARACTER];
+	t->ap_skill = t->modules[MODULE_SKILL];
+	t->registry = ap_module_registry_new();
+	for (i = 0; i < MODULE_COUNT; i++) {
+		struct ap_module_instance * instance = t->modules[i];
+		if (!ap_module_registry_register(t->registry, instance) ||
+			(instance->cb_register &&
+				!instance->cb_register(instance, t->registry))) {
+			ERROR("Module registration failed (%s).",
+				instance->context.name);
+			return FALSE;
+		}
+	}
+	for (i = 0; i < MODULE_COUNT; i++) {
+		struct ap_module_instance * instance = t->modules[i];
+		if (instance->cb_initialize &&
+			!instance->cb_initialize(instance)) {
+			ERROR("Module initialization failed (%s).",
+				instance->context.name);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static void destroymodules(struct skill_test * t)
+{
+	int32_t i;
+	for (i = MODULE_COUNT - 1; i >= 0; i--) {
+		struct ap_module_instance * instance = t->modules[i];
+		if (instance && instance->cb_close)
+			instance->cb_close(instance);
+	}
+	for (i = MODULE_COUNT - 1; i >= 0; i--) {
+		struct ap_module_instance * instance = t->modules[i];
+		if (!instance)
+			continue;
+		if (instance->cb_shutdown)
+			instance->cb_shutdown(instance);
+		ap_module_instance_destroy(instance);
+	}
+	if (t->registry)
+		ap_module_registry_destroy(t->registry);
+}
+
+/*
+ * Checks that every applied buff references the const
+ * factors of the generation it was added in, and that
+ * removing buffs restores what adding them changed.
+ */
+static boolean checkcharacter(
+	struct skill_test * t,
+	struct ap_character * c)
+{
+	struct ap_skill_character * attachment =
+		ap_skill_get_character(t->ap_skill, c);
+	float str = 0.0f;
+	uint32_t i;
+	for (i = 0; i < attachment->buff_count; i++) {
+		const struct ap_skill_buff_list * buff = &attachment->buff_list[i];
+		float expected;
+		if (buff->const_epoch > t->round) {
+			ERROR("Buff is in const generation %u before round %u.",
+				buff->const_epoch, t->round);
+			return FALSE;
+		}
+		expected = (float)(t->const_round[buff->const_epoch][buff->skill_tid - 1] *
+			ROUND_MARKER + buff->skill_level);
+		if (ap_skill_get_buff_const_factor(buff)[AP_SKILL_CONST_POINT_STR] != expected ||
+			ap_skill_get_buff_const_factor2(buff)[AP_SKILL_CONST_POINT_STR] != expected) {
+			ERROR("Buff of const generation %u has const factors of another generation (tid = %u, level = %u).",
+				buff->const_epoch, buff->skill_tid, buff->skill_level);
+			return FALSE;
+		}
+		str += expected;
+	}
+	if (c->factor.char_status.str != str) {
+		ERROR("Character strength (%g) does not match applied buffs (%g).",
+			c->factor.char_status.str, str);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static boolean checkgenerations(struct skill_test * t)
+{
+	uint32_t applied = 0;
+	uint32_t counted = ap_skill_get_const_generation_buff_count(t->ap_skill);
+	uint32_t retired = ap_skill_get_retired_const_generation_count(t->ap_skill);
+	uint32_t i;
+	for (i = 0; i < CHARACTER_COUNT; i++) {
+		struct ap_character * c = t->characters[i];
+		if (!c)
+			continue;
+		if (!checkcharacter(t, c))
+			return FALSE;
+		applied += ap_skill_get_character(t->ap_skill, c)->buff_count;
+	}
+	if (applied != counted) {
+		ERROR("Const generations count %u buffs while %u are applied.",
+			counted, applied);
+		return FALSE;
+	}
+	if (retired > t->max_retired_count)
+		t->max_retired_count = retired;
+	return TRUE;
+}
+
+static void changebuffs(struct skill_test * t)
+{
+	struct ap_character * c = t->characters[
+		testrandom(t) % CHARACTER_COUNT];
+	struct ap_skill_character * attachment =
+		ap_skill_get_character(t->ap_skill, c);
+	struct ap_skill_template * temp;
+	uint32_t level;
+	if (attachment->buff_count &&
+		(ap_skill_is_buff_list_full(attachment) || testrandom(t) % 2)) {
+		ap_skill_remove_buff(t->ap_skill, c,
+			testrandom(t) % attachment->buff_count);
+		t->removed_buff_count++;
+		return;
+	}
+	temp = t->skills[testrandom(t) % TEMPLATE_COUNT];
+	level = 1 + testrandom(t) % (AP_SKILL_MAX_SKILL_CAP - 1);
+	if (ap_skill_is_stronger_effect_applied(t->ap_skill, c, temp, level))
+		return;
+	ap_skill_add_buff(t->ap_skill, c, 0, level, temp, 60000, 0, 0);
+	t->added_buff_count++;
+}
+
+static boolean frame(struct skill_test * t)
+{
+	uint32_t i;
+	for (i = 0; i < FRAME_CHANGE_COUNT; i++)
+		changebuffs(t);
+	/* Staged tables are applied here. */
+	task_do_post_cb();
+	t->frame_count++;
+	return checkgenerations(t);
+}
+
+/*
+ * Const tables are read into a stage on a task thread
+ * while buffs change, like `/reload` does.
+ */
+static boolean readstage(void * data)
+{
+	struct skill_test * t = data;
+	t->stage = ap_skill_read_const_stage(t->ap_skill,
+		CONST_FILE_PATH, CONST2_FILE_PATH, FALSE);
+	return (t->stage != NULL);
+}
+
+static void applystage(
+	struct task_descriptor * task,
+	void * data,
+	boolean result)
+{
+	struct skill_test * t = data;
+	uint32_t i;
+	t->reloading = FALSE;
+	if (!result) {
+		t->reload_failed = TRUE;
+		return;
+	}
+	ap_skill_apply_const_stage(t->ap_skill, t->stage);
+	t->stage = NULL;
+	for (i = 0; i < TEMPLATE_COUNT; i++) {
+		t->const_round[t->round][i] = isreloaded(t->round, i) ?
+			t->round : t->const_round[t->round - 1][i];
+	}
+}
+
+static void waitreload(struct skill_test * t)
+{
+	while (t->reloading) {
+		task_do_post_cb();
+		sleep(1);
+	}
+}
+
+static boolean reload(struct skill_test * t)
+{
+	if (!writeconsttables(t->round)) {
+		ERROR("Failed to write const tables.");
+		return FALSE;
+	}
+	t->reloading = TRUE;
+	t->task.work_cb = readstage;
+	t->task.post_cb = applystage;
+	t->task.data = t;
+	task_add(&t->task, FALSE);
+	while (t->reloading) {
+		if (!frame(t)) {
+			waitreload(t);
+			return FALSE;
+		}
+		sleep(1);
+	}
+	if (t->reload_failed) {
+		ERROR("Failed to read const stage (round = %u).", t->round);
+		return FALSE;
+	}
+	return frame(t);
+}
+
+static boolean setup(struct skill_test * t)
+{
+	uint32_t i;
+	if (!writetemplates() || !writeconsttables(0)) {
+		ERROR("Failed to write skill tables.");
+		return FALSE;
+	}
+	if (!createmodules(t))
+		return FALSE;
+	if (!ap_skill_read_templates(t->ap_skill, TEMPLATE_FILE_PATH, FALSE) ||
+		!ap_skill_read_const(t->ap_skill, CONST_FILE_PATH, FALSE) ||
+		!ap_skill_read_const2(t->ap_skill, CONST2_FILE_PATH, FALSE)) {
+		ERROR("Failed to read skill tables.");
+		return FALSE;
+	}
+	for (i = 0; i < TEMPLATE_COUNT; i++) {
+		t->skills[i] = ap_skill_get_template(t->ap_skill, i + 1);
+		if (!t->skills[i]) {
+			ERROR("Failed to retrieve skill template (tid = %u).", i + 1);
+			return FALSE;
+		}
+		/* Attributes are read from skill spec table. */
+		t->skills[i]->attribute |= AP_SKILL_ATTRIBUTE_BUFF;
+	}
+	for (i = 0; i < CHARACTER_COUNT; i++) {
+		t->characters[i] = ap_character_new(t->ap_character);
+		ap_character_set_template(t->ap_character, t->characters[i],
+			&t->character_template);
+	}
+	return TRUE;
+}
+
+/*
+ * Half of the characters are freed with their buffs
+ * applied, so that both ways of releasing const
+ * generations are tested.
+ */
+static boolean teardown(struct skill_test * t)
+{
+	uint32_t i;
+	for (i = 0; i < CHARACTER_COUNT; i++) {
+		struct ap_character * c = t->characters[i];
+		if (i % 2) {
+			struct ap_skill_character * attachment =
+				ap_skill_get_character(t->ap_skill, c);
+			while (attachment->buff_count) {
+				ap_skill_remove_buff(t->ap_skill, c, 0);
+				t->removed_buff_count++;
+			}
+			if (c->factor.char_status.str != 0.0f) {
+				ERROR("Removing all buffs did not restore character strength (%g).",
+					c->factor.char_status.str);
+				return FALSE;
+			}
+		}
+		ap_character_free(t->ap_character, c);
+		t->characters[i] = NULL;
+	}
+	if (ap_skill_get_const_generation_buff_count(t->ap_skill) ||
+		ap_skill_get_retired_const_generation_count(t->ap_skill)) {
+		ERROR("Const generations were not released (%u buffs, %u retired generations).",
+			ap_skill_get_const_generation_buff_count(t->ap_skill),
+			ap_skill_get_retired_const_generation_count(t->ap_skill));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static boolean run(struct skill_test * t)
+{
+	uint32_t i;
+	if (!setup(t))
+		return FALSE;
+	/* Buffs are applied before the first reload, so
+	 * that it retires a generation that is in use. */
+	for (i = 0; i < 16; i++) {
+		if (!frame(t))
+			return FALSE;
+	}
+	for (t->round = 1; t->round <= ROUND_COUNT; t->round++) {
+		if (!reload(t))
+			return FALSE;
+	}
+	t->round = ROUND_COUNT;
+	if (!teardown(t))
+		return FALSE;
+	INFO("Added %llu buffs and removed %llu buffs in %llu frames over %u reloads, up to %u retired const generations were in use.",
+		(unsigned long long)t->added_buff_count,
+		(unsigned long long)t->removed_buff_count,
+		(unsigned long long)t->frame_count,
+		ROUND_COUNT, t->max_retired_count);
+	return TRUE;
+}
+
+boolean test_ap_skill_const()
+{
+	struct skill_test * t = alloc(sizeof(*t));
+	uint32_t seed = (uint32_t)time(NULL);
+	boolean result;
+	uint32_t i;
+	memset(t, 0, sizeof(*t));
+	t->seed = seed;
+	result = run(t);
+	if (!result)
+		ERROR("Skill const test failed (seed = %u).", seed);
+	/* Characters are only left when the test failed. */
+	for (i = 0; i < CHARACTER_COUNT; i++) {
+		if (t->characters[i])
+			ap_character_free(t->ap_character, t->characters[i]);
+	}
+	destroymodules(t);
+	removefiles();
+	dealloc(t);
+	return result;
+}
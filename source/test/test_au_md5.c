@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "core/file_system.h"
+#include "core/log.h"
+#include "core/malloc.h"
+
+#include "utility/au_md5.h"
+#include "utility/au_table.h"
+
+#include "test/test.h"
+
+#define CONTENT_KEY "1111"
+#define PLAIN_FILE_PATH "test_au_md5_plain.tmp"
+#define ENCRYPTED_FILE_PATH "test_au_md5_encrypted.tmp"
+
+/*
+ * Content vectors were generated with OpenSSL, by
+ * encrypting with RC4 keyed with the MD5 digest of
+ * the content key:
+ *
+ *   openssl enc -rc4 -nosalt -K $(printf 1111 | openssl md5 -r)
+ *
+ * which is what CryptoAPI derives from an MD5 hash
+ * with CRYPT_CREATE_SALT.
+ */
+static const char CONTENT_KEY_DIGEST[] =
+	"b59c67bf196a4758191e42f76670ceba";
+
+static const char TABLE_PLAINTEXT[] =
+	"Name\tValue\nAlpha\t1\nBeta\t2\n";
+
+static const char TABLE_CIPHERTEXT[] =
+	"f4591f630a4b770902b622aff162282583eabd427e49a49ab31c";
+
+/* Length of the stream vector, long enough for the
+ * cipher state to be permuted several times over. */
+#define STREAM_SIZE 4096
+
+/* MD5 digest of the encrypted stream vector. */
+static const char STREAM_CIPHERTEXT_DIGEST[] =
+	"eec4249461009783328990a70cfd2d1e";
+
+enum table_column_id {
+	TABLE_COLUMN_NAME,
+	TABLE_COLUMN_VALUE,
+};
+
+static void tohex(const uint8_t * data, size_t size, char * hex)
+{
+	size_t i;
+	for (i = 0; i < size; i++)
+		snprintf(hex + 2 * i, 3, "%02x", data[i]);
+}
+
+static boolean checkhex(
+	const char * test,
+	const uint8_t * data,
+	size_t size,
+	const char * expected)
+{
+	char hex[2 * 64 + 1] = "";
+	if (2 * size >= sizeof(hex)) {
+		ERROR("Output is too long to compare (%s).", test);
+		return FALSE;
+	}
+	tohex(data, size, hex);
+	if (strcmp(hex, expected) != 0) {
+		ERROR("Output does not match (%s): %s != %s.", test, hex,
+			expected);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static boolean testdigest()
+{
+	/* Test suite of RFC 1321, appendix A.5. */
+	static const struct {
+		const char * input;
+		const char * digest;
+	} tests[] = {
+		{ "",
+			"d41d8cd98f00b204e9800998ecf8427e" },
+		{ "a",
+			"0cc175b9c0f1b6a831c399e269772661" },
+		{ "abc",
+			"900150983cd24fb0d6963f7d28e17f72" },
+		{ "message digest",
+			"f96b697d7cb7938d525a2f31aaf161d0" },
+		{ "abcdefghijklmnopqrstuvwxyz",
+			"c3fcd3d76192e4007dfb496cca67e13b" },
+		{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+			"d174ab98d277d9f5a5611c2c9f419d9f" },
+		{ "1234567890123456789012345678901234567890"
+		  "1234567890123456789012345678901234567890",
+			"57edf4a22be3c955ac49da2e2107b67a" },
+		{ CONTENT_KEY, CONTENT_KEY_DIGEST } };
+	uint32_t i;
+	for (i = 0; i < COUNT_OF(tests); i++) {
+		uint8_t digest[AU_MD5_DIGEST_SIZE];
+		au_md5_digest(tests[i].input, strlen(tests[i].input), digest);
+		if (!checkhex(tests[i].input, digest, sizeof(digest),
+				tests[i].digest)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static boolean testcrypt()
+{
+	uint8_t data[sizeof(TABLE_PLAINTEXT) - 1];
+	memcpy(data, TABLE_PLAINTEXT, sizeof(data));
+	au_md5_crypt(data, sizeof(data), (const uint8_t *)CONTENT_KEY, 4);
+	if (!checkhex("encrypt", data, sizeof(data), TABLE_CIPHERTEXT))
+		return FALSE;
+	au_md5_crypt(data, sizeof(data), (const uint8_t *)CONTENT_KEY, 4);
+	if (memcmp(data, TABLE_PLAINTEXT, sizeof(data)) != 0) {
+		ERROR("Decrypted data does not match plaintext.");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Stream is processed in parts of uneven sizes, to
+ * test that consecutive calls continue the stream.
+ */
+static boolean teststream()
+{
+	static const size_t parts[] = { 1, 255, 1000, 7, 0, 2833 };
+	uint8_t * data = alloc(STREAM_SIZE);
+	uint8_t * encrypted = alloc(STREAM_SIZE);
+	struct au_md5_rc4 ctx;
+	uint8_t digest[AU_MD5_DIGEST_SIZE];
+	size_t offset = 0;
+	uint32_t i;
+	boolean result;
+	for (i = 0; i < STREAM_SIZE; i++)
+		data[i] = (uint8_t)(i * 31 + (i >> 8));
+	au_md5_rc4_init(&ctx, (const uint8_t *)CONTENT_KEY, 4);
+	for (i = 0; i < COUNT_OF(parts); i++) {
+		au_md5_rc4_crypt(&ctx, data + offset, encrypted + offset,
+			parts[i]);
+		offset += parts[i];
+	}
+	if (offset != STREAM_SIZE) {
+		ERROR("Stream parts do not add up to stream size.");
+		dealloc(data);
+		dealloc(encrypted);
+		return FALSE;
+	}
+	au_md5_digest(encrypted, STREAM_SIZE, digest);
+	result = checkhex("stream", digest, sizeof(digest),
+		STREAM_CIPHERTEXT_DIGEST);
+	dealloc(data);
+	dealloc(encrypted);
+	return result;
+}
+
+/*
+ * Encrypts a file the way the editor exports content,
+ * then reads it back the way the server loads tables.
+ */
+static boolean testcontentfile()
+{
+	struct au_table * table;
+	const uint8_t * encrypted;
+	size_t size = 0;
+	boolean result = TRUE;
+	uint32_t rows = 0;
+	if (!make_file(PLAIN_FILE_PATH, TABLE_PLAINTEXT,
+			sizeof(TABLE_PLAINTEXT) - 1)) {
+		ERROR("Failed to create file (%s).", PLAIN_FILE_PATH);
+		return FALSE;
+	}
+	if (!au_md5_copy_and_encrypt_file(PLAIN_FILE_PATH,
+			ENCRYPTED_FILE_PATH)) {
+		ERROR("Failed to encrypt file (%s).", PLAIN_FILE_PATH);
+		remove_file(PLAIN_FILE_PATH);
+		return FALSE;
+	}
+	remove_file(PLAIN_FILE_PATH);
+	encrypted = map_file(ENCRYPTED_FILE_PATH, &size);
+	if (!encrypted) {
+		ERROR("Failed to map file (%s).", ENCRYPTED_FILE_PATH);
+		remove_file(ENCRYPTED_FILE_PATH);
+		return FALSE;
+	}
+	result = checkhex("file", encrypted, size, TABLE_CIPHERTEXT);
+	unmap_file(encrypted, size);
+	if (!result) {
+		remove_file(ENCRYPTED_FILE_PATH);
+		return FALSE;
+	}
+	table = au_table_open(ENCRYPTED_FILE_PATH, TRUE);
+	if (!table) {
+		ERROR("Failed to open table (%s).", ENCRYPTED_FILE_PATH);
+		remove_file(ENCRYPTED_FILE_PATH);
+		return FALSE;
+	}
+	au_table_set_column(table, "Name", TABLE_COLUMN_NAME);
+	au_table_set_column(table, "Value", TABLE_COLUMN_VALUE);
+	while (result && au_table_read_next_line(table)) {
+		static const char * names[] = { "Alpha", "Beta" };
+		while (au_table_read_next_column(table)) {
+			switch (au_table_get_column(table)) {
+			case TABLE_COLUMN_NAME:
+				result &= rows < COUNT_OF(names) &&
+					strcmp(au_table_get_value(table), names[rows]) == 0;
+				break;
+			case TABLE_COLUMN_VALUE:
+				result &= au_table_get_i32(table) == (int32_t)rows + 1;
+				break;
+			}
+		}
+		rows++;
+	}
+	au_table_destroy(table);
+	remove_file(ENCRYPTED_FILE_PATH);
+	if (!result || rows != 2) {
+		ERROR("Decrypted table does not match plaintext.");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+boolean test_au_md5()
+{
+	return testdigest() && testcrypt() && teststream() &&
+		testcontentfile();
+}
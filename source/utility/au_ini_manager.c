@@ -5,6 +5,7 @@
 #include "core/string.h"
 
 #include "utility/au_md5.h"
+#include "utility/au_snapshot.h"
 
 #include <assert.h>
 #include <stdarg.h>
@@ -14,6 +15,17 @@
 #define CRLF_LENGTH		2
 #define HASH_KEY_STRING	"1111"
 
+/* Sections with fewer keys are searched linearly. */
+#define KEY_LOOKUP_MIN_COUNT 8
+
+static char * dupstr(const char * str)
+{
+	size_t size = strlen(str) + 1;
+	char * copy = alloc(size);
+	memcpy(copy, str, size);
+	return copy;
+}
+
 static void strip_trailing_spaces(char * str)
 {
 	size_t len = strlen(str);
@@ -48,6 +60,129 @@ static size_t print_compact_float(char * str, float value)
 	return len;
 }
 
+static uint32_t hash_name(const char * name)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261u;
+	while (*name)
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	return h;
+}
+
+static uint32_t hash_id(uint32_t id)
+{
+	return id * 2654435761u;
+}
+
+static void index_clear(struct au_ini_mgr_index * index)
+{
+	if (index->slots)
+		dealloc(index->slots);
+	memset(index, 0, sizeof(*index));
+}
+
+static void index_add(
+	struct au_ini_mgr_index * index,
+	uint32_t hash,
+	uint32_t id)
+{
+	uint32_t mask;
+	uint32_t i;
+	/* Load factor is kept below one half so that 
+	 * probing always reaches an empty slot. */
+	if ((index->count + 1) * 2 > index->capacity) {
+		struct au_ini_mgr_index_slot * slots = index->slots;
+		uint32_t capacity = index->capacity;
+		index->capacity = capacity ? capacity * 2 : 16;
+		index->slots = alloc(index->capacity * sizeof(*slots));
+		memset(index->slots, 0xFF, index->capacity * sizeof(*slots));
+		index->count = 0;
+		for (i = 0; i < capacity; i++) {
+			if (slots[i].id != UINT32_MAX)
+				index_add(index, slots[i].hash, slots[i].id);
+		}
+		if (slots)
+			dealloc(slots);
+	}
+	mask = index->capacity - 1;
+	for (i = hash & mask; index->slots[i].id != UINT32_MAX; i = (i + 1) & mask);
+	index->slots[i].hash = hash;
+	index->slots[i].id = id;
+	index->count++;
+}
+
+/*
+ * Returns the next id that was added with `hash`, 
+ * UINT32_MAX if there are no more candidates.
+ *
+ * `cursor` needs to be zero for the first call.
+ */
+static uint32_t index_next(
+	const struct au_ini_mgr_index * index,
+	uint32_t hash,
+	uint32_t * cursor)
+{
+	uint32_t mask = index->capacity - 1;
+	while (*cursor < index->capacity) {
+		const struct au_ini_mgr_index_slot * slot =
+			&index->slots[(hash + (*cursor)++) & mask];
+		if (slot->id == UINT32_MAX)
+			return UINT32_MAX;
+		if (slot->hash == hash)
+			return slot->id;
+	}
+	return UINT32_MAX;
+}
+
+static uint32_t find_section(
+	struct au_ini_mgr_ctx * ctx,
+	const char * section_name,
+	uint32_t hash)
+{
+	uint32_t cursor = 0;
+	uint32_t id;
+	while ((id = index_next(&ctx->section_lookup, hash, 
+			&cursor)) != UINT32_MAX) {
+		if (strcmp(section_name, ctx->sections[id].section_name) == 0)
+			return id;
+	}
+	return UINT32_MAX;
+}
+
+static void add_section_lookup(struct au_ini_mgr_ctx * ctx, uint32_t id)
+{
+	const char * name = ctx->sections[id].section_name;
+	uint32_t hash = hash_name(name);
+	/* If there are sections with the same name, 
+	 * first one is found. */
+	if (find_section(ctx, name, hash) == UINT32_MAX)
+		index_add(&ctx->section_lookup, hash, id);
+}
+
+static uint32_t find_section_key(
+	struct au_ini_mgr_section * section,
+	uint32_t key_index)
+{
+	uint32_t cursor = 0;
+	uint32_t hash = hash_id(key_index);
+	uint32_t id;
+	while ((id = index_next(&section->key_lookup, hash, 
+			&cursor)) != UINT32_MAX) {
+		if (section->keys[id].key_index == key_index)
+			return id;
+	}
+	return UINT32_MAX;
+}
+
+static void add_key_lookup(struct au_ini_mgr_section * section, uint32_t id)
+{
+	uint32_t key_index = section->keys[id].key_index;
+	/* In name overwrite mode, a section can have 
+	 * duplicate keys and the first one is found. */
+	if (find_section_key(section, key_index) == UINT32_MAX)
+		index_add(&section->key_lookup, hash_id(key_index), id);
+}
+
 struct au_ini_mgr_ctx * au_ini_mgr_create()
 {
 	struct au_ini_mgr_ctx * ctx = alloc(sizeof(*ctx));
@@ -71,11 +206,13 @@ void au_ini_mgr_destroy(struct au_ini_mgr_ctx * ctx)
 		for (i = 0; i < ctx->section_count; i++) {
 			if (ctx->sections[i].keys)
 				dealloc(ctx->sections[i].keys);
+			index_clear(&ctx->sections[i].key_lookup);
 		}
 		dealloc(ctx->sections);
 		ctx->sections = NULL;
 		ctx->section_count = 0;
 	}
+	index_clear(&ctx->section_lookup);
 	if (ctx->binary_sections) {
 		for (i = 0; i < ctx->binary_section_count; i++) {
 			if (ctx->binary_sections[i].keys)
@@ -93,9 +230,12 @@ void au_ini_mgr_destroy(struct au_ini_mgr_ctx * ctx)
 	if (ctx->key_table) {
 		for (uint32_t i = 0; i < ctx->key_table_count; i++)
 			dealloc(ctx->key_table[i]);
+		dealloc(ctx->key_table);
 		ctx->key_table = NULL;
 		ctx->key_table_count = 0;
+		ctx->key_table_capacity = 0;
 	}
+	index_clear(&ctx->key_table_lookup);
 }
 
 const char * au_ini_mgr_get_key_name_table(
@@ -110,21 +250,24 @@ uint32_t au_ini_mgr_get_key_index(
 	struct au_ini_mgr_ctx * ctx,
 	const char * str)
 {
-	char ** table;
+	uint32_t hash = hash_name(str);
+	uint32_t cursor = 0;
 	uint32_t i;
-	for (uint32_t i = 0; i < ctx->key_table_count; i++) {
+	while ((i = index_next(&ctx->key_table_lookup, hash, 
+			&cursor)) != UINT32_MAX) {
 		if (strcmp(str, ctx->key_table[i]) == 0)
 			return i;
 	}
 	/* Key not found, add a new key to table and returns 
 	 * its index. */
-	table = alloc(
-		((size_t)ctx->key_table_count + 1) * sizeof(*table));
-	for (i = 0; i < ctx->key_table_count; i++)
-		table[i] = ctx->key_table[i];
-	dealloc(ctx->key_table);
-	ctx->key_table = table;
-	table[ctx->key_table_count] = _strdup(str);
+	if (ctx->key_table_count == ctx->key_table_capacity) {
+		ctx->key_table_capacity = ctx->key_table_capacity ?
+			ctx->key_table_capacity * 2 : 64;
+		ctx->key_table = reallocate(ctx->key_table,
+			ctx->key_table_capacity * sizeof(*ctx->key_table));
+	}
+	ctx->key_table[ctx->key_table_count] = dupstr(str);
+	index_add(&ctx->key_table_lookup, hash, ctx->key_table_count);
 	return ctx->key_table_count++;
 }
 
@@ -134,7 +277,7 @@ void au_ini_mgr_set_path(
 {
 	if (ctx->path_name)
 		dealloc(ctx->path_name);
-	ctx->path_name = _strdup(path);
+	ctx->path_name = dupstr(path);
 }
 
 void au_ini_mgr_set_process_mode(
@@ -450,21 +593,30 @@ boolean au_ini_mgr_from_memory(
 	char line[AU_INI_MGR_MAX_NAME + AU_INI_MGR_MAX_KEYVALUE + 1];
 	size_t line_len;
 	uint32_t file_section_count = 0;
-	static uint32_t file_key_count[AU_INI_MGR_MAX_SECTIONCOUNT];
+	/* Files may be read from several threads at once. */
+	uint32_t * file_key_count;
 	size_t offset_bytes = 0;
 	size_t offset = 0;
 	char * buffer = NULL;
 	size_t tmp;
 	uint32_t key_index_count = 0;
 	boolean use_key_index = FALSE;
+	buffer = (char *)alloc((size_t)data_size + 1);
 	if (decrypt) {
-		if (!au_md5_crypt(data, data_size, "1111", 4))
-			return FALSE;
+		/* Decrypt while copying so that source data is 
+		 * left intact. */
+		struct au_md5_rc4 rc4;
+		au_md5_rc4_init(&rc4, (const uint8_t *)"1111", 4);
+		au_md5_rc4_crypt(&rc4, data, buffer, data_size);
+	}
+	else {
+		memcpy(buffer, data, data_size);
 	}
-	buffer = (char *)alloc((size_t)data_size + 1);
-	memcpy(buffer, data, data_size);
 	buffer[data_size] = '\0';
-	memset(file_key_count, 0, sizeof(file_key_count));
+	file_key_count = alloc(
+		AU_INI_MGR_MAX_SECTIONCOUNT * sizeof(*file_key_count));
+	memset(file_key_count, 0,
+		AU_INI_MGR_MAX_SECTIONCOUNT * sizeof(*file_key_count));
 	while (offset_bytes < data_size) {
 		offset = read_line_from_buffer(line, sizeof(line),
 			buffer + offset_bytes);
@@ -486,6 +638,7 @@ boolean au_ini_mgr_from_memory(
 		ctx->section_count * sizeof(*ctx->sections));
 	memset(ctx->sections, 0,
 		ctx->section_count * sizeof(*ctx->sections));
+	index_clear(&ctx->section_lookup);
 	ctx->half_section_count = ctx->section_count / 2;
 	ctx->is_section_count_odd = (ctx->section_count % 2) ? 1 : 0;
 	// TODO: Allocate all keys in one block.
@@ -499,11 +652,11 @@ boolean au_ini_mgr_from_memory(
 			ctx->sections[i].keys = NULL;
 		}
 	}
+	dealloc(file_key_count);
 	if (key_index_count)
 		use_key_index = TRUE;
 	offset_bytes = 0;
 	file_section_count = 0;
-	memset(file_key_count, 0, sizeof(file_key_count));
 	while (offset_bytes < data_size) {
 		char c;
 		const char * cursor;
@@ -524,6 +677,7 @@ boolean au_ini_mgr_from_memory(
 		if (line[0] == '[') {
 			midstr(ctx->sections[file_section_count].section_name, 
 				AU_INI_MGR_MAX_NAME, line + 1, ']');
+			add_section_lookup(ctx, file_section_count);
 			file_section_count++;
 		}
 		cursor = strchr(line, '=');
@@ -533,9 +687,9 @@ boolean au_ini_mgr_from_memory(
 		strcpy_s(key_value, sizeof(key_value), cursor + 1);
 		if (file_section_count) {
 			uint32_t sidx = file_section_count - 1;
-			uint32_t kidx = file_key_count[sidx];
 			struct au_ini_mgr_section * section =
 				&ctx->sections[sidx];
+			uint32_t kidx = section->key_count;
 			if (use_key_index) {
 				section->keys[kidx].key_index = strtoul(
 					key_name, NULL, 10);
@@ -546,7 +700,6 @@ boolean au_ini_mgr_from_memory(
 			}
 			strcpy(section->keys[kidx].key_value, key_value);
 			section->key_count++;
-			file_key_count[sidx]++;
 		}
 		else if (use_key_index) {
 			if (key_name[0] && key_value[0]) {
@@ -569,6 +722,14 @@ boolean au_ini_mgr_from_file(
 	void * data;
 	size_t data_size = 0;
 	boolean r;
+	const void * snapshot = au_snapshot_find(ctx->path_name, index, 
+		&data_size);
+	if (snapshot) {
+		/* Snapshot records are already decrypted and 
+		 * are not modified when decrypt is not set. */
+		return au_ini_mgr_from_memory(ctx, (void *)snapshot, 
+			(uint32_t)data_size, FALSE);
+	}
 	if (ctx->type & AU_INI_MGR_TYPE_PART_INDEX) {
 		FILE * file = fopen(ctx->path_name, "rb");
 		int start;
@@ -607,12 +768,97 @@ boolean au_ini_mgr_from_file(
 			return FALSE;
 		}
 	}
+	/* Decrypt in-place so that decrypted data 
+	 * can be captured. */
+	if (decrypt)
+		au_md5_crypt(data, data_size, (const uint8_t *)"1111", 4);
 	r = au_ini_mgr_from_memory(ctx,
-		data, (uint32_t)data_size, decrypt);
+		data, (uint32_t)data_size, FALSE);
+	if (r && au_snapshot_is_capturing())
+		au_snapshot_add(ctx->path_name, index, data, data_size);
 	dealloc(data);
 	return r;
 }
 
+static boolean parse_part(
+	struct au_ini_mgr_ctx * ctx,
+	uint32_t index,
+	const char * data,
+	size_t size,
+	boolean decrypt)
+{
+	char * decrypted = NULL;
+	boolean r;
+	if (decrypt) {
+		decrypted = alloc(size ? size : 1);
+		memcpy(decrypted, data, size);
+		au_md5_crypt(decrypted, size, (const uint8_t *)"1111", 4);
+		data = decrypted;
+	}
+	r = au_ini_mgr_from_memory(ctx, (void *)data, (uint32_t)size, FALSE);
+	if (r && au_snapshot_is_capturing())
+		au_snapshot_add(ctx->path_name, index, data, size);
+	if (decrypted)
+		dealloc(decrypted);
+	return r;
+}
+
+boolean au_ini_mgr_read_parts(
+	struct au_ini_mgr_ctx ** ctxs,
+	uint32_t ctx_count,
+	const char * path,
+	boolean decrypt)
+{
+	char * data = NULL;
+	size_t data_size = 0;
+	uint32_t i;
+	if (!ctx_count)
+		return TRUE;
+	for (i = 0; i < ctx_count; i++) {
+		struct au_ini_mgr_ctx * ctx = ctxs[i];
+		const void * snapshot;
+		size_t size = 0;
+		uint32_t start;
+		uint32_t end;
+		au_ini_mgr_set_path(ctx, path);
+		au_ini_mgr_clear_all_section_keys(ctx);
+		snapshot = au_snapshot_find(path, i, &size);
+		if (snapshot) {
+			if (!au_ini_mgr_from_memory(ctx, (void *)snapshot, 
+					(uint32_t)size, FALSE)) {
+				break;
+			}
+			continue;
+		}
+		if (!data) {
+			/* File is only read when a part is 
+			 * missing from snapshot. */
+			if (!get_file_size(path, &data_size))
+				break;
+			data = alloc(data_size + 1);
+			if (!load_file(path, data, data_size))
+				break;
+			data[data_size] = '\0';
+			if (!au_ini_mgr_read_part_indices_buffer(ctxs[0], data))
+				break;
+		}
+		if (i >= ctxs[0]->part_count)
+			break;
+		start = ctxs[0]->part_indices[i];
+		if (i + 1 < ctxs[0]->part_count)
+			end = ctxs[0]->part_indices[i + 1];
+		else
+			end = (uint32_t)data_size;
+		if (start > end || end > data_size)
+			break;
+		if (!parse_part(ctx, i, data + start, end - start, decrypt))
+			break;
+	}
+	if (data)
+		dealloc(data);
+	return (i == ctx_count);
+}
+
 static boolean println_to_buf(
 	void *			buffer, 
 	size_t			buffer_size, 
@@ -695,11 +941,13 @@ void au_ini_mgr_clear_all_section_keys(
 		for (uint32_t i = 0; i < ctx->section_count; i++) {
 			if (ctx->sections[i].keys)
 				dealloc(ctx->sections[i].keys);
+			index_clear(&ctx->sections[i].key_lookup);
 		}
 		dealloc(ctx->sections);
 		ctx->sections = NULL;
 	}
 	ctx->section_count = 0;
+	index_clear(&ctx->section_lookup);
 	if (ctx->binary_sections) {
 		for (uint32_t i = 0; i < ctx->binary_section_count; i++) {
 			if (ctx->binary_sections[i].keys)
@@ -751,12 +999,8 @@ uint32_t au_ini_mgr_find_section(
 	struct au_ini_mgr_ctx * ctx,
 	const char * section_name)
 {
-	if (au_ini_mgr_is_process_mode(ctx, AU_INI_MGR_PROCESS_MODE_TXT)) {
-		for (uint32_t i = 0; i < ctx->section_count; i++) {
-			if (strcmp(section_name, ctx->sections[i].section_name) == 0)
-				return i;
-		}
-	}
+	if (au_ini_mgr_is_process_mode(ctx, AU_INI_MGR_PROCESS_MODE_TXT))
+		return find_section(ctx, section_name, hash_name(section_name));
 	else if (au_ini_mgr_is_process_mode(ctx, AU_INI_MGR_PROCESS_MODE_BIN)) {
 		for (uint32_t i = 0; i < ctx->binary_section_count; i++) {
 			if (strcmp(section_name, ctx->binary_sections[i].section_name) == 0)
@@ -789,11 +1033,18 @@ uint32_t au_ini_mgr_find_key(
 	if (au_ini_mgr_is_process_mode(ctx, AU_INI_MGR_PROCESS_MODE_TXT)) {
 		struct au_ini_mgr_section * section =
 			&ctx->sections[section_id];
-		for (uint32_t i = 0; i < section->key_count; i++) {
-			if (section->keys[i].key_index == key_index)
-				return i;
+		if (!section->key_lookup.slots) {
+			if (section->key_count < KEY_LOOKUP_MIN_COUNT) {
+				for (uint32_t i = 0; i < section->key_count; i++) {
+					if (section->keys[i].key_index == key_index)
+						return i;
+				}
+				return UINT32_MAX;
+			}
+			for (uint32_t i = 0; i < section->key_count; i++)
+				add_key_lookup(section, i);
 		}
-		return UINT32_MAX;
+		return find_section_key(section, key_index);
 	}
 	else if (au_ini_mgr_is_process_mode(ctx, AU_INI_MGR_PROCESS_MODE_BIN)) {
 		struct au_ini_mgr_section_bin * section = 
@@ -826,8 +1077,11 @@ uint32_t au_ini_mgr_add_section(
 			(ctx->section_count % 2) ? TRUE : FALSE;
 		ctx->sections[ctx->section_count].key_count = 0;
 		ctx->sections[ctx->section_count].keys = NULL;
+		memset(&ctx->sections[ctx->section_count].key_lookup, 0,
+			sizeof(ctx->sections[ctx->section_count].key_lookup));
 		strcpy_s(ctx->sections[ctx->section_count].section_name, 
 			AU_INI_MGR_MAX_NAME, section_name);
+		add_section_lookup(ctx, ctx->section_count);
 		return ctx->section_count++;
 	}
 	else if (au_ini_mgr_is_process_mode(ctx, 
@@ -1019,7 +1273,8 @@ boolean au_ini_mgr_read_part_indices_buffer(
 	char line[400];
 	uint32_t offset_bytes = 0;
 	uint32_t offset = 0;
-	if (!read_line_from_buffer(line, sizeof(line), buffer))
+	offset_bytes = read_line_from_buffer(line, sizeof(line), buffer);
+	if (!offset_bytes)
 		return FALSE;
 	strip_trailing_spaces(line);
 	ctx->part_count = strtoul(line, NULL, 10);
@@ -1029,7 +1284,8 @@ boolean au_ini_mgr_read_part_indices_buffer(
 	for (uint32_t i = 0; i < ctx->part_count; i++) {
 		offset = read_line_from_buffer(line, sizeof(line),
 			buffer + offset_bytes);
-		assert(offset);
+		if (!offset)
+			return FALSE;
 		offset_bytes += offset;
 		strip_trailing_spaces(line);
 		ctx->part_indices[i] = strtoul(line, NULL, 10);
@@ -1191,6 +1447,8 @@ uint32_t au_ini_mgr_add_key(
 			++section->key_count * sizeof(*section->keys));
 		section->keys[key_id].key_index = 
 			au_ini_mgr_get_key_index(ctx, key_name);
+		if (section->key_lookup.slots)
+			add_key_lookup(section, key_id);
 		au_ini_mgr_set_value_by_id(ctx, section_id, key_id, 
 			type, data);
 		return key_id;
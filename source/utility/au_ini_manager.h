@@ -42,6 +42,23 @@ enum au_ini_mgr_process_mode {
 	AU_INI_MGR_PROCESS_MODE_BIN = 2,
 };
 
+struct au_ini_mgr_index_slot {
+	uint32_t hash;
+	uint32_t id;
+};
+
+/*
+ * Open-addressing index that maps a hash to ids.
+ *
+ * Names are not stored in the index, owner compares 
+ * candidate ids with the name that is looked up.
+ */
+struct au_ini_mgr_index {
+	struct au_ini_mgr_index_slot * slots;
+	uint32_t capacity;
+	uint32_t count;
+};
+
 struct au_ini_mgr_key {
 	uint32_t key_index;
 	char key_value[AU_INI_MGR_MAX_KEYVALUE];
@@ -53,6 +70,9 @@ struct au_ini_mgr_section {
 	char section_name[AU_INI_MGR_MAX_NAME];
 	uint32_t key_count;
 	struct au_ini_mgr_key * keys;
+	/* Maps key table index to key id, built once 
+	 * keys are looked up by name. */
+	struct au_ini_mgr_index key_lookup;
 };
 
 union au_ini_mgr_key_bin_data {
@@ -88,7 +108,10 @@ struct au_ini_mgr_ctx {
 	uint32_t part_count;
 	uint32_t * part_indices;
 	uint32_t key_table_count;
+	uint32_t key_table_capacity;
 	char ** key_table;
+	struct au_ini_mgr_index key_table_lookup;
+	struct au_ini_mgr_index section_lookup;
 };
 
 struct au_ini_mgr_ctx * au_ini_mgr_create();
@@ -132,6 +155,20 @@ boolean au_ini_mgr_from_file(
 	uint32_t index,
 	boolean decrypt);
 
+/*
+ * Reads the first `ctx_count` parts of a part-indexed 
+ * file in a single pass.
+ *
+ * File is read once and part `i` is parsed into `ctxs[i]`, 
+ * same as calling `au_ini_mgr_read_file` with index `i` 
+ * for each context.
+ */
+boolean au_ini_mgr_read_parts(
+	struct au_ini_mgr_ctx ** ctxs,
+	uint32_t ctx_count,
+	const char * path,
+	boolean decrypt);
+
 boolean au_ini_mgr_write_to_memory(
 	struct au_ini_mgr_ctx * ctx,
 	void * buffer, 
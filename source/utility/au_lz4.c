@@ -0,0 +1,205 @@
+#include "utility/au_lz4.h"
+
+#include <string.h>
+
+#define MIN_MATCH 4
+/* Last match must start at least 12 bytes before
+ * the end of block and the last 5 bytes are always
+ * literals. */
+#define MF_LIMIT 12
+#define LAST_LITERALS 5
+#define MAX_OFFSET 65535
+#define HASH_LOG 12
+#define RUN_MASK 15
+
+static uint32_t read32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t hash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+static uint8_t * write_length(uint8_t * op, size_t length)
+{
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (uint8_t)length;
+	return op;
+}
+
+static uint8_t * write_literals(
+	uint8_t * op,
+	const uint8_t * literals,
+	size_t length)
+{
+	if (length) {
+		memcpy(op, literals, length);
+		op += length;
+	}
+	return op;
+}
+
+static boolean read_length(
+	const uint8_t ** ip,
+	const uint8_t * iend,
+	size_t * length)
+{
+	uint8_t b;
+	do {
+		if (*ip >= iend)
+			return FALSE;
+		b = *(*ip)++;
+		*length += b;
+	} while (b == 255);
+	return TRUE;
+}
+
+size_t au_lz4_compress_bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t au_lz4_compress(
+	const void * src,
+	size_t size,
+	void * dst,
+	size_t maxcount)
+{
+	const uint8_t * base = src;
+	const uint8_t * ip = base;
+	const uint8_t * anchor = base;
+	const uint8_t * iend = base + size;
+	uint8_t * op = dst;
+	uint8_t * token;
+	uint32_t table[1u << HASH_LOG];
+	size_t literals;
+	if (maxcount < au_lz4_compress_bound(size))
+		return 0;
+	if (size >= MF_LIMIT + 1) {
+		const uint8_t * mflimit = iend - MF_LIMIT;
+		const uint8_t * matchlimit = iend - LAST_LITERALS;
+		memset(table, 0, sizeof(table));
+		while (ip <= mflimit) {
+			uint32_t sequence = read32(ip);
+			uint32_t h = hash(sequence);
+			const uint8_t * ref = base + table[h];
+			const uint8_t * end;
+			size_t offset;
+			size_t match;
+			table[h] = (uint32_t)(ip - base);
+			if (ref >= ip || (size_t)(ip - ref) > MAX_OFFSET ||
+				read32(ref) != sequence) {
+				ip++;
+				continue;
+			}
+			/* Extend match backwards over pending literals. */
+			while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			end = ip + MIN_MATCH;
+			while (end < matchlimit && *end == ref[end - ip])
+				end++;
+			literals = (size_t)(ip - anchor);
+			match = (size_t)(end - ip) - MIN_MATCH;
+			offset = (size_t)(ip - ref);
+			token = op++;
+			if (literals >= RUN_MASK) {
+				*token = RUN_MASK << 4;
+				op = write_length(op, literals - RUN_MASK);
+			}
+			else {
+				*token = (uint8_t)(literals << 4);
+			}
+			op = write_literals(op, anchor, literals);
+			*op++ = (uint8_t)(offset & 0xFF);
+			*op++ = (uint8_t)(offset >> 8);
+			if (match >= RUN_MASK) {
+				*token |= RUN_MASK;
+				op = write_length(op, match - RUN_MASK);
+			}
+			else {
+				*token |= (uint8_t)match;
+			}
+			ip = end;
+			anchor = ip;
+			if (ip - 2 > base)
+				table[hash(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+		}
+	}
+	literals = (size_t)(iend - anchor);
+	token = op++;
+	if (literals >= RUN_MASK) {
+		*token = RUN_MASK << 4;
+		op = write_length(op, literals - RUN_MASK);
+	}
+	else {
+		*token = (uint8_t)(literals << 4);
+	}
+	op = write_literals(op, anchor, literals);
+	return (size_t)(op - (uint8_t *)dst);
+}
+
+boolean au_lz4_decompress(
+	const void * src,
+	size_t size,
+	void * dst,
+	size_t maxcount,
+	size_t * length)
+{
+	const uint8_t * ip = src;
+	const uint8_t * iend = ip + size;
+	uint8_t * base = dst;
+	uint8_t * op = base;
+	uint8_t * oend = base + maxcount;
+	while (ip < iend) {
+		uint8_t token = *ip++;
+		size_t literals = token >> 4;
+		size_t match = token & RUN_MASK;
+		size_t offset;
+		const uint8_t * ref;
+		size_t i;
+		if (literals == RUN_MASK && !read_length(&ip, iend, &literals))
+			return FALSE;
+		if ((size_t)(iend - ip) < literals ||
+			(size_t)(oend - op) < literals) {
+			return FALSE;
+		}
+		op = write_literals(op, ip, literals);
+		ip += literals;
+		/* Last sequence only contains literals. */
+		if (ip == iend)
+			break;
+		if (iend - ip < 2)
+			return FALSE;
+		offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (!offset || offset > (size_t)(op - base))
+			return FALSE;
+		if (match == RUN_MASK && !read_length(&ip, iend, &match))
+			return FALSE;
+		match += MIN_MATCH;
+		if ((size_t)(oend - op) < match)
+			return FALSE;
+		ref = op - offset;
+		/* Source and destination overlap when offset is
+		 * shorter than match, copy byte by byte. */
+		if (offset >= match) {
+			memcpy(op, ref, match);
+		}
+		else {
+			for (i = 0; i < match; i++)
+				op[i] = ref[i];
+		}
+		op += match;
+	}
+	*length = (size_t)(op - base);
+	return TRUE;
+}
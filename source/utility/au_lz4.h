@@ -0,0 +1,46 @@
+#ifndef _AU_LZ4_H_
+#define _AU_LZ4_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+BEGIN_DECLS
+
+/*
+ * Returns the maximum size of compressed data
+ * for input of given size.
+ */
+size_t au_lz4_compress_bound(size_t size);
+
+/*
+ * Compresses data into LZ4 block format.
+ *
+ * Destination buffer must be at least
+ * `au_lz4_compress_bound(size)` bytes.
+ *
+ * Returns compressed size if successful, otherwise 0.
+ */
+size_t au_lz4_compress(
+	const void * src,
+	size_t size,
+	void * dst,
+	size_t maxcount);
+
+/*
+ * Decompresses a LZ4 block.
+ *
+ * Input is validated, malformed or truncated blocks
+ * never read or write out of bounds.
+ *
+ * Decompressed size will be returned in length.
+ */
+boolean au_lz4_decompress(
+	const void * src,
+	size_t size,
+	void * dst,
+	size_t maxcount,
+	size_t * length);
+
+END_DECLS
+
+#endif /* _AU_LZ4_H_ */
@@ -0,0 +1,238 @@
+#include "utility/au_md5.h"
+
+#include "core/file_system.h"
+#include "core/malloc.h"
+
+#include <string.h>
+
+struct md5_ctx {
+	uint32_t state[4];
+	uint64_t size;
+	uint8_t block[64];
+};
+
+static const uint32_t MD5_K[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391 };
+
+static const uint8_t MD5_R[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21 };
+
+static void md5_transform(struct md5_ctx * ctx, const uint8_t * block)
+{
+	uint32_t m[16];
+	uint32_t a = ctx->state[0];
+	uint32_t b = ctx->state[1];
+	uint32_t c = ctx->state[2];
+	uint32_t d = ctx->state[3];
+	uint32_t i;
+	for (i = 0; i < 16; i++) {
+		m[i] = (uint32_t)block[i * 4] |
+			((uint32_t)block[i * 4 + 1] << 8) |
+			((uint32_t)block[i * 4 + 2] << 16) |
+			((uint32_t)block[i * 4 + 3] << 24);
+	}
+	for (i = 0; i < 64; i++) {
+		uint32_t f;
+		uint32_t g;
+		uint32_t t;
+		switch (i / 16) {
+		case 0:
+			f = (b & c) | (~b & d);
+			g = i;
+			break;
+		case 1:
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) % 16;
+			break;
+		case 2:
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+			break;
+		default:
+			f = c ^ (b | ~d);
+			g = (7 * i) % 16;
+			break;
+		}
+		t = a + f + MD5_K[i] + m[g];
+		a = d;
+		d = c;
+		c = b;
+		b += (t << MD5_R[i]) | (t >> (32 - MD5_R[i]));
+	}
+	ctx->state[0] += a;
+	ctx->state[1] += b;
+	ctx->state[2] += c;
+	ctx->state[3] += d;
+}
+
+static void md5_init(struct md5_ctx * ctx)
+{
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xefcdab89;
+	ctx->state[2] = 0x98badcfe;
+	ctx->state[3] = 0x10325476;
+	ctx->size = 0;
+}
+
+static void md5_update(
+	struct md5_ctx * ctx,
+	const uint8_t * data,
+	size_t size)
+{
+	size_t used = (size_t)(ctx->size % 64);
+	ctx->size += size;
+	if (used) {
+		size_t count = MIN(64 - used, size);
+		memcpy(ctx->block + used, data, count);
+		data += count;
+		size -= count;
+		if (used + count < 64)
+			return;
+		md5_transform(ctx, ctx->block);
+	}
+	while (size >= 64) {
+		md5_transform(ctx, data);
+		data += 64;
+		size -= 64;
+	}
+	memcpy(ctx->block, data, size);
+}
+
+static void md5_final(
+	struct md5_ctx * ctx,
+	uint8_t digest[AU_MD5_DIGEST_SIZE])
+{
+	static const uint8_t padding[64] = { 0x80 };
+	uint64_t bits = ctx->size * 8;
+	size_t used = (size_t)(ctx->size % 64);
+	uint8_t length[8];
+	uint32_t i;
+	for (i = 0; i < 8; i++)
+		length[i] = (uint8_t)(bits >> (i * 8));
+	md5_update(ctx, padding, (used < 56) ? 56 - used : 120 - used);
+	md5_update(ctx, length, sizeof(length));
+	for (i = 0; i < 16; i++)
+		digest[i] = (uint8_t)(ctx->state[i / 4] >> ((i % 4) * 8));
+}
+
+void au_md5_digest(
+	const void * data,
+	size_t size,
+	uint8_t digest[AU_MD5_DIGEST_SIZE])
+{
+	struct md5_ctx ctx;
+	md5_init(&ctx);
+	md5_update(&ctx, data, size);
+	md5_final(&ctx, digest);
+}
+
+static void rc4_init(
+	struct au_md5_rc4 * ctx,
+	const uint8_t * key,
+	uint32_t key_size)
+{
+	uint32_t i;
+	uint8_t j = 0;
+	for (i = 0; i < 256; i++)
+		ctx->state[i] = (uint8_t)i;
+	for (i = 0; i < 256; i++) {
+		uint8_t t = ctx->state[i];
+		j += t + key[i % key_size];
+		ctx->state[i] = ctx->state[j];
+		ctx->state[j] = t;
+	}
+	ctx->i = 0;
+	ctx->j = 0;
+}
+
+void au_md5_rc4_init(
+	struct au_md5_rc4 * ctx,
+	const uint8_t * key,
+	uint32_t key_size)
+{
+	uint8_t digest[AU_MD5_DIGEST_SIZE];
+	/* CryptoAPI derives a 40-bit key from the first bytes of
+	 * the digest, and with CRYPT_CREATE_SALT the remaining
+	 * bytes are used as salt, which is appended to the key.
+	 * As a result, the whole digest is the RC4 key. */
+	au_md5_digest(key, key_size, digest);
+	rc4_init(ctx, digest, AU_MD5_DIGEST_SIZE);
+}
+
+void au_md5_rc4_crypt(
+	struct au_md5_rc4 * ctx,
+	const void * src,
+	void * dst,
+	size_t size)
+{
+	const uint8_t * in = src;
+	uint8_t * out = dst;
+	uint8_t * s = ctx->state;
+	uint8_t i = ctx->i;
+	uint8_t j = ctx->j;
+	size_t k;
+	for (k = 0; k < size; k++) {
+		uint8_t t;
+		i++;
+		t = s[i];
+		j += t;
+		s[i] = s[j];
+		s[j] = t;
+		out[k] = in[k] ^ s[(uint8_t)(s[i] + t)];
+	}
+	ctx->i = i;
+	ctx->j = j;
+}
+
+boolean au_md5_crypt(
+	void * data,
+	size_t size,
+	const uint8_t * key,
+	uint32_t key_size)
+{
+	struct au_md5_rc4 ctx;
+	au_md5_rc4_init(&ctx, key, key_size);
+	au_md5_rc4_crypt(&ctx, data, data, size);
+	return TRUE;
+}
+
+boolean au_md5_copy_and_encrypt_file(const char * src_path, const char * dst_path)
+{
+	const void * src;
+	void * data;
+	size_t size = 0;
+	boolean result;
+	struct au_md5_rc4 ctx;
+	if (!get_file_size(src_path, &size))
+		return FALSE;
+	if (!size)
+		return make_file(dst_path, "", 0);
+	src = map_file(src_path, &size);
+	if (!src)
+		return FALSE;
+	data = alloc(size);
+	au_md5_rc4_init(&ctx, (const uint8_t *)"1111", 4);
+	au_md5_rc4_crypt(&ctx, src, data, size);
+	unmap_file(src, size);
+	result = make_file(dst_path, data, size);
+	dealloc(data);
+	return result;
+}
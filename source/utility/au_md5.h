@@ -4,8 +4,53 @@
 #include "core/macros.h"
 #include "core/types.h"
 
+#define AU_MD5_DIGEST_SIZE 16
+
 BEGIN_DECLS
 
+/*
+ * RC4 cipher keyed with the MD5 digest of a key string.
+ *
+ * Output is identical to a CryptoAPI RC4 key derived
+ * from an MD5 hash (`CryptDeriveKey` with CRYPT_CREATE_SALT),
+ * which is how game content files are encrypted.
+ *
+ * Cipher state is kept by the caller, so any number
+ * of files can be decrypted in parallel.
+ */
+struct au_md5_rc4 {
+	uint8_t state[256];
+	uint8_t i;
+	uint8_t j;
+};
+
+void au_md5_digest(
+	const void * data,
+	size_t size,
+	uint8_t digest[AU_MD5_DIGEST_SIZE]);
+
+void au_md5_rc4_init(
+	struct au_md5_rc4 * ctx,
+	const uint8_t * key,
+	uint32_t key_size);
+
+/*
+ * Encrypts or decrypts `size` bytes from `src` to `dst`.
+ *
+ * `src` and `dst` may be the same buffer. Consecutive 
+ * calls continue the same stream, so input can be 
+ * processed in parts (i.e. from a read-only mapping 
+ * into a smaller buffer).
+ */
+void au_md5_rc4_crypt(
+	struct au_md5_rc4 * ctx,
+	const void * src,
+	void * dst,
+	size_t size);
+
+/*
+ * Encrypts or decrypts `data` in-place.
+ */
 boolean au_md5_crypt(
 	void * data,
 	size_t size,
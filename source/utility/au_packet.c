@@ -9,6 +9,28 @@ static const uint32_t TYPE_LENGTH[] = {
 		0x04, 0x08, 0x08, 0x04, 0x0C, 0x40, 
 		0x08, 0x00, 0x06, 0x02 };
 
+/* Flag length of packets by packet type, learned when 
+ * packets are made. Used to read the operation of 
+ * packets without knowing which module they belong to. 
+ * 
+ * Zero when no packet of the type was made yet and 
+ * UINT8_MAX when first field is not an operation. */
+static uint8_t g_OperationFlagLength[256];
+
+static void learnlayout(const struct au_packet * p, uint8_t type)
+{
+	uint8_t len = UINT8_MAX;
+	if (p->field_count && p->field_len[0] == 1 &&
+		(p->field_type[0] == AU_PACKET_TYPE_INT8 || 
+			p->field_type[0] == AU_PACKET_TYPE_UINT8)) {
+		len = (uint8_t)p->flag_len;
+	}
+	/* Avoids writing to shared memory 
+	 * after layout is learned. */
+	if (g_OperationFlagLength[type] != len)
+		g_OperationFlagLength[type] = len;
+}
+
 static uint16_t block_size(const void * block)
 {
 	return *(uint16_t *)(block);
@@ -190,8 +212,10 @@ void au_packet_make_packet(
 	uint32_t bit;
 	uint32_t i;
 	uint8_t * cursor;
-	if (is_packet)
+	if (is_packet) {
 		len = sizeof(struct au_packet_header) + p->flag_len;
+		learnlayout(p, type);
+	}
 	else
 		len = sizeof(uint16_t)/* packet length */ + p->flag_len;
 	va_start(ap, type);
@@ -351,4 +375,26 @@ void au_packet_make_packet(
 		field = va_arg(ap, void *);
 	}
 	va_end(ap);
-}
\ No newline at end of file
+}
+
+boolean au_packet_get_operation(
+	const void * data,
+	uint16_t length,
+	uint8_t * operation)
+{
+	const uint8_t * d = data;
+	uint8_t flag_len;
+	if (length < sizeof(struct au_packet_header))
+		return FALSE;
+	flag_len = g_OperationFlagLength[d[3]];
+	if (!flag_len || flag_len == UINT8_MAX)
+		return FALSE;
+	if (length < sizeof(struct au_packet_header) + flag_len + 1)
+		return FALSE;
+	/* Flags are little-endian, first field is 
+	 * present if the lowest bit is set. */
+	if (!(d[sizeof(struct au_packet_header)] & 1))
+		return FALSE;
+	*operation = d[sizeof(struct au_packet_header) + flag_len];
+	return TRUE;
+}
@@ -77,6 +77,19 @@ void au_packet_make_packet(
 	uint16_t * length, 
 	uint8_t type, ...);
 
+/*
+ * Reads the operation (first field) of a packet.
+ *
+ * Layout of a packet type is learned when a packet 
+ * of the same type is made, and returns FALSE until 
+ * then, or if first field of the packet type is not 
+ * an 8-bit integer or is not set.
+ */
+boolean au_packet_get_operation(
+	const void * data,
+	uint16_t length,
+	uint8_t * operation);
+
 END_DECLS
 
 #endif /* _AU_PACKET_H_ */
@@ -0,0 +1,400 @@
+#include "utility/au_snapshot.h"
+
+#include "core/file_system.h"
+#include "core/hash_map.h"
+#include "core/log.h"
+#include "core/malloc.h"
+#include "core/os.h"
+#include "core/string.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define IMAGE_MAGIC 0x50414E53u
+
+enum state {
+	STATE_NONE,
+	STATE_LOADED,
+	STATE_CAPTURE,
+};
+
+struct image_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t reserved;
+	uint64_t size;
+	/* Checksum of everything that follows the header. */
+	uint64_t checksum;
+};
+
+struct image_entry {
+	uint64_t source_size;
+	uint64_t source_time;
+	uint64_t data_offset;
+	uint64_t data_size;
+	uint32_t path_offset;
+	uint32_t index;
+};
+
+struct record {
+	const char * path;
+	uint32_t index;
+	const void * data;
+	size_t size;
+	/* Only set for captured records. */
+	uint64_t source_size;
+	uint64_t source_time;
+};
+
+struct snapshot {
+	enum state state;
+	mutex_t mutex;
+	hmap_t records;
+	const void * image;
+	size_t image_size;
+	/* A table was read that is not in loaded image. */
+	boolean missed;
+};
+
+static struct snapshot g_Snapshot;
+
+static uint64_t hash_record(
+	const void * item,
+	uint64_t seed0,
+	uint64_t seed1)
+{
+	const struct record * r = item;
+	return hmap_murmur(r->path, strlen(r->path), seed0, seed1) ^
+		(r->index * 0x9E3779B97F4A7C15ull);
+}
+
+static int compare_record(
+	const void * a,
+	const void * b,
+	void * user_data)
+{
+	const struct record * ra = a;
+	const struct record * rb = b;
+	if (ra->index != rb->index)
+		return 1;
+	return strcmp(ra->path, rb->path);
+}
+
+static void free_record(void * item)
+{
+	struct record * r = item;
+	if (g_Snapshot.state == STATE_CAPTURE) {
+		dealloc((void *)r->path);
+		dealloc((void *)r->data);
+	}
+}
+
+static uint64_t rotl(uint64_t x, uint32_t r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t checksum(const void * data, size_t size)
+{
+	const uint8_t * p = data;
+	uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+	while (size >= sizeof(uint64_t)) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		h ^= rotl(v * 0x87C37B91114253D5ull, 31) * 0x4CF5AD432745937Full;
+		h = rotl(h, 27) * 5 + 0x52DCE729;
+		p += sizeof(v);
+		size -= sizeof(v);
+	}
+	while (size--) {
+		h ^= *p++ * 0x87C37B91114253D5ull;
+		h = rotl(h, 11) * 0x4CF5AD432745937Full;
+	}
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	return h;
+}
+
+static void init_records()
+{
+	g_Snapshot.mutex = create_mutex();
+	g_Snapshot.records = hmap_new(sizeof(struct record), 256,
+		(uint64_t)strcpy, (uint64_t)memset,
+		hash_record, compare_record, free_record, NULL);
+}
+
+static boolean is_source_modified(
+	const char * path,
+	uint64_t size,
+	uint64_t time)
+{
+	size_t current_size;
+	uint64_t current_time;
+	if (!get_file_size(path, &current_size) ||
+		!get_file_time(path, &current_time)) {
+		return TRUE;
+	}
+	return (current_size != size || current_time != time);
+}
+
+static boolean validate_image(const uint8_t * image, size_t size)
+{
+	struct image_header header;
+	size_t entries_end;
+	uint32_t i;
+	if (size < sizeof(header)) {
+		WARN("Data snapshot is truncated.");
+		return FALSE;
+	}
+	memcpy(&header, image, sizeof(header));
+	if (header.magic != IMAGE_MAGIC ||
+		header.version != AU_SNAPSHOT_VERSION) {
+		INFO("Data snapshot version does not match.");
+		return FALSE;
+	}
+	if (header.size != size ||
+		header.checksum != checksum(image + sizeof(header),
+			size - sizeof(header))) {
+		WARN("Data snapshot checksum does not match.");
+		return FALSE;
+	}
+	entries_end = sizeof(header) +
+		(size_t)header.entry_count * sizeof(struct image_entry);
+	if (entries_end > size) {
+		WARN("Data snapshot is truncated.");
+		return FALSE;
+	}
+	for (i = 0; i < header.entry_count; i++) {
+		struct image_entry e;
+		const char * path;
+		memcpy(&e, image + sizeof(header) + i * sizeof(e), sizeof(e));
+		if (e.path_offset < entries_end || e.path_offset >= size ||
+			!memchr(image + e.path_offset, '\0', size - e.path_offset) ||
+			e.data_offset > size || e.data_size > size - e.data_offset) {
+			WARN("Data snapshot has an invalid entry.");
+			return FALSE;
+		}
+		path = (const char *)(image + e.path_offset);
+		if (is_source_modified(path, e.source_size, e.source_time)) {
+			INFO("Data snapshot is stale (%s).", path);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+boolean au_snapshot_open(const char * path)
+{
+	size_t size = 0;
+	const uint8_t * image;
+	struct image_header header;
+	uint32_t i;
+	assert(g_Snapshot.state == STATE_NONE);
+	image = map_file(path, &size);
+	if (!image)
+		return FALSE;
+	if (!validate_image(image, size)) {
+		unmap_file(image, size);
+		return FALSE;
+	}
+	memcpy(&header, image, sizeof(header));
+	init_records();
+	for (i = 0; i < header.entry_count; i++) {
+		struct image_entry e;
+		struct record r = { 0 };
+		memcpy(&e, image + sizeof(header) + i * sizeof(e), sizeof(e));
+		r.path = (const char *)(image + e.path_offset);
+		r.index = e.index;
+		r.data = image + e.data_offset;
+		r.size = (size_t)e.data_size;
+		hmap_set(g_Snapshot.records, &r);
+	}
+	g_Snapshot.image = image;
+	g_Snapshot.image_size = size;
+	g_Snapshot.state = STATE_LOADED;
+	return TRUE;
+}
+
+void au_snapshot_begin_capture()
+{
+	assert(g_Snapshot.state == STATE_NONE);
+	init_records();
+	g_Snapshot.state = STATE_CAPTURE;
+}
+
+boolean au_snapshot_is_loaded()
+{
+	return (g_Snapshot.state == STATE_LOADED);
+}
+
+boolean au_snapshot_is_capturing()
+{
+	return (g_Snapshot.state == STATE_CAPTURE);
+}
+
+const void * au_snapshot_find(
+	const char * path,
+	uint32_t index,
+	size_t * size)
+{
+	struct record key = { 0 };
+	const struct record * r;
+	const void * data;
+	if (g_Snapshot.state == STATE_NONE)
+		return NULL;
+	key.path = path;
+	key.index = index;
+	lock_mutex(g_Snapshot.mutex);
+	r = hmap_get(g_Snapshot.records, &key);
+	if (!r) {
+		if (g_Snapshot.state == STATE_LOADED)
+			g_Snapshot.missed = TRUE;
+		unlock_mutex(g_Snapshot.mutex);
+		return NULL;
+	}
+	data = r->data;
+	*size = r->size;
+	unlock_mutex(g_Snapshot.mutex);
+	return data;
+}
+
+const void * au_snapshot_add(
+	const char * path,
+	uint32_t index,
+	const void * data,
+	size_t size)
+{
+	struct record r = { 0 };
+	const struct record * existing;
+	size_t length = strlen(path);
+	size_t source_size;
+	void * copy;
+	if (g_Snapshot.state != STATE_CAPTURE)
+		return NULL;
+	if (!get_file_size(path, &source_size) ||
+		!get_file_time(path, &r.source_time)) {
+		return NULL;
+	}
+	r.source_size = source_size;
+	r.path = path;
+	r.index = index;
+	lock_mutex(g_Snapshot.mutex);
+	existing = hmap_get(g_Snapshot.records, &r);
+	if (existing) {
+		data = existing->data;
+		unlock_mutex(g_Snapshot.mutex);
+		return data;
+	}
+	copy = alloc(length + 1);
+	memcpy(copy, path, length + 1);
+	r.path = copy;
+	copy = alloc(size ? size : 1);
+	memcpy(copy, data, size);
+	r.data = copy;
+	r.size = size;
+	hmap_set(g_Snapshot.records, &r);
+	unlock_mutex(g_Snapshot.mutex);
+	return copy;
+}
+
+void au_snapshot_remove(
+	const char * path,
+	uint32_t index)
+{
+	struct record key = { 0 };
+	struct record * r;
+	if (g_Snapshot.state != STATE_CAPTURE)
+		return;
+	key.path = path;
+	key.index = index;
+	lock_mutex(g_Snapshot.mutex);
+	r = hmap_delete(g_Snapshot.records, &key);
+	if (r)
+		free_record(r);
+	unlock_mutex(g_Snapshot.mutex);
+}
+
+static boolean write_image(const char * path)
+{
+	struct image_header header = { 0 };
+	size_t count = hmap_count(g_Snapshot.records);
+	size_t size = sizeof(header) + count * sizeof(struct image_entry);
+	size_t path_offset = size;
+	size_t data_offset;
+	size_t i = 0;
+	uint32_t index = 0;
+	struct record * r = NULL;
+	uint8_t * image;
+	boolean result;
+	while (hmap_iter(g_Snapshot.records, &i, (void **)&r))
+		size += strlen(r->path) + 1;
+	data_offset = size;
+	i = 0;
+	while (hmap_iter(g_Snapshot.records, &i, (void **)&r))
+		size += r->size;
+	if (size > UINT32_MAX) {
+		ERROR("Data snapshot is too large.");
+		return FALSE;
+	}
+	image = alloc(size);
+	i = 0;
+	while (hmap_iter(g_Snapshot.records, &i, (void **)&r)) {
+		struct image_entry e = { 0 };
+		size_t length = strlen(r->path) + 1;
+		e.source_size = r->source_size;
+		e.source_time = r->source_time;
+		e.data_offset = data_offset;
+		e.data_size = r->size;
+		e.path_offset = (uint32_t)path_offset;
+		e.index = r->index;
+		memcpy(image + sizeof(header) + index++ * sizeof(e),
+			&e, sizeof(e));
+		memcpy(image + path_offset, r->path, length);
+		memcpy(image + data_offset, r->data, r->size);
+		path_offset += length;
+		data_offset += r->size;
+	}
+	header.magic = IMAGE_MAGIC;
+	header.version = AU_SNAPSHOT_VERSION;
+	header.entry_count = (uint32_t)count;
+	header.size = size;
+	header.checksum = checksum(image + sizeof(header),
+		size - sizeof(header));
+	memcpy(image, &header, sizeof(header));
+	result = make_file(path, image, size);
+	dealloc(image);
+	if (!result) {
+		ERROR("Failed to write data snapshot (%s).", path);
+		return FALSE;
+	}
+	INFO("Wrote data snapshot with %u tables (%s, %u bytes).",
+		(uint32_t)count, path, (uint32_t)size);
+	return TRUE;
+}
+
+boolean au_snapshot_finish(const char * path)
+{
+	boolean result = TRUE;
+	switch (g_Snapshot.state) {
+	case STATE_NONE:
+		return TRUE;
+	case STATE_LOADED:
+		if (g_Snapshot.missed) {
+			INFO("Data snapshot is incomplete, it will be rebuilt on next startup.");
+			remove_file(path);
+		}
+		break;
+	case STATE_CAPTURE:
+		result = write_image(path);
+		break;
+	}
+	/* Records are freed according to current state. */
+	hmap_free(g_Snapshot.records);
+	destroy_mutex(g_Snapshot.mutex);
+	if (g_Snapshot.image)
+		unmap_file(g_Snapshot.image, g_Snapshot.image_size);
+	memset(&g_Snapshot, 0, sizeof(g_Snapshot));
+	return result;
+}
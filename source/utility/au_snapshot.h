@@ -0,0 +1,109 @@
+#ifndef _AU_SNAPSHOT_H_
+#define _AU_SNAPSHOT_H_
+
+#include "core/macros.h"
+#include "core/types.h"
+
+/*
+ * Increase when the image layout or the way
+ * records are produced by readers changes.
+ */
+#define AU_SNAPSHOT_VERSION 3
+
+/*
+ * Records at or above this index hold tables in the
+ * form that the owning module keeps them in memory,
+ * so that they can be restored without being parsed.
+ *
+ * Such records are keyed by the path of the source
+ * table and are validated against it like any other.
+ */
+#define AU_SNAPSHOT_INDEX_PARSED 0x80000000u
+
+BEGIN_DECLS
+
+/*
+ * Data table snapshot.
+ *
+ * A snapshot is a single binary image that holds
+ * preprocessed contents of every data table that was
+ * read at startup, keyed by source path and part index.
+ *
+ * Table readers (`au_table`, `au_ini_mgr`) query the
+ * snapshot before reading a source file. When capturing,
+ * readers add what they have read so that the image can
+ * be written after initialization.
+ *
+ * Modules that own large tables may instead add their
+ * parsed data (see `AU_SNAPSHOT_INDEX_PARSED`) and remove
+ * the reader record of the source.
+ *
+ * Functions are thread-safe.
+ */
+
+/*
+ * Maps an image and validates it.
+ *
+ * The image is rejected if its version or checksum
+ * does not match, or if any of the source files were
+ * modified after the image was created.
+ *
+ * Returns TRUE if image can be used.
+ */
+boolean au_snapshot_open(const char * path);
+
+/*
+ * Starts recording tables that are read so that
+ * they can be written to a new image.
+ */
+void au_snapshot_begin_capture();
+
+boolean au_snapshot_is_loaded();
+
+boolean au_snapshot_is_capturing();
+
+/*
+ * Retrieves record data.
+ *
+ * Returned data remains valid until `au_snapshot_finish`
+ * is called.
+ *
+ * Returns NULL if snapshot is not in use or does
+ * not contain the record.
+ */
+const void * au_snapshot_find(
+	const char * path,
+	uint32_t index,
+	size_t * size);
+
+/*
+ * Adds a record while capturing.
+ *
+ * Returns a pointer to the copy of data that is
+ * kept by the snapshot, NULL if not capturing.
+ */
+const void * au_snapshot_add(
+	const char * path,
+	uint32_t index,
+	const void * data,
+	size_t size);
+
+/*
+ * Removes a record while capturing.
+ */
+void au_snapshot_remove(
+	const char * path,
+	uint32_t index);
+
+/*
+ * Ends snapshot use once data tables are loaded.
+ *
+ * If tables were captured, a new image is written to `path`.
+ * If a loaded image did not contain a table that was read,
+ * it is removed so that it will be rebuilt on next startup.
+ */
+boolean au_snapshot_finish(const char * path);
+
+END_DECLS
+
+#endif /* _AU_SNAPSHOT_H_ */
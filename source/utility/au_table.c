@@ -5,16 +5,30 @@
 #include "core/malloc.h"
 #include "core/string.h"
 
+#include "utility/au_md5.h"
+#include "utility/au_snapshot.h"
+
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 
-#define MAX_VALUE_SIZE 256
+#if defined(_M_X64) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 struct au_table {
-	file file;
 	char path[1024];
-	char line_buf[8096];
+	/* Whole table, null-terminated. Lines and cells 
+	 * are terminated in-place as they are read. */
+	char * data;
+	char * end;
 	char * cursor;
+	char * line_end;
+	char * column;
 	char column_names[AU_TABLE_MAX_COLUMN_COUNT][AU_TABLE_MAX_COLUMN_SIZE];
 	uint32_t column_ids[AU_TABLE_MAX_COLUMN_COUNT];
 	boolean column_parse_empty[AU_TABLE_MAX_COLUMN_COUNT];
@@ -23,21 +37,86 @@ struct au_table {
 	uint32_t current_column_id;
 	uint32_t current_setup_index;
 	uint32_t current_column_index;
-	char current_value[MAX_VALUE_SIZE];
+	char * current_value;
+	size_t current_value_length;
 	boolean parsed_header;
 	boolean end_of_line;
 };
 
+#ifdef USE_SSE2
+static uint32_t first_set_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+/*
+ * Returns the first occurrence of `c` in [s, end), 
+ * or `end` if there is none.
+ */
+static char * find_char(char * s, const char * end, char c)
+{
+#ifdef USE_SSE2
+	const __m128i v = _mm_set1_epi8(c);
+	while (end - s >= 16) {
+		__m128i b = _mm_loadu_si128((const __m128i *)s);
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(b, v));
+		if (mask)
+			return s + first_set_bit(mask);
+		s += 16;
+	}
+#endif
+	while (s < end && *s != c)
+		s++;
+	return s;
+}
+
+/*
+ * Terminates the line at cursor and advances cursor 
+ * to the next line.
+ */
+static boolean next_line(struct au_table * t, char ** line)
+{
+	char * nl;
+	char * e;
+	if (t->cursor >= t->end)
+		return FALSE;
+	nl = find_char(t->cursor, t->end, '\n');
+	e = nl;
+	if (e > t->cursor && e[-1] == '\r')
+		e--;
+	*e = '\0';
+	*line = t->cursor;
+	t->line_end = e;
+	t->cursor = (nl < t->end) ? nl + 1 : t->end;
+	return TRUE;
+}
+
 static boolean parse_header(struct au_table * t)
 {
+	char * line;
 	char * col;
 	uint32_t index = 0;
-	if (!read_line(t->file, t->line_buf, sizeof(t->line_buf)))
+	if (!next_line(t, &line))
 		return FALSE;
-	col = strtok(t->line_buf, "\t");
-	while (col) {
+	col = line;
+	while (col < t->line_end) {
+		char * tab = find_char(col, t->line_end, '\t');
 		uint32_t i;
 		boolean mapped = FALSE;
+		*tab = '\0';
+		/* Consecutive tabs do not create header columns. */
+		if (!col[0]) {
+			col = tab + 1;
+			continue;
+		}
 		if (index >= AU_TABLE_MAX_COLUMN_COUNT) {
 			assert(0);
 			return FALSE;
@@ -54,26 +133,79 @@ static boolean parse_header(struct au_table * t)
 				col, t->path);
 			t->column_map[index] = AU_TABLE_INVALID_COLUMN;
 		}
-		col = strtok(NULL, "\t");
+		col = tab + 1;
 		index++;
 	}
 	return TRUE;
 }
 
+static char * read_table(
+	const char * file_path, 
+	boolean decrypt,
+	size_t * size)
+{
+	const void * mapped;
+	char * data;
+	size_t length = 0;
+	if (!get_file_size(file_path, &length))
+		return NULL;
+	if (!length) {
+		data = alloc(1);
+		data[0] = '\0';
+		*size = 0;
+		return data;
+	}
+	mapped = map_file(file_path, &length);
+	if (!mapped)
+		return NULL;
+	data = alloc(length + 1);
+	if (decrypt) {
+		struct au_md5_rc4 rc4;
+		au_md5_rc4_init(&rc4, (const uint8_t *)"1111", 4);
+		au_md5_rc4_crypt(&rc4, mapped, data, length);
+	}
+	else {
+		memcpy(data, mapped, length);
+	}
+	unmap_file(mapped, length);
+	data[length] = '\0';
+	*size = length;
+	return data;
+}
+
 struct au_table * au_table_open(
 	const char * file_path, 
 	boolean decrypt)
 {
-	file f = open_file(file_path, FILE_ACCESS_READ);
+	size_t size = 0;
+	const void * snapshot = au_snapshot_find(file_path, 0, &size);
+	char * data;
 	struct au_table * t;
 	uint32_t i;
-	if (!f)
-		return NULL;
+	if (snapshot) {
+		/* Snapshot records hold decrypted table data. */
+		data = alloc(size + 1);
+		memcpy(data, snapshot, size);
+		data[size] = '\0';
+	}
+	else {
+		data = read_table(file_path, decrypt, &size);
+		if (!data)
+			return NULL;
+		if (au_snapshot_is_capturing() &&
+			!au_snapshot_add(file_path, 0, data, size)) {
+			ERROR("Failed to capture table (%s).", file_path);
+			dealloc(data);
+			return NULL;
+		}
+	}
 	t = alloc(sizeof(*t));
 	memset(t, 0, sizeof(*t));
 	strlcpy(t->path, file_path, sizeof(t->path));
-	t->file = f;
-	t->cursor = t->line_buf;
+	t->data = data;
+	t->end = data + size;
+	t->cursor = data;
+	t->line_end = data;
 	for (i = 0; i < AU_TABLE_MAX_COLUMN_COUNT; i++)
 		t->column_map[i] = AU_TABLE_INVALID_COLUMN;
 	return t;
@@ -94,10 +226,7 @@ struct au_table * au_table_open_fmt(
 
 void au_table_destroy(struct au_table * table)
 {
-	if (table->file){
-		close_file(table->file);
-		table->file = NULL;
-	}
+	dealloc(table->data);
 	dealloc(table);
 }
 
@@ -151,16 +280,18 @@ boolean au_table_read_next_line(struct au_table * table)
 			return FALSE;
 		table->parsed_header = TRUE;
 	}
-	table->cursor = table->line_buf;
 	table->current_column_index = 0;
 	table->end_of_line = FALSE;
 	/* Read until there is a non-empty line or 
 	 * end of the file is reached. */
 	while (TRUE) {
-		if (!read_line(table->file, table->line_buf, sizeof(table->line_buf)))
+		char * line;
+		if (!next_line(table, &line))
 			return FALSE;
-		if (table->line_buf[0])
+		if (line[0]) {
+			table->column = line;
 			return TRUE;
+		}
 	}
 	return TRUE;
 }
@@ -168,24 +299,26 @@ boolean au_table_read_next_line(struct au_table * table)
 boolean au_table_read_next_column(struct au_table * table)
 {
 	while (!table->end_of_line) {
-		char * s = strchr(table->cursor, '\t');
+		char * s = find_char(table->column, table->line_end, '\t');
 		uint32_t i;
-		if (s) {
-			size_t max = MIN(MAX_VALUE_SIZE, 
-				(size_t)((uintptr_t)s - (uintptr_t)table->cursor) + 1);
-			strlcpy(table->current_value, table->cursor, max);
-			table->cursor = s + 1;
+		/* Values are terminated in-place and remain valid 
+		 * until the next line is read. */
+		table->current_value = table->column;
+		table->current_value_length = (size_t)(s - table->column);
+		if (s < table->line_end) {
+			*s = '\0';
+			table->column = s + 1;
 		}
 		else {
 			/* This is either the last column or the end 
 			 * of the line. */
-			strlcpy(table->current_value, table->cursor, sizeof(table->current_value));
-			table->cursor = table->cursor + strlen(table->cursor);
 			table->end_of_line = TRUE;
 		}
 		/* A column can be unmapped or empty, in which case 
 		 * it will be skipped. */
 		i = table->current_column_index++;
+		if (i >= AU_TABLE_MAX_COLUMN_COUNT)
+			break;
 		table->current_setup_index = table->column_map[i];
 		if (table->current_setup_index == AU_TABLE_INVALID_COLUMN) {
 			table->current_column_id = AU_TABLE_INVALID_COLUMN;
@@ -193,7 +326,7 @@ boolean au_table_read_next_column(struct au_table * table)
 		}
 		assert(table->current_setup_index < table->column_count);
 		table->current_column_id = table->column_ids[table->current_setup_index];
-		if (!table->current_value[0] && 
+		if (!table->current_value_length && 
 			!table->column_parse_empty[table->current_setup_index]) {
 			continue;
 		}
@@ -212,7 +345,71 @@ char * au_table_get_value(struct au_table * table)
 	return table->current_value;
 }
 
+size_t au_table_get_value_length(struct au_table * table)
+{
+	return table->current_value_length;
+}
+
 int32_t au_table_get_i32(struct au_table * table)
 {
-	return strtol(table->current_value, NULL, 10);
+	const char * s = table->current_value;
+	boolean negative = FALSE;
+	int64_t value = 0;
+	while (*s == ' ' || *s == '\t')
+		s++;
+	if (*s == '-' || *s == '+')
+		negative = (*s++ == '-');
+	while (*s >= '0' && *s <= '9') {
+		value = value * 10 + (*s++ - '0');
+		/* Out of range values are clamped, same as `strtol`. */
+		if (value > (int64_t)INT32_MAX + 1) {
+			value = (int64_t)INT32_MAX + 1;
+			break;
+		}
+	}
+	if (negative)
+		return (int32_t)MAX(-value, (int64_t)INT32_MIN);
+	return (int32_t)MIN(value, (int64_t)INT32_MAX);
+}
+
+float au_table_get_f32(struct au_table * table)
+{
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+		1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+	const char * s = table->current_value;
+	boolean negative = FALSE;
+	uint64_t mantissa = 0;
+	uint32_t digits = 0;
+	uint32_t fraction = 0;
+	const char * start;
+	while (*s == ' ' || *s == '\t')
+		s++;
+	if (*s == '-' || *s == '+')
+		negative = (*s++ == '-');
+	start = s;
+	while (*s >= '0' && *s <= '9' && digits < 15) {
+		mantissa = mantissa * 10 + (*s++ - '0');
+		if (mantissa)
+			digits++;
+	}
+	if (*s == '.') {
+		s++;
+		while (*s >= '0' && *s <= '9' && digits < 15) {
+			mantissa = mantissa * 10 + (*s++ - '0');
+			if (mantissa)
+				digits++;
+			fraction++;
+		}
+	}
+	/* Values with up to 15 significant digits and no 
+	 * exponent are exact in double precision, anything 
+	 * else is left to the C library. */
+	if (s == start || (*s >= '0' && *s <= '9') || *s == 'e' || *s == 'E' ||
+		fraction >= COUNT_OF(powers)) {
+		return strtof(table->current_value, NULL);
+	}
+	if (negative)
+		return (float)(-(double)mantissa / powers[fraction]);
+	return (float)((double)mantissa / powers[fraction]);
 }
@@ -35,10 +35,34 @@ boolean au_table_read_next_column(struct au_table * table);
 
 uint32_t au_table_get_column(struct au_table * table);
 
+/*
+ * Returns current value.
+ *
+ * Value is null-terminated and points into table data, 
+ * it remains valid until the next line is read.
+ */
 char * au_table_get_value(struct au_table * table);
 
+/*
+ * Returns length of current value.
+ */
+size_t au_table_get_value_length(struct au_table * table);
+
+/*
+ * Parses current value as a decimal integer.
+ *
+ * Behaves like `strtol` with base 10, parsing stops 
+ * at the first character that is not a digit.
+ */
 int32_t au_table_get_i32(struct au_table * table);
 
+/*
+ * Parses current value as a floating point number.
+ *
+ * Behaves like `strtof`.
+ */
+float au_table_get_f32(struct au_table * table);
+
 END_DECLS
 
 #endif /* _AU_TABLE_H_ */
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""
+Measures request throughput of the embedded HTTP server.
+
+Usage:
+    http_bench.py HOST:PORT [--clients 64] [--duration 10] [--path /status]
+
+Every client keeps a single request in flight at all times.
+Use a path that is queued for the main thread (i.e. an
+unknown path) to measure the request pipeline, or a path
+with a concurrent handler (i.e. /status) to measure
+worker-side throughput.
+"""
+import argparse
+import http.client
+import threading
+import time
+
+
+def client(host, port, path, deadline, results, index):
+    conn = http.client.HTTPConnection(host, port, timeout=5)
+    count = 0
+    errors = 0
+    latency = 0.0
+    while time.perf_counter() < deadline:
+        start = time.perf_counter()
+        try:
+            conn.request("GET", path)
+            res = conn.getresponse()
+            res.read()
+            if res.status != 200:
+                errors += 1
+        except (OSError, http.client.HTTPException):
+            errors += 1
+            conn.close()
+            conn = http.client.HTTPConnection(host, port, timeout=5)
+            continue
+        latency += time.perf_counter() - start
+        count += 1
+    conn.close()
+    results[index] = (count, errors, latency)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("address")
+    parser.add_argument("--clients", type=int, default=64)
+    parser.add_argument("--duration", type=float, default=10.0)
+    parser.add_argument("--path", default="/status")
+    args = parser.parse_args()
+    host, port = args.address.split(":")
+    results = [None] * args.clients
+    deadline = time.perf_counter() + args.duration
+    threads = [threading.Thread(target=client,
+        args=(host, int(port), args.path, deadline, results, i))
+        for i in range(args.clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    count = sum(r[0] for r in results)
+    errors = sum(r[1] for r in results)
+    latency = sum(r[2] for r in results)
+    print("clients:      %d" % args.clients)
+    print("requests:     %d" % count)
+    print("errors:       %d" % errors)
+    print("requests/sec: %.1f" % (count / args.duration))
+    if count:
+        print("avg latency:  %.2f ms" % (latency / count * 1000.0))
+
+
+if __name__ == "__main__":
+    main()